@@ -0,0 +1,79 @@
+/* Copyright (C) 2020 - Jose Ivan Lopez Romo - All rights reserved
+ *
+ * This file is part of the MayaVectorDisplacementDeformer project found in the
+ * following repository: https://github.com/Zhibade/maya-vector-displacement-deformer
+ *
+ * Released under MIT license. Please see LICENSE file for details.
+ */
+
+#include "BackendSelector.h"
+
+
+constexpr unsigned int WARM_UP_SAMPLES = 1; // First evaluations of a backend, which aren't representative
+constexpr unsigned int MEASURED_SAMPLES = 4; // Samples averaged before the backend is compared
+constexpr double MOVING_AVERAGE_WEIGHT = 0.1; // Weight of each new sample once the backend is measured
+constexpr double SWITCH_COST_RATIO = 0.9; // The other backend needs to cost less than this fraction of the current one to switch
+
+
+bool BackendSelector::update(unsigned int vertexCount, uint64_t settingsHash)
+{
+    if (vertexCount == this->vertexCount && settingsHash == this->settingsHash)
+    {
+        return false;
+    }
+
+    this->vertexCount = vertexCount;
+    this->settingsHash = settingsHash;
+    costs[0] = BackendCost();
+    costs[1] = BackendCost();
+
+    return true;
+}
+
+
+void BackendSelector::addSample(EvaluationBackend backend, double milliseconds)
+{
+    BackendCost& cost = costs[static_cast<int>(backend)];
+    cost.sampleCount++;
+
+    if (cost.sampleCount <= WARM_UP_SAMPLES)
+    {
+        return;
+    }
+
+    unsigned int measuredCount = cost.sampleCount - WARM_UP_SAMPLES;
+    double weight = measuredCount <= MEASURED_SAMPLES ? 1.0 / measuredCount : MOVING_AVERAGE_WEIGHT;
+
+    cost.averageMs += (milliseconds - cost.averageMs) * weight;
+}
+
+
+bool BackendSelector::isMeasuring(EvaluationBackend backend) const
+{
+    return costs[static_cast<int>(backend)].sampleCount < WARM_UP_SAMPLES + MEASURED_SAMPLES;
+}
+
+
+EvaluationBackend BackendSelector::getPreferredBackend(EvaluationBackend currentBackend) const
+{
+    EvaluationBackend otherBackend = currentBackend == EvaluationBackend::GPU ? EvaluationBackend::CPU : EvaluationBackend::GPU;
+
+    if (isMeasuring(currentBackend))
+    {
+        return currentBackend;
+    }
+
+    if (isMeasuring(otherBackend))
+    {
+        return otherBackend;
+    }
+
+    return getCost(otherBackend) < getCost(currentBackend) * SWITCH_COST_RATIO ? otherBackend : currentBackend;
+}
+
+
+double BackendSelector::getCost(EvaluationBackend backend) const
+{
+    const BackendCost& cost = costs[static_cast<int>(backend)];
+    return cost.sampleCount > WARM_UP_SAMPLES ? cost.averageMs : -1.0;
+}
\ No newline at end of file
@@ -0,0 +1,73 @@
+/* Copyright (C) 2020 - Jose Ivan Lopez Romo - All rights reserved
+ *
+ * This file is part of the MayaVectorDisplacementDeformer project found in the
+ * following repository: https://github.com/Zhibade/maya-vector-displacement-deformer
+ *
+ * Released under MIT license. Please see LICENSE file for details.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+
+enum class EvaluationBackend : int
+{
+    GPU = 0,
+    CPU = 1
+};
+
+
+/*
+ * Chooses between the CPU and GPU deformers of a geometry from their measured evaluation cost. Each backend is measured for a few
+ * evaluations after a warm-up one (which pays for allocations, kernel builds and full uploads), and the cheaper backend is kept from then on.
+ * Measurements start over when the vertex count or the settings that change the cost of an evaluation change. Has no Maya dependency.
+ */
+class BackendSelector final
+{
+public:
+    /**
+    * Starts measuring again if the vertex count or the settings changed since the last call
+    *
+    * @param[in] vertexCount - Vertex count of the geometry
+    * @param[in] settingsHash - Hash of the settings that change the cost of an evaluation
+    *
+    * @return True if the measurements were reset
+    */
+    bool update(unsigned int vertexCount, uint64_t settingsHash);
+
+    /**
+    * Adds the measured cost of an evaluation
+    *
+    * @param[in] backend - Backend that evaluated the geometry
+    * @param[in] milliseconds - Evaluation cost, including any data the backend needs to transfer
+    */
+    void addSample(EvaluationBackend backend, double milliseconds);
+
+    /** Returns true while the given backend still needs samples before it can be compared */
+    bool isMeasuring(EvaluationBackend backend) const;
+
+    /**
+    * Gets the backend the geometry should be evaluated with. Backends that still need samples are measured first (the current one before the other),
+    * and once both are measured, the other backend is only preferred if it's clearly cheaper, so similar costs don't make the choice flip.
+    *
+    * @param[in] currentBackend - Backend the geometry is evaluated with
+    *
+    * @return Preferred backend
+    */
+    EvaluationBackend getPreferredBackend(EvaluationBackend currentBackend) const;
+
+    /** Returns the average cost of the given backend in milliseconds, or a negative value if it hasn't been measured yet */
+    double getCost(EvaluationBackend backend) const;
+
+private:
+    struct BackendCost
+    {
+        unsigned int sampleCount = 0; // Including the warm-up evaluation
+        double averageMs = 0.0; // Mean of the measured samples, then a moving average once the backend is measured
+    };
+
+    BackendCost costs[2]; // Indexed by backend
+    unsigned int vertexCount = 0;
+    uint64_t settingsHash = 0;
+};
\ No newline at end of file
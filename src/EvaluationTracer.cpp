@@ -0,0 +1,300 @@
+/* Copyright (C) 2020 - Jose Ivan Lopez Romo - All rights reserved
+ *
+ * This file is part of the MayaVectorDisplacementDeformer project found in the
+ * following repository: https://github.com/Zhibade/maya-vector-displacement-deformer
+ *
+ * Released under MIT license. Please see LICENSE file for details.
+ */
+
+#include "EvaluationTracer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+
+
+constexpr size_t SPANS_PER_THREAD = 1 << 16; // Ring size of each thread (48 bytes per span). Older spans are overwritten.
+constexpr const char* SPAN_CATEGORY = "vectorDisplacement";
+
+
+std::atomic<bool> EvaluationTracer::enabled{ false };
+std::atomic<uint32_t> EvaluationTracer::nextNodeId{ 1 };
+std::mutex EvaluationTracer::buffersMutex;
+std::vector<std::unique_ptr<EvaluationTracer::ThreadBuffer>> EvaluationTracer::threadBuffers;
+
+
+EvaluationTracer::Scope::Scope(const char* name, const TraceTag& tag) : name(name), tag(tag)
+{
+    isRecording = EvaluationTracer::isEnabled();
+
+    if (isRecording)
+    {
+        startTime = EvaluationTracer::now();
+    }
+}
+
+
+EvaluationTracer::Scope::~Scope()
+{
+    if (isRecording)
+    {
+        EvaluationTracer::record(name, tag, startTime, EvaluationTracer::now());
+    }
+}
+
+
+void EvaluationTracer::Scope::next(const char* nextName)
+{
+    if (isRecording)
+    {
+        uint64_t endTime = EvaluationTracer::now();
+        EvaluationTracer::record(name, tag, startTime, endTime);
+        startTime = endTime;
+    }
+
+    name = nextName;
+}
+
+
+void EvaluationTracer::setEnabled(bool isTracingEnabled)
+{
+    enabled.store(isTracingEnabled, std::memory_order_relaxed);
+}
+
+
+bool EvaluationTracer::isEnabled()
+{
+    return enabled.load(std::memory_order_relaxed);
+}
+
+
+uint32_t EvaluationTracer::newNodeId()
+{
+    return nextNodeId.fetch_add(1, std::memory_order_relaxed);
+}
+
+
+void EvaluationTracer::clear()
+{
+    std::lock_guard<std::mutex> lock(buffersMutex);
+
+    for (const std::unique_ptr<ThreadBuffer>& buffer : threadBuffers)
+    {
+        buffer->tail.store(buffer->head.load(std::memory_order_acquire), std::memory_order_relaxed);
+    }
+}
+
+
+size_t EvaluationTracer::getSpanCount()
+{
+    std::lock_guard<std::mutex> lock(buffersMutex);
+
+    size_t count = 0;
+
+    for (const std::unique_ptr<ThreadBuffer>& buffer : threadBuffers)
+    {
+        uint64_t head = buffer->head.load(std::memory_order_acquire);
+        uint64_t first = std::max(buffer->tail.load(std::memory_order_relaxed), head > SPANS_PER_THREAD ? head - SPANS_PER_THREAD : 0);
+        count += static_cast<size_t>(head - first);
+    }
+
+    return count;
+}
+
+
+bool EvaluationTracer::write(const std::string& path, const std::map<uint32_t, std::string>& nodeNames)
+{
+    // Copy the spans of every thread first. Spans a thread overwrote while they were being copied are dropped.
+
+    std::vector<std::pair<unsigned int, Span>> spans;
+
+    {
+        std::lock_guard<std::mutex> lock(buffersMutex);
+
+        for (const std::unique_ptr<ThreadBuffer>& buffer : threadBuffers)
+        {
+            uint64_t head = buffer->head.load(std::memory_order_acquire);
+            uint64_t first = std::max(buffer->tail.load(std::memory_order_relaxed), head > SPANS_PER_THREAD ? head - SPANS_PER_THREAD : 0);
+            Span span;
+
+            for (uint64_t sequence = first; sequence < head; sequence++)
+            {
+                if (readSpan(buffer->slots[sequence % SPANS_PER_THREAD], sequence, span))
+                {
+                    spans.emplace_back(buffer->threadIndex, span);
+                }
+            }
+        }
+    }
+
+    std::ofstream file(path, std::ios::out | std::ios::trunc);
+
+    if (!file)
+    {
+        return false;
+    }
+
+    // Timestamps are written in microseconds from the first span, which trace viewers expect
+
+    uint64_t origin = spans.empty() ? 0 : std::min_element(spans.begin(), spans.end(),
+        [](const std::pair<unsigned int, Span>& a, const std::pair<unsigned int, Span>& b) { return a.second.startTime < b.second.startTime; })->second.startTime;
+
+    auto writeString = [&file](const std::string& value)
+    {
+        file << '"';
+
+        for (char character : value)
+        {
+            if (character == '"' || character == '\\')
+            {
+                file << '\\';
+            }
+
+            file << (static_cast<unsigned char>(character) < 0x20 ? ' ' : character);
+        }
+
+        file << '"';
+    };
+
+    file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    file << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"Vector displacement\"}}";
+
+    std::vector<unsigned int> threadIndices;
+
+    for (const std::pair<unsigned int, Span>& span : spans)
+    {
+        threadIndices.push_back(span.first);
+    }
+
+    std::sort(threadIndices.begin(), threadIndices.end());
+    threadIndices.erase(std::unique(threadIndices.begin(), threadIndices.end()), threadIndices.end());
+
+    for (unsigned int threadIndex : threadIndices)
+    {
+        file << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << threadIndex << ",\"args\":{\"name\":\"Thread " << threadIndex << "\"}}";
+    }
+
+    file.precision(3);
+    file << std::fixed;
+
+    for (const std::pair<unsigned int, Span>& entry : spans)
+    {
+        const Span& span = entry.second;
+        auto nodeName = nodeNames.find(span.tag.node);
+
+        file << ",\n{\"name\":";
+        writeString(span.name ? span.name : "");
+        file << ",\"cat\":\"" << SPAN_CATEGORY << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << entry.first;
+        file << ",\"ts\":" << (span.startTime - origin) / 1000.0 << ",\"dur\":" << span.duration / 1000.0;
+        file << ",\"args\":{\"node\":";
+        writeString(nodeName != nodeNames.end() ? nodeName->second : "node " + std::to_string(span.tag.node));
+        file << ",\"geometry\":" << span.tag.geometry << ",\"frame\":" << span.tag.frame << "}}";
+    }
+
+    file << "\n]}\n";
+
+    return file.good();
+}
+
+
+EvaluationTracer::ThreadBufferOwner::~ThreadBufferOwner()
+{
+    if (buffer)
+    {
+        std::lock_guard<std::mutex> lock(buffersMutex);
+        buffer->isInUse = false;
+    }
+}
+
+
+EvaluationTracer::ThreadBuffer* EvaluationTracer::getThreadBuffer()
+{
+    thread_local ThreadBufferOwner owner;
+
+    if (!owner.buffer)
+    {
+        std::lock_guard<std::mutex> lock(buffersMutex);
+
+        // Spans of the previous owner stay in a reused buffer, on the same track
+
+        auto freeBuffer = std::find_if(threadBuffers.begin(), threadBuffers.end(), [](const std::unique_ptr<ThreadBuffer>& buffer) { return !buffer->isInUse; });
+
+        if (freeBuffer == threadBuffers.end())
+        {
+            std::unique_ptr<ThreadBuffer> buffer(new ThreadBuffer());
+            buffer->slots.reset(new SpanSlot[SPANS_PER_THREAD]);
+            buffer->threadIndex = static_cast<unsigned int>(threadBuffers.size());
+
+            threadBuffers.push_back(std::move(buffer));
+            freeBuffer = threadBuffers.end() - 1;
+        }
+
+        owner.buffer = freeBuffer->get();
+        owner.buffer->isInUse = true;
+    }
+
+    return owner.buffer;
+}
+
+
+bool EvaluationTracer::readSpan(const SpanSlot& slot, uint64_t sequence, Span& span)
+{
+    uint64_t expectedVersion = (sequence + 1) * 2;
+
+    if (slot.version.load(std::memory_order_acquire) != expectedVersion)
+    {
+        return false;
+    }
+
+    uint64_t words[SPAN_WORDS];
+
+    for (size_t i = 0; i < SPAN_WORDS; i++)
+    {
+        words[i] = slot.words[i].load(std::memory_order_relaxed);
+    }
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+
+    if (slot.version.load(std::memory_order_relaxed) != expectedVersion)
+    {
+        return false;
+    }
+
+    std::memcpy(&span, words, sizeof(Span));
+    return true;
+}
+
+
+void EvaluationTracer::record(const char* name, const TraceTag& tag, uint64_t startTime, uint64_t endTime)
+{
+    ThreadBuffer* buffer = getThreadBuffer();
+    uint64_t sequence = buffer->head.load(std::memory_order_relaxed);
+
+    Span span;
+    span.name = name;
+    span.tag = tag;
+    span.startTime = startTime;
+    span.duration = endTime - startTime;
+
+    uint64_t words[SPAN_WORDS] = {};
+    std::memcpy(words, &span, sizeof(Span));
+
+    SpanSlot& slot = buffer->slots[sequence % SPANS_PER_THREAD];
+    slot.version.store(sequence * 2 + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    for (size_t i = 0; i < SPAN_WORDS; i++)
+    {
+        slot.words[i].store(words[i], std::memory_order_relaxed);
+    }
+
+    slot.version.store((sequence + 1) * 2, std::memory_order_release);
+    buffer->head.store(sequence + 1, std::memory_order_release);
+}
+
+
+uint64_t EvaluationTracer::now()
+{
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
\ No newline at end of file
@@ -0,0 +1,163 @@
+/* Copyright (C) 2020 - Jose Ivan Lopez Romo - All rights reserved
+ *
+ * This file is part of the MayaVectorDisplacementDeformer project found in the
+ * following repository: https://github.com/Zhibade/maya-vector-displacement-deformer
+ *
+ * Released under MIT license. Please see LICENSE file for details.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+
+// Evaluation a traced span belongs to
+struct TraceTag
+{
+    uint32_t node = 0; // Trace id of the deformer node
+    uint32_t geometry = 0; // Geometry index
+    double frame = 0.0;
+};
+
+
+/*
+ * Records timestamped spans of the evaluation stages and writes them as a Chrome trace-event JSON file (viewable in chrome://tracing or Perfetto).
+ * Each thread records into its own ring buffer without locking, so tracing can stay enabled on the farm. The oldest spans of a thread are
+ * overwritten once its buffer is full. Buffers of exited threads are handed to new threads, so short-lived threads don't add a buffer each,
+ * and a track of the trace file can hold the spans of several threads that ran one after the other. Recording does nothing while tracing
+ * is disabled. Has no Maya dependency.
+ */
+class EvaluationTracer final
+{
+public:
+    /* Records the span of a stage from its construction to its destruction, or until the next stage starts */
+    class Scope final
+    {
+    public:
+        /**
+        * Starts recording a stage
+        *
+        * @param[in] name - Stage name. Needs to be a string literal, since only the pointer is recorded.
+        * @param[in] tag - Evaluation the stage belongs to
+        */
+        Scope(const char* name, const TraceTag& tag);
+        ~Scope();
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+        /**
+        * Ends the current stage and starts the next one
+        *
+        * @param[in] nextName - Name of the next stage (string literal)
+        */
+        void next(const char* nextName);
+
+    private:
+        const char* name;
+        TraceTag tag;
+        uint64_t startTime = 0;
+        bool isRecording = false;
+    };
+
+    /** Starts or stops recording. Spans already recorded are kept. */
+    static void setEnabled(bool enabled);
+
+    /** Returns true while spans are being recorded */
+    static bool isEnabled();
+
+    /** Returns a new trace id for a node, used to tag its spans */
+    static uint32_t newNodeId();
+
+    /** Discards every recorded span */
+    static void clear();
+
+    /** Returns the number of recorded spans that would be written */
+    static size_t getSpanCount();
+
+    /**
+    * Writes the recorded spans as a Chrome trace-event JSON file. Each thread is a track, and each span has its node, geometry and frame as arguments.
+    *
+    * @param[in] path - Path of the file to write
+    * @param[in] nodeNames - Name of each node trace id. Nodes without a name are written as "node <id>".
+    *
+    * @return True if the file was written
+    */
+    static bool write(const std::string& path, const std::map<uint32_t, std::string>& nodeNames);
+
+private:
+    struct Span
+    {
+        const char* name = nullptr;
+        TraceTag tag;
+        uint64_t startTime = 0; // Nanoseconds
+        uint64_t duration = 0; // Nanoseconds
+    };
+
+    static constexpr size_t SPAN_WORDS = (sizeof(Span) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+    // Ring entry guarded by a sequence lock: the owner thread marks it as being written (odd) and then as holding a given span (even),
+    // and readers drop copies taken while it changed. The span is stored as atomic words so copies never race with the owner.
+    struct SpanSlot
+    {
+        std::atomic<uint64_t> version{ 0 }; // 2 * (sequence number + 1) once the span is complete, odd while it's being written
+        std::atomic<uint64_t> words[SPAN_WORDS] = {};
+    };
+
+    // Spans of a single thread at a time. Only the owner thread writes to it.
+    struct ThreadBuffer
+    {
+        std::unique_ptr<SpanSlot[]> slots; // Ring of spans, indexed by sequence number modulo its size
+        std::atomic<uint64_t> head{ 0 }; // Sequence number of the next span
+        std::atomic<uint64_t> tail{ 0 }; // Sequence number of the first span that wasn't cleared
+        unsigned int threadIndex = 0; // Track of the buffer in the trace file
+        bool isInUse = false; // Owned by a running thread. Guarded by buffersMutex.
+    };
+
+    // Hands the buffer of a thread back when the thread exits
+    struct ThreadBufferOwner
+    {
+        ThreadBuffer* buffer = nullptr;
+
+        ~ThreadBufferOwner();
+    };
+
+    /** Returns the ring buffer of the calling thread. Taken the first time the thread records a span, from the buffers of exited threads if possible. */
+    static ThreadBuffer* getThreadBuffer();
+
+    /**
+    * Copies a span out of a ring slot
+    *
+    * @param[in] slot - Slot to read
+    * @param[in] sequence - Sequence number of the span expected in the slot
+    * @param[out] span - Copied span
+    *
+    * @return False if the slot was overwritten or being written, in which case the span is dropped
+    */
+    static bool readSpan(const SpanSlot& slot, uint64_t sequence, Span& span);
+
+    /**
+    * Records a span in the ring buffer of the calling thread
+    *
+    * @param[in] name - Stage name
+    * @param[in] tag - Evaluation the stage belongs to
+    * @param[in] startTime - Start of the stage, in nanoseconds
+    * @param[in] endTime - End of the stage, in nanoseconds
+    */
+    static void record(const char* name, const TraceTag& tag, uint64_t startTime, uint64_t endTime);
+
+    /** Returns the current time in nanoseconds */
+    static uint64_t now();
+
+    static std::atomic<bool> enabled;
+    static std::atomic<uint32_t> nextNodeId;
+    static std::mutex buffersMutex; // Guards the list of buffers (not the spans, which are written without locking)
+    static std::vector<std::unique_ptr<ThreadBuffer>> threadBuffers; // Buffers live until the plugin is unloaded, since running threads keep a pointer to theirs
+};
\ No newline at end of file
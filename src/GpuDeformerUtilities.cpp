@@ -10,39 +10,115 @@
 
 #include <clew/clew_cl.h>
 
+#include <algorithm>
+#include <fstream>
+#include <sstream>
 
-MStatus GpuDeformerUtilities::calculateWorkSize(unsigned int numOfElements, const MAutoCLKernel& kernel, size_t& localWorkSize, size_t& globalWorkSize)
+
+constexpr unsigned int TILE_SIZE_GRANULARITY = 4096; // Vertices
+
+
+MStatus GpuDeformerUtilities::calculateWorkSize(unsigned int numOfElements, const MAutoCLKernel& kernel, const KernelLaunchConfig& config, size_t& localWorkSize, size_t& globalWorkSize)
 {
-    // Calculate local work group size
+    // Calculate local work group size (configured size, limited by what the kernel supports)
 
-    localWorkSize = 0;
+    size_t maxWorkSize = 0;
     size_t retSize = 0;
 
-    cl_int err = clGetKernelWorkGroupInfo(kernel.get(), MOpenCLInfo::getOpenCLDeviceId(), CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &localWorkSize, &retSize);
+    cl_int err = clGetKernelWorkGroupInfo(kernel.get(), MOpenCLInfo::getOpenCLDeviceId(), CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &maxWorkSize, &retSize);
     MOpenCLInfo::checkCLErrorStatus(err);
 
-    if (err != CL_SUCCESS || localWorkSize == 0 || retSize == 0)
+    if (err != CL_SUCCESS || maxWorkSize == 0 || retSize == 0)
     {
         return MS::kFailure;
     }
 
-    // Calculate global work size (multiple of local work size)
+    localWorkSize = config.localWorkSize > 0 && config.localWorkSize < maxWorkSize ? config.localWorkSize : maxWorkSize;
+
+    // Calculate global work size (one work item per group of elements, multiple of local work size)
+
+    size_t verticesPerWorkItem = config.verticesPerWorkItem > 0 ? config.verticesPerWorkItem : 1;
+    size_t numOfWorkItems = (numOfElements + verticesPerWorkItem - 1) / verticesPerWorkItem;
 
     globalWorkSize = 0;
-    const size_t remain = numOfElements % localWorkSize;
+    const size_t remain = numOfWorkItems % localWorkSize;
 
     if (remain)
     {
-        globalWorkSize = numOfElements + (localWorkSize - remain);
+        globalWorkSize = numOfWorkItems + (localWorkSize - remain);
     }
     else
     {
-        globalWorkSize = numOfElements;
+        globalWorkSize = numOfWorkItems;
     }
 
     return MS::kSuccess;
 }
 
+MString GpuDeformerUtilities::getKernelName(VectorDisplacementMapType mapType, const KernelLaunchConfig& config)
+{
+    MString kernelName = mapType == VectorDisplacementMapType::OBJECT_SPACE ? "ObjectSpaceDisplacement" : "TangentSpaceDisplacement";
+
+    if (config.verticesPerWorkItem > 1)
+    {
+        kernelName += MString("_x") + config.verticesPerWorkItem;
+        kernelName += config.useVectorLoads ? "v" : "";
+    }
+
+    return kernelName;
+}
+
+MString GpuDeformerUtilities::getTiledKernelName(VectorDisplacementMapType mapType)
+{
+    return mapType == VectorDisplacementMapType::OBJECT_SPACE ? "ObjectSpaceDisplacementTiled" : "TangentSpaceDisplacementTiled";
+}
+
+MAutoCLKernel GpuDeformerUtilities::getDisplacementKernel(const MString& kernelFile, const MString& kernelName, WeightMode weightMode)
+{
+    if (weightMode == WeightMode::PAINTED)
+    {
+        return MOpenCLInfo::getOpenCLKernel(kernelFile, kernelName);
+    }
+
+    std::ifstream stream(kernelFile.asChar(), std::ios::binary);
+    if (!stream)
+    {
+        return MAutoCLKernel();
+    }
+
+    // Line directive keeps the build log line numbers matching the file
+
+    std::stringstream source;
+    source << "#define WEIGHT_MODE " << static_cast<int>(weightMode) << "\n#line 1\n" << stream.rdbuf();
+
+    MString debugName = kernelName + "_weightMode" + static_cast<int>(weightMode);
+
+    return MOpenCLInfo::getOpenCLKernelFromString(MString(source.str().c_str()), debugName, kernelName);
+}
+
+unsigned int GpuDeformerUtilities::calculateTileSize(unsigned int numOfElements, size_t bytesPerVertex, size_t memoryBudget, size_t maxBufferSize,
+                                                     size_t largestElementSize, unsigned int numOfSlots)
+{
+    if (numOfElements == 0 || bytesPerVertex == 0 || largestElementSize == 0)
+    {
+        return 0;
+    }
+
+    if (numOfElements * bytesPerVertex <= memoryBudget && numOfElements * largestElementSize <= maxBufferSize)
+    {
+        return 0;
+    }
+
+    // Tile size is kept a multiple of the granularity so tiles start at aligned offsets
+
+    size_t tileSize = memoryBudget / (bytesPerVertex * std::max(numOfSlots, 1u));
+    tileSize = std::min(tileSize, maxBufferSize / largestElementSize);
+    tileSize = tileSize / TILE_SIZE_GRANULARITY * TILE_SIZE_GRANULARITY;
+    tileSize = std::max(tileSize, static_cast<size_t>(TILE_SIZE_GRANULARITY));
+
+    return static_cast<unsigned int>(std::min(tileSize, static_cast<size_t>(numOfElements)));
+}
+
 cl_int GpuDeformerUtilities::enqueueBuffer(size_t bufferSize, void* data, MAutoCLMem& clMem)
 {
     cl_int err = CL_SUCCESS;
@@ -60,6 +136,131 @@ cl_int GpuDeformerUtilities::enqueueBuffer(size_t bufferSize, void* data, MAutoC
     return err;
 }
 
+cl_int GpuDeformerUtilities::allocateBuffer(size_t bufferSize, cl_mem_flags flags, MAutoCLMem& clMem)
+{
+    cl_int err = CL_SUCCESS;
+
+    // Recreate the buffer if the size changed (e.g. vertex count changed)
+
+    if (clMem.get())
+    {
+        size_t currentSize = 0;
+        err = clGetMemObjectInfo(clMem.get(), CL_MEM_SIZE, sizeof(size_t), &currentSize, NULL);
+
+        if (err != CL_SUCCESS || currentSize != bufferSize)
+        {
+            clMem.reset();
+        }
+    }
+
+    if (!clMem.get())
+    {
+        clMem.attach(clCreateBuffer(MOpenCLInfo::getOpenCLContext(), flags, bufferSize, NULL, &err));
+        MOpenCLInfo::checkCLErrorStatus(err);
+    }
+
+    return err;
+}
+
+void* GpuDeformerUtilities::mapBufferForWriting(size_t bufferSize, MAutoCLMem& clMem, cl_int& err)
+{
+    err = CL_SUCCESS;
+
+    if (bufferSize == 0)
+    {
+        err = CL_INVALID_VALUE;
+        return nullptr;
+    }
+
+    err = allocateBuffer(bufferSize, CL_MEM_ALLOC_HOST_PTR | CL_MEM_READ_ONLY, clMem);
+    if (err != CL_SUCCESS)
+    {
+        return nullptr;
+    }
+
+    // The whole buffer is overwritten, so its previous contents don't need to be transferred back to the host
+
+    void* mappedData = clEnqueueMapBuffer(MOpenCLInfo::getMayaDefaultOpenCLCommandQueue(), clMem.get(), CL_TRUE, CL_MAP_WRITE_INVALIDATE_REGION,
+        0, bufferSize, 0, NULL, NULL, &err);
+    MOpenCLInfo::checkCLErrorStatus(err);
+
+    return err == CL_SUCCESS ? mappedData : nullptr;
+}
+
+cl_int GpuDeformerUtilities::unmapBuffer(void* mappedData, MAutoCLMem& clMem)
+{
+    cl_int err = clEnqueueUnmapMemObject(MOpenCLInfo::getMayaDefaultOpenCLCommandQueue(), clMem.get(), mappedData, 0, NULL, NULL);
+    MOpenCLInfo::checkCLErrorStatus(err);
+
+    return err;
+}
+
+void GpuDeformerUtilities::mergeIndexRanges(std::vector<unsigned int>& indices, unsigned int maxGap, unsigned int maxRanges, std::vector<IndexRange>& ranges)
+{
+    ranges.clear();
+
+    if (indices.empty())
+    {
+        return;
+    }
+
+    std::sort(indices.begin(), indices.end());
+    indices.erase(std::unique(indices.begin(), indices.end()), indices.end());
+
+    IndexRange currentRange;
+    currentRange.first = indices[0];
+    currentRange.count = 1;
+
+    for (size_t i = 1; i < indices.size(); i++)
+    {
+        unsigned int rangeEnd = currentRange.first + currentRange.count;
+
+        if (indices[i] - rangeEnd <= maxGap)
+        {
+            currentRange.count = indices[i] - currentRange.first + 1;
+        }
+        else
+        {
+            ranges.push_back(currentRange);
+
+            currentRange.first = indices[i];
+            currentRange.count = 1;
+        }
+    }
+
+    ranges.push_back(currentRange);
+
+    // Too many small writes cost more than a single bigger one
+
+    if (ranges.size() > maxRanges)
+    {
+        IndexRange fullRange;
+        fullRange.first = ranges.front().first;
+        fullRange.count = ranges.back().first + ranges.back().count - fullRange.first;
+
+        ranges.assign(1, fullRange);
+    }
+}
+
+cl_int GpuDeformerUtilities::enqueueBufferRanges(const std::vector<IndexRange>& ranges, size_t elementSize, const void* data, MAutoCLMem& clMem)
+{
+    cl_int err = CL_SUCCESS;
+    const char* bytes = static_cast<const char*>(data);
+
+    // Only the last write is blocking. The queue is in-order, so all the previous writes are done by then.
+
+    for (size_t i = 0; i < ranges.size() && err == CL_SUCCESS; i++)
+    {
+        cl_bool isBlocking = i + 1 == ranges.size() ? CL_TRUE : CL_FALSE;
+        size_t offset = ranges[i].first * elementSize;
+        size_t size = ranges[i].count * elementSize;
+
+        err = clEnqueueWriteBuffer(MOpenCLInfo::getMayaDefaultOpenCLCommandQueue(), clMem.get(), isBlocking, offset, size, bytes + offset, 0, NULL, NULL);
+    }
+
+    return err;
+}
+
 MStatus GpuDeformerUtilities::sendParametersToKernel(GpuKernelData data, VectorDisplacementMapType mapType, MAutoCLKernel& kernel)
 {
     unsigned int parameterId = 0;
@@ -92,6 +293,12 @@ MStatus GpuDeformerUtilities::sendParametersToKernel(GpuKernelData data, VectorD
     err = clSetKernelArg(kernel.get(), parameterId++, sizeof(cl_uint), (void*)&data.numOfElements);
     MOpenCLInfo::checkCLErrorStatus(err);
 
+    if (data.isTiled)
+    {
+        err = clSetKernelArg(kernel.get(), parameterId++, sizeof(cl_uint), (void*)&data.firstVertex);
+        MOpenCLInfo::checkCLErrorStatus(err);
+    }
+
     err = clSetKernelArg(kernel.get(), parameterId++, sizeof(cl_mem), (void*)data.outputPositions->getReadOnlyRef());
     MOpenCLInfo::checkCLErrorStatus(err);
 
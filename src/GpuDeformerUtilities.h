@@ -13,6 +13,8 @@
 #include <maya/MStatus.h>
 #include <maya/MOpenCLInfo.h>
 
+#include <vector>
+
 
 /* Generic utilities for Maya GPU deformers */
 class GpuDeformerUtilities final
@@ -23,12 +25,61 @@ public:
     *
     * @param[in] numOfElements - Number of elements that will be calculated this evaluation
     * @param[in] kernel - Kernel to calculate the work size for
+    * @param[in] config - Launch configuration of the kernel (local size and elements per work item)
     * @param[out] localWorkSize - Calculated local work size
     * @param[out] globalWorkSize - Calculated global work size
     *
     * @return Status indicating whether the operation was successful or not
     */
-    static MStatus calculateWorkSize(unsigned int numOfElements, const MAutoCLKernel& kernel, size_t& localWorkSize, size_t& globalWorkSize);
+    static MStatus calculateWorkSize(unsigned int numOfElements, const MAutoCLKernel& kernel, const KernelLaunchConfig& config, size_t& localWorkSize, size_t& globalWorkSize);
+
+    /**
+    * Gets the kernel function name that matches the given map type and launch configuration
+    *
+    * @param[in] mapType - Vector displacement map type that will be calculated
+    * @param[in] config - Launch configuration (elements per work item and vector loads)
+    *
+    * @return Kernel function name
+    */
+    static MString getKernelName(VectorDisplacementMapType mapType, const KernelLaunchConfig& config);
+
+    /**
+    * Gets the name of the kernel function used for tiled execution
+    *
+    * @param[in] mapType - Vector displacement map type that will be calculated
+    *
+    * @return Kernel function name
+    */
+    static MString getTiledKernelName(VectorDisplacementMapType mapType);
+
+    /**
+    * Gets a displacement kernel built for the given weight mode. The kernel file is built with WEIGHT_MODE defined to the mode
+    * (Maya's kernel loader doesn't take build options, so the definition is prepended to the source), and the PAINTED variants
+    * use the file as it is.
+    *
+    * @param[in] kernelFile - Path of the kernel file
+    * @param[in] kernelName - Kernel function name
+    * @param[in] weightMode - Paint weight handling the kernel is specialized for
+    *
+    * @return Kernel (null if the file couldn't be read or built)
+    */
+    static MAutoCLKernel getDisplacementKernel(const MString& kernelFile, const MString& kernelName, WeightMode weightMode);
+
+    /**
+    * Calculates how many vertices each tile holds when the auxiliary per-vertex data doesn't fit in the given memory budget.
+    * The budget is shared by every tile slot, and no single buffer can exceed the device allocation limit.
+    *
+    * @param[in] numOfElements - Number of vertices
+    * @param[in] bytesPerVertex - Size of all the auxiliary data of a single vertex
+    * @param[in] memoryBudget - Device memory available for the auxiliary buffers (in bytes)
+    * @param[in] maxBufferSize - Maximum size of a single buffer (in bytes)
+    * @param[in] largestElementSize - Size of the largest per-vertex element stored in a single buffer
+    * @param[in] numOfSlots - Number of tile slots that are allocated at the same time
+    *
+    * @return Vertices per tile, or 0 if the data fits without tiling
+    */
+    static unsigned int calculateTileSize(unsigned int numOfElements, size_t bytesPerVertex, size_t memoryBudget, size_t maxBufferSize,
+                                          size_t largestElementSize, unsigned int numOfSlots);
 
     /**
     * Generic function for copying any data to GPU. If buffer is not initialized it initializes it first.
@@ -42,6 +93,63 @@ public:
 
     static cl_int enqueueBuffer(size_t bufferSize, void* data, MAutoCLMem& clMem);
 
+    /**
+    * Creates a GPU buffer if it's not initialized or its size changed. Its contents are undefined.
+    *
+    * @param[in] bufferSize - Size of the buffer
+    * @param[in] flags - OpenCL memory flags to create the buffer with
+    * @param[in,out] clMem - OpenCL memory buffer to create
+    *
+    * @return OpenCL status/error code
+    */
+    static cl_int allocateBuffer(size_t bufferSize, cl_mem_flags flags, MAutoCLMem& clMem);
+
+    /**
+    * Maps a GPU buffer so the host can write the data directly into it, without any intermediate staging copy.
+    * If the buffer is not initialized (or its size changed) it is created first in host-accessible (pinned) memory.
+    * The buffer needs to be unmapped with unmapBuffer once the data is written.
+    *
+    * @param[in] bufferSize - Size of the data that will be written
+    * @param[in,out] clMem - OpenCL memory buffer to create and map
+    * @param[out] err - OpenCL status/error code
+    *
+    * @return Pointer to the mapped memory, or null if the operation failed
+    */
+    static void* mapBufferForWriting(size_t bufferSize, MAutoCLMem& clMem, cl_int& err);
+
+    /**
+    * Unmaps a buffer mapped with mapBufferForWriting, making the written data available to the kernels
+    *
+    * @param[in] mappedData - Pointer returned by mapBufferForWriting
+    * @param[in] clMem - OpenCL memory buffer that was mapped
+    *
+    * @return OpenCL status/error code
+    */
+    static cl_int unmapBuffer(void* mappedData, MAutoCLMem& clMem);
+
+    /**
+    * Sorts the given element indices and merges them into a few contiguous ranges, to limit the number of buffer writes.
+    * Indices closer than the given gap are merged into the same range, even if the elements in between didn't change.
+    *
+    * @param[in,out] indices - Changed element indices. Sorted and deduplicated by this function.
+    * @param[in] maxGap - Maximum number of unchanged elements between two indices of the same range
+    * @param[in] maxRanges - Maximum number of ranges. If more are needed, a single range covering all the indices is returned.
+    * @param[out] ranges - Merged ranges
+    */
+    static void mergeIndexRanges(std::vector<unsigned int>& indices, unsigned int maxGap, unsigned int maxRanges, std::vector<IndexRange>& ranges);
+
+    /**
+    * Copies only the given element ranges of the data to an already initialized GPU buffer
+    *
+    * @param[in] ranges - Element ranges to copy
+    * @param[in] elementSize - Size of each element in bytes
+    * @param[in] data - Data with all the elements. Element offsets match the offsets in the buffer.
+    * @param[in] clMem - OpenCL memory buffer to copy data to
+    *
+    * @return OpenCL status/error code
+    */
+    static cl_int enqueueBufferRanges(const std::vector<IndexRange>& ranges, size_t elementSize, const void* data, MAutoCLMem& clMem);
+
     /**
     * Sends the required parameters to the kernel
     *
@@ -0,0 +1,237 @@
+/* Copyright (C) 2020 - Jose Ivan Lopez Romo - All rights reserved
+ *
+ * This file is part of the MayaVectorDisplacementDeformer project found in the
+ * following repository: https://github.com/Zhibade/maya-vector-displacement-deformer
+ *
+ * Released under MIT license. Please see LICENSE file for details.
+ */
+
+#include "GpuKernelAutotuner.h"
+#include "GpuDeformerUtilities.h"
+
+#include <clew/clew_cl.h>
+
+#include <chrono>
+#include <fstream>
+#include <limits>
+#include <sstream>
+
+
+constexpr char* STORE_FILE_NAME = "vectorDisplacementKernelTuning.txt";
+constexpr unsigned int BENCHMARK_RUNS = 5;
+constexpr unsigned int MIN_TUNED_VERTEX_COUNT = 1 << 16; // Smaller meshes use the default configuration
+
+// Kernel variants and local work sizes to benchmark
+
+const KernelLaunchConfig VARIANT_CANDIDATES[] = {
+    { 1, false, 0 },
+    { 2, false, 0 },
+    { 4, false, 0 },
+    { 8, false, 0 },
+    { 4, true, 0 }
+};
+
+const size_t LOCAL_WORK_SIZE_CANDIDATES[] = { 32, 64, 128, 256, 512, 1024 };
+
+
+MString GpuKernelAutotuner::storeDirectory;
+std::map<std::string, KernelLaunchConfig> GpuKernelAutotuner::storedConfigs;
+bool GpuKernelAutotuner::areConfigsLoaded = false;
+std::mutex GpuKernelAutotuner::configsMutex;
+
+
+bool GpuKernelAutotuner::getStoredConfig(VectorDisplacementMapType mapType, unsigned int numOfElements, KernelLaunchConfig& config)
+{
+    if (numOfElements < MIN_TUNED_VERTEX_COUNT)
+    {
+        config = KernelLaunchConfig();
+        return true;
+    }
+
+    std::lock_guard<std::mutex> lock(configsMutex);
+    loadStoredConfigs();
+
+    auto storedConfig = storedConfigs.find(getConfigKey(mapType, numOfElements));
+    if (storedConfig == storedConfigs.end())
+    {
+        return false;
+    }
+
+    config = storedConfig->second;
+    return true;
+}
+
+MStatus GpuKernelAutotuner::tune(const MString& kernelFile, VectorDisplacementMapType mapType, GpuKernelData data, KernelLaunchConfig& config)
+{
+    // Inputs need to be ready before timing anything
+
+    clFinish(MOpenCLInfo::getMayaDefaultOpenCLCommandQueue());
+
+    KernelLaunchConfig bestConfig;
+    double bestTime = std::numeric_limits<double>::max();
+
+    for (const KernelLaunchConfig& variant : VARIANT_CANDIDATES)
+    {
+        MAutoCLKernel kernel = MOpenCLInfo::getOpenCLKernel(kernelFile, GpuDeformerUtilities::getKernelName(mapType, variant));
+        if (kernel.isNull())
+        {
+            continue;
+        }
+
+        size_t maxWorkSize = 0;
+        cl_int err = clGetKernelWorkGroupInfo(kernel.get(), MOpenCLInfo::getOpenCLDeviceId(), CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &maxWorkSize, NULL);
+
+        if (err == CL_SUCCESS && GpuDeformerUtilities::sendParametersToKernel(data, mapType, kernel) == MS::kSuccess)
+        {
+            for (size_t localWorkSize : LOCAL_WORK_SIZE_CANDIDATES)
+            {
+                if (localWorkSize > maxWorkSize)
+                {
+                    break;
+                }
+
+                KernelLaunchConfig candidate = variant;
+                candidate.localWorkSize = localWorkSize;
+
+                double time = benchmark(kernel, candidate, data.numOfElements);
+                if (time >= 0.0 && time < bestTime)
+                {
+                    bestTime = time;
+                    bestConfig = candidate;
+                }
+            }
+        }
+
+        MOpenCLInfo::releaseOpenCLKernel(kernel);
+    }
+
+    if (bestTime == std::numeric_limits<double>::max())
+    {
+        return MS::kFailure;
+    }
+
+    config = bestConfig;
+
+    std::lock_guard<std::mutex> lock(configsMutex);
+    storedConfigs[getConfigKey(mapType, data.numOfElements)] = bestConfig;
+    saveStoredConfigs();
+
+    return MS::kSuccess;
+}
+
+double GpuKernelAutotuner::benchmark(const MAutoCLKernel& kernel, const KernelLaunchConfig& config, unsigned int numOfElements)
+{
+    size_t localWorkSize = 0;
+    size_t globalWorkSize = 0;
+
+    if (GpuDeformerUtilities::calculateWorkSize(numOfElements, kernel, config, localWorkSize, globalWorkSize) != MS::kSuccess ||
+        localWorkSize != config.localWorkSize)
+    {
+        return -1.0;
+    }
+
+    cl_command_queue queue = MOpenCLInfo::getMayaDefaultOpenCLCommandQueue();
+
+    // Warm-up run, so one-time costs are not measured
+
+    cl_int err = clEnqueueNDRangeKernel(queue, kernel.get(), 1, NULL, &globalWorkSize, &localWorkSize, 0, NULL, NULL);
+    clFinish(queue);
+
+    if (err != CL_SUCCESS)
+    {
+        return -1.0;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    for (unsigned int i = 0; i < BENCHMARK_RUNS && err == CL_SUCCESS; i++)
+    {
+        err = clEnqueueNDRangeKernel(queue, kernel.get(), 1, NULL, &globalWorkSize, &localWorkSize, 0, NULL, NULL);
+    }
+
+    clFinish(queue);
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return err == CL_SUCCESS ? elapsed.count() / BENCHMARK_RUNS : -1.0;
+}
+
+unsigned int GpuKernelAutotuner::getSizeBucket(unsigned int numOfElements)
+{
+    unsigned int bucket = 0;
+
+    for (unsigned int count = numOfElements; count >= 4; count /= 4)
+    {
+        bucket++;
+    }
+
+    return bucket;
+}
+
+std::string GpuKernelAutotuner::getConfigKey(VectorDisplacementMapType mapType, unsigned int numOfElements)
+{
+    char deviceName[256] = {};
+    char driverVersion[256] = {};
+
+    clGetDeviceInfo(MOpenCLInfo::getOpenCLDeviceId(), CL_DEVICE_NAME, sizeof(deviceName) - 1, deviceName, NULL);
+    clGetDeviceInfo(MOpenCLInfo::getOpenCLDeviceId(), CL_DRIVER_VERSION, sizeof(driverVersion) - 1, driverVersion, NULL);
+
+    std::ostringstream key;
+    key << deviceName << "|" << driverVersion << "|" << static_cast<int>(mapType) << "|" << getSizeBucket(numOfElements);
+
+    return key.str();
+}
+
+MString GpuKernelAutotuner::getStorePath()
+{
+    return storeDirectory.length() > 0 ? storeDirectory + STORE_FILE_NAME : MString();
+}
+
+void GpuKernelAutotuner::loadStoredConfigs()
+{
+    if (areConfigsLoaded)
+    {
+        return;
+    }
+
+    areConfigsLoaded = true;
+
+    // One configuration per line: key, vertices per work item, vector loads, local work size (tab separated)
+
+    MString storePath = getStorePath();
+    if (storePath.length() == 0)
+    {
+        return;
+    }
+
+    std::ifstream stream(storePath.asChar());
+    std::string line;
+
+    while (std::getline(stream, line))
+    {
+        std::istringstream lineStream(line);
+        std::string key;
+        KernelLaunchConfig config;
+
+        if (std::getline(lineStream, key, '\t') && lineStream >> config.verticesPerWorkItem >> config.useVectorLoads >> config.localWorkSize)
+        {
+            storedConfigs[key] = config;
+        }
+    }
+}
+
+void GpuKernelAutotuner::saveStoredConfigs()
+{
+    MString storePath = getStorePath();
+    if (storePath.length() == 0)
+    {
+        return;
+    }
+
+    std::ofstream stream(storePath.asChar(), std::ios::trunc);
+
+    for (const auto& storedConfig : storedConfigs)
+    {
+        const KernelLaunchConfig& config = storedConfig.second;
+        stream << storedConfig.first << "\t" << config.verticesPerWorkItem << "\t" << config.useVectorLoads << "\t" << config.localWorkSize << "\n";
+    }
+}
\ No newline at end of file
@@ -0,0 +1,86 @@
+/* Copyright (C) 2020 - Jose Ivan Lopez Romo - All rights reserved
+ *
+ * This file is part of the MayaVectorDisplacementDeformer project found in the
+ * following repository: https://github.com/Zhibade/maya-vector-displacement-deformer
+ *
+ * Released under MIT license. Please see LICENSE file for details.
+ */
+
+#pragma once
+
+#include "VectorDisplacementHelperTypes.h"
+
+#include <maya/MOpenCLInfo.h>
+#include <maya/MStatus.h>
+#include <maya/MString.h>
+
+#include <map>
+#include <mutex>
+#include <string>
+
+
+/*
+ * Finds the fastest kernel launch configuration (local work size and vertices per work item) for the current OpenCL device.
+ * Results are stored per device, driver, map type and vertex count bucket, and persisted to a file in the Maya user app directory so tuning only runs once.
+ * Small meshes always use the default configuration, since launch overhead dominates and tuning would stall their first evaluation for nothing.
+ */
+class GpuKernelAutotuner final
+{
+public:
+    /**
+    * Gets the stored launch configuration for the current device
+    *
+    * @param[in] mapType - Vector displacement map type of the kernel
+    * @param[in] numOfElements - Number of vertices the kernel runs on
+    * @param[out] config - Stored configuration (or the default one for small meshes), if found
+    *
+    * @return True if a configuration was found. False if the kernel needs to be tuned first.
+    */
+    static bool getStoredConfig(VectorDisplacementMapType mapType, unsigned int numOfElements, KernelLaunchConfig& config);
+
+    /**
+    * Benchmarks every kernel variant and local work size on the current device using the given kernel data, then stores the fastest one.
+    * The output buffer in the kernel data is overwritten while benchmarking.
+    *
+    * @param[in] kernelFile - Path of the OpenCL kernel file
+    * @param[in] mapType - Vector displacement map type of the kernel
+    * @param[in] data - Kernel data to benchmark with (same data that is used for the actual evaluation). Stored for its vertex count bucket.
+    * @param[out] config - Fastest configuration
+    *
+    * @return Status indicating whether the operation was successful or not
+    */
+    static MStatus tune(const MString& kernelFile, VectorDisplacementMapType mapType, GpuKernelData data, KernelLaunchConfig& config);
+
+    /** Returns the vertex count bucket configurations are stored for. Each bucket covers 4 times the vertex counts of the previous one. */
+    static unsigned int getSizeBucket(unsigned int numOfElements);
+
+    static MString storeDirectory; // Directory where configurations are persisted (Maya user app directory). Not persisted if empty.
+
+private:
+    /**
+    * Measures the average time of a kernel launch
+    *
+    * @param[in] kernel - Kernel to benchmark. Parameters need to be already set.
+    * @param[in] config - Launch configuration to use
+    * @param[in] numOfElements - Number of vertices
+    *
+    * @return Average time in seconds, or a negative value if the kernel could not be launched
+    */
+    static double benchmark(const MAutoCLKernel& kernel, const KernelLaunchConfig& config, unsigned int numOfElements);
+
+    /** Returns the key used to store configurations of the current device, driver, given map type and vertex count bucket */
+    static std::string getConfigKey(VectorDisplacementMapType mapType, unsigned int numOfElements);
+
+    /** Returns the path of the file where configurations are persisted, or an empty string if they are not persisted */
+    static MString getStorePath();
+
+    /* Loads the persisted configurations (only the first time it's called) */
+    static void loadStoredConfigs();
+
+    /* Persists all the stored configurations */
+    static void saveStoredConfigs();
+
+    static std::map<std::string, KernelLaunchConfig> storedConfigs;
+    static bool areConfigsLoaded;
+    static std::mutex configsMutex;
+};
\ No newline at end of file
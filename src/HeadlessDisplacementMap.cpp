@@ -0,0 +1,109 @@
+/* Copyright (C) 2020 - Jose Ivan Lopez Romo - All rights reserved
+ *
+ * This file is part of the MayaVectorDisplacementDeformer project found in the
+ * following repository: https://github.com/Zhibade/maya-vector-displacement-deformer
+ *
+ * Released under MIT license. Please see LICENSE file for details.
+ */
+
+#include "HeadlessDisplacementMap.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <utility>
+
+
+bool HeadlessDisplacementMap::load(const std::string& path, std::string& error)
+{
+    std::ifstream stream(path, std::ios::binary);
+    if (!stream)
+    {
+        error = "Could not open displacement map: " + path;
+        return false;
+    }
+
+    // Header: "PF" (color), width and height, then the scale (negative = little endian). Each is followed by whitespace.
+
+    std::string format;
+    float scale = 0.f;
+    stream >> format >> width >> height >> scale;
+
+    if (!stream || format != "PF")
+    {
+        error = "Not a color PFM file: " + path;
+        return false;
+    }
+
+    if (width == 0 || height == 0)
+    {
+        error = "Displacement map is empty: " + path;
+        return false;
+    }
+
+    stream.get(); // Single whitespace character before the data
+
+    texels.resize(static_cast<size_t>(width) * height);
+    stream.read(reinterpret_cast<char*>(texels.data()), texels.size() * sizeof(Float3));
+
+    if (!stream)
+    {
+        error = "Unexpected end of data in displacement map: " + path;
+        return false;
+    }
+
+    // Swap bytes if the file endianness does not match the host
+
+    uint16_t endianTest = 1;
+    bool isHostLittleEndian = *reinterpret_cast<uint8_t*>(&endianTest) == 1;
+
+    if ((scale < 0.f) != isHostLittleEndian)
+    {
+        for (Float3& texel : texels)
+        {
+            for (float* channel : { &texel.x, &texel.y, &texel.z })
+            {
+                uint8_t bytes[4];
+                std::memcpy(bytes, channel, 4);
+                std::swap(bytes[0], bytes[3]);
+                std::swap(bytes[1], bytes[2]);
+                std::memcpy(channel, bytes, 4);
+            }
+        }
+    }
+
+    return true;
+}
+
+Float3 HeadlessDisplacementMap::sample(float u, float v) const
+{
+    // Texel centers are at half-pixel offsets
+
+    float x = u * width - 0.5f;
+    float y = v * height - 0.5f;
+
+    float x0 = std::floor(x);
+    float y0 = std::floor(y);
+    float fractionX = x - x0;
+    float fractionY = y - y0;
+
+    int pixelX = static_cast<int>(x0);
+    int pixelY = static_cast<int>(y0);
+
+    Float3 bottom = getTexel(pixelX, pixelY) * (1.f - fractionX) + getTexel(pixelX + 1, pixelY) * fractionX;
+    Float3 top = getTexel(pixelX, pixelY + 1) * (1.f - fractionX) + getTexel(pixelX + 1, pixelY + 1) * fractionX;
+
+    return bottom * (1.f - fractionY) + top * fractionY;
+}
+
+const Float3& HeadlessDisplacementMap::getTexel(int x, int y) const
+{
+    int wrappedX = x % static_cast<int>(width);
+    int wrappedY = y % static_cast<int>(height);
+
+    if (wrappedX < 0) wrappedX += width;
+    if (wrappedY < 0) wrappedY += height;
+
+    return texels[static_cast<size_t>(wrappedY) * width + wrappedX];
+}
\ No newline at end of file
@@ -0,0 +1,57 @@
+/* Copyright (C) 2020 - Jose Ivan Lopez Romo - All rights reserved
+ *
+ * This file is part of the MayaVectorDisplacementDeformer project found in the
+ * following repository: https://github.com/Zhibade/maya-vector-displacement-deformer
+ *
+ * Released under MIT license. Please see LICENSE file for details.
+ */
+
+#pragma once
+
+#include "VectorDisplacementMath.h"
+
+#include <string>
+#include <vector>
+
+
+/*
+ * Floating point vector displacement map loaded from a PFM (Portable Float Map) file, outside of Maya.
+ * Vector displacement maps store raw offsets, so they need a float format. EXR maps can be converted to PFM with most image tools.
+ */
+class HeadlessDisplacementMap final
+{
+public:
+    /**
+    * Loads a color PFM file
+    *
+    * @param[in] path - Path of the .pfm file
+    * @param[out] error - Reason of the failure, if any
+    *
+    * @return True if the map was loaded successfully
+    */
+    bool load(const std::string& path, std::string& error);
+
+    /**
+    * Samples the map with bilinear filtering. UVs wrap around (repeat), and V = 0 is the bottom row like in Maya.
+    *
+    * @param[in] u - U coordinate
+    * @param[in] v - V coordinate
+    *
+    * @return RGB value at the given UV
+    */
+    Float3 sample(float u, float v) const;
+
+    /** Returns the width of the map in pixels */
+    unsigned int getWidth() const { return width; }
+
+    /** Returns the height of the map in pixels */
+    unsigned int getHeight() const { return height; }
+
+private:
+    /** Returns the texel at the given pixel coordinates, wrapped to the map size */
+    const Float3& getTexel(int x, int y) const;
+
+    unsigned int width = 0;
+    unsigned int height = 0;
+    std::vector<Float3> texels; // Rows from bottom to top (PFM order)
+};
\ No newline at end of file
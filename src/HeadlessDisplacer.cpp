@@ -0,0 +1,188 @@
+/* Copyright (C) 2020 - Jose Ivan Lopez Romo - All rights reserved
+ *
+ * This file is part of the MayaVectorDisplacementDeformer project found in the
+ * following repository: https://github.com/Zhibade/maya-vector-displacement-deformer
+ *
+ * Released under MIT license. Please see LICENSE file for details.
+ */
+
+#include "HeadlessDisplacer.h"
+
+#include <algorithm>
+#include <cmath>
+
+
+void HeadlessDisplacer::displace(HeadlessMesh& mesh, const HeadlessDisplacementMap& map, HeadlessMapType mapType, float strength, unsigned int threadCount)
+{
+    std::vector<float> vertexUvs;
+    HeadlessMeshFile::getVertexUvs(mesh, vertexUvs);
+
+    std::vector<Float3> normals;
+    std::vector<Float3> tangents;
+    std::vector<Float3> binormals;
+
+    if (mapType == HeadlessMapType::TANGENT_SPACE)
+    {
+        getVertexFrames(mesh, normals, tangents, binormals, threadCount);
+    }
+
+    VectorDisplacementMath::parallelFor(mesh.positions.size(), threadCount, [&](size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; i++)
+        {
+            Float3 rgbData = map.sample(vertexUvs[i * 2], vertexUvs[i * 2 + 1]);
+
+            mesh.positions[i] += mapType == HeadlessMapType::TANGENT_SPACE
+                ? VectorDisplacementMath::getTangentSpaceOffset(normals[i], tangents[i], binormals[i], rgbData, strength)
+                : VectorDisplacementMath::getObjectSpaceOffset(rgbData, strength);
+        }
+    });
+}
+
+void HeadlessDisplacer::getVertexFrames(const HeadlessMesh& mesh, std::vector<Float3>& normals, std::vector<Float3>& tangents, std::vector<Float3>& binormals,
+                                        unsigned int threadCount)
+{
+    size_t vertexCount = mesh.positions.size();
+    size_t faceCount = mesh.faceVertexCounts.size();
+
+    // Face offsets, and the face of each face-vertex
+
+    std::vector<size_t> faceOffsets(faceCount + 1, 0);
+    for (size_t i = 0; i < faceCount; i++)
+    {
+        faceOffsets[i + 1] = faceOffsets[i] + mesh.faceVertexCounts[i];
+    }
+
+    std::vector<unsigned int> faceVertexFaces(mesh.faceVertexIds.size());
+    for (size_t i = 0; i < faceCount; i++)
+    {
+        std::fill(faceVertexFaces.begin() + faceOffsets[i], faceVertexFaces.begin() + faceOffsets[i + 1], static_cast<unsigned int>(i));
+    }
+
+    // Face-vertices of each vertex, in face index order, so frames can be gathered per vertex in parallel
+
+    std::vector<size_t> vertexOffsets(vertexCount + 1, 0);
+    for (unsigned int vertexIndex : mesh.faceVertexIds)
+    {
+        vertexOffsets[vertexIndex + 1]++;
+    }
+
+    for (size_t i = 0; i < vertexCount; i++)
+    {
+        vertexOffsets[i + 1] += vertexOffsets[i];
+    }
+
+    std::vector<size_t> vertexFaceVertices(mesh.faceVertexIds.size());
+    std::vector<size_t> insertPositions(vertexOffsets.begin(), vertexOffsets.end() - 1);
+
+    for (size_t i = 0; i < mesh.faceVertexIds.size(); i++)
+    {
+        vertexFaceVertices[insertPositions[mesh.faceVertexIds[i]]++] = i;
+    }
+
+    // Face normals (Newell's method, so their length is twice the face area and larger faces weigh more)
+
+    std::vector<Float3> faceNormals(faceCount);
+
+    VectorDisplacementMath::parallelFor(faceCount, threadCount, [&](size_t begin, size_t end)
+    {
+        for (size_t face = begin; face < end; face++)
+        {
+            Float3 normal;
+
+            for (size_t i = faceOffsets[face]; i < faceOffsets[face + 1]; i++)
+            {
+                size_t next = i + 1 < faceOffsets[face + 1] ? i + 1 : faceOffsets[face];
+
+                const Float3& current = mesh.positions[mesh.faceVertexIds[i]];
+                const Float3& following = mesh.positions[mesh.faceVertexIds[next]];
+
+                normal += Float3((current.y - following.y) * (current.z + following.z),
+                                 (current.z - following.z) * (current.x + following.x),
+                                 (current.x - following.x) * (current.y + following.y));
+            }
+
+            faceNormals[face] = normal;
+        }
+    });
+
+    // Vertex frames
+
+    normals.assign(vertexCount, Float3());
+    tangents.assign(vertexCount, Float3());
+    binormals.assign(vertexCount, Float3());
+
+    VectorDisplacementMath::parallelFor(vertexCount, threadCount, [&](size_t begin, size_t end)
+    {
+        for (size_t vertex = begin; vertex < end; vertex++)
+        {
+            Float3 normal;
+            for (size_t i = vertexOffsets[vertex]; i < vertexOffsets[vertex + 1]; i++)
+            {
+                normal += faceNormals[faceVertexFaces[vertexFaceVertices[i]]];
+            }
+
+            normal.normalize();
+            normals[vertex] = normal;
+
+            for (size_t i = vertexOffsets[vertex]; i < vertexOffsets[vertex + 1]; i++)
+            {
+                // Tangent and binormal of the corner triangle (previous, current, next face-vertex) from its UV gradients
+
+                size_t faceVertex = vertexFaceVertices[i];
+                unsigned int face = faceVertexFaces[faceVertex];
+                size_t faceStart = faceOffsets[face];
+                size_t faceSize = faceOffsets[face + 1] - faceStart;
+
+                if (faceSize < 3)
+                {
+                    continue;
+                }
+
+                size_t corner = faceVertex - faceStart;
+                size_t previous = faceStart + (corner + faceSize - 1) % faceSize;
+                size_t next = faceStart + (corner + 1) % faceSize;
+
+                int uvIndex = mesh.faceVertexUvIds[faceVertex];
+                int previousUvIndex = mesh.faceVertexUvIds[previous];
+                int nextUvIndex = mesh.faceVertexUvIds[next];
+
+                if (uvIndex < 0 || previousUvIndex < 0 || nextUvIndex < 0)
+                {
+                    continue;
+                }
+
+                Float3 edge1 = mesh.positions[mesh.faceVertexIds[next]] - mesh.positions[mesh.faceVertexIds[faceVertex]];
+                Float3 edge2 = mesh.positions[mesh.faceVertexIds[previous]] - mesh.positions[mesh.faceVertexIds[faceVertex]];
+
+                float deltaU1 = mesh.uvs[nextUvIndex * 2] - mesh.uvs[uvIndex * 2];
+                float deltaV1 = mesh.uvs[nextUvIndex * 2 + 1] - mesh.uvs[uvIndex * 2 + 1];
+                float deltaU2 = mesh.uvs[previousUvIndex * 2] - mesh.uvs[uvIndex * 2];
+                float deltaV2 = mesh.uvs[previousUvIndex * 2 + 1] - mesh.uvs[uvIndex * 2 + 1];
+
+                float determinant = deltaU1 * deltaV2 - deltaU2 * deltaV1;
+                if (std::abs(determinant) < 1e-12f)
+                {
+                    continue; // Degenerate UVs
+                }
+
+                Float3 uDirection = (edge1 * deltaV2 - edge2 * deltaV1) / determinant;
+                Float3 vDirection = (edge2 * deltaU1 - edge1 * deltaU2) / determinant;
+
+                // Orthonormal frame around the vertex normal. The binormal keeps the handedness of the UVs.
+
+                Float3 faceVertexTangent = uDirection - normal * normal.dot(uDirection);
+                faceVertexTangent.normalize();
+
+                Float3 faceVertexBinormal = normal.cross(faceVertexTangent);
+                if (faceVertexBinormal.dot(vDirection) < 0.f)
+                {
+                    faceVertexBinormal = faceVertexBinormal * -1.f;
+                }
+
+                VectorDisplacementMath::accumulateFrameVector(tangents[vertex], faceVertexTangent);
+                VectorDisplacementMath::accumulateFrameVector(binormals[vertex], faceVertexBinormal);
+            }
+        }
+    });
+}
\ No newline at end of file
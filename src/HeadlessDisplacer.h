@@ -0,0 +1,53 @@
+/* Copyright (C) 2020 - Jose Ivan Lopez Romo - All rights reserved
+ *
+ * This file is part of the MayaVectorDisplacementDeformer project found in the
+ * following repository: https://github.com/Zhibade/maya-vector-displacement-deformer
+ *
+ * Released under MIT license. Please see LICENSE file for details.
+ */
+
+#pragma once
+
+#include "HeadlessDisplacementMap.h"
+#include "HeadlessMeshFile.h"
+
+
+/* Vector displacement map space, matching the map type of the deformer node */
+enum class HeadlessMapType
+{
+    OBJECT_SPACE,
+    TANGENT_SPACE
+};
+
+
+/*
+ * Displaces meshes outside of Maya with the same math as the deformer node (see VectorDisplacementMath).
+ * Vertex frames are an approximation of Maya's: area-weighted smooth normals, tangents along +U and binormals along +V.
+ * Hard edges, locked normals and Maya's own tangent orthogonalization are not reproduced, so tangent-space results can differ from the deformer.
+ */
+class HeadlessDisplacer final
+{
+public:
+    /**
+    * Displaces every vertex of the given mesh in parallel
+    *
+    * @param[in,out] mesh - Mesh to displace. Vertex positions will be updated here.
+    * @param[in] map - Displacement map
+    * @param[in] mapType - Displacement map type
+    * @param[in] strength - Displacement strength
+    * @param[in] threadCount - Number of worker threads (0 = hardware concurrency)
+    */
+    static void displace(HeadlessMesh& mesh, const HeadlessDisplacementMap& map, HeadlessMapType mapType, float strength, unsigned int threadCount);
+
+    /**
+    * Gets the normal, tangent and binormal of each vertex
+    *
+    * @param[in] mesh - Mesh to get the frames from
+    * @param[out] normals - Area-weighted vertex normals
+    * @param[out] tangents - Averaged face-vertex tangents
+    * @param[out] binormals - Averaged face-vertex binormals
+    * @param[in] threadCount - Number of worker threads
+    */
+    static void getVertexFrames(const HeadlessMesh& mesh, std::vector<Float3>& normals, std::vector<Float3>& tangents, std::vector<Float3>& binormals,
+                                unsigned int threadCount);
+};
\ No newline at end of file
@@ -0,0 +1,642 @@
+/* Copyright (C) 2020 - Jose Ivan Lopez Romo - All rights reserved
+ *
+ * This file is part of the MayaVectorDisplacementDeformer project found in the
+ * following repository: https://github.com/Zhibade/maya-vector-displacement-deformer
+ *
+ * Released under MIT license. Please see LICENSE file for details.
+ */
+
+#include "HeadlessMeshFile.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+
+namespace
+{
+    enum class PlyType { INT8, UINT8, INT16, UINT16, INT32, UINT32, FLOAT32, FLOAT64, INVALID };
+
+    struct PlyProperty
+    {
+        std::string name;
+        PlyType type = PlyType::INVALID;
+        bool isList = false;
+        PlyType countType = PlyType::INVALID; // Only used by list properties
+    };
+
+    struct PlyElement
+    {
+        std::string name;
+        size_t count = 0;
+        std::vector<PlyProperty> properties;
+    };
+
+    PlyType getPlyType(const std::string& typeName)
+    {
+        if (typeName == "char" || typeName == "int8") return PlyType::INT8;
+        if (typeName == "uchar" || typeName == "uint8") return PlyType::UINT8;
+        if (typeName == "short" || typeName == "int16") return PlyType::INT16;
+        if (typeName == "ushort" || typeName == "uint16") return PlyType::UINT16;
+        if (typeName == "int" || typeName == "int32") return PlyType::INT32;
+        if (typeName == "uint" || typeName == "uint32") return PlyType::UINT32;
+        if (typeName == "float" || typeName == "float32") return PlyType::FLOAT32;
+        if (typeName == "double" || typeName == "float64") return PlyType::FLOAT64;
+
+        return PlyType::INVALID;
+    }
+
+    template <typename T>
+    bool readBinary(std::istream& stream, double& value)
+    {
+        // Binary PLY files are read as little endian, which is the byte order of every platform Maya runs on
+
+        T binaryValue;
+        if (!stream.read(reinterpret_cast<char*>(&binaryValue), sizeof(T)))
+        {
+            return false;
+        }
+
+        value = static_cast<double>(binaryValue);
+        return true;
+    }
+
+    bool readPlyValue(std::istream& stream, PlyType type, bool isAscii, double& value)
+    {
+        if (isAscii)
+        {
+            return static_cast<bool>(stream >> value);
+        }
+
+        switch (type)
+        {
+            case PlyType::INT8: return readBinary<int8_t>(stream, value);
+            case PlyType::UINT8: return readBinary<uint8_t>(stream, value);
+            case PlyType::INT16: return readBinary<int16_t>(stream, value);
+            case PlyType::UINT16: return readBinary<uint16_t>(stream, value);
+            case PlyType::INT32: return readBinary<int32_t>(stream, value);
+            case PlyType::UINT32: return readBinary<uint32_t>(stream, value);
+            case PlyType::FLOAT32: return readBinary<float>(stream, value);
+            case PlyType::FLOAT64: return readBinary<double>(stream, value);
+            default: return false;
+        }
+    }
+
+    /** Parses an OBJ face-vertex index (1-based, or negative to count back from the last element). Returns -1 if invalid. */
+    int getObjIndex(const char* token, size_t elementCount)
+    {
+        char* end = nullptr;
+        long index = std::strtol(token, &end, 10);
+
+        if (end == token || index == 0)
+        {
+            return -1;
+        }
+
+        long resolvedIndex = index > 0 ? index - 1 : static_cast<long>(elementCount) + index;
+        return resolvedIndex >= 0 && resolvedIndex < static_cast<long>(elementCount) ? static_cast<int>(resolvedIndex) : -1;
+    }
+
+    /** Returns true if the given OBJ line is a vertex position statement */
+    bool isObjVertexLine(const std::string& line)
+    {
+        size_t start = line.find_first_not_of(" \t");
+        return start != std::string::npos && start + 1 < line.size() && line[start] == 'v' && (line[start + 1] == ' ' || line[start + 1] == '\t');
+    }
+
+    /** Appends the given float with enough precision to be read back exactly */
+    void appendFloat(std::string& buffer, float value)
+    {
+        char text[32];
+        int length = std::snprintf(text, sizeof(text), "%.9g", value);
+        buffer.append(text, length);
+    }
+}
+
+
+bool HeadlessMeshFile::read(const std::string& path, HeadlessMesh& mesh, std::string& error)
+{
+    mesh = HeadlessMesh();
+    std::string extension = getExtension(path);
+
+    if (extension == ".obj")
+    {
+        return readObj(path, mesh, error);
+    }
+    else if (extension == ".ply")
+    {
+        return readPly(path, mesh, error);
+    }
+
+    error = "Unsupported mesh format (only .obj and .ply are supported): " + path;
+    return false;
+}
+
+bool HeadlessMeshFile::write(const std::string& path, const HeadlessMesh& mesh, std::string& error)
+{
+    std::string extension = getExtension(path);
+
+    if (extension == ".obj")
+    {
+        return writeObj(path, mesh, error);
+    }
+    else if (extension == ".ply")
+    {
+        return writePly(path, mesh, error);
+    }
+
+    error = "Unsupported mesh format (only .obj and .ply are supported): " + path;
+    return false;
+}
+
+bool HeadlessMeshFile::readObj(const std::string& path, HeadlessMesh& mesh, std::string& error)
+{
+    std::ifstream stream(path);
+    if (!stream)
+    {
+        error = "Could not open mesh file: " + path;
+        return false;
+    }
+
+    std::string line;
+    std::string token;
+
+    while (std::getline(stream, line))
+    {
+        if (!line.empty() && line.back() == '\r')
+        {
+            line.pop_back();
+        }
+
+        mesh.objLines.push_back(line);
+
+        std::istringstream lineStream(line);
+        std::string statement;
+        lineStream >> statement;
+
+        if (statement == "v")
+        {
+            Float3 position;
+            if (!(lineStream >> position.x >> position.y >> position.z))
+            {
+                error = "Invalid vertex position in line " + std::to_string(mesh.objLines.size()) + " of " + path;
+                return false;
+            }
+
+            mesh.positions.push_back(position);
+        }
+        else if (statement == "vt")
+        {
+            float u = 0.f;
+            float v = 0.f;
+            lineStream >> u >> v;
+
+            mesh.uvs.push_back(u);
+            mesh.uvs.push_back(v);
+        }
+        else if (statement == "f")
+        {
+            unsigned int faceVertexCount = 0;
+
+            while (lineStream >> token)
+            {
+                // Face-vertices are either v, v/vt, v//vn or v/vt/vn
+
+                int vertexIndex = getObjIndex(token.c_str(), mesh.positions.size());
+                if (vertexIndex < 0)
+                {
+                    error = "Invalid face vertex index in line " + std::to_string(mesh.objLines.size()) + " of " + path;
+                    return false;
+                }
+
+                size_t slash = token.find('/');
+                int uvIndex = -1;
+
+                if (slash != std::string::npos && slash + 1 < token.size() && token[slash + 1] != '/')
+                {
+                    uvIndex = getObjIndex(token.c_str() + slash + 1, mesh.uvs.size() / 2);
+                }
+
+                mesh.faceVertexIds.push_back(static_cast<unsigned int>(vertexIndex));
+                mesh.faceVertexUvIds.push_back(uvIndex);
+                faceVertexCount++;
+            }
+
+            mesh.faceVertexCounts.push_back(faceVertexCount);
+        }
+    }
+
+    return true;
+}
+
+bool HeadlessMeshFile::readPly(const std::string& path, HeadlessMesh& mesh, std::string& error)
+{
+    std::ifstream stream(path, std::ios::binary);
+    if (!stream)
+    {
+        error = "Could not open mesh file: " + path;
+        return false;
+    }
+
+    // Header
+
+    std::string line;
+    std::getline(stream, line);
+
+    if (line.compare(0, 3, "ply") != 0)
+    {
+        error = "Not a PLY file: " + path;
+        return false;
+    }
+
+    bool isAscii = false;
+    std::vector<PlyElement> elements;
+
+    while (std::getline(stream, line))
+    {
+        if (!line.empty() && line.back() == '\r')
+        {
+            line.pop_back();
+        }
+
+        std::istringstream lineStream(line);
+        std::string keyword;
+        lineStream >> keyword;
+
+        if (keyword == "format")
+        {
+            std::string format;
+            lineStream >> format;
+
+            if (format != "ascii" && format != "binary_little_endian")
+            {
+                error = "Unsupported PLY format (" + format + "): " + path;
+                return false;
+            }
+
+            isAscii = format == "ascii";
+        }
+        else if (keyword == "element")
+        {
+            PlyElement element;
+            lineStream >> element.name >> element.count;
+            elements.push_back(element);
+        }
+        else if (keyword == "property" && !elements.empty())
+        {
+            PlyProperty property;
+            std::string typeName;
+            lineStream >> typeName;
+
+            if (typeName == "list")
+            {
+                std::string countTypeName;
+                lineStream >> countTypeName >> typeName;
+
+                property.isList = true;
+                property.countType = getPlyType(countTypeName);
+            }
+
+            lineStream >> property.name;
+            property.type = getPlyType(typeName);
+
+            if (property.type == PlyType::INVALID || (property.isList && property.countType == PlyType::INVALID))
+            {
+                error = "Unsupported PLY property type in: " + path;
+                return false;
+            }
+
+            elements.back().properties.push_back(property);
+        }
+        else if (keyword == "end_header")
+        {
+            break;
+        }
+    }
+
+    // Elements
+
+    for (const PlyElement& element : elements)
+    {
+        bool isVertexElement = element.name == "vertex";
+        bool isFaceElement = element.name == "face";
+
+        int xIndex = -1;
+        int yIndex = -1;
+        int zIndex = -1;
+        int uIndex = -1;
+        int vIndex = -1;
+
+        for (int i = 0; i < static_cast<int>(element.properties.size()); i++)
+        {
+            const std::string& name = element.properties[i].name;
+
+            if (name == "x") xIndex = i;
+            else if (name == "y") yIndex = i;
+            else if (name == "z") zIndex = i;
+            else if (name == "u" || name == "s" || name == "texture_u") uIndex = i;
+            else if (name == "v" || name == "t" || name == "texture_v") vIndex = i;
+        }
+
+        bool hasUvs = isVertexElement && uIndex >= 0 && vIndex >= 0;
+
+        if (isVertexElement)
+        {
+            mesh.positions.resize(element.count);
+            mesh.uvs.resize(hasUvs ? element.count * 2 : 0);
+        }
+
+        std::vector<double> values(element.properties.size());
+
+        for (size_t item = 0; item < element.count; item++)
+        {
+            for (size_t i = 0; i < element.properties.size(); i++)
+            {
+                const PlyProperty& property = element.properties[i];
+
+                if (!property.isList)
+                {
+                    if (!readPlyValue(stream, property.type, isAscii, values[i]))
+                    {
+                        error = "Unexpected end of PLY data in: " + path;
+                        return false;
+                    }
+
+                    continue;
+                }
+
+                double listLength = 0.0;
+                if (!readPlyValue(stream, property.countType, isAscii, listLength))
+                {
+                    error = "Unexpected end of PLY data in: " + path;
+                    return false;
+                }
+
+                bool isFaceIndexList = isFaceElement && (property.name == "vertex_indices" || property.name == "vertex_index");
+
+                for (unsigned int j = 0; j < static_cast<unsigned int>(listLength); j++)
+                {
+                    double listValue = 0.0;
+                    if (!readPlyValue(stream, property.type, isAscii, listValue))
+                    {
+                        error = "Unexpected end of PLY data in: " + path;
+                        return false;
+                    }
+
+                    if (isFaceIndexList)
+                    {
+                        mesh.faceVertexIds.push_back(static_cast<unsigned int>(listValue));
+                    }
+                }
+
+                if (isFaceIndexList)
+                {
+                    mesh.faceVertexCounts.push_back(static_cast<unsigned int>(listLength));
+                }
+            }
+
+            if (isVertexElement)
+            {
+                mesh.positions[item] = Float3(xIndex >= 0 ? static_cast<float>(values[xIndex]) : 0.f,
+                                              yIndex >= 0 ? static_cast<float>(values[yIndex]) : 0.f,
+                                              zIndex >= 0 ? static_cast<float>(values[zIndex]) : 0.f);
+
+                if (hasUvs)
+                {
+                    mesh.uvs[item * 2] = static_cast<float>(values[uIndex]);
+                    mesh.uvs[item * 2 + 1] = static_cast<float>(values[vIndex]);
+                }
+            }
+        }
+    }
+
+    // PLY UVs are per vertex, so every face-vertex uses the UV of its vertex
+
+    bool hasUvs = !mesh.uvs.empty();
+    mesh.faceVertexUvIds.resize(mesh.faceVertexIds.size());
+
+    for (size_t i = 0; i < mesh.faceVertexIds.size(); i++)
+    {
+        if (mesh.faceVertexIds[i] >= mesh.positions.size())
+        {
+            error = "Invalid face vertex index in: " + path;
+            return false;
+        }
+
+        mesh.faceVertexUvIds[i] = hasUvs ? static_cast<int>(mesh.faceVertexIds[i]) : -1;
+    }
+
+    return true;
+}
+
+bool HeadlessMeshFile::writeObj(const std::string& path, const HeadlessMesh& mesh, std::string& error)
+{
+    std::ofstream stream(path, std::ios::binary | std::ios::trunc);
+    if (!stream)
+    {
+        error = "Could not open mesh file for writing: " + path;
+        return false;
+    }
+
+    std::string buffer;
+
+    if (!mesh.objLines.empty())
+    {
+        // Only the first 3 values of each vertex statement are replaced. Anything after them (w, vertex colors) is kept.
+
+        size_t vertexIndex = 0;
+
+        for (const std::string& line : mesh.objLines)
+        {
+            if (!isObjVertexLine(line) || vertexIndex >= mesh.positions.size())
+            {
+                buffer.append(line);
+                buffer.push_back('\n');
+                continue;
+            }
+
+            std::istringstream lineStream(line);
+            std::string token;
+            lineStream >> token >> token >> token >> token;
+
+            std::string remainder;
+            std::getline(lineStream, remainder);
+
+            const Float3& position = mesh.positions[vertexIndex++];
+
+            buffer.append("v ");
+            appendFloat(buffer, position.x);
+            buffer.push_back(' ');
+            appendFloat(buffer, position.y);
+            buffer.push_back(' ');
+            appendFloat(buffer, position.z);
+            buffer.append(remainder);
+            buffer.push_back('\n');
+        }
+    }
+    else
+    {
+        for (const Float3& position : mesh.positions)
+        {
+            buffer.append("v ");
+            appendFloat(buffer, position.x);
+            buffer.push_back(' ');
+            appendFloat(buffer, position.y);
+            buffer.push_back(' ');
+            appendFloat(buffer, position.z);
+            buffer.push_back('\n');
+        }
+
+        for (size_t i = 0; i + 1 < mesh.uvs.size(); i += 2)
+        {
+            buffer.append("vt ");
+            appendFloat(buffer, mesh.uvs[i]);
+            buffer.push_back(' ');
+            appendFloat(buffer, mesh.uvs[i + 1]);
+            buffer.push_back('\n');
+        }
+
+        size_t faceVertex = 0;
+
+        for (unsigned int faceVertexCount : mesh.faceVertexCounts)
+        {
+            buffer.push_back('f');
+
+            for (unsigned int i = 0; i < faceVertexCount; i++, faceVertex++)
+            {
+                buffer.push_back(' ');
+                buffer.append(std::to_string(mesh.faceVertexIds[faceVertex] + 1));
+
+                if (mesh.faceVertexUvIds[faceVertex] >= 0)
+                {
+                    buffer.push_back('/');
+                    buffer.append(std::to_string(mesh.faceVertexUvIds[faceVertex] + 1));
+                }
+            }
+
+            buffer.push_back('\n');
+        }
+    }
+
+    stream.write(buffer.data(), buffer.size());
+
+    if (!stream)
+    {
+        error = "Could not write mesh file: " + path;
+        return false;
+    }
+
+    return true;
+}
+
+bool HeadlessMeshFile::writePly(const std::string& path, const HeadlessMesh& mesh, std::string& error)
+{
+    std::ofstream stream(path, std::ios::binary | std::ios::trunc);
+    if (!stream)
+    {
+        error = "Could not open mesh file for writing: " + path;
+        return false;
+    }
+
+    // PLY UVs are per vertex, so each vertex takes the UV of its first face-vertex
+
+    std::vector<float> vertexUvs;
+    bool hasUvs = !mesh.uvs.empty();
+
+    if (hasUvs)
+    {
+        getVertexUvs(mesh, vertexUvs);
+    }
+
+    stream << "ply\nformat binary_little_endian 1.0\n";
+    stream << "element vertex " << mesh.positions.size() << "\n";
+    stream << "property float x\nproperty float y\nproperty float z\n";
+
+    if (hasUvs)
+    {
+        stream << "property float u\nproperty float v\n";
+    }
+
+    stream << "element face " << mesh.faceVertexCounts.size() << "\n";
+    stream << "property list uchar int vertex_indices\nend_header\n";
+
+    for (size_t i = 0; i < mesh.positions.size(); i++)
+    {
+        stream.write(reinterpret_cast<const char*>(&mesh.positions[i]), sizeof(float) * 3);
+
+        if (hasUvs)
+        {
+            stream.write(reinterpret_cast<const char*>(&vertexUvs[i * 2]), sizeof(float) * 2);
+        }
+    }
+
+    size_t faceVertex = 0;
+
+    for (unsigned int faceVertexCount : mesh.faceVertexCounts)
+    {
+        if (faceVertexCount > 255)
+        {
+            error = "Faces with more than 255 vertices can't be written to PLY files: " + path;
+            return false;
+        }
+
+        uint8_t count = static_cast<uint8_t>(faceVertexCount);
+        stream.write(reinterpret_cast<const char*>(&count), sizeof(count));
+
+        for (unsigned int i = 0; i < faceVertexCount; i++, faceVertex++)
+        {
+            int32_t vertexIndex = static_cast<int32_t>(mesh.faceVertexIds[faceVertex]);
+            stream.write(reinterpret_cast<const char*>(&vertexIndex), sizeof(vertexIndex));
+        }
+    }
+
+    if (!stream)
+    {
+        error = "Could not write mesh file: " + path;
+        return false;
+    }
+
+    return true;
+}
+
+void HeadlessMeshFile::getVertexUvs(const HeadlessMesh& mesh, std::vector<float>& vertexUvs)
+{
+    vertexUvs.assign(mesh.positions.size() * 2, 0.f);
+    std::vector<char> hasVertexUv(mesh.positions.size(), 0);
+
+    for (size_t i = 0; i < mesh.faceVertexIds.size(); i++)
+    {
+        unsigned int vertexIndex = mesh.faceVertexIds[i];
+        int uvIndex = mesh.faceVertexUvIds[i];
+
+        if (uvIndex < 0 || hasVertexUv[vertexIndex])
+        {
+            continue;
+        }
+
+        vertexUvs[vertexIndex * 2] = mesh.uvs[uvIndex * 2];
+        vertexUvs[vertexIndex * 2 + 1] = mesh.uvs[uvIndex * 2 + 1];
+        hasVertexUv[vertexIndex] = 1;
+    }
+}
+
+std::string HeadlessMeshFile::getExtension(const std::string& path)
+{
+    size_t dot = path.find_last_of('.');
+    size_t separator = path.find_last_of("/\\");
+
+    if (dot == std::string::npos || (separator != std::string::npos && dot < separator))
+    {
+        return std::string();
+    }
+
+    std::string extension = path.substr(dot);
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+
+    return extension;
+}
\ No newline at end of file
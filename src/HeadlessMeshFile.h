@@ -0,0 +1,80 @@
+/* Copyright (C) 2020 - Jose Ivan Lopez Romo - All rights reserved
+ *
+ * This file is part of the MayaVectorDisplacementDeformer project found in the
+ * following repository: https://github.com/Zhibade/maya-vector-displacement-deformer
+ *
+ * Released under MIT license. Please see LICENSE file for details.
+ */
+
+#pragma once
+
+#include "VectorDisplacementMath.h"
+
+#include <string>
+#include <vector>
+
+
+/* Polygon mesh loaded from a file, outside of Maya */
+struct HeadlessMesh
+{
+    std::vector<Float3> positions;
+    std::vector<float> uvs; // 2 floats per UV
+    std::vector<unsigned int> faceVertexCounts; // Vertex count of each face
+    std::vector<unsigned int> faceVertexIds; // Vertex index of each face-vertex
+    std::vector<int> faceVertexUvIds; // UV index of each face-vertex. -1 = No UV.
+
+    std::vector<std::string> objLines; // Source lines of OBJ files. Rewritten on save so everything but the positions is kept as is.
+};
+
+
+/* Reads and writes meshes in OBJ and PLY format (chosen by file extension) */
+class HeadlessMeshFile final
+{
+public:
+    /**
+    * Reads a mesh file. PLY files can be ASCII or binary (little endian), and take their UVs from the u/v, s/t or texture_u/texture_v vertex properties.
+    *
+    * @param[in] path - Path of the .obj or .ply file
+    * @param[out] mesh - Loaded mesh
+    * @param[out] error - Reason of the failure, if any
+    *
+    * @return True if the mesh was read successfully
+    */
+    static bool read(const std::string& path, HeadlessMesh& mesh, std::string& error);
+
+    /**
+    * Writes a mesh file. OBJ files keep every line of the source file except for the vertex positions.
+    * PLY files are written in binary (little endian) with positions, UVs and faces.
+    *
+    * @param[in] path - Path of the .obj or .ply file
+    * @param[in] mesh - Mesh to write
+    * @param[out] error - Reason of the failure, if any
+    *
+    * @return True if the mesh was written successfully
+    */
+    static bool write(const std::string& path, const HeadlessMesh& mesh, std::string& error);
+
+    /**
+    * Gets the UV of each vertex (UV of its first face-vertex, or 0,0 if it has none), like the deformer node does
+    *
+    * @param[in] mesh - Mesh to get the UVs from
+    * @param[out] vertexUvs - 2 floats per vertex
+    */
+    static void getVertexUvs(const HeadlessMesh& mesh, std::vector<float>& vertexUvs);
+
+private:
+    /** Reads an OBJ file (v, vt and f statements). Negative (relative) indices are supported. See read(). */
+    static bool readObj(const std::string& path, HeadlessMesh& mesh, std::string& error);
+
+    /** Reads a PLY file. See read(). */
+    static bool readPly(const std::string& path, HeadlessMesh& mesh, std::string& error);
+
+    /** Writes an OBJ file. See write(). */
+    static bool writeObj(const std::string& path, const HeadlessMesh& mesh, std::string& error);
+
+    /** Writes a binary PLY file. See write(). */
+    static bool writePly(const std::string& path, const HeadlessMesh& mesh, std::string& error);
+
+    /** Returns the lower-case extension of the given path, including the dot */
+    static std::string getExtension(const std::string& path);
+};
\ No newline at end of file
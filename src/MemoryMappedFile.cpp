@@ -0,0 +1,116 @@
+/* Copyright (C) 2020 - Jose Ivan Lopez Romo - All rights reserved
+ *
+ * This file is part of the MayaVectorDisplacementDeformer project found in the
+ * following repository: https://github.com/Zhibade/maya-vector-displacement-deformer
+ *
+ * Released under MIT license. Please see LICENSE file for details.
+ */
+
+#include "MemoryMappedFile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+MemoryMappedFile::~MemoryMappedFile()
+{
+    close();
+}
+
+MStatus MemoryMappedFile::open(const MString& path)
+{
+    close();
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.asChar(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        return MS::kNotFound;
+    }
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+    {
+        CloseHandle(file);
+        return MS::kFailure;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping == NULL)
+    {
+        CloseHandle(file);
+        return MS::kFailure;
+    }
+
+    const void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (view == NULL)
+    {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return MS::kFailure;
+    }
+
+    fileHandle = file;
+    mappingHandle = mapping;
+    mappedSize = static_cast<size_t>(fileSize.QuadPart);
+#else
+    int fileDescriptor = ::open(path.asChar(), O_RDONLY);
+    if (fileDescriptor < 0)
+    {
+        return MS::kNotFound;
+    }
+
+    struct stat fileStats;
+    if (fstat(fileDescriptor, &fileStats) != 0 || fileStats.st_size == 0)
+    {
+        ::close(fileDescriptor);
+        return MS::kFailure;
+    }
+
+    void* view = mmap(NULL, static_cast<size_t>(fileStats.st_size), PROT_READ, MAP_SHARED, fileDescriptor, 0);
+    ::close(fileDescriptor); // The mapping keeps its own reference to the file
+
+    if (view == MAP_FAILED)
+    {
+        return MS::kFailure;
+    }
+
+    mappedSize = static_cast<size_t>(fileStats.st_size);
+#endif
+
+    mappedData = view;
+    mappedPath = path;
+
+    return MS::kSuccess;
+}
+
+void MemoryMappedFile::close()
+{
+    if (!mappedData)
+    {
+        return;
+    }
+
+#ifdef _WIN32
+    UnmapViewOfFile(mappedData);
+    CloseHandle(mappingHandle);
+    CloseHandle(fileHandle);
+
+    mappingHandle = nullptr;
+    fileHandle = nullptr;
+#else
+    munmap(const_cast<void*>(mappedData), mappedSize);
+#endif
+
+    mappedData = nullptr;
+    mappedSize = 0;
+    mappedPath = MString();
+}
\ No newline at end of file
@@ -0,0 +1,60 @@
+/* Copyright (C) 2020 - Jose Ivan Lopez Romo - All rights reserved
+ *
+ * This file is part of the MayaVectorDisplacementDeformer project found in the
+ * following repository: https://github.com/Zhibade/maya-vector-displacement-deformer
+ *
+ * Released under MIT license. Please see LICENSE file for details.
+ */
+
+#pragma once
+
+#include <maya/MStatus.h>
+#include <maya/MString.h>
+
+#include <cstddef>
+
+
+/* Read-only memory mapping of a file. The mapping is released when the object is closed or destroyed. */
+class MemoryMappedFile final
+{
+public:
+    MemoryMappedFile() {};
+    ~MemoryMappedFile();
+
+    MemoryMappedFile(const MemoryMappedFile&) = delete;
+    MemoryMappedFile& operator=(const MemoryMappedFile&) = delete;
+
+    /**
+    * Maps the given file in memory. Any previously mapped file is closed first.
+    *
+    * @param[in] path - Path of the file to map
+    *
+    * @return MStatus indicating whether the operation was successful or not
+    */
+    MStatus open(const MString& path);
+
+    /* Unmaps the current file, if any */
+    void close();
+
+    /** Returns true if a file is currently mapped */
+    bool isOpen() const { return mappedData != nullptr; }
+
+    /** Returns a pointer to the beginning of the mapped file, or null if no file is mapped */
+    const void* data() const { return mappedData; }
+
+    /** Returns the size of the mapped file in bytes */
+    size_t size() const { return mappedSize; }
+
+    /** Returns the path of the mapped file */
+    const MString& path() const { return mappedPath; }
+
+private:
+    const void* mappedData = nullptr;
+    size_t mappedSize = 0;
+    MString mappedPath;
+
+#ifdef _WIN32
+    void* fileHandle = nullptr;
+    void* mappingHandle = nullptr;
+#endif
+};
\ No newline at end of file
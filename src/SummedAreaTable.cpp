@@ -0,0 +1,149 @@
+/* Copyright (C) 2020 - Jose Ivan Lopez Romo - All rights reserved
+ *
+ * This file is part of the MayaVectorDisplacementDeformer project found in the
+ * following repository: https://github.com/Zhibade/maya-vector-displacement-deformer
+ *
+ * Released under MIT license. Please see LICENSE file for details.
+ */
+
+#include "SummedAreaTable.h"
+
+#include <algorithm>
+#include <cmath>
+
+
+constexpr float MAX_SAMPLE_MAGNITUDE = 100000.f; // Keeps the sums of tables up to 32768^2 texels within 64 bits (32768^2 * 1e5 * 65536 < 2^63)
+
+
+void SummedAreaTable::build(unsigned int width, unsigned int height, const std::vector<float>& rgb)
+{
+    reset(width, height);
+
+    if (rgb.size() < static_cast<size_t>(width) * height * 3)
+    {
+        sums.clear();
+        return;
+    }
+
+    addRows(0, height, rgb.data());
+}
+
+void SummedAreaTable::reset(unsigned int width, unsigned int height)
+{
+    this->width = width;
+    this->height = height;
+
+    size_t rowSize = (static_cast<size_t>(width) + 1) * 3;
+    sums.assign(rowSize * (static_cast<size_t>(height) + 1), 0);
+}
+
+void SummedAreaTable::addRows(unsigned int firstRow, unsigned int rowCount, const float* rgb)
+{
+    size_t rowSize = (static_cast<size_t>(width) + 1) * 3;
+    unsigned int endRow = std::min(firstRow + rowCount, height);
+
+    // Each corner holds the row prefix sum plus the corner below it
+
+    for (unsigned int y = firstRow; y < endRow; y++)
+    {
+        int64_t rowSum[3] = { 0, 0, 0 };
+        const float* row = rgb + static_cast<size_t>(y - firstRow) * width * 3;
+        const int64_t* corners = sums.data() + static_cast<size_t>(y) * rowSize;
+        int64_t* nextCorners = sums.data() + static_cast<size_t>(y + 1) * rowSize;
+
+        for (unsigned int x = 0; x < width; x++)
+        {
+            for (unsigned int channel = 0; channel < 3; channel++)
+            {
+                float value = row[x * 3 + channel];
+                value = std::isnan(value) ? 0.f : std::max(-MAX_SAMPLE_MAGNITUDE, std::min(value, MAX_SAMPLE_MAGNITUDE));
+                rowSum[channel] += std::llround(value * FIXED_POINT_SCALE);
+                nextCorners[(x + 1) * 3 + channel] = corners[(x + 1) * 3 + channel] + rowSum[channel];
+            }
+        }
+    }
+}
+
+
+Float3 SummedAreaTable::getBoxAverage(float u, float v, float halfWidth, float halfHeight) const
+{
+    if (isEmpty() || width == 0 || height == 0)
+    {
+        return Float3();
+    }
+
+    unsigned int x0, x1, y0, y1;
+    getTexelRange(u, halfWidth, width, x0, x1);
+    getTexelRange(v, halfHeight, height, y0, y1);
+
+    // Rectangles that cross the image border are split into up to four parts
+
+    int64_t sum[3] = { 0, 0, 0 };
+    unsigned int xEnds[2] = { std::min(x1, width), x1 > width ? x1 - width : 0 };
+    unsigned int yEnds[2] = { std::min(y1, height), y1 > height ? y1 - height : 0 };
+
+    for (unsigned int yPart = 0; yPart < 2; yPart++)
+    {
+        for (unsigned int xPart = 0; xPart < 2; xPart++)
+        {
+            unsigned int xFirst = xPart == 0 ? x0 : 0;
+            unsigned int yFirst = yPart == 0 ? y0 : 0;
+
+            if (xEnds[xPart] > xFirst && yEnds[yPart] > yFirst)
+            {
+                addRectangleSum(xFirst, yFirst, xEnds[xPart], yEnds[yPart], sum);
+            }
+        }
+    }
+
+    double scale = 1.0 / (static_cast<double>(x1 - x0) * (y1 - y0) * FIXED_POINT_SCALE);
+
+    return Float3(static_cast<float>(sum[0] * scale), static_cast<float>(sum[1] * scale), static_cast<float>(sum[2] * scale));
+}
+
+
+void SummedAreaTable::addRectangleSum(unsigned int x0, unsigned int y0, unsigned int x1, unsigned int y1, int64_t sum[3]) const
+{
+    size_t rowSize = (static_cast<size_t>(width) + 1) * 3;
+    const int64_t* bottomRow = sums.data() + y0 * rowSize;
+    const int64_t* topRow = sums.data() + y1 * rowSize;
+
+    for (unsigned int channel = 0; channel < 3; channel++)
+    {
+        sum[channel] += topRow[x1 * 3 + channel] - topRow[x0 * 3 + channel] - bottomRow[x1 * 3 + channel] + bottomRow[x0 * 3 + channel];
+    }
+}
+
+
+void SummedAreaTable::getTexelRange(float center, float halfSize, unsigned int size, unsigned int& first, unsigned int& end)
+{
+    float firstTexel = std::round((center - halfSize) * size);
+    float endTexel = std::round((center + halfSize) * size);
+
+    if (!std::isfinite(firstTexel) || !std::isfinite(endTexel))
+    {
+        first = 0;
+        end = 1;
+        return;
+    }
+
+    // Single precision all the way through, step for step like the OpenCL kernel, so both pick the same texels at range edges
+
+    float count = std::min(endTexel - firstTexel, static_cast<float>(size));
+
+    if (count < 1.f)
+    {
+        firstTexel = std::floor(center * size);
+        count = 1.f;
+    }
+
+    float wrappedFirst = std::fmod(firstTexel, static_cast<float>(size));
+
+    if (wrappedFirst < 0.f)
+    {
+        wrappedFirst += size;
+    }
+
+    first = std::min(static_cast<unsigned int>(wrappedFirst), size - 1);
+    end = first + static_cast<unsigned int>(count);
+}
\ No newline at end of file
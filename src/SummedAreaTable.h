@@ -0,0 +1,101 @@
+/* Copyright (C) 2020 - Jose Ivan Lopez Romo - All rights reserved
+ *
+ * This file is part of the MayaVectorDisplacementDeformer project found in the
+ * following repository: https://github.com/Zhibade/maya-vector-displacement-deformer
+ *
+ * Released under MIT license. Please see LICENSE file for details.
+ */
+
+#pragma once
+
+#include "VectorDisplacementMath.h"
+
+#include <cstdint>
+#include <vector>
+
+
+/*
+ * Summed-area table of an RGB image, used to get the box-filtered average of any texel rectangle in constant time.
+ * Sums are stored as 64-bit fixed-point integers, so rectangle sums are exact no matter how large the table is,
+ * and the OpenCL kernel that reads the same table gets the same results. Has no Maya dependency.
+ */
+class SummedAreaTable final
+{
+public:
+    /**
+    * Builds the table
+    *
+    * @param[in] width - Image width in texels
+    * @param[in] height - Image height in texels
+    * @param[in] rgb - 3 values per texel, rows of the image from V = 0 upwards
+    */
+    void build(unsigned int width, unsigned int height, const std::vector<float>& rgb);
+
+    /**
+    * Starts building the table a band of rows at a time, so the whole image never needs to be in memory. Rows are added with addRows().
+    *
+    * @param[in] width - Image width in texels
+    * @param[in] height - Image height in texels
+    */
+    void reset(unsigned int width, unsigned int height);
+
+    /**
+    * Adds the next rows of the image to a table started with reset(). Rows need to be added in order, from V = 0 upwards.
+    *
+    * @param[in] firstRow - Index of the first row to add (rows added so far)
+    * @param[in] rowCount - Number of rows to add
+    * @param[in] rgb - 3 values per texel of the added rows
+    */
+    void addRows(unsigned int firstRow, unsigned int rowCount, const float* rgb);
+
+    /**
+    * Gets the average of the image over a UV rectangle. The image repeats outside of the 0 - 1 range. The rectangle is snapped
+    * to texel boundaries and covers at least one texel, so footprints smaller than a texel return the texel under the center.
+    *
+    * @param[in] u - Rectangle center U
+    * @param[in] v - Rectangle center V
+    * @param[in] halfWidth - Half of the rectangle width in UV units
+    * @param[in] halfHeight - Half of the rectangle height in UV units
+    *
+    * @return Average value (zero if the table is empty)
+    */
+    Float3 getBoxAverage(float u, float v, float halfWidth, float halfHeight) const;
+
+    /** Returns true if the table hasn't been built */
+    bool isEmpty() const { return sums.empty(); }
+
+    unsigned int getWidth() const { return width; }
+    unsigned int getHeight() const { return height; }
+
+    /** Returns the sums, 3 per table corner. Rows have (width + 1) corners and there are (height + 1) rows, the first row and column being zero. */
+    const std::vector<int64_t>& getSums() const { return sums; }
+
+    static constexpr double FIXED_POINT_SCALE = 65536.0; // Fixed-point units per map unit
+
+private:
+    /**
+    * Adds the sum of a texel rectangle that doesn't wrap around the image
+    *
+    * @param[in] x0 - First column
+    * @param[in] y0 - First row
+    * @param[in] x1 - Column after the last one
+    * @param[in] y1 - Row after the last one
+    * @param[in,out] sum - Sum of each channel
+    */
+    void addRectangleSum(unsigned int x0, unsigned int y0, unsigned int x1, unsigned int y1, int64_t sum[3]) const;
+
+    /**
+    * Snaps a UV interval to texels, wrapped so the first texel is inside the image
+    *
+    * @param[in] center - Interval center in UV units
+    * @param[in] halfSize - Half of the interval size in UV units
+    * @param[in] size - Image size in texels along the interval
+    * @param[out] first - First texel, in [0, size)
+    * @param[out] end - Texel after the last one, in (first, first + size]. Values past size wrap around to the start of the image.
+    */
+    static void getTexelRange(float center, float halfSize, unsigned int size, unsigned int& first, unsigned int& end);
+
+    std::vector<int64_t> sums;
+    unsigned int width = 0;
+    unsigned int height = 0;
+};
\ No newline at end of file
@@ -0,0 +1,504 @@
+/* Copyright (C) 2020 - Jose Ivan Lopez Romo - All rights reserved
+ *
+ * This file is part of the MayaVectorDisplacementDeformer project found in the
+ * following repository: https://github.com/Zhibade/maya-vector-displacement-deformer
+ *
+ * Released under MIT license. Please see LICENSE file for details.
+ */
+
+#include "TriangleBvh.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+
+constexpr unsigned int MAX_LEAF_SIZE = 4;
+constexpr unsigned int MAX_QUERY_DEPTH = 64; // Every split halves the triangles, so this is never reached
+constexpr float MORTON_GRID_SIZE = 1023.f; // Cells per axis of the Morton code grid (10 bits per axis)
+
+
+void TriangleBvh::build(const std::vector<Float3>& positions, const std::vector<unsigned int>& triangleVertexIds)
+{
+    nodes.clear();
+    triangleIds.clear();
+    triangleEntries.clear();
+    triangleVertices.clear();
+
+    unsigned int triangleCount = static_cast<unsigned int>(triangleVertexIds.size() / 3);
+
+    if (triangleCount == 0)
+    {
+        return;
+    }
+
+    // Sort the triangles along a Morton curve through their centroids, so any contiguous range of them is spatially compact
+
+    Float3 centroidMin(FLT_MAX, FLT_MAX, FLT_MAX);
+    Float3 centroidMax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+    std::vector<Float3> centroids(triangleCount);
+
+    for (unsigned int i = 0; i < triangleCount; i++)
+    {
+        Float3 centroid = (positions[triangleVertexIds[i * 3]] + positions[triangleVertexIds[i * 3 + 1]] + positions[triangleVertexIds[i * 3 + 2]]) / 3.f;
+
+        centroidMin = Float3(std::min(centroidMin.x, centroid.x), std::min(centroidMin.y, centroid.y), std::min(centroidMin.z, centroid.z));
+        centroidMax = Float3(std::max(centroidMax.x, centroid.x), std::max(centroidMax.y, centroid.y), std::max(centroidMax.z, centroid.z));
+        centroids[i] = centroid;
+    }
+
+    Float3 extent = centroidMax - centroidMin;
+    Float3 scale(extent.x > 0.f ? MORTON_GRID_SIZE / extent.x : 0.f,
+                 extent.y > 0.f ? MORTON_GRID_SIZE / extent.y : 0.f,
+                 extent.z > 0.f ? MORTON_GRID_SIZE / extent.z : 0.f);
+
+    std::vector<uint64_t> sortKeys(triangleCount); // Morton code in the high bits, triangle index in the low bits
+
+    VectorDisplacementMath::parallelFor(triangleCount, 0, [&](size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; i++)
+        {
+            Float3 cell = (centroids[i] - centroidMin);
+            uint64_t code = getMortonCode(cell.x * scale.x, cell.y * scale.y, cell.z * scale.z);
+
+            sortKeys[i] = (code << 32) | i;
+        }
+    });
+
+    std::sort(sortKeys.begin(), sortKeys.end());
+
+    triangleIds.resize(triangleCount);
+    triangleEntries.resize(triangleCount);
+    triangleVertices.resize(static_cast<size_t>(triangleCount) * 3);
+
+    VectorDisplacementMath::parallelFor(triangleCount, 0, [&](size_t begin, size_t end)
+    {
+        for (size_t entry = begin; entry < end; entry++)
+        {
+            unsigned int triangle = static_cast<unsigned int>(sortKeys[entry] & 0xFFFFFFFF);
+
+            triangleIds[entry] = triangle;
+            triangleEntries[triangle] = static_cast<unsigned int>(entry);
+
+            for (unsigned int i = 0; i < 3; i++)
+            {
+                triangleVertices[entry * 3 + i] = positions[triangleVertexIds[triangle * 3 + i]];
+            }
+        }
+    });
+
+    // Split the sorted entries top-down. Children always come after their parent, so bounds can be computed in reverse order afterwards.
+
+    struct BuildTask
+    {
+        unsigned int node;
+        unsigned int first;
+        unsigned int count;
+    };
+
+    std::vector<BuildTask> tasks;
+    tasks.push_back({ 0, 0, triangleCount });
+
+    nodes.reserve(2 * (triangleCount / MAX_LEAF_SIZE + 1));
+    nodes.emplace_back();
+
+    while (!tasks.empty())
+    {
+        BuildTask task = tasks.back();
+        tasks.pop_back();
+
+        if (task.count <= MAX_LEAF_SIZE)
+        {
+            nodes[task.node].first = task.first;
+            nodes[task.node].count = task.count;
+            continue;
+        }
+
+        // Split where the highest Morton code bit that differs within the range flips, so nodes match octree cells and don't overlap.
+        // Ranges where every triangle has the same code are split in halves.
+
+        uint64_t firstCode = sortKeys[task.first] >> 32;
+        uint64_t lastCode = sortKeys[task.first + task.count - 1] >> 32;
+        unsigned int leftCount = task.count / 2;
+
+        if (firstCode != lastCode)
+        {
+            unsigned int splitBit = 63;
+
+            while (!(((firstCode ^ lastCode) >> splitBit) & 1))
+            {
+                splitBit--;
+            }
+
+            auto splitKey = std::partition_point(sortKeys.begin() + task.first, sortKeys.begin() + task.first + task.count,
+                [splitBit](uint64_t key) { return !(((key >> 32) >> splitBit) & 1); });
+
+            leftCount = static_cast<unsigned int>(splitKey - (sortKeys.begin() + task.first));
+        }
+
+        unsigned int firstChild = static_cast<unsigned int>(nodes.size());
+
+        nodes[task.node].first = firstChild;
+        nodes[task.node].count = 0;
+
+        nodes.emplace_back();
+        nodes.emplace_back();
+
+        tasks.push_back({ firstChild + 1, task.first + leftCount, task.count - leftCount });
+        tasks.push_back({ firstChild, task.first, leftCount });
+    }
+
+    for (size_t i = nodes.size(); i-- > 0;)
+    {
+        Node& node = nodes[i];
+
+        Float3 boundsMin(FLT_MAX, FLT_MAX, FLT_MAX);
+        Float3 boundsMax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+
+        auto expand = [&boundsMin, &boundsMax](const Float3& minPoint, const Float3& maxPoint)
+        {
+            boundsMin = Float3(std::min(boundsMin.x, minPoint.x), std::min(boundsMin.y, minPoint.y), std::min(boundsMin.z, minPoint.z));
+            boundsMax = Float3(std::max(boundsMax.x, maxPoint.x), std::max(boundsMax.y, maxPoint.y), std::max(boundsMax.z, maxPoint.z));
+        };
+
+        if (node.count > 0)
+        {
+            for (size_t vertex = static_cast<size_t>(node.first) * 3; vertex < static_cast<size_t>(node.first + node.count) * 3; vertex++)
+            {
+                expand(triangleVertices[vertex], triangleVertices[vertex]);
+            }
+        }
+        else
+        {
+            expand(nodes[node.first].boundsMin, nodes[node.first].boundsMax);
+            expand(nodes[node.first + 1].boundsMin, nodes[node.first + 1].boundsMax);
+        }
+
+        node.boundsMin = boundsMin;
+        node.boundsMax = boundsMax;
+    }
+}
+
+bool TriangleBvh::findClosestPoint(const Float3& point, unsigned int& triangle, Float3& closestPoint) const
+{
+    if (nodes.empty())
+    {
+        return false;
+    }
+
+    float bestDistanceSquared = FLT_MAX;
+    unsigned int bestEntry = INVALID_TRIANGLE;
+
+    auto testEntry = [&](unsigned int entry)
+    {
+        const Float3* vertices = &triangleVertices[static_cast<size_t>(entry) * 3];
+        Float3 candidate = getClosestPointOnTriangle(point, vertices[0], vertices[1], vertices[2]);
+        Float3 difference = candidate - point;
+        float distanceSquared = difference.dot(difference);
+
+        if (distanceSquared < bestDistanceSquared)
+        {
+            bestDistanceSquared = distanceSquared;
+            bestEntry = entry;
+            closestPoint = candidate;
+        }
+    };
+
+    // Start from the hint triangle so most of the hierarchy is culled right away
+
+    if (triangle < triangleEntries.size())
+    {
+        testEntry(triangleEntries[triangle]);
+    }
+
+    unsigned int stack[MAX_QUERY_DEPTH];
+    unsigned int stackSize = 0;
+    stack[stackSize++] = 0;
+
+    while (stackSize > 0)
+    {
+        const Node& node = nodes[stack[--stackSize]];
+
+        if (getDistanceSquaredToBounds(point, node) >= bestDistanceSquared)
+        {
+            continue;
+        }
+
+        if (node.count > 0)
+        {
+            for (unsigned int entry = node.first; entry < node.first + node.count; entry++)
+            {
+                testEntry(entry);
+            }
+
+            continue;
+        }
+
+        // Visit the nearest child first (pushed last)
+
+        unsigned int nearChild = node.first;
+        unsigned int farChild = node.first + 1;
+        float nearDistanceSquared = getDistanceSquaredToBounds(point, nodes[nearChild]);
+        float farDistanceSquared = getDistanceSquaredToBounds(point, nodes[farChild]);
+
+        if (farDistanceSquared < nearDistanceSquared)
+        {
+            std::swap(nearChild, farChild);
+            std::swap(nearDistanceSquared, farDistanceSquared);
+        }
+
+        if (farDistanceSquared < bestDistanceSquared && stackSize < MAX_QUERY_DEPTH)
+        {
+            stack[stackSize++] = farChild;
+        }
+
+        if (nearDistanceSquared < bestDistanceSquared && stackSize < MAX_QUERY_DEPTH)
+        {
+            stack[stackSize++] = nearChild;
+        }
+    }
+
+    triangle = triangleIds[bestEntry];
+    return true;
+}
+
+bool TriangleBvh::findNearestHit(const Float3& origin, const Float3& direction, float maxDistance, unsigned int& triangle, Float3& hitPoint) const
+{
+    if (nodes.empty())
+    {
+        return false;
+    }
+
+    float bestDistance = maxDistance;
+    unsigned int bestEntry = INVALID_TRIANGLE;
+
+    auto testEntry = [&](unsigned int entry)
+    {
+        const Float3* vertices = &triangleVertices[static_cast<size_t>(entry) * 3];
+        float distance = 0.f;
+
+        if (intersectTriangle(origin, direction, vertices[0], vertices[1], vertices[2], distance) && std::abs(distance) < bestDistance)
+        {
+            bestDistance = std::abs(distance);
+            bestEntry = entry;
+            hitPoint = origin + direction * distance;
+        }
+    };
+
+    if (triangle < triangleEntries.size())
+    {
+        testEntry(triangleEntries[triangle]);
+    }
+
+    Float3 inverseDirection(1.f / direction.x, 1.f / direction.y, 1.f / direction.z);
+
+    unsigned int stack[MAX_QUERY_DEPTH];
+    unsigned int stackSize = 0;
+    stack[stackSize++] = 0;
+
+    while (stackSize > 0)
+    {
+        const Node& node = nodes[stack[--stackSize]];
+
+        if (getLineDistanceToBounds(origin, inverseDirection, node) >= bestDistance)
+        {
+            continue;
+        }
+
+        if (node.count > 0)
+        {
+            for (unsigned int entry = node.first; entry < node.first + node.count; entry++)
+            {
+                testEntry(entry);
+            }
+
+            continue;
+        }
+
+        unsigned int nearChild = node.first;
+        unsigned int farChild = node.first + 1;
+        float nearDistance = getLineDistanceToBounds(origin, inverseDirection, nodes[nearChild]);
+        float farDistance = getLineDistanceToBounds(origin, inverseDirection, nodes[farChild]);
+
+        if (farDistance < nearDistance)
+        {
+            std::swap(nearChild, farChild);
+            std::swap(nearDistance, farDistance);
+        }
+
+        if (farDistance < bestDistance && stackSize < MAX_QUERY_DEPTH)
+        {
+            stack[stackSize++] = farChild;
+        }
+
+        if (nearDistance < bestDistance && stackSize < MAX_QUERY_DEPTH)
+        {
+            stack[stackSize++] = nearChild;
+        }
+    }
+
+    if (bestEntry == INVALID_TRIANGLE)
+    {
+        return false;
+    }
+
+    triangle = triangleIds[bestEntry];
+    return true;
+}
+
+Float3 TriangleBvh::getClosestPointOnTriangle(const Float3& point, const Float3& a, const Float3& b, const Float3& c)
+{
+    // Voronoi region tests (Ericson, Real-Time Collision Detection 5.1.5)
+
+    Float3 ab = b - a;
+    Float3 ac = c - a;
+    Float3 ap = point - a;
+
+    float d1 = ab.dot(ap);
+    float d2 = ac.dot(ap);
+
+    if (d1 <= 0.f && d2 <= 0.f)
+    {
+        return a;
+    }
+
+    Float3 bp = point - b;
+    float d3 = ab.dot(bp);
+    float d4 = ac.dot(bp);
+
+    if (d3 >= 0.f && d4 <= d3)
+    {
+        return b;
+    }
+
+    float vc = d1 * d4 - d3 * d2;
+
+    if (vc <= 0.f && d1 >= 0.f && d3 <= 0.f)
+    {
+        return a + ab * (d1 / (d1 - d3));
+    }
+
+    Float3 cp = point - c;
+    float d5 = ab.dot(cp);
+    float d6 = ac.dot(cp);
+
+    if (d6 >= 0.f && d5 <= d6)
+    {
+        return c;
+    }
+
+    float vb = d5 * d2 - d1 * d6;
+
+    if (vb <= 0.f && d2 >= 0.f && d6 <= 0.f)
+    {
+        return a + ac * (d2 / (d2 - d6));
+    }
+
+    float va = d3 * d6 - d5 * d4;
+
+    if (va <= 0.f && (d4 - d3) >= 0.f && (d5 - d6) >= 0.f)
+    {
+        return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+    }
+
+    float denominator = 1.f / (va + vb + vc);
+
+    return a + ab * (vb * denominator) + ac * (vc * denominator);
+}
+
+bool TriangleBvh::intersectTriangle(const Float3& origin, const Float3& direction, const Float3& a, const Float3& b, const Float3& c, float& distance)
+{
+    Float3 ab = b - a;
+    Float3 ac = c - a;
+    Float3 p = direction.cross(ac);
+    float determinant = ab.dot(p);
+
+    if (std::abs(determinant) < 1e-12f)
+    {
+        return false; // Parallel to the triangle, or degenerate triangle
+    }
+
+    float inverseDeterminant = 1.f / determinant;
+    Float3 ao = origin - a;
+    float u = ao.dot(p) * inverseDeterminant;
+
+    if (u < 0.f || u > 1.f)
+    {
+        return false;
+    }
+
+    Float3 q = ao.cross(ab);
+    float v = direction.dot(q) * inverseDeterminant;
+
+    if (v < 0.f || u + v > 1.f)
+    {
+        return false;
+    }
+
+    distance = ac.dot(q) * inverseDeterminant;
+    return true;
+}
+
+float TriangleBvh::getLineDistanceToBounds(const Float3& origin, const Float3& inverseDirection, const Node& node)
+{
+    // Slab test over the whole line, then the closest point of the overlap to the origin
+
+    float entry = -FLT_MAX;
+    float exit = FLT_MAX;
+
+    const float Float3::* axes[3] = { &Float3::x, &Float3::y, &Float3::z };
+
+    for (const float Float3::* axis : axes)
+    {
+        float t0 = (node.boundsMin.*axis - origin.*axis) * inverseDirection.*axis;
+        float t1 = (node.boundsMax.*axis - origin.*axis) * inverseDirection.*axis;
+
+        if (std::isnan(t0) || std::isnan(t1))
+        {
+            continue; // Origin on the slab plane with a parallel line. Treated as inside the slab.
+        }
+
+        entry = std::max(entry, std::min(t0, t1));
+        exit = std::min(exit, std::max(t0, t1));
+    }
+
+    if (entry > exit)
+    {
+        return FLT_MAX;
+    }
+
+    if (entry <= 0.f && exit >= 0.f)
+    {
+        return 0.f;
+    }
+
+    return std::min(std::abs(entry), std::abs(exit));
+}
+
+uint64_t TriangleBvh::getMortonCode(float x, float y, float z)
+{
+    // Interleave the bits of the 3 cell coordinates (zyxzyx...)
+
+    auto spreadBits = [](uint64_t value)
+    {
+        value &= 0x3FF;
+        value = (value | (value << 16)) & 0x30000FF;
+        value = (value | (value << 8)) & 0x300F00F;
+        value = (value | (value << 4)) & 0x30C30C3;
+        value = (value | (value << 2)) & 0x9249249;
+        return value;
+    };
+
+    auto toCell = [](float coordinate) { return static_cast<uint64_t>(std::min(std::max(coordinate, 0.f), MORTON_GRID_SIZE)); };
+
+    return spreadBits(toCell(x)) | (spreadBits(toCell(y)) << 1) | (spreadBits(toCell(z)) << 2);
+}
+
+float TriangleBvh::getDistanceSquaredToBounds(const Float3& point, const Node& node)
+{
+    float dx = std::max({ node.boundsMin.x - point.x, 0.f, point.x - node.boundsMax.x });
+    float dy = std::max({ node.boundsMin.y - point.y, 0.f, point.y - node.boundsMax.y });
+    float dz = std::max({ node.boundsMin.z - point.z, 0.f, point.z - node.boundsMax.z });
+
+    return dx * dx + dy * dy + dz * dz;
+}
\ No newline at end of file
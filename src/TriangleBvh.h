@@ -0,0 +1,118 @@
+/* Copyright (C) 2020 - Jose Ivan Lopez Romo - All rights reserved
+ *
+ * This file is part of the MayaVectorDisplacementDeformer project found in the
+ * following repository: https://github.com/Zhibade/maya-vector-displacement-deformer
+ *
+ * Released under MIT license. Please see LICENSE file for details.
+ */
+
+#pragma once
+
+#include "VectorDisplacementMath.h"
+
+#include <cstdint>
+#include <vector>
+
+
+/*
+ * Bounding volume hierarchy over the triangles of a mesh, used to find the closest surface point to a query point.
+ * Has no Maya dependency. Queries are read-only, so any number of threads can query the same hierarchy.
+ */
+class TriangleBvh final
+{
+public:
+    /**
+    * Builds the hierarchy. Triangles are sorted along a Morton curve through their centroids, and each node splits its sorted range
+    * at the Morton octree cell boundary, so building only takes a single sort.
+    *
+    * @param[in] positions - Vertex positions of the mesh
+    * @param[in] triangleVertexIds - 3 vertex indices per triangle
+    */
+    void build(const std::vector<Float3>& positions, const std::vector<unsigned int>& triangleVertexIds);
+
+    /**
+    * Finds the closest point to the given point on the surface of the mesh
+    *
+    * @param[in] point - Query point
+    * @param[in,out] triangle - Triangle of the closest point. When valid on input, it's tested first to speed up coherent queries.
+    * @param[out] closestPoint - Closest point on the surface
+    *
+    * @return True if a point was found (false if the mesh has no triangles)
+    */
+    bool findClosestPoint(const Float3& point, unsigned int& triangle, Float3& closestPoint) const;
+
+    /**
+    * Finds the intersection nearest to the origin of a line through the mesh. Hits in front of and behind the origin are both considered.
+    *
+    * @param[in] origin - Line origin
+    * @param[in] direction - Line direction (doesn't need to be normalized, distances are measured in multiples of it)
+    * @param[in] maxDistance - Hits further away than this from the origin are ignored
+    * @param[in,out] triangle - Triangle that was hit. When valid on input, it's tested first to speed up coherent queries.
+    * @param[out] hitPoint - Intersection point
+    *
+    * @return True if the line hits the mesh within the maximum distance
+    */
+    bool findNearestHit(const Float3& origin, const Float3& direction, float maxDistance, unsigned int& triangle, Float3& hitPoint) const;
+
+    /** Returns true if the hierarchy has no triangles */
+    bool isEmpty() const { return nodes.empty(); }
+
+    static constexpr unsigned int INVALID_TRIANGLE = 0xFFFFFFFF;
+
+private:
+    struct Node
+    {
+        Float3 boundsMin;
+        Float3 boundsMax;
+        unsigned int first = 0; // Interior nodes: index of the first child (the second one follows it). Leaves: first entry in triangleIds.
+        unsigned int count = 0; // Number of triangles in the leaf. 0 = Interior node.
+    };
+
+    /**
+    * Gets the closest point to the given point on a triangle
+    *
+    * @param[in] point - Query point
+    * @param[in] a - First triangle vertex
+    * @param[in] b - Second triangle vertex
+    * @param[in] c - Third triangle vertex
+    *
+    * @return Closest point on the triangle
+    */
+    static Float3 getClosestPointOnTriangle(const Float3& point, const Float3& a, const Float3& b, const Float3& c);
+
+    /**
+    * Intersects a line with a triangle (Moller-Trumbore, both sides)
+    *
+    * @param[in] origin - Line origin
+    * @param[in] direction - Line direction
+    * @param[in] a - First triangle vertex
+    * @param[in] b - Second triangle vertex
+    * @param[in] c - Third triangle vertex
+    * @param[out] distance - Signed distance along the line, in multiples of the direction
+    *
+    * @return True if the line crosses the triangle
+    */
+    static bool intersectTriangle(const Float3& origin, const Float3& direction, const Float3& a, const Float3& b, const Float3& c, float& distance);
+
+    /**
+    * Gets the smallest absolute distance along a line at which it's inside a node's bounds
+    *
+    * @param[in] origin - Line origin
+    * @param[in] inverseDirection - Reciprocal of each component of the line direction
+    * @param[in] node - Node to test
+    *
+    * @return Absolute distance (0 if the origin is inside), or FLT_MAX if the line misses the bounds
+    */
+    static float getLineDistanceToBounds(const Float3& origin, const Float3& inverseDirection, const Node& node);
+
+    /** Returns the 30-bit Morton code of the given cell coordinates (0 - 1023 per axis) */
+    static uint64_t getMortonCode(float x, float y, float z);
+
+    /** Returns the squared distance between the given point and a node's bounds (0 if the point is inside) */
+    static float getDistanceSquaredToBounds(const Float3& point, const Node& node);
+
+    std::vector<Node> nodes; // Root first
+    std::vector<unsigned int> triangleIds; // Triangle index of each leaf entry
+    std::vector<unsigned int> triangleEntries; // Leaf entry of each triangle
+    std::vector<Float3> triangleVertices; // 3 vertices per leaf entry, stored in leaf order for locality
+};
\ No newline at end of file
@@ -0,0 +1,233 @@
+/* Copyright (C) 2020 - Jose Ivan Lopez Romo - All rights reserved
+ *
+ * This file is part of the MayaVectorDisplacementDeformer project found in the
+ * following repository: https://github.com/Zhibade/maya-vector-displacement-deformer
+ *
+ * Released under MIT license. Please see LICENSE file for details.
+ */
+
+#include "VectorDisplacementBakeCommand.h"
+#include "VectorDisplacementDeformerNode.h"
+#include "VectorDisplacementUtilities.h"
+
+#include <maya/MArgDatabase.h>
+#include <maya/MFloatVectorArray.h>
+#include <maya/MFnDependencyNode.h>
+#include <maya/MFnMesh.h>
+#include <maya/MGlobal.h>
+#include <maya/MIntArray.h>
+#include <maya/MPlug.h>
+#include <maya/MSelectionList.h>
+#include <maya/MVectorArray.h>
+
+#include <algorithm>
+
+
+constexpr char* FILE_FLAG = "-f";
+constexpr char* FILE_FLAG_LONG = "-file";
+
+
+MStatus VectorDisplacementBakeCommand::doIt(const MArgList& args)
+{
+    MStatus status;
+    MArgDatabase argData(syntax(), args, &status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    // Get cache file path and deformer node
+
+    if (!argData.isFlagSet(FILE_FLAG))
+    {
+        displayError("Please specify the cache file path with the -file flag.");
+        return MS::kInvalidParameter;
+    }
+
+    MString path;
+    argData.getFlagArgument(FILE_FLAG, 0, path);
+
+    MSelectionList selection;
+    argData.getObjects(selection);
+
+    MObject node;
+    if (selection.length() != 1 || selection.getDependNode(0, node) != MS::kSuccess ||
+        MFnDependencyNode(node).typeId() != VectorDisplacementDeformerNode::Id)
+    {
+        displayError("Please specify a single vector displacement deformer node.");
+        return MS::kInvalidParameter;
+    }
+
+    // Bake every connected geometry
+
+    MPlug inputPlug(node, MPxDeformerNode::input);
+
+    MIntArray geomIndices;
+    inputPlug.getExistingArrayAttributeIndices(geomIndices);
+
+    std::vector<BakedGeometryData> geometries;
+    geometries.reserve(geomIndices.length());
+
+    for (unsigned int i = 0; i < geomIndices.length(); i++)
+    {
+        BakedGeometryData geometry;
+
+        MStatus bakeStatus = bakeGeometry(node, geomIndices[i], geometry);
+        if (bakeStatus != MS::kSuccess)
+        {
+            displayError("Could not bake geometry " + MString() + geomIndices[i] + " of " + MFnDependencyNode(node).name() + ".");
+            return bakeStatus;
+        }
+
+        geometries.push_back(std::move(geometry));
+    }
+
+    status = VectorDisplacementCacheFile::write(path, geometries);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    // Evaluate again in case the node already reads this path, so it maps the new file
+    MGlobal::executeCommand("dgdirty " + MPlug(node, VectorDisplacementDeformerNode::bakedCacheFileAttribute).name());
+
+    setResult(path);
+    return MS::kSuccess;
+}
+
+void* VectorDisplacementBakeCommand::creator()
+{
+    return new VectorDisplacementBakeCommand;
+}
+
+MSyntax VectorDisplacementBakeCommand::newSyntax()
+{
+    MSyntax syntax;
+    syntax.addFlag(FILE_FLAG, FILE_FLAG_LONG, MSyntax::kString);
+    syntax.setObjectType(MSyntax::kSelectionList, 1, 1);
+    syntax.useSelectionAsDefault(true);
+
+    return syntax;
+}
+
+MStatus VectorDisplacementBakeCommand::bakeGeometry(const MObject& node, unsigned int geomIndex, BakedGeometryData& geometry) const
+{
+    // Get input mesh and node values (same ones used by the deformer when evaluating)
+
+    MPlug inputGeomPlug = MPlug(node, MPxDeformerNode::input).elementByLogicalIndex(geomIndex).child(MPxDeformerNode::inputGeom);
+    MObject mesh = inputGeomPlug.asMObject();
+
+    MString uvSetName = MPlug(node, VectorDisplacementDeformerNode::uvSetAttribute).asString();
+    EvaluationScratch scratch;
+
+    MStatus fingerprintStatus = VectorDisplacementUtilities::getMeshFingerprint(mesh, uvSetName, geometry.fingerprint, scratch);
+    CHECK_MSTATUS_AND_RETURN_IT(fingerprintStatus);
+
+    geometry.geometryIndex = geomIndex;
+
+    float strengthVal = MPlug(node, VectorDisplacementDeformerNode::strengthAttribute).asFloat();
+    VectorDisplacementMapType mapType = static_cast<VectorDisplacementMapType>(
+        MPlug(node, VectorDisplacementDeformerNode::displacementMapTypeAttribute).asInt());
+
+    // Get texture, vertex and weight data
+
+    MVectorArray mapColor;
+    MDoubleArray mapAlpha;
+    MapSamplingMode samplingMode = static_cast<MapSamplingMode>(MPlug(node, VectorDisplacementDeformerNode::mapSamplingAttribute).asInt());
+    SeamSamplingMode seamSampling = VectorDisplacementDeformerNode::getSeamSampling(
+        static_cast<SeamSamplingMode>(MPlug(node, VectorDisplacementDeformerNode::seamSamplingAttribute).asInt()), mapType);
+    unsigned int filterResolution = static_cast<unsigned int>(std::max(MPlug(node, VectorDisplacementDeformerNode::filterResolutionAttribute).asInt(), 1));
+
+    std::vector<float> vertexUvs;
+    UvSamplingOrder samplingOrder;
+
+    if (seamSampling == SeamSamplingMode::FIRST_ISLAND)
+    {
+        MStatus uvDataFetchStatus = VectorDisplacementUtilities::getMeshUvData(mesh, uvSetName, vertexUvs, scratch);
+        CHECK_MSTATUS_AND_RETURN_IT(uvDataFetchStatus);
+
+        VectorDisplacementUtilities::getUvSamplingOrder(vertexUvs, samplingOrder);
+    }
+
+    if (seamSampling == SeamSamplingMode::AVERAGE)
+    {
+        SeamUvSamples seamSamples;
+        SummedAreaTable mapTable;
+
+        MStatus seamSamplingStatus = VectorDisplacementUtilities::getSeamTextureData(node, VectorDisplacementDeformerNode::DISPLACEMENT_MAP_ATTRIBUTE, mesh, uvSetName,
+            samplingMode == MapSamplingMode::AREA ? filterResolution : 0, seamSamples, mapTable, mapColor, mapAlpha, scratch);
+        CHECK_MSTATUS_AND_RETURN_IT(seamSamplingStatus);
+    }
+    else if (samplingMode == MapSamplingMode::AREA)
+    {
+        SummedAreaTable mapTable;
+        std::vector<float> uvFootprints;
+
+        MStatus areaSamplingStatus = VectorDisplacementUtilities::prepareAreaSampling(node, VectorDisplacementDeformerNode::DISPLACEMENT_MAP_ATTRIBUTE, mesh, uvSetName,
+            filterResolution, vertexUvs, samplingOrder, mapTable, uvFootprints, scratch);
+        CHECK_MSTATUS_AND_RETURN_IT(areaSamplingStatus);
+
+        VectorDisplacementUtilities::getFilteredTextureData(mapTable, samplingOrder, uvFootprints, mapColor, mapAlpha);
+    }
+    else
+    {
+        MStatus textureDataFetchStatus = VectorDisplacementUtilities::getTextureData(node, vertexUvs, VectorDisplacementDeformerNode::DISPLACEMENT_MAP_ATTRIBUTE, mapColor, mapAlpha,
+            scratch, nullptr, &samplingOrder);
+        CHECK_MSTATUS_AND_RETURN_IT(textureDataFetchStatus);
+    }
+
+    MFloatVectorArray normals;
+    MFloatVectorArray tangents;
+    MFloatVectorArray binormals;
+
+    if (mapType == VectorDisplacementMapType::TANGENT_SPACE)
+    {
+        MStatus vertexDataFetchStatus = VectorDisplacementUtilities::getMeshVertexData(mesh, normals, tangents, binormals, scratch);
+        CHECK_MSTATUS_AND_RETURN_IT(vertexDataFetchStatus);
+    }
+
+    unsigned int vertexCount = geometry.fingerprint.vertexCount;
+
+    MFloatArray paintWeights;
+    getPaintWeights(node, geomIndex, vertexCount, paintWeights);
+
+    // Calculate final offsets, relaxed the same way as when evaluating. Envelope is not baked so it can still be animated when evaluating from the cache.
+
+    VectorDisplacementUtilities::getDisplacementOffsets(mapColor, normals, tangents, binormals, mapType, geometry.offsets);
+
+    int relaxIterations = std::max(MPlug(node, VectorDisplacementDeformerNode::relaxIterationsAttribute).asInt(), 0);
+    float relaxStrength = std::min(std::max(MPlug(node, VectorDisplacementDeformerNode::relaxStrengthAttribute).asFloat(), 0.f), 1.f);
+
+    if (relaxIterations > 0 && relaxStrength > 0.f)
+    {
+        VertexAdjacency adjacency;
+        MStatus adjacencyStatus = VectorDisplacementUtilities::getVertexAdjacency(mesh, adjacency, scratch);
+        CHECK_MSTATUS_AND_RETURN_IT(adjacencyStatus);
+
+        VectorDisplacementRelax::relaxOffsets(adjacency, static_cast<unsigned int>(relaxIterations), relaxStrength, geometry.offsets, scratch.relaxOffsets);
+    }
+
+    for (unsigned int i = 0; i < vertexCount; i++)
+    {
+        float weight = paintWeights[i] * strengthVal;
+
+        geometry.offsets[i * 3] *= weight;
+        geometry.offsets[i * 3 + 1] *= weight;
+        geometry.offsets[i * 3 + 2] *= weight;
+    }
+
+    return MS::kSuccess;
+}
+
+void VectorDisplacementBakeCommand::getPaintWeights(const MObject& node, unsigned int geomIndex, unsigned int numOfElements, MFloatArray& paintWeights) const
+{
+    paintWeights = MFloatArray(numOfElements, 1.f);
+
+    MPlug weightsPlug = MPlug(node, MPxDeformerNode::weightList).elementByLogicalIndex(geomIndex).child(MPxDeformerNode::weights);
+
+    MIntArray weightIndices;
+    weightsPlug.getExistingArrayAttributeIndices(weightIndices);
+
+    for (unsigned int i = 0; i < weightIndices.length(); i++)
+    {
+        unsigned int index = weightIndices[i];
+        if (index < numOfElements)
+        {
+            paintWeights[index] = weightsPlug.elementByLogicalIndex(index).asFloat();
+        }
+    }
+}
\ No newline at end of file
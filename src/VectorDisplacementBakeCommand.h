@@ -0,0 +1,70 @@
+/* Copyright (C) 2020 - Jose Ivan Lopez Romo - All rights reserved
+ *
+ * This file is part of the MayaVectorDisplacementDeformer project found in the
+ * following repository: https://github.com/Zhibade/maya-vector-displacement-deformer
+ *
+ * Released under MIT license. Please see LICENSE file for details.
+ */
+
+#pragma once
+
+#include "VectorDisplacementCacheFile.h"
+
+#include <maya/MArgList.h>
+#include <maya/MFloatArray.h>
+#include <maya/MPxCommand.h>
+#include <maya/MSyntax.h>
+
+
+/*
+ * Command that bakes the final per-vertex offsets of a vector displacement deformer to a cache file.
+ * Usage: vectorDisplacementBake -file "path/to/cache.vdc" vectorDisplacement1;
+ */
+class VectorDisplacementBakeCommand : public MPxCommand
+{
+public:
+    VectorDisplacementBakeCommand() {};
+    ~VectorDisplacementBakeCommand() override {};
+
+    /**
+    * Bakes every input geometry of the given deformer node and writes the cache file
+    *
+    * @param[in] args - Command arguments
+    *
+    * @return MStatus indicating if operation was successful or not
+    */
+    MStatus doIt(const MArgList& args) override;
+
+    /** Baking does not change the scene, so there is nothing to undo */
+    bool isUndoable() const override { return false; }
+
+    /** Creator function that returns a new instance of this command */
+    static void* creator();
+
+    /** Returns the syntax of this command */
+    static MSyntax newSyntax();
+
+    static constexpr char* COMMAND_NAME = "vectorDisplacementBake";
+
+private:
+    /**
+    * Calculates the final displacement offsets of one geometry of the deformer node
+    *
+    * @param[in] node - Deformer node
+    * @param[in] geomIndex - Index of the geometry to bake
+    * @param[out] geometry - Baked offsets and fingerprints
+    *
+    * @return MStatus indicating if operation was successful or not
+    */
+    MStatus bakeGeometry(const MObject& node, unsigned int geomIndex, BakedGeometryData& geometry) const;
+
+    /**
+    * Gets the paint weights of one geometry of the deformer node through its plugs
+    *
+    * @param[in] node - Deformer node
+    * @param[in] geomIndex - Index of the geometry
+    * @param[in] numOfElements - Total number of vertices
+    * @param[out] paintWeights - Paint weights will be stored here (1 for vertices that were not painted)
+    */
+    void getPaintWeights(const MObject& node, unsigned int geomIndex, unsigned int numOfElements, MFloatArray& paintWeights) const;
+};
\ No newline at end of file
@@ -0,0 +1,264 @@
+/* Copyright (C) 2020 - Jose Ivan Lopez Romo - All rights reserved
+ *
+ * This file is part of the MayaVectorDisplacementDeformer project found in the
+ * following repository: https://github.com/Zhibade/maya-vector-displacement-deformer
+ *
+ * Released under MIT license. Please see LICENSE file for details.
+ */
+
+#include "VectorDisplacementCacheFile.h"
+
+#include <maya/MGlobal.h>
+
+#include <sys/stat.h>
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+
+constexpr char* TEMPORARY_FILE_EXTENSION = ".tmp";
+
+
+std::mutex VectorDisplacementCacheFile::cacheFilesMutex;
+std::set<VectorDisplacementCacheFile*> VectorDisplacementCacheFile::cacheFiles;
+
+
+VectorDisplacementCacheFile::VectorDisplacementCacheFile()
+{
+    std::lock_guard<std::mutex> lock(cacheFilesMutex);
+    cacheFiles.insert(this);
+}
+
+VectorDisplacementCacheFile::~VectorDisplacementCacheFile()
+{
+    std::lock_guard<std::mutex> lock(cacheFilesMutex);
+    cacheFiles.erase(this);
+}
+
+MStatus VectorDisplacementCacheFile::write(const MString& path, const std::vector<BakedGeometryData>& geometries)
+{
+    // Layout: header, geometry entries, then the aligned offset arrays of each geometry
+
+    FileHeader header;
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.geometryCount = static_cast<uint32_t>(geometries.size());
+    header.reserved = 0;
+
+    std::vector<GeometryEntry> entries(geometries.size());
+    uint64_t dataOffset = sizeof(FileHeader) + sizeof(GeometryEntry) * entries.size();
+
+    for (size_t i = 0; i < geometries.size(); i++)
+    {
+        const BakedGeometryData& geometry = geometries[i];
+
+        if (geometry.offsets.size() != static_cast<size_t>(geometry.fingerprint.vertexCount) * 3)
+        {
+            logError("Baked offsets do not match the vertex count of geometry " + MString() + geometry.geometryIndex + ". Cache file was not written.");
+            return MS::kInvalidParameter;
+        }
+
+        dataOffset = (dataOffset + DATA_ALIGNMENT - 1) / DATA_ALIGNMENT * DATA_ALIGNMENT;
+
+        entries[i].geometryIndex = geometry.geometryIndex;
+        entries[i].vertexCount = geometry.fingerprint.vertexCount;
+        entries[i].topologyFingerprint = geometry.fingerprint.topology;
+        entries[i].uvFingerprint = geometry.fingerprint.uvs;
+        entries[i].dataOffset = dataOffset;
+
+        dataOffset += geometry.offsets.size() * sizeof(float);
+    }
+
+    // Nodes can have the previous file mapped, so it's never truncated in place (reading a truncated mapping crashes)
+
+    MString temporaryPath = path + TEMPORARY_FILE_EXTENSION;
+    std::ofstream stream(temporaryPath.asChar(), std::ios::binary | std::ios::trunc);
+    if (!stream)
+    {
+        logError("Could not open cache file for writing: " + temporaryPath);
+        return MS::kFailure;
+    }
+
+    stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    stream.write(reinterpret_cast<const char*>(entries.data()), sizeof(GeometryEntry) * entries.size());
+
+    const char padding[DATA_ALIGNMENT] = {};
+
+    for (size_t i = 0; i < geometries.size(); i++)
+    {
+        uint64_t position = static_cast<uint64_t>(stream.tellp());
+        stream.write(padding, entries[i].dataOffset - position);
+        stream.write(reinterpret_cast<const char*>(geometries[i].offsets.data()), geometries[i].offsets.size() * sizeof(float));
+    }
+
+    stream.close();
+
+    if (!stream)
+    {
+        logError("An error occurred while writing cache file: " + temporaryPath);
+        std::remove(temporaryPath.asChar());
+        return MS::kFailure;
+    }
+
+    // Mapped files can't be replaced on Windows, so the caches that map the previous file are closed. They map the new file on their next use.
+    // Caches that are being read by an evaluation are closed once it's done with the offsets.
+
+    {
+        std::lock_guard<std::mutex> lock(cacheFilesMutex);
+
+        for (VectorDisplacementCacheFile* cacheFile : cacheFiles)
+        {
+            std::lock_guard<std::mutex> mappingLock(cacheFile->mappingMutex);
+
+            if (cacheFile->file.isOpen() && cacheFile->requestedPath == path)
+            {
+                cacheFile->close();
+            }
+        }
+    }
+
+    // Renaming doesn't replace existing files on Windows
+
+    if (std::rename(temporaryPath.asChar(), path.asChar()) != 0 &&
+        (std::remove(path.asChar()) != 0 || std::rename(temporaryPath.asChar(), path.asChar()) != 0))
+    {
+        logError("Could not replace cache file: " + path);
+        std::remove(temporaryPath.asChar());
+        return MS::kFailure;
+    }
+
+    return MS::kSuccess;
+}
+
+MStatus VectorDisplacementCacheFile::open(const MString& path)
+{
+    if (path.length() == 0)
+    {
+        close();
+        return MS::kFailure;
+    }
+
+    // Files can be written again by other tools or sessions, so the file is mapped again when it changes (or appears after failing to open)
+
+    FileState state = getFileState(path);
+
+    if (path == requestedPath && state == requestedState)
+    {
+        return isOpen() ? MS::kSuccess : MS::kFailure;
+    }
+
+    close();
+    requestedPath = path;
+    requestedState = state;
+
+    MStatus openStatus = file.open(path);
+    if (openStatus != MS::kSuccess)
+    {
+        logError("Could not map cache file: " + path);
+        return openStatus;
+    }
+
+    // Validate header and entries before handing out any pointers into the file
+
+    const FileHeader* header = static_cast<const FileHeader*>(file.data());
+    bool isValid = file.size() >= sizeof(FileHeader) &&
+        std::memcmp(header->magic, MAGIC, sizeof(MAGIC)) == 0 &&
+        header->version == VERSION &&
+        file.size() >= sizeof(FileHeader) + sizeof(GeometryEntry) * static_cast<uint64_t>(header->geometryCount);
+
+    const GeometryEntry* entries = reinterpret_cast<const GeometryEntry*>(header + 1);
+
+    for (uint32_t i = 0; isValid && i < header->geometryCount; i++)
+    {
+        uint64_t dataSize = static_cast<uint64_t>(entries[i].vertexCount) * 3 * sizeof(float);
+        isValid = entries[i].dataOffset % sizeof(float) == 0 && entries[i].dataOffset + dataSize <= file.size();
+    }
+
+    if (!isValid)
+    {
+        logError("Invalid or corrupted cache file: " + path);
+        file.close();
+        return MS::kFailure;
+    }
+
+    mappingVersion++;
+    return MS::kSuccess;
+}
+
+void VectorDisplacementCacheFile::close()
+{
+    file.close();
+    requestedPath = MString();
+    requestedState = FileState();
+    reportedMismatches.clear();
+}
+
+const float* VectorDisplacementCacheFile::getOffsets(unsigned int geometryIndex, const MeshFingerprint& fingerprint)
+{
+    if (!isOpen())
+    {
+        return nullptr;
+    }
+
+    const GeometryEntry* entry = findGeometry(geometryIndex);
+    if (!entry)
+    {
+        return nullptr;
+    }
+
+    bool matches = fingerprint.vertexCount == entry->vertexCount &&
+        fingerprint.topology == entry->topologyFingerprint &&
+        fingerprint.uvs == entry->uvFingerprint;
+
+    if (!matches)
+    {
+        auto reported = reportedMismatches.find(geometryIndex);
+        if (reported == reportedMismatches.end() || reported->second != fingerprint)
+        {
+            logError("Topology or UVs of geometry " + MString() + geometryIndex + " changed since the cache was baked. Using live displacement instead.");
+            reportedMismatches[geometryIndex] = fingerprint;
+        }
+
+        return nullptr;
+    }
+
+    const char* fileData = static_cast<const char*>(file.data());
+    return reinterpret_cast<const float*>(fileData + entry->dataOffset);
+}
+
+const VectorDisplacementCacheFile::GeometryEntry* VectorDisplacementCacheFile::findGeometry(unsigned int geometryIndex) const
+{
+    const FileHeader* header = static_cast<const FileHeader*>(file.data());
+    const GeometryEntry* entries = reinterpret_cast<const GeometryEntry*>(header + 1);
+
+    for (uint32_t i = 0; i < header->geometryCount; i++)
+    {
+        if (entries[i].geometryIndex == geometryIndex)
+        {
+            return &entries[i];
+        }
+    }
+
+    return nullptr;
+}
+
+VectorDisplacementCacheFile::FileState VectorDisplacementCacheFile::getFileState(const MString& path)
+{
+    FileState state;
+    struct stat fileStatus;
+
+    if (stat(path.asChar(), &fileStatus) == 0)
+    {
+        state.size = static_cast<uint64_t>(fileStatus.st_size);
+        state.modificationTime = static_cast<int64_t>(fileStatus.st_mtime);
+    }
+
+    return state;
+}
+
+void VectorDisplacementCacheFile::logError(const MString& message)
+{
+    MString errorHeader = "Vector Displacement Cache: ";
+    MGlobal::displayError(errorHeader + message);
+}
\ No newline at end of file
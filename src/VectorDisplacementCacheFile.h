@@ -0,0 +1,151 @@
+/* Copyright (C) 2020 - Jose Ivan Lopez Romo - All rights reserved
+ *
+ * This file is part of the MayaVectorDisplacementDeformer project found in the
+ * following repository: https://github.com/Zhibade/maya-vector-displacement-deformer
+ *
+ * Released under MIT license. Please see LICENSE file for details.
+ */
+
+#pragma once
+
+#include "MemoryMappedFile.h"
+#include "VectorDisplacementHelperTypes.h"
+
+#include <maya/MStatus.h>
+#include <maya/MString.h>
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <set>
+#include <vector>
+
+
+/* Baked displacement of a single deformed geometry, as written to a cache file */
+struct BakedGeometryData
+{
+    unsigned int geometryIndex = 0;
+    MeshFingerprint fingerprint;
+    std::vector<float> offsets; // 3 floats (XYZ) per vertex. Already multiplied by strength and paint weights.
+};
+
+
+/*
+ * Binary file with the final per-vertex displacement offsets of a deformer node.
+ * Files are memory-mapped when read, so evaluating from a cache only pages in the offsets that are used.
+ */
+class VectorDisplacementCacheFile final
+{
+public:
+    VectorDisplacementCacheFile();
+    ~VectorDisplacementCacheFile();
+
+    /**
+    * Writes the given baked geometries to a cache file. The file is written under a temporary name and then renamed, and every cache
+    * that has the previous file mapped is closed first, so it's mapped again on its next use. Caches that are in use (see lockMapping)
+    * are closed once their owner is done with them, so nodes can keep evaluating in the background (e.g. for cached playback).
+    *
+    * @param[in] path - Path of the file to write. Existing files are overwritten.
+    * @param[in] geometries - Baked data of each geometry
+    *
+    * @return MStatus indicating whether the operation was successful or not
+    */
+    static MStatus write(const MString& path, const std::vector<BakedGeometryData>& geometries);
+
+    /**
+    * Maps the given cache file. Does nothing if the same path was already opened and the file size and modification time didn't change
+    * (even if opening it failed, so errors are only logged once per version of the file).
+    *
+    * @param[in] path - Path of the cache file
+    *
+    * @return MStatus indicating whether the file is mapped and valid
+    */
+    MStatus open(const MString& path);
+
+    /* Unmaps the current cache file */
+    void close();
+
+    /**
+    * Locks the mapping, so write() can't close it from another thread. Needs to be held from open() until the offsets returned by getOffsets()
+    * are no longer read, and while calling close().
+    *
+    * @return Lock of the mapping
+    */
+    std::unique_lock<std::mutex> lockMapping() { return std::unique_lock<std::mutex>(mappingMutex); }
+
+    /** Returns true if a valid cache file is currently mapped */
+    bool isOpen() const { return file.isOpen(); }
+
+    /** Returns a number that changes every time a file is mapped, so copies of the offsets (e.g. in GPU buffers) know when to be updated */
+    uint64_t getMappingVersion() const { return mappingVersion; }
+
+    /**
+    * Gets the baked offsets of the given geometry. The mesh fingerprints are validated against the baked topology and UV fingerprints.
+    *
+    * @param[in] geometryIndex - Index of the deformed geometry
+    * @param[in] fingerprint - Current fingerprints of the input mesh of that geometry
+    *
+    * @return Pointer to 3 floats per vertex, or null if the geometry is not in the cache or does not match the mesh
+    */
+    const float* getOffsets(unsigned int geometryIndex, const MeshFingerprint& fingerprint);
+
+private:
+    struct FileHeader
+    {
+        char magic[4];
+        uint32_t version;
+        uint32_t geometryCount;
+        uint32_t reserved;
+    };
+
+    // Size and modification time of a file, used to detect when it's written again
+    struct FileState
+    {
+        uint64_t size = 0;
+        int64_t modificationTime = 0;
+
+        bool operator==(const FileState& other) const { return size == other.size && modificationTime == other.modificationTime; }
+    };
+
+    struct GeometryEntry
+    {
+        uint32_t geometryIndex;
+        uint32_t vertexCount;
+        uint64_t topologyFingerprint;
+        uint64_t uvFingerprint;
+        uint64_t dataOffset; // Offset in bytes from the beginning of the file
+    };
+
+    /**
+    * Finds the entry that matches the given geometry index
+    *
+    * @param[in] geometryIndex - Index of the deformed geometry
+    *
+    * @return Matching entry or null if it is not in the file
+    */
+    const GeometryEntry* findGeometry(unsigned int geometryIndex) const;
+
+    /** Returns the size and modification time of the given file. Both are 0 if the file doesn't exist. */
+    static FileState getFileState(const MString& path);
+
+    /**
+    * Logs an error using a predefined format using the given message
+    *
+    * @param[in] message - Error message to log
+    */
+    static void logError(const MString& message);
+
+    static constexpr char MAGIC[4] = { 'V', 'D', 'B', 'C' };
+    static constexpr uint32_t VERSION = 1;
+    static constexpr uint64_t DATA_ALIGNMENT = 64;
+
+    std::mutex mappingMutex; // Guards the members below between the owning node and write()
+    MemoryMappedFile file;
+    MString requestedPath;
+    FileState requestedState; // State of the file when it was last opened
+    uint64_t mappingVersion = 0;
+    std::map<unsigned int, MeshFingerprint> reportedMismatches; // Last mismatching fingerprints reported per geometry, so errors are only logged once
+
+    static std::mutex cacheFilesMutex;
+    static std::set<VectorDisplacementCacheFile*> cacheFiles; // Every cache of every node, so the ones that map a file can be closed before it's replaced
+};
\ No newline at end of file
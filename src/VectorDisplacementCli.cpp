@@ -0,0 +1,444 @@
+/* Copyright (C) 2020 - Jose Ivan Lopez Romo - All rights reserved
+ *
+ * This file is part of the MayaVectorDisplacementDeformer project found in the
+ * following repository: https://github.com/Zhibade/maya-vector-displacement-deformer
+ *
+ * Released under MIT license. Please see LICENSE file for details.
+ */
+
+#include "HeadlessDisplacementMap.h"
+#include "HeadlessDisplacer.h"
+#include "HeadlessMeshFile.h"
+#include "WorkerThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+namespace
+{
+    /* Single displacement job (one input mesh, one map, one output mesh) */
+    struct DisplacementJob
+    {
+        std::string inputPath;
+        std::string mapPath;
+        std::string outputPath;
+        HeadlessMapType mapType = HeadlessMapType::TANGENT_SPACE;
+        float strength = 1.f;
+    };
+
+    /* Loaded map, or the reason why it could not be loaded */
+    struct LoadedMap
+    {
+        std::shared_ptr<const HeadlessDisplacementMap> map;
+        std::string error;
+    };
+
+    /*
+     * Maps shared by every job of a manifest. Each map is loaded once, by the first job that needs it,
+     * and dropped once every job that uses it has finished.
+     */
+    class DisplacementMapCache final
+    {
+    public:
+        /**
+        * Counts the jobs that use each map
+        *
+        * @param[in] jobs - Every job that will get its map from this cache
+        */
+        explicit DisplacementMapCache(const std::vector<DisplacementJob>& jobs)
+        {
+            for (const DisplacementJob& job : jobs)
+            {
+                pendingJobs[job.mapPath]++;
+            }
+        }
+
+        /**
+        * Gets the given map, loading it if no other job did yet. Waits if another job is currently loading it.
+        *
+        * @param[in] path - Path of the map
+        * @param[out] wasLoaded - Whether this call loaded the map
+        *
+        * @return Loaded map
+        */
+        LoadedMap get(const std::string& path, bool& wasLoaded)
+        {
+            std::promise<LoadedMap> loadPromise;
+            std::shared_future<LoadedMap> loadedMap;
+            wasLoaded = false;
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+
+                auto it = maps.find(path);
+                if (it != maps.end())
+                {
+                    loadedMap = it->second;
+                }
+                else
+                {
+                    loadedMap = loadPromise.get_future().share();
+                    maps[path] = loadedMap;
+                    wasLoaded = true;
+                }
+            }
+
+            if (wasLoaded)
+            {
+                LoadedMap result;
+                std::shared_ptr<HeadlessDisplacementMap> map = std::make_shared<HeadlessDisplacementMap>();
+
+                if (map->load(path, result.error))
+                {
+                    result.map = map;
+                }
+
+                loadPromise.set_value(result);
+            }
+
+            return loadedMap.get();
+        }
+
+        /**
+        * Marks a job that uses the given map as finished. The map is dropped from the cache after the last one.
+        * Jobs that still hold the map keep it alive until they are done with it.
+        *
+        * @param[in] path - Path of the map
+        */
+        void release(const std::string& path)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+
+            auto it = pendingJobs.find(path);
+            if (it == pendingJobs.end() || --it->second > 0)
+            {
+                return;
+            }
+
+            pendingJobs.erase(it);
+            maps.erase(path);
+        }
+
+    private:
+        std::mutex mutex;
+        std::map<std::string, std::shared_future<LoadedMap>> maps;
+        std::map<std::string, size_t> pendingJobs; // Jobs that have not finished yet, per map
+    };
+
+    /* Time spent in each step of a job */
+    struct JobTiming
+    {
+        double loadMeshMs = 0.0;
+        double loadMapMs = 0.0;
+        double displaceMs = 0.0;
+        double writeMs = 0.0;
+    };
+
+    double getElapsedMs(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    bool parseMapType(const std::string& text, HeadlessMapType& mapType)
+    {
+        if (text == "object")
+        {
+            mapType = HeadlessMapType::OBJECT_SPACE;
+            return true;
+        }
+        else if (text == "tangent")
+        {
+            mapType = HeadlessMapType::TANGENT_SPACE;
+            return true;
+        }
+
+        return false;
+    }
+
+    /**
+    * Runs a single job: loads the mesh and map, displaces the mesh and writes it
+    *
+    * @param[in] job - Job to run
+    * @param[in] mapCache - Cache to get the map from
+    * @param[in] threadCount - Number of threads used to displace the mesh
+    * @param[out] timing - Time spent in each step
+    * @param[out] error - Reason of the failure, if any
+    *
+    * @return True if the job was successful
+    */
+    bool runJob(const DisplacementJob& job, DisplacementMapCache& mapCache, unsigned int threadCount, JobTiming& timing, std::string& error)
+    {
+        auto start = std::chrono::steady_clock::now();
+
+        HeadlessMesh mesh;
+        if (!HeadlessMeshFile::read(job.inputPath, mesh, error))
+        {
+            return false;
+        }
+
+        timing.loadMeshMs = getElapsedMs(start);
+        start = std::chrono::steady_clock::now();
+
+        bool wasMapLoaded = false;
+        LoadedMap loadedMap = mapCache.get(job.mapPath, wasMapLoaded);
+
+        if (!loadedMap.map)
+        {
+            error = loadedMap.error;
+            return false;
+        }
+
+        timing.loadMapMs = wasMapLoaded ? getElapsedMs(start) : 0.0; // Waiting for a map loaded by another job is not counted
+        start = std::chrono::steady_clock::now();
+
+        HeadlessDisplacer::displace(mesh, *loadedMap.map, job.mapType, job.strength, threadCount);
+
+        timing.displaceMs = getElapsedMs(start);
+        start = std::chrono::steady_clock::now();
+
+        if (!HeadlessMeshFile::write(job.outputPath, mesh, error))
+        {
+            return false;
+        }
+
+        timing.writeMs = getElapsedMs(start);
+        return true;
+    }
+
+    /**
+    * Reads a manifest file. Each non-empty line that does not start with # is a job: input map output [object|tangent] [strength]
+    *
+    * @param[in] path - Path of the manifest
+    * @param[in] defaultJob - Map type and strength used when a line does not set them
+    * @param[out] jobs - Jobs of the manifest
+    * @param[out] error - Reason of the failure, if any
+    *
+    * @return True if the manifest was read successfully
+    */
+    bool readManifest(const std::string& path, const DisplacementJob& defaultJob, std::vector<DisplacementJob>& jobs, std::string& error)
+    {
+        std::ifstream stream(path);
+        if (!stream)
+        {
+            error = "Could not open manifest: " + path;
+            return false;
+        }
+
+        std::string line;
+        unsigned int lineNumber = 0;
+
+        while (std::getline(stream, line))
+        {
+            lineNumber++;
+
+            std::istringstream lineStream(line);
+            DisplacementJob job = defaultJob;
+
+            if (!(lineStream >> job.inputPath) || job.inputPath[0] == '#')
+            {
+                continue;
+            }
+
+            std::string mapType;
+            std::string strength;
+
+            if (!(lineStream >> job.mapPath >> job.outputPath) || ((lineStream >> mapType) && !parseMapType(mapType, job.mapType)))
+            {
+                error = "Invalid job in line " + std::to_string(lineNumber) + " of manifest " + path;
+                return false;
+            }
+
+            if (lineStream >> strength)
+            {
+                job.strength = std::strtof(strength.c_str(), nullptr);
+            }
+
+            jobs.push_back(job);
+        }
+
+        return true;
+    }
+
+    void printUsage()
+    {
+        std::printf(
+            "Usage:\n"
+            "  vectorDisplace <input mesh> <map> <output mesh> [options]\n"
+            "  vectorDisplace --manifest <file> [options]\n"
+            "\n"
+            "Meshes can be .obj or .ply files. Maps are color .pfm files.\n"
+            "Manifest lines: <input mesh> <map> <output mesh> [object|tangent] [strength]\n"
+            "\n"
+            "Options:\n"
+            "  --space object|tangent  Displacement map type (default: tangent)\n"
+            "  --strength <value>      Displacement strength (default: 1)\n"
+            "  --threads <count>       Total worker threads (default: hardware concurrency)\n"
+            "  --jobs <count>          Jobs of a manifest processed at the same time (default: automatic)\n");
+    }
+}
+
+
+int main(int argc, char* argv[])
+{
+    DisplacementJob defaultJob;
+    std::string manifestPath;
+    std::vector<std::string> positionalArguments;
+    unsigned int threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+    unsigned int concurrentJobs = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string argument = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if (argument == "--help" || argument == "-h")
+        {
+            printUsage();
+            return 0;
+        }
+        else if (argument == "--manifest" && hasValue)
+        {
+            manifestPath = argv[++i];
+        }
+        else if (argument == "--space" && hasValue)
+        {
+            if (!parseMapType(argv[++i], defaultJob.mapType))
+            {
+                std::fprintf(stderr, "Invalid map type: %s (use object or tangent)\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (argument == "--strength" && hasValue)
+        {
+            defaultJob.strength = std::strtof(argv[++i], nullptr);
+        }
+        else if (argument == "--threads" && hasValue)
+        {
+            threadCount = std::max(static_cast<unsigned int>(std::strtoul(argv[++i], nullptr, 10)), 1u);
+        }
+        else if (argument == "--jobs" && hasValue)
+        {
+            concurrentJobs = static_cast<unsigned int>(std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (argument.compare(0, 2, "--") == 0)
+        {
+            std::fprintf(stderr, "Unknown option or missing value: %s\n", argument.c_str());
+            printUsage();
+            return 1;
+        }
+        else
+        {
+            positionalArguments.push_back(argument);
+        }
+    }
+
+    // Jobs
+
+    std::vector<DisplacementJob> jobs;
+    std::string error;
+
+    if (!manifestPath.empty())
+    {
+        if (!readManifest(manifestPath, defaultJob, jobs, error))
+        {
+            std::fprintf(stderr, "%s\n", error.c_str());
+            return 1;
+        }
+    }
+    else if (positionalArguments.size() == 3)
+    {
+        DisplacementJob job = defaultJob;
+        job.inputPath = positionalArguments[0];
+        job.mapPath = positionalArguments[1];
+        job.outputPath = positionalArguments[2];
+
+        jobs.push_back(job);
+    }
+    else
+    {
+        printUsage();
+        return 1;
+    }
+
+    if (jobs.empty())
+    {
+        std::printf("No jobs to process\n");
+        return 0;
+    }
+
+    // Jobs run concurrently and split the threads between them. Small meshes scale better across jobs than across threads.
+
+    if (concurrentJobs == 0)
+    {
+        concurrentJobs = threadCount;
+    }
+
+    concurrentJobs = std::min(concurrentJobs, static_cast<unsigned int>(jobs.size()));
+    unsigned int threadsPerJob = std::max(threadCount / concurrentJobs, 1u);
+
+    // Job threads run ranges of their own loops, so the shared workers only make up the rest of the thread count
+    WorkerThreadPool::setThreadCount(std::max(threadCount, concurrentJobs) - concurrentJobs + 1);
+
+    DisplacementMapCache mapCache(jobs);
+    std::atomic<size_t> nextJob(0);
+    std::atomic<unsigned int> failedJobs(0);
+    std::mutex printMutex;
+
+    auto start = std::chrono::steady_clock::now();
+
+    auto worker = [&]()
+    {
+        for (size_t jobIndex = nextJob++; jobIndex < jobs.size(); jobIndex = nextJob++)
+        {
+            const DisplacementJob& job = jobs[jobIndex];
+            JobTiming timing;
+            std::string jobError;
+
+            bool isSuccessful = runJob(job, mapCache, threadsPerJob, timing, jobError);
+            mapCache.release(job.mapPath);
+
+            std::lock_guard<std::mutex> lock(printMutex);
+
+            if (isSuccessful)
+            {
+                std::printf("[%zu/%zu] %s: load %.1f ms, map %.1f ms, displace %.1f ms, write %.1f ms\n", jobIndex + 1, jobs.size(), job.outputPath.c_str(),
+                            timing.loadMeshMs, timing.loadMapMs, timing.displaceMs, timing.writeMs);
+            }
+            else
+            {
+                std::fprintf(stderr, "[%zu/%zu] %s: %s\n", jobIndex + 1, jobs.size(), job.inputPath.c_str(), jobError.c_str());
+                failedJobs++;
+            }
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (unsigned int i = 1; i < concurrentJobs; i++)
+    {
+        workers.emplace_back(worker);
+    }
+
+    worker();
+
+    for (std::thread& thread : workers)
+    {
+        thread.join();
+    }
+
+    std::printf("Processed %zu job(s) in %.1f ms (%u failed)\n", jobs.size(), getElapsedMs(start), failedJobs.load());
+
+    return failedJobs == 0 ? 0 : 1;
+}
\ No newline at end of file
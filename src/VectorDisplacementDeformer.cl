@@ -6,6 +6,155 @@
  * Released under MIT license. Please see LICENSE file for details.
  */
 
+/*
+* Paint weight handling is chosen when building the program by defining WEIGHT_MODE (values match the WeightMode enum).
+* NONE applies the map offsets as they are, UNIFORM only scales them by the strength (the uniform weight is folded into it),
+* and PAINTED also reads the paint weight of each vertex. Builds without the definition get the PAINTED variants.
+*/
+#define WEIGHT_MODE_NONE 0
+#define WEIGHT_MODE_UNIFORM 1
+#define WEIGHT_MODE_PAINTED 2
+
+#ifndef WEIGHT_MODE
+#define WEIGHT_MODE WEIGHT_MODE_PAINTED
+#endif
+
+/**
+* Gets the factor the offset of a vertex is scaled by
+*
+* @param[in] index - Vertex index
+* @param[in] paintWeights - Maya paint weights. 1 value per vertex (only read by the PAINTED variants)
+* @param[in] strength - Strength to apply to the displacement
+*
+* @return Strength multiplied by the paint weight
+*/
+inline float getVertexWeight(uint index, __global const float* paintWeights, const float strength)
+{
+#if WEIGHT_MODE == WEIGHT_MODE_NONE
+    return 1.f;
+#elif WEIGHT_MODE == WEIGHT_MODE_UNIFORM
+    return strength;
+#else
+    return strength * paintWeights[index];
+#endif
+}
+
+/**
+* Gets the factors the offsets of 4 consecutive vertices are scaled by
+*
+* @param[in] block - Index of the group of 4 vertices
+* @param[in] paintWeights - Maya paint weights. 1 value per vertex (only read by the PAINTED variants)
+* @param[in] strength - Strength to apply to the displacement
+*
+* @return Strength multiplied by the paint weight of each vertex
+*/
+inline float4 getVertexWeights4(uint block, __global const float* paintWeights, const float strength)
+{
+#if WEIGHT_MODE == WEIGHT_MODE_NONE
+    return (float4)(1.f);
+#elif WEIGHT_MODE == WEIGHT_MODE_UNIFORM
+    return (float4)(strength);
+#else
+    return vload4(block, paintWeights) * strength;
+#endif
+}
+
+/**
+* Displaces a single vertex using object-space vector displacement
+*
+* @param[in] index - Vertex index
+* @param[in] initialPos - Initial vertex positions (read as float3)
+* @param[in] displacementMap - Displacement map texture data (read as float3 - RGB)
+* @param[in] paintWeights - Maya paint weights. 1 value per vertex (only read by the PAINTED variants)
+* @param[in] strength - Strength to apply to the displacement
+* @param[out] finalPos - Output vertex position (stored as float3)
+*/
+inline void displaceObjectSpace(
+    uint index,
+    __global const float* initialPos,
+    __global const float* displacementMap,
+    __global const float* paintWeights,
+    const float strength,
+    __global float* finalPos
+    )
+{
+    float3 initialPosition = vload3(index, initialPos);
+    float3 rgbData = vload3(index, displacementMap);
+
+    float3 finalPosition = initialPosition + (rgbData * getVertexWeight(index, paintWeights, strength));
+    vstore3(finalPosition, index, finalPos);
+}
+
+/**
+* Displaces a single vertex using tangent-space vector displacement
+*
+* @param[in] index - Vertex index
+* @param[in] initialPos - Initial vertex positions (read as float3)
+* @param[in] displacementMap - Displacement map texture data (read as float3 - RGB)
+* @param[in] paintWeights - Maya paint weights. 1 value per vertex (only read by the PAINTED variants)
+* @param[in] strength - Strength to apply to the displacement
+* @param[in] normals - Vertex normal data (read as float3)
+* @param[in] tangents - Vertex tangent data (read as float3)
+* @param[in] binormals - Vertex binormal data (read as float3)
+* @param[out] finalPos - Output vertex position (stored as float3)
+*/
+inline void displaceTangentSpace(
+    uint index,
+    __global const float* initialPos,
+    __global const float* displacementMap,
+    __global const float* paintWeights,
+    const float strength,
+    __global const float* normals,
+    __global const float* tangents,
+    __global const float* binormals,
+    __global float* finalPos
+    )
+{
+    float3 initialPosition = vload3(index, initialPos);
+    float3 rgbData = vload3(index, displacementMap);
+    float3 normal = vload3(index, normals);
+    float3 tangent = vload3(index, tangents);
+    float3 binormal = vload3(index, binormals);
+
+    float3 offset = (tangent * rgbData.x) + (normal * rgbData.y) + (binormal * rgbData.z);
+
+    float3 finalPosition = initialPosition + (offset * getVertexWeight(index, paintWeights, strength));
+    vstore3(finalPosition, index, finalPos);
+}
+
+/**
+* Loads 4 consecutive float3 values using 3 aligned float4 loads
+*
+* @param[in] block - Index of the group of 4 values
+* @param[in] data - Data to read from
+* @param[out] values - Loaded values
+*/
+inline void loadFloat3x4(uint block, __global const float* data, float3 values[4])
+{
+    float4 a = vload4(block * 3, data);
+    float4 b = vload4(block * 3 + 1, data);
+    float4 c = vload4(block * 3 + 2, data);
+
+    values[0] = a.xyz;
+    values[1] = (float3)(a.w, b.xy);
+    values[2] = (float3)(b.zw, c.x);
+    values[3] = c.yzw;
+}
+
+/**
+* Stores 4 consecutive float3 values using 3 aligned float4 stores
+*
+* @param[in] values - Values to store
+* @param[in] block - Index of the group of 4 values
+* @param[out] data - Data to write to
+*/
+inline void storeFloat3x4(const float3 values[4], uint block, __global float* data)
+{
+    vstore4((float4)(values[0], values[1].x), block * 3, data);
+    vstore4((float4)(values[1].yz, values[2].xy), block * 3 + 1, data);
+    vstore4((float4)(values[2].z, values[3]), block * 3 + 2, data);
+}
+
 /**
 * Performs object-space vector displacement calculations
 *
@@ -31,15 +180,7 @@ __kernel void ObjectSpaceDisplacement(
         return;
     }
 
-    float3 initialPosition = vload3(index, initialPos);
-    float3 rgbData = vload3(index, displacementMap);
-
-    float x = initialPosition.x + (rgbData.x * strength * paintWeights[index]);
-    float y = initialPosition.y + (rgbData.y * strength * paintWeights[index]);
-    float z = initialPosition.z + (rgbData.z * strength * paintWeights[index]);
-
-    float3 finalPosition = (float3)(x, y ,z);
-    vstore3(finalPosition, index, finalPos);
+    displaceObjectSpace(index, initialPos, displacementMap, paintWeights, strength, finalPos);
 }
 
 /**
@@ -73,20 +214,428 @@ __kernel void TangentSpaceDisplacement(
         return;
     }
 
-    float3 initialPosition = vload3(index, initialPos);
+    displaceTangentSpace(index, initialPos, displacementMap, paintWeights, strength, normals, tangents, binormals, finalPos);
+}
+
+/*
+* Coarsened variants. Each work item processes VERTS vertices, strided by the global size so that
+* neighbouring work items still access neighbouring vertices. Parameters match the single-vertex kernels.
+*/
+#define DEFINE_OBJECT_SPACE_KERNEL(VERTS) \
+__kernel void ObjectSpaceDisplacement_x##VERTS( \
+    __global const float* initialPos, \
+    __global const float* displacementMap, \
+    __global const float* paintWeights, \
+    const float strength, \
+    const uint count, \
+    __global float* finalPos \
+    ) \
+{ \
+    uint stride = get_global_size(0); \
+    uint index = get_global_id(0); \
+    for (uint i = 0; i < VERTS && index < count; i++, index += stride) \
+    { \
+        displaceObjectSpace(index, initialPos, displacementMap, paintWeights, strength, finalPos); \
+    } \
+}
+
+#define DEFINE_TANGENT_SPACE_KERNEL(VERTS) \
+__kernel void TangentSpaceDisplacement_x##VERTS( \
+    __global const float* initialPos, \
+    __global const float* displacementMap, \
+    __global const float* paintWeights, \
+    const float strength, \
+    __global const float* normals, \
+    __global const float* tangents, \
+    __global const float* binormals, \
+    const uint count, \
+    __global float* finalPos \
+    ) \
+{ \
+    uint stride = get_global_size(0); \
+    uint index = get_global_id(0); \
+    for (uint i = 0; i < VERTS && index < count; i++, index += stride) \
+    { \
+        displaceTangentSpace(index, initialPos, displacementMap, paintWeights, strength, normals, tangents, binormals, finalPos); \
+    } \
+}
+
+DEFINE_OBJECT_SPACE_KERNEL(2)
+DEFINE_OBJECT_SPACE_KERNEL(4)
+DEFINE_OBJECT_SPACE_KERNEL(8)
+
+DEFINE_TANGENT_SPACE_KERNEL(2)
+DEFINE_TANGENT_SPACE_KERNEL(4)
+DEFINE_TANGENT_SPACE_KERNEL(8)
+
+/**
+* Object-space variant that processes 4 consecutive vertices per work item using aligned float4 loads and stores.
+* Parameters match ObjectSpaceDisplacement.
+*/
+__kernel void ObjectSpaceDisplacement_x4v(
+    __global const float* initialPos,
+    __global const float* displacementMap,
+    __global const float* paintWeights,
+    const float strength,
+    const uint count,
+    __global float* finalPos
+    )
+{
+    uint block = get_global_id(0);
+    uint first = block * 4;
+
+    if (first + 4 > count)
+    {
+        // Last partial block
+
+        for (uint index = first; index < count; index++)
+        {
+            displaceObjectSpace(index, initialPos, displacementMap, paintWeights, strength, finalPos);
+        }
+
+        return;
+    }
+
+    float3 positions[4];
+    float3 rgbData[4];
+
+    loadFloat3x4(block, initialPos, positions);
+    loadFloat3x4(block, displacementMap, rgbData);
+    float4 weights = getVertexWeights4(block, paintWeights, strength);
+
+    positions[0] += rgbData[0] * weights.x;
+    positions[1] += rgbData[1] * weights.y;
+    positions[2] += rgbData[2] * weights.z;
+    positions[3] += rgbData[3] * weights.w;
+
+    storeFloat3x4(positions, block, finalPos);
+}
+
+/**
+* Tangent-space variant that processes 4 consecutive vertices per work item using aligned float4 loads and stores.
+* Parameters match TangentSpaceDisplacement.
+*/
+__kernel void TangentSpaceDisplacement_x4v(
+    __global const float* initialPos,
+    __global const float* displacementMap,
+    __global const float* paintWeights,
+    const float strength,
+    __global const float* normals,
+    __global const float* tangents,
+    __global const float* binormals,
+    const uint count,
+    __global float* finalPos
+    )
+{
+    uint block = get_global_id(0);
+    uint first = block * 4;
+
+    if (first + 4 > count)
+    {
+        // Last partial block
+
+        for (uint index = first; index < count; index++)
+        {
+            displaceTangentSpace(index, initialPos, displacementMap, paintWeights, strength, normals, tangents, binormals, finalPos);
+        }
+
+        return;
+    }
+
+    float3 positions[4];
+    float3 rgbData[4];
+    float3 vertexNormals[4];
+    float3 vertexTangents[4];
+    float3 vertexBinormals[4];
+
+    loadFloat3x4(block, initialPos, positions);
+    loadFloat3x4(block, displacementMap, rgbData);
+    loadFloat3x4(block, normals, vertexNormals);
+    loadFloat3x4(block, tangents, vertexTangents);
+    loadFloat3x4(block, binormals, vertexBinormals);
+    float4 weights = getVertexWeights4(block, paintWeights, strength);
+
+    float weightValues[4] = { weights.x, weights.y, weights.z, weights.w };
+
+    for (uint i = 0; i < 4; i++)
+    {
+        float3 offset = (vertexTangents[i] * rgbData[i].x) + (vertexNormals[i] * rgbData[i].y) + (vertexBinormals[i] * rgbData[i].z);
+        positions[i] += offset * weightValues[i];
+    }
+
+    storeFloat3x4(positions, block, finalPos);
+}
+
+/**
+* Object-space variant for tiled execution. Auxiliary buffers only hold the data of the current tile,
+* while the position buffers hold the whole mesh.
+*
+* @param[in] initialPos - Initial vertex positions of the whole mesh (read as float3)
+* @param[in] displacementMap - Displacement map texture data of the tile (read as float3 - RGB)
+* @param[in] paintWeights - Maya paint weights of the tile. 1 value per vertex
+* @param[in] strength - Strength to apply to the displacement
+* @param[in] count - Vertex count of the tile
+* @param[in] firstVertex - Mesh index of the first vertex of the tile
+* @param[out] finalPos - Output vertex positions of the whole mesh (stored as float3)
+*/
+__kernel void ObjectSpaceDisplacementTiled(
+    __global const float* initialPos,
+    __global const float* displacementMap,
+    __global const float* paintWeights,
+    const float strength,
+    const uint count,
+    const uint firstVertex,
+    __global float* finalPos
+    )
+{
+    unsigned int index = get_global_id(0);
+    if (index >= count)
+    {
+        return;
+    }
+
+    displaceObjectSpace(index, initialPos + firstVertex * 3, displacementMap, paintWeights, strength, finalPos + firstVertex * 3);
+}
+
+/**
+* Tangent-space variant for tiled execution. Auxiliary buffers only hold the data of the current tile,
+* while the position buffers hold the whole mesh.
+*
+* @param[in] initialPos - Initial vertex positions of the whole mesh (read as float3)
+* @param[in] displacementMap - Displacement map texture data of the tile (read as float3 - RGB)
+* @param[in] paintWeights - Maya paint weights of the tile. 1 value per vertex
+* @param[in] strength - Strength to apply to the displacement
+* @param[in] normals - Vertex normal data of the tile (read as float3)
+* @param[in] tangents - Vertex tangent data of the tile (read as float3)
+* @param[in] binormals - Vertex binormal data of the tile (read as float3)
+* @param[in] count - Vertex count of the tile
+* @param[in] firstVertex - Mesh index of the first vertex of the tile
+* @param[out] finalPos - Output vertex positions of the whole mesh (stored as float3)
+*/
+__kernel void TangentSpaceDisplacementTiled(
+    __global const float* initialPos,
+    __global const float* displacementMap,
+    __global const float* paintWeights,
+    const float strength,
+    __global const float* normals,
+    __global const float* tangents,
+    __global const float* binormals,
+    const uint count,
+    const uint firstVertex,
+    __global float* finalPos
+    )
+{
+    unsigned int index = get_global_id(0);
+    if (index >= count)
+    {
+        return;
+    }
+
+    displaceTangentSpace(index, initialPos + firstVertex * 3, displacementMap, paintWeights, strength, normals, tangents, binormals, finalPos + firstVertex * 3);
+}
+
+/**
+* Calculates the raw tangent-space offset of each vertex (no strength or paint weights), used as the input of the relax pass
+*
+* @param[in] displacementMap - Displacement map texture data (read as float3 - RGB)
+* @param[in] normals - Vertex normal data (read as float3)
+* @param[in] tangents - Vertex tangent data (read as float3)
+* @param[in] binormals - Vertex binormal data (read as float3)
+* @param[in] count - Total vertex count
+* @param[out] offsets - Offset of each vertex (stored as float3)
+*/
+__kernel void TangentSpaceOffsets(
+    __global const float* displacementMap,
+    __global const float* normals,
+    __global const float* tangents,
+    __global const float* binormals,
+    const uint count,
+    __global float* offsets
+    )
+{
+    unsigned int index = get_global_id(0);
+    if (index >= count)
+    {
+        return;
+    }
+
     float3 rgbData = vload3(index, displacementMap);
     float3 normal = vload3(index, normals);
     float3 tangent = vload3(index, tangents);
     float3 binormal = vload3(index, binormals);
 
-    float3 tangentOffset = tangent * rgbData.x;
-    float3 normalOffset = normal * rgbData.y;
-    float3 binormalOffset = binormal * rgbData.z;
+    float3 offset = (tangent * rgbData.x) + (normal * rgbData.y) + (binormal * rgbData.z);
+    vstore3(offset, index, offsets);
+}
+
+/**
+* Runs one Laplacian relax iteration over the per-vertex offsets. Ping-ponged between two buffers, one launch per iteration.
+* Relaxed offsets are then applied with ObjectSpaceDisplacement.
+*
+* @param[in] sourceOffsets - Offsets of the previous iteration (read as float3)
+* @param[in] adjacencyOffsets - First neighbour entry of each vertex (plus one extra entry at the end)
+* @param[in] adjacencyIndices - Neighbour vertex indices
+* @param[in] strength - How far each offset moves towards the neighbour average (0 - 1)
+* @param[in] count - Total vertex count
+* @param[out] relaxedOffsets - Relaxed offsets (stored as float3)
+*/
+__kernel void RelaxOffsets(
+    __global const float* sourceOffsets,
+    __global const uint* adjacencyOffsets,
+    __global const uint* adjacencyIndices,
+    const float strength,
+    const uint count,
+    __global float* relaxedOffsets
+    )
+{
+    unsigned int index = get_global_id(0);
+    if (index >= count)
+    {
+        return;
+    }
+
+    float3 offset = vload3(index, sourceOffsets);
+    uint first = adjacencyOffsets[index];
+    uint last = adjacencyOffsets[index + 1];
 
-    float x = initialPosition.x + ((tangentOffset.x + normalOffset.x + binormalOffset.x) * strength * paintWeights[index]);
-    float y = initialPosition.y + ((tangentOffset.y + normalOffset.y + binormalOffset.y) * strength * paintWeights[index]);
-    float z = initialPosition.z + ((tangentOffset.z + normalOffset.z + binormalOffset.z) * strength * paintWeights[index]);
+    if (first == last)
+    {
+        vstore3(offset, index, relaxedOffsets); // Isolated vertex
+        return;
+    }
 
-    float3 finalPosition = (float3)(x, y ,z);
-    vstore3(finalPosition, index, finalPos);
+    float3 average = (float3)(0.f, 0.f, 0.f);
+
+    for (uint i = first; i < last; i++)
+    {
+        average += vload3(adjacencyIndices[i], sourceOffsets);
+    }
+
+    average /= (float)(last - first);
+
+    vstore3(offset + (average - offset) * strength, index, relaxedOffsets);
+}
+
+/**
+* Snaps a UV interval to texels of a summed-area table, wrapped so the first texel is inside the map (matches SummedAreaTable on the CPU)
+*
+* @param[in] center - Interval center in UV units
+* @param[in] halfSize - Half of the interval size in UV units
+* @param[in] size - Map size in texels along the interval
+* @param[out] first - First texel, in [0, size)
+* @param[out] end - Texel after the last one, in (first, first + size]. Values past size wrap around to the start of the map.
+*/
+inline void getTexelRange(float center, float halfSize, uint size, uint* first, uint* end)
+{
+    #pragma OPENCL FP_CONTRACT OFF // Multiply-adds would round differently than the CPU copy
+
+    float firstTexel = round((center - halfSize) * size);
+    float endTexel = round((center + halfSize) * size);
+
+    if (!isfinite(firstTexel) || !isfinite(endTexel))
+    {
+        *first = 0;
+        *end = 1;
+        return;
+    }
+
+    float count = fmin(endTexel - firstTexel, (float)size);
+
+    if (count < 1.f)
+    {
+        firstTexel = floor(center * size);
+        count = 1.f;
+    }
+
+    float wrappedFirst = fmod(firstTexel, (float)size);
+
+    if (wrappedFirst < 0.f)
+    {
+        wrappedFirst += size;
+    }
+
+    *first = min((uint)wrappedFirst, size - 1);
+    *end = *first + (uint)count;
+}
+
+/**
+* Adds the sum of a texel rectangle that doesn't wrap around the map
+*
+* @param[in] table - Summed-area table (3 fixed-point sums per corner, rows of (width + 1) corners)
+* @param[in] width - Map width in texels
+* @param[in] x0 - First column
+* @param[in] y0 - First row
+* @param[in] x1 - Column after the last one
+* @param[in] y1 - Row after the last one
+* @param[in,out] sum - Sum of each channel
+*/
+inline void addRectangleSum(__global const long* table, uint width, uint x0, uint y0, uint x1, uint y1, long sum[3])
+{
+    __global const long* bottomRow = table + (size_t)y0 * (width + 1) * 3;
+    __global const long* topRow = table + (size_t)y1 * (width + 1) * 3;
+
+    for (uint channel = 0; channel < 3; channel++)
+    {
+        sum[channel] += topRow[x1 * 3 + channel] - topRow[x0 * 3 + channel] - bottomRow[x1 * 3 + channel] + bottomRow[x0 * 3 + channel];
+    }
+}
+
+/**
+* Gets the box-filtered map sample of each vertex from a summed-area table of the map. Sums are 64-bit fixed-point integers,
+* so the rectangle sums match the CPU implementation exactly, and the samples are then applied like point-sampled texture data.
+* Work items run in sampling order (along a Morton curve through the UVs), so neighbouring work items read nearby table entries.
+*
+* @param[in] table - Summed-area table (3 fixed-point sums per corner, rows of (width + 1) corners, (height + 1) rows)
+* @param[in] width - Map width in texels
+* @param[in] height - Map height in texels
+* @param[in] fixedPointScale - Fixed-point units per map unit
+* @param[in] uvFootprints - Footprint of each entry in sampling order (read as float4 - U, V, half width, half height)
+* @param[in] vertexOrder - Vertex index of each entry in sampling order
+* @param[in] count - Total vertex count
+* @param[out] samples - Filtered map sample of each vertex, in vertex order (stored as float3 - RGB)
+*/
+__kernel void AreaFilteredSamples(
+    __global const long* table,
+    const uint width,
+    const uint height,
+    const float fixedPointScale,
+    __global const float* uvFootprints,
+    __global const uint* vertexOrder,
+    const uint count,
+    __global float* samples
+    )
+{
+    unsigned int index = get_global_id(0);
+    if (index >= count)
+    {
+        return;
+    }
+
+    float4 footprint = vload4(index, uvFootprints);
+    uint x0, x1, y0, y1;
+    getTexelRange(footprint.x, footprint.z, width, &x0, &x1);
+    getTexelRange(footprint.y, footprint.w, height, &y0, &y1);
+
+    // Rectangles that cross the map border are split into up to four parts
+
+    long sum[3] = { 0, 0, 0 };
+    uint xEnds[2] = { min(x1, width), x1 > width ? x1 - width : 0 };
+    uint yEnds[2] = { min(y1, height), y1 > height ? y1 - height : 0 };
+
+    for (uint yPart = 0; yPart < 2; yPart++)
+    {
+        for (uint xPart = 0; xPart < 2; xPart++)
+        {
+            uint xFirst = xPart == 0 ? x0 : 0;
+            uint yFirst = yPart == 0 ? y0 : 0;
+
+            if (xEnds[xPart] > xFirst && yEnds[yPart] > yFirst)
+            {
+                addRectangleSum(table, width, xFirst, yFirst, xEnds[xPart], yEnds[yPart], sum);
+            }
+        }
+    }
+
+    float scale = 1.f / ((float)(x1 - x0) * (float)(y1 - y0) * fixedPointScale);
+    vstore3((float3)((float)sum[0], (float)sum[1], (float)sum[2]) * scale, vertexOrder[index], samples);
 }
\ No newline at end of file
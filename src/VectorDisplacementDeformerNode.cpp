@@ -7,36 +7,104 @@
  */
 
 #include "VectorDisplacementDeformerNode.h"
+#include "GpuKernelAutotuner.h"
+#include "VectorDisplacementBakeCommand.h"
+#include "VectorDisplacementExtractCommand.h"
 #include "VectorDisplacementGpuDeformerNode.h"
 #include "VectorDisplacementHelperTypes.h"
+#include "VectorDisplacementStreamingPipeline.h"
+#include "VectorDisplacementTraceCommand.h"
 #include "VectorDisplacementUtilities.h"
+#include "VectorDisplacementWarmCache.h"
+#include "WorkerThreadPool.h"
 
+#include <maya/MAnimControl.h>
 #include <maya/MDataBlock.h>
+#include <maya/MEvaluationNode.h>
 #include <maya/MFloatVectorArray.h>
 #include <maya/MFnEnumAttribute.h>
 #include <maya/MFnDependencyNode.h>
 #include <maya/MFnNumericAttribute.h>
 #include <maya/MFnPlugin.h>
+#include <maya/MFnStringData.h>
 #include <maya/MFnTypedAttribute.h>
 #include <maya/MGlobal.h>
 #include <maya/MItGeometry.h>
+#include <maya/MPlug.h>
+#include <maya/MPlugArray.h>
 #include <maya/MPoint.h>
 #include <maya/MPxGeometryFilter.h>
+#include <maya/MRenderUtil.h>
+#include <maya/MThreadUtils.h>
+#include <maya/MTime.h>
 #include <maya/MTypes.h>
 
+#include <algorithm>
+#include <chrono>
+#include <functional>
+
 
 constexpr char* NODE_NAME = "vectorDisplacement";
+constexpr size_t MAX_RECORDED_WEIGHT_CHANGES = 1 << 20; // Past this, consumers fetch all the weights again instead
+constexpr int MIN_FILTER_RESOLUTION = 16;
+constexpr int MAX_FILTER_RESOLUTION = 8192; // Map tables take 24 bytes per texel (1.5 GB at this resolution)
+constexpr char* WARM_CACHE_ENVIRONMENT_VARIABLE = "VECTOR_DISPLACEMENT_CACHE_DIR"; // Warm-start cache is only enabled when this is set
+constexpr char* WARM_CACHE_SIZE_ENVIRONMENT_VARIABLE = "VECTOR_DISPLACEMENT_CACHE_SIZE_MB";
+constexpr int DEFAULT_WARM_CACHE_SIZE_MB = 2048;
+constexpr double POSITION_UPLOAD_BYTES_PER_MS = 4e6; // Conservative host to device bandwidth (4 GB/s), used to charge the CPU backend for uploading its output positions
 
 
 MTypeId VectorDisplacementDeformerNode::Id(0x00000001); // Can't be 0, otherwise the GPU deformer registration won't work
 MObject VectorDisplacementDeformerNode::strengthAttribute;
 MObject VectorDisplacementDeformerNode::displacementMapAttribute;
 MObject VectorDisplacementDeformerNode::displacementMapTypeAttribute;
+MObject VectorDisplacementDeformerNode::useBakedCacheAttribute;
+MObject VectorDisplacementDeformerNode::bakedCacheFileAttribute;
+MObject VectorDisplacementDeformerNode::evaluationQualityAttribute;
+MObject VectorDisplacementDeformerNode::proxyLevelAttribute;
+MObject VectorDisplacementDeformerNode::streamingChunkSizeAttribute;
+MObject VectorDisplacementDeformerNode::gpuMemoryBudgetAttribute;
+MObject VectorDisplacementDeformerNode::uvSetAttribute;
+MObject VectorDisplacementDeformerNode::relaxIterationsAttribute;
+MObject VectorDisplacementDeformerNode::relaxStrengthAttribute;
+MObject VectorDisplacementDeformerNode::mapSamplingAttribute;
+MObject VectorDisplacementDeformerNode::filterResolutionAttribute;
+MObject VectorDisplacementDeformerNode::seamSamplingAttribute;
+MObject VectorDisplacementDeformerNode::backendAttribute;
+MObject VectorDisplacementDeformerNode::activeBackendAttribute;
 
 MStringArray VectorDisplacementDeformerNode::menuItems;
 
 
 MStatus VectorDisplacementDeformerNode::deform(MDataBlock& data, MItGeometry& itGeometry, const MMatrix& localToWorldMatrix, unsigned int mIndex)
+{
+    TraceTag traceTag = getTraceTag(data, mIndex);
+    EvaluationTracer::Scope traceScope("deform", traceTag);
+
+    BackendMode backendMode = static_cast<BackendMode>(data.inputValue(backendAttribute).asInt());
+
+    if (backendMode != BackendMode::AUTO)
+    {
+        return deformGeometry(data, itGeometry, mIndex, traceTag);
+    }
+
+    // Auto backend: measure the evaluation so it can be compared with the GPU deformer
+
+    auto startTime = std::chrono::steady_clock::now();
+    MStatus status = deformGeometry(data, itGeometry, mIndex, traceTag);
+    std::chrono::duration<double, std::milli> elapsedTime = std::chrono::steady_clock::now() - startTime;
+
+    uint64_t settingsHash = getBackendSettingsHash(data, thisMObject());
+
+    if (status == MS::kSuccess && settingsHash != 0)
+    {
+        recordBackendCost(mIndex, EvaluationBackend::CPU, static_cast<unsigned int>(itGeometry.count()), settingsHash, elapsedTime.count());
+    }
+
+    return status;
+}
+
+MStatus VectorDisplacementDeformerNode::deformGeometry(MDataBlock& data, MItGeometry& itGeometry, unsigned int mIndex, const TraceTag& traceTag)
 {
     // Get envelope and weights
     
@@ -44,59 +112,370 @@ MStatus VectorDisplacementDeformerNode::deform(MDataBlock& data, MItGeometry& it
     float strengthVal = data.inputValue(strengthAttribute).asFloat();
     float finalWeight = envelopeVal * strengthVal;
 
-    // Get texture data. Exit early if operation failed
+    bool useBakedCache = data.inputValue(useBakedCacheAttribute).asBool();
+
+    // Leave the input points untouched when displacement can't have any effect.
+    // Checked before taking the dirty flags so cached data is still refreshed once the deformer has an effect again.
+
+    if (envelopeVal == 0.f ||
+        (!useBakedCache && (strengthVal == 0.f || !VectorDisplacementUtilities::isTextureConnected(thisMObject(), DISPLACEMENT_MAP_ATTRIBUTE))))
+    {
+        return MS::kSuccess;
+    }
+
+    // Classify input geometry changes so cached data is only invalidated when needed.
+    // Texture samples only depend on the UVs, but frames depend on the points too.
+
+    EvaluationTracer::Scope stage("fingerprint", traceTag);
+
+    GeometryCache& cache = geometryCaches[mIndex];
+    GeometryDirtyFlags dirtyFlags = takeDirtyFlags(mIndex);
+    MObject inputMesh = getInputGeom(data, mIndex);
+    MString uvSetName = data.inputValue(uvSetAttribute).asString();
+
+    if (dirtyFlags.isGeometryDirty || cache.fingerprint.uvSetName != uvSetName)
+    {
+        MeshChangeType meshChange = VectorDisplacementUtilities::updateMeshFingerprint(inputMesh, uvSetName, cache.fingerprint, scratch);
+
+        cache.hasVertexData = false;
+        cache.hasTextureData = cache.hasTextureData && meshChange < MeshChangeType::UVS;
+
+        if (meshChange >= MeshChangeType::UVS)
+        {
+            cache.vertexUvs.clear();
+            cache.uvFootprints.clear();
+            cache.seamSamples = SeamUvSamples();
+        }
+
+        if (meshChange == MeshChangeType::TOPOLOGY)
+        {
+            cache.proxySampling = ProxySampling();
+            cache.adjacency = VertexAdjacency();
+        }
+    }
+
+    if (dirtyFlags.isMapDirty)
+    {
+        cache.hasTextureData = false;
+        cache.mapTable = SummedAreaTable();
+    }
+
+    // Apply baked offsets directly when using a valid cache file. Strength and paint weights are already baked in.
+
+    if (useBakedCache)
+    {
+        stage.next("bakedOffsets");
+
+        std::unique_lock<std::mutex> bakedCacheLock = bakedCache.lockMapping(); // Keeps the file mapped while the offsets are applied
+        const float* bakedOffsets = getBakedOffsets(data, mIndex, cache.fingerprint);
+
+        if (bakedOffsets)
+        {
+            for (; !itGeometry.isDone(); itGeometry.next())
+            {
+                const float* offset = bakedOffsets + itGeometry.index() * 3;
+
+                MPoint position = itGeometry.position();
+                position += MVector(offset[0], offset[1], offset[2]) * envelopeVal;
+                itGeometry.setPosition(position);
+            }
+
+            return MS::kSuccess;
+        }
+
+        if (strengthVal == 0.f || !VectorDisplacementUtilities::isTextureConnected(thisMObject(), DISPLACEMENT_MAP_ATTRIBUTE))
+        {
+            return MS::kSuccess; // Cache can't be used and the live displacement has no effect either
+        }
+    }
+
+    // Streaming mode: process the mesh in fixed-size chunks instead of keeping full-size arrays for every vertex
+
+    unsigned int streamingChunkSize = static_cast<unsigned int>(std::max(data.inputValue(streamingChunkSizeAttribute).asInt(), 0));
 
-    MVectorArray mapColor;
-    MDoubleArray mapAlpha;
-    MStatus textureDataFetchStatus = VectorDisplacementUtilities::getTextureData(thisMObject(), getInputGeom(data, mIndex), DISPLACEMENT_MAP_ATTRIBUTE, mapColor, mapAlpha);
+    if (streamingChunkSize > 0)
+    {
+        stage.next("streaming");
+        return deformStreaming(data, itGeometry, mIndex, inputMesh, streamingChunkSize, finalWeight);
+    }
+
+    // Get paint weights (dense array that is only updated when weights change). Nothing to displace if every weight is 0,
+    // which is checked before any map or mesh data is fetched.
+
+    stage.next("paintWeights");
+    updatePaintWeights(data, mIndex, cache, dirtyFlags.isWeightListDirty);
+
+    if (cache.areWeightsUniform && cache.uniformWeight == 0.f)
+    {
+        return MS::kSuccess;
+    }
+
+    // Get texture data (resampled when switching between full and proxy quality, between point and area sampling, or between seam sampling modes)
+    // and the other mesh data needed for tangent-space maps
+
+    unsigned int proxyLevel = getProxyLevel(data);
+    unsigned int filterResolution = getFilterResolution(data);
+    SeamSamplingMode seamSampling = getSeamSampling(data);
+    VectorDisplacementMapType mapType = static_cast<VectorDisplacementMapType>(data.inputValue(displacementMapTypeAttribute).asInt());
+
+    bool needsTextureData = !cache.hasTextureData || cache.textureProxyLevel != proxyLevel || cache.textureFilterResolution != filterResolution ||
+        cache.textureSeamSampling != seamSampling;
+    bool needsVertexData = mapType == VectorDisplacementMapType::TANGENT_SPACE && !cache.hasVertexData;
+
+    // The warm-start cache is only used for the first fetch of each geometry (e.g. when a scene is opened), so animated meshes aren't hashed every frame
+
+    MString mapFilePath;
+    bool useFrameWarmCache = needsVertexData && cache.isFrameWarmStartPending;
+
+    if (needsTextureData && cache.isTextureWarmStartPending)
+    {
+        mapFilePath = VectorDisplacementWarmCache::getMapFilePath(thisMObject(), DISPLACEMENT_MAP_ATTRIBUTE);
+        cache.isTextureWarmStartPending = false;
+    }
+
+    if (useFrameWarmCache)
+    {
+        cache.isFrameWarmStartPending = false;
+    }
+
+    // UVs, map samples and frames are read through the Maya API, which is only safe on the evaluation thread. Area filtering is pure math
+    // on the data read here, so it runs on the shared worker threads while the frames are read.
+
+    stage.next("meshData");
+
+    WorkerThreadPool::Task filterTask;
+    MStatus textureDataFetchStatus = MS::kSuccess;
+    MStatus vertexDataFetchStatus = MS::kSuccess;
+
+    if (needsTextureData)
+    {
+        textureDataFetchStatus = updateTextureData(inputMesh, uvSetName, proxyLevel, filterResolution, seamSampling, mapFilePath, cache, traceTag, filterTask);
+    }
+
+    if (needsVertexData && textureDataFetchStatus == MS::kSuccess)
+    {
+        vertexDataFetchStatus = updateVertexData(inputMesh, useFrameWarmCache, cache, traceTag);
+    }
+
+    if (filterTask.isValid())
+    {
+        stage.next("waitForData");
+        filterTask.wait();
+    }
+
+    // Exit early if an operation failed
 
     if (textureDataFetchStatus != MS::kSuccess)
     {
         return textureDataFetchStatus;
     }
 
-    // Get vector displacement map type from plug
+    if (vertexDataFetchStatus != MS::kSuccess)
+    {
+        return vertexDataFetchStatus;
+    }
 
-    VectorDisplacementMapType mapType = static_cast<VectorDisplacementMapType>(data.inputValue(displacementMapTypeAttribute).asInt());
+    if (needsVertexData)
+    {
+        cache.hasVertexData = true;
+        cache.hasRelaxedOffsets = false;
+    }
 
-    // Get other mesh data needed for tangent-space maps
+    const MVectorArray& mapColor = cache.mapColor;
+    const MFloatVectorArray& normals = cache.normals;
+    const MFloatVectorArray& tangents = cache.tangents;
+    const MFloatVectorArray& binormals = cache.binormals;
 
-    MFloatVectorArray normals;
-    MFloatVectorArray tangents;
-    MFloatVectorArray binormals;
+    // Relax the raw offsets (kept until the texture data, the frames or the relax settings change)
 
-    if (mapType == VectorDisplacementMapType::TANGENT_SPACE)
+    RelaxSettings relaxSettings = getRelaxSettings(data);
+    relaxSettings.mapType = mapType;
+
+    if (relaxSettings.iterations > 0 && (!cache.hasRelaxedOffsets || cache.relaxSettings != relaxSettings))
     {
-        MStatus vertexDataFetchStatus = VectorDisplacementUtilities::getMeshVertexData(getInputGeom(data, mIndex), normals, tangents, binormals);
+        stage.next("relax");
 
-        if (vertexDataFetchStatus != MS::kSuccess)
+        if (cache.adjacency.isEmpty())
         {
-            return vertexDataFetchStatus;
+            MStatus adjacencyStatus = VectorDisplacementUtilities::getVertexAdjacency(inputMesh, cache.adjacency, scratch);
+
+            if (adjacencyStatus != MS::kSuccess)
+            {
+                return adjacencyStatus;
+            }
         }
+
+        VectorDisplacementUtilities::getDisplacementOffsets(mapColor, normals, tangents, binormals, mapType, cache.relaxedOffsets);
+        VectorDisplacementRelax::relaxOffsets(cache.adjacency, relaxSettings.iterations, relaxSettings.strength, cache.relaxedOffsets, scratch.relaxOffsets);
+
+        cache.hasRelaxedOffsets = true;
+        cache.relaxSettings = relaxSettings;
     }
-    
-    // Iterate through mesh vertices and deform based on texture data
+
+    // Displace with the variant that matches the map type and paint weights
+
+    stage.next("displace");
+    displaceVertices(itGeometry, cache, mapType, relaxSettings.iterations > 0, finalWeight);
+
+    return MS::kSuccess;
+}
+
+void VectorDisplacementDeformerNode::displaceVertices(MItGeometry& itGeometry, const GeometryCache& cache, VectorDisplacementMapType mapType, bool useRelaxedOffsets, float finalWeight)
+{
+    WeightMode weightMode = VectorDisplacementUtilities::getWeightMode(cache.areWeightsUniform, cache.uniformWeight, finalWeight);
+    float strength = cache.areWeightsUniform ? cache.uniformWeight * finalWeight : finalWeight;
+
+    if (useRelaxedOffsets)
+    {
+        switch (weightMode)
+        {
+            case WeightMode::NONE:
+                applyRelaxedOffsets<WeightMode::NONE>(itGeometry, cache, strength);
+                break;
+
+            case WeightMode::UNIFORM:
+                applyRelaxedOffsets<WeightMode::UNIFORM>(itGeometry, cache, strength);
+                break;
+
+            default:
+                applyRelaxedOffsets<WeightMode::PAINTED>(itGeometry, cache, strength);
+                break;
+        }
+
+        return;
+    }
+
+    bool isTangentSpace = mapType == VectorDisplacementMapType::TANGENT_SPACE;
+
+    switch (weightMode)
+    {
+        case WeightMode::NONE:
+            if (isTangentSpace)
+            {
+                applyMapOffsets<VectorDisplacementMapType::TANGENT_SPACE, WeightMode::NONE>(itGeometry, cache, strength);
+            }
+            else
+            {
+                applyMapOffsets<VectorDisplacementMapType::OBJECT_SPACE, WeightMode::NONE>(itGeometry, cache, strength);
+            }
+            break;
+
+        case WeightMode::UNIFORM:
+            if (isTangentSpace)
+            {
+                applyMapOffsets<VectorDisplacementMapType::TANGENT_SPACE, WeightMode::UNIFORM>(itGeometry, cache, strength);
+            }
+            else
+            {
+                applyMapOffsets<VectorDisplacementMapType::OBJECT_SPACE, WeightMode::UNIFORM>(itGeometry, cache, strength);
+            }
+            break;
+
+        default:
+            if (isTangentSpace)
+            {
+                applyMapOffsets<VectorDisplacementMapType::TANGENT_SPACE, WeightMode::PAINTED>(itGeometry, cache, strength);
+            }
+            else
+            {
+                applyMapOffsets<VectorDisplacementMapType::OBJECT_SPACE, WeightMode::PAINTED>(itGeometry, cache, strength);
+            }
+            break;
+    }
+}
+
+template <VectorDisplacementMapType MAP_TYPE, WeightMode WEIGHT_MODE>
+void VectorDisplacementDeformerNode::applyMapOffsets(MItGeometry& itGeometry, const GeometryCache& cache, float strength)
+{
+    const float* paintWeights = cache.paintWeights.data();
 
     for (; !itGeometry.isDone(); itGeometry.next())
     {
-        float paintedWeight = weightValue(data, mIndex, itGeometry.index());
+        unsigned int index = itGeometry.index();
+        const MVector& rgbData = cache.mapColor[index];
+        MVector offset;
+
+        // Conditions below are resolved at compile time
 
-        VertexData vertexData;
-        vertexData.position = itGeometry.position();
-        vertexData.index = itGeometry.index();
+        if (MAP_TYPE == VectorDisplacementMapType::TANGENT_SPACE)
+        {
+            offset = VectorDisplacementMath::getTangentSpaceOffset(MVector(cache.normals[index]), MVector(cache.tangents[index]), MVector(cache.binormals[index]), rgbData, 1.f);
+        }
+        else
+        {
+            offset = rgbData;
+        }
 
-        if (mapType == VectorDisplacementMapType::TANGENT_SPACE)
+        if (WEIGHT_MODE == WeightMode::PAINTED)
         {
-            vertexData.normal = normals[vertexData.index];
-            vertexData.tangent = tangents[vertexData.index];
-            vertexData.binormal = binormals[vertexData.index];
+            offset *= paintWeights[index] * strength;
+        }
+        else if (WEIGHT_MODE == WeightMode::UNIFORM)
+        {
+            offset *= strength;
         }
 
-        MPoint displacedVert = VectorDisplacementUtilities::getDisplacedVertex(vertexData, mapColor, mapAlpha, paintedWeight * finalWeight, mapType);
-        itGeometry.setPosition(displacedVert);
+        itGeometry.setPosition(itGeometry.position() + offset);
     }
+}
 
-    return MS::kSuccess;
+template <WeightMode WEIGHT_MODE>
+void VectorDisplacementDeformerNode::applyRelaxedOffsets(MItGeometry& itGeometry, const GeometryCache& cache, float strength)
+{
+    const float* relaxedOffsets = cache.relaxedOffsets.data();
+    const float* paintWeights = cache.paintWeights.data();
+
+    for (; !itGeometry.isDone(); itGeometry.next())
+    {
+        unsigned int index = itGeometry.index();
+        const float* offset = relaxedOffsets + index * 3;
+        MVector vertexOffset(offset[0], offset[1], offset[2]);
+
+        if (WEIGHT_MODE == WeightMode::PAINTED)
+        {
+            vertexOffset *= paintWeights[index] * strength;
+        }
+        else if (WEIGHT_MODE == WeightMode::UNIFORM)
+        {
+            vertexOffset *= strength;
+        }
+
+        itGeometry.setPosition(itGeometry.position() + vertexOffset);
+    }
+}
+
+void VectorDisplacementDeformerNode::getCacheSetup(const MEvaluationNode& evalNode, MNodeCacheDisablingInfo& disablingInfo,
+                                                   MNodeCacheSetupInfo& cacheSetupInfo, MObjectArray& monitoredAttributes) const
+{
+    MPxDeformerNode::getCacheSetup(evalNode, disablingInfo, cacheSetupInfo, monitoredAttributes);
+    cacheSetupInfo.setPreference(MNodeCacheSetupInfo::kWantToCacheByDefault, true);
+}
+
+MStatus VectorDisplacementDeformerNode::deformStreaming(MDataBlock& data, MItGeometry& itGeometry, unsigned int mIndex, const MObject& inputMesh,
+                                                       unsigned int chunkSize, float finalWeight)
+{
+    // Release the full-size cached data of this geometry. Only its fingerprint is still needed.
+
+    GeometryCache& cache = geometryCaches[mIndex];
+    MeshFingerprint fingerprint = cache.fingerprint;
+
+    cache = GeometryCache();
+    cache.fingerprint = fingerprint;
+
+    releaseWeightChanges(mIndex, WeightChangeConsumer::CPU); // Weights are read per chunk
+    MStatus textureStatus = VectorDisplacementUtilities::validateTexture(thisMObject(), DISPLACEMENT_MAP_ATTRIBUTE);
+    if (textureStatus != MS::kSuccess)
+    {
+        return textureStatus;
+    }
+
+    VectorDisplacementMapType mapType = static_cast<VectorDisplacementMapType>(data.inputValue(displacementMapTypeAttribute).asInt());
+    MString uvSetName = data.inputValue(uvSetAttribute).asString();
+    VectorDisplacementStreamingPipeline pipeline(thisMObject(), inputMesh, DISPLACEMENT_MAP_ATTRIBUTE, uvSetName, mapType, chunkSize);
+
+    // Paint weights are looked up per vertex, so no dense weight array is needed either
+
+    return pipeline.deform(itGeometry, [&](unsigned int index) { return weightValue(data, mIndex, index) * finalWeight; });
 }
 
 MObject VectorDisplacementDeformerNode::getInputGeom(MDataBlock& data, unsigned int geomIndex) const
@@ -109,12 +488,512 @@ MObject VectorDisplacementDeformerNode::getInputGeom(MDataBlock& data, unsigned
     return inputHandle.outputValue().child(inputGeom).asMesh();
 }
 
+MStatus VectorDisplacementDeformerNode::setDependentsDirty(const MPlug& plug, MPlugArray& plugArray)
+{
+    bool isMapPlug = plug == displacementMapAttribute || (plug.isChild() && plug.parent() == displacementMapAttribute);
+    bool isGeometryPlug = plug == inputGeom || plug == input;
+
+    if (isMapPlug || isGeometryPlug)
+    {
+        markGeometryCachesDirty(isGeometryPlug, isMapPlug, false);
+    }
+
+    if (plug == weights || plug == weightList)
+    {
+        recordWeightChange(plug);
+        markGeometryCachesDirty(false, false, true);
+    }
+
+    return MPxDeformerNode::setDependentsDirty(plug, plugArray);
+}
+
+MStatus VectorDisplacementDeformerNode::preEvaluation(const MDGContext& context, const MEvaluationNode& evaluationNode)
+{
+    bool isMapDirty = evaluationNode.dirtyPlugExists(displacementMapAttribute);
+    bool isGeometryDirty = evaluationNode.dirtyPlugExists(inputGeom) || evaluationNode.dirtyPlugExists(input);
+    bool isWeightListDirty = evaluationNode.dirtyPlugExists(weightList);
+
+    if (isMapDirty || isGeometryDirty || isWeightListDirty)
+    {
+        markGeometryCachesDirty(isGeometryDirty, isMapDirty, isWeightListDirty);
+    }
+
+    return MPxDeformerNode::preEvaluation(context, evaluationNode);
+}
+
+const float* VectorDisplacementDeformerNode::getBakedOffsets(MDataBlock& data, unsigned int geomIndex, const MeshFingerprint& fingerprint)
+{
+    MString cachePath = data.inputValue(bakedCacheFileAttribute).asString();
+
+    if (bakedCache.open(cachePath) != MS::kSuccess)
+    {
+        return nullptr;
+    }
+
+    return bakedCache.getOffsets(geomIndex, fingerprint);
+}
+
+bool VectorDisplacementDeformerNode::getWeightChanges(unsigned int geomIndex, WeightChangeConsumer consumer, uint64_t& version, std::vector<unsigned int>& changedIndices)
+{
+    changedIndices.clear();
+
+    std::lock_guard<std::mutex> lock(dirtyStateMutex);
+
+    WeightChangeJournal& journal = weightChangeJournals[geomIndex];
+
+    uint64_t lastVersion = version;
+    version = journal.currentVersion();
+
+    bool areChangesKnown = lastVersion >= journal.baseVersion;
+
+    if (areChangesKnown)
+    {
+        changedIndices.assign(journal.changedIndices.begin() + static_cast<size_t>(lastVersion - journal.baseVersion), journal.changedIndices.end());
+    }
+
+    // Drop the changes every consumer has seen
+
+    journal.consumerVersions[static_cast<int>(consumer)] = version;
+
+    uint64_t seenVersion = version;
+
+    for (uint64_t consumerVersion : journal.consumerVersions)
+    {
+        if (consumerVersion != 0)
+        {
+            seenVersion = std::min(seenVersion, consumerVersion);
+        }
+    }
+
+    if (seenVersion > journal.baseVersion)
+    {
+        journal.changedIndices.erase(journal.changedIndices.begin(), journal.changedIndices.begin() + static_cast<size_t>(seenVersion - journal.baseVersion));
+        journal.baseVersion = seenVersion;
+    }
+
+    return areChangesKnown;
+}
+
+void VectorDisplacementDeformerNode::releaseWeightChanges(unsigned int geomIndex, WeightChangeConsumer consumer)
+{
+    std::lock_guard<std::mutex> lock(dirtyStateMutex);
+
+    auto journal = weightChangeJournals.find(geomIndex);
+
+    if (journal != weightChangeJournals.end())
+    {
+        journal->second.consumerVersions[static_cast<int>(consumer)] = 0;
+    }
+}
+
+unsigned int VectorDisplacementDeformerNode::getProxyLevel(MDataBlock& data)
+{
+    EvaluationQuality quality = static_cast<EvaluationQuality>(data.inputValue(evaluationQualityAttribute).asInt());
+
+    if (quality != EvaluationQuality::PROXY)
+    {
+        return 0;
+    }
+
+    // Batch and render evaluations always use full quality
+
+    if (MGlobal::mayaState() != MGlobal::kInteractive || MRenderUtil::mayaRenderState() != MRenderUtil::kNotRendering)
+    {
+        return 0;
+    }
+
+    return static_cast<unsigned int>(std::max(data.inputValue(proxyLevelAttribute).asInt(), 1));
+}
+
+RelaxSettings VectorDisplacementDeformerNode::getRelaxSettings(MDataBlock& data)
+{
+    RelaxSettings settings;
+    settings.iterations = static_cast<unsigned int>(std::max(data.inputValue(relaxIterationsAttribute).asInt(), 0));
+    settings.strength = std::min(std::max(data.inputValue(relaxStrengthAttribute).asFloat(), 0.f), 1.f);
+
+    if (settings.strength == 0.f)
+    {
+        settings.iterations = 0; // Relaxing wouldn't change anything
+    }
+
+    return settings;
+}
+
+unsigned int VectorDisplacementDeformerNode::getFilterResolution(MDataBlock& data)
+{
+    MapSamplingMode samplingMode = static_cast<MapSamplingMode>(data.inputValue(mapSamplingAttribute).asInt());
+
+    if (samplingMode != MapSamplingMode::AREA || getProxyLevel(data) > 0)
+    {
+        return 0;
+    }
+
+    return static_cast<unsigned int>(std::min(std::max(data.inputValue(filterResolutionAttribute).asInt(), MIN_FILTER_RESOLUTION), MAX_FILTER_RESOLUTION));
+}
+
+SeamSamplingMode VectorDisplacementDeformerNode::getSeamSampling(MDataBlock& data)
+{
+    if (getProxyLevel(data) > 0)
+    {
+        return SeamSamplingMode::FIRST_ISLAND;
+    }
+
+    VectorDisplacementMapType mapType = static_cast<VectorDisplacementMapType>(data.inputValue(displacementMapTypeAttribute).asInt());
+    return getSeamSampling(static_cast<SeamSamplingMode>(data.inputValue(seamSamplingAttribute).asInt()), mapType);
+}
+
+SeamSamplingMode VectorDisplacementDeformerNode::getSeamSampling(SeamSamplingMode seamSampling, VectorDisplacementMapType mapType)
+{
+    return mapType == VectorDisplacementMapType::TANGENT_SPACE ? SeamSamplingMode::FIRST_ISLAND : seamSampling;
+}
+
+uint64_t VectorDisplacementDeformerNode::getBackendSettingsHash(MDataBlock& data, const MObject& nodeObject)
+{
+    float envelopeVal = data.inputValue(envelope).asFloat();
+    float strengthVal = data.inputValue(strengthAttribute).asFloat();
+    bool useBakedCache = data.inputValue(useBakedCacheAttribute).asBool();
+
+    if (envelopeVal == 0.f ||
+        (!useBakedCache && (strengthVal == 0.f || !VectorDisplacementUtilities::isTextureConnected(nodeObject, DISPLACEMENT_MAP_ATTRIBUTE))))
+    {
+        return 0;
+    }
+
+    // Only settings that change the amount of work (not the values it's done with), so animated strength doesn't restart the measurements
+
+    int settings[] = {
+        useBakedCache ? 1 : 0,
+        data.inputValue(displacementMapTypeAttribute).asInt(),
+        static_cast<int>(getProxyLevel(data)),
+        static_cast<int>(getFilterResolution(data)),
+        static_cast<int>(getSeamSampling(data)),
+        static_cast<int>(getRelaxSettings(data).iterations),
+        data.inputValue(gpuMemoryBudgetAttribute).asInt()
+    };
+
+    uint64_t hash = VectorDisplacementUtilities::hashBytes(VectorDisplacementUtilities::hashInit(), settings, sizeof(settings));
+
+    return hash != 0 ? hash : 1;
+}
+
+EvaluationBackend VectorDisplacementDeformerNode::getActiveBackend(MDataBlock& data, unsigned int geomIndex)
+{
+    MArrayDataHandle activeBackendHandle = data.inputArrayValue(activeBackendAttribute);
+
+    if (activeBackendHandle.jumpToElement(geomIndex) != MS::kSuccess)
+    {
+        return EvaluationBackend::GPU;
+    }
+
+    return static_cast<EvaluationBackend>(activeBackendHandle.inputValue().asInt());
+}
+
+bool VectorDisplacementDeformerNode::isMeasuringBackend(unsigned int geomIndex, EvaluationBackend backend, unsigned int vertexCount, uint64_t settingsHash)
+{
+    std::lock_guard<std::mutex> lock(backendMutex);
+
+    BackendSelector& selector = backendSelectors[geomIndex];
+    selector.update(vertexCount, settingsHash);
+
+    return selector.isMeasuring(backend);
+}
+
+void VectorDisplacementDeformerNode::recordBackendCost(unsigned int geomIndex, EvaluationBackend backend, unsigned int vertexCount, uint64_t settingsHash, double milliseconds)
+{
+    // The GPU deformer reads its input positions from the device. When the CPU deformer runs instead, Maya uploads its output for the GPU
+    // deformers and the drawing that follow, which isn't part of the measured time.
+
+    if (backend == EvaluationBackend::CPU)
+    {
+        milliseconds += static_cast<double>(vertexCount) * sizeof(float) * 3 / POSITION_UPLOAD_BYTES_PER_MS;
+    }
+
+    EvaluationBackend preferredBackend;
+
+    {
+        std::lock_guard<std::mutex> lock(backendMutex);
+
+        BackendSelector& selector = backendSelectors[geomIndex];
+        selector.update(vertexCount, settingsHash);
+        selector.addSample(backend, milliseconds);
+
+        preferredBackend = selector.getPreferredBackend(backend);
+
+        auto requestedBackend = requestedBackends.find(geomIndex);
+
+        if (preferredBackend == backend ||
+            (requestedBackend != requestedBackends.end() && requestedBackend->second == preferredBackend))
+        {
+            return; // Already on the preferred backend, or already requested (e.g. GPU override can't evaluate this geometry)
+        }
+
+        requestedBackends[geomIndex] = preferredBackend;
+    }
+
+    // Attributes can't be set while evaluating. The change is left out of the undo queue since it's not a user edit, and the undo state
+    // is restored afterwards (even if the node was deleted in the meantime), so undo stays off if the user or a script turned it off.
+
+    MString command = "{ int $undoState = `undoInfo -q -stateWithoutFlush`; undoInfo -stateWithoutFlush off; catchQuiet(`setAttr \"" + name() + ".activeBackend[";
+    command += geomIndex;
+    command += "]\" ";
+    command += static_cast<int>(preferredBackend);
+    command += "`); undoInfo -stateWithoutFlush $undoState; }";
+
+    MGlobal::executeCommandOnIdle(command);
+}
+
+TraceTag VectorDisplacementDeformerNode::getTraceTag(MDataBlock& data, unsigned int geomIndex) const
+{
+    TraceTag tag;
+    tag.node = traceId;
+    tag.geometry = geomIndex;
+
+    if (EvaluationTracer::isEnabled())
+    {
+        // Background evaluations (e.g. cached playback) evaluate other frames than the current one
+
+        MTime time;
+
+        if (!data.context().getTime(time))
+        {
+            time = MAnimControl::currentTime();
+        }
+
+        tag.frame = time.as(MTime::uiUnit());
+    }
+
+    return tag;
+}
+
 void VectorDisplacementDeformerNode::logError(const MString& message) const
 {
     MString msg = name() + ": " + message;
     MGlobal::displayError(msg);
 }
 
+void VectorDisplacementDeformerNode::markGeometryCachesDirty(bool isGeometryDirty, bool isMapDirty, bool isWeightListDirty)
+{
+    std::lock_guard<std::mutex> lock(dirtyStateMutex);
+
+    for (auto& flags : geometryDirtyFlags)
+    {
+        flags.second.isGeometryDirty = flags.second.isGeometryDirty || isGeometryDirty;
+        flags.second.isMapDirty = flags.second.isMapDirty || isMapDirty;
+        flags.second.isWeightListDirty = flags.second.isWeightListDirty || isWeightListDirty;
+    }
+}
+
+GeometryDirtyFlags VectorDisplacementDeformerNode::takeDirtyFlags(unsigned int geomIndex)
+{
+    std::lock_guard<std::mutex> lock(dirtyStateMutex);
+
+    GeometryDirtyFlags& flags = geometryDirtyFlags[geomIndex]; // New geometries start fully dirty
+    GeometryDirtyFlags takenFlags = flags;
+
+    flags.isGeometryDirty = false;
+    flags.isMapDirty = false;
+    flags.isWeightListDirty = false;
+
+    return takenFlags;
+}
+
+void VectorDisplacementDeformerNode::updatePaintWeights(MDataBlock& data, unsigned int geomIndex, GeometryCache& cache, bool isWeightListDirty)
+{
+    unsigned int numOfElements = cache.fingerprint.vertexCount;
+
+    std::vector<unsigned int>& changedIndices = scratch.changedWeightIndices;
+    bool areChangesKnown = getWeightChanges(geomIndex, WeightChangeConsumer::CPU, cache.paintWeightsVersion, changedIndices);
+
+    if (!areChangesKnown || cache.paintWeights.size() != numOfElements || (isWeightListDirty && changedIndices.empty()))
+    {
+        VectorDisplacementUtilities::getPaintWeights(data, geomIndex, numOfElements, cache.paintWeights);
+    }
+    else if (!changedIndices.empty())
+    {
+        VectorDisplacementUtilities::updatePaintWeights(data, geomIndex, changedIndices, cache.paintWeights);
+    }
+    else
+    {
+        return; // Nothing changed
+    }
+
+    // Check if the weights are uniform so the deform loop can skip per-vertex weights
+
+    cache.uniformWeight = cache.paintWeights.empty() ? 1.f : cache.paintWeights[0];
+    cache.areWeightsUniform = std::all_of(cache.paintWeights.begin(), cache.paintWeights.end(),
+        [&cache](float weight) { return weight == cache.uniformWeight; });
+}
+
+MStatus VectorDisplacementDeformerNode::updateTextureData(const MObject& inputMesh, const MString& uvSetName, unsigned int proxyLevel, unsigned int filterResolution,
+                                                         SeamSamplingMode seamSampling, const MString& mapFilePath, GeometryCache& cache, const TraceTag& traceTag,
+                                                         WorkerThreadPool::Task& filterTask)
+{
+    EvaluationTracer::Scope stage("textureData", traceTag);
+
+    uint64_t warmCacheKey = 0;
+
+    if (mapFilePath.length() > 0)
+    {
+        stage.next("warmCacheRead");
+        warmCacheKey = VectorDisplacementWarmCache::getMapSamplesKey(thisMObject(), DISPLACEMENT_MAP_ATTRIBUTE, mapFilePath, cache.fingerprint, proxyLevel,
+            filterResolution, seamSampling);
+
+        if (VectorDisplacementWarmCache::readMapSamples(warmCacheKey, cache.fingerprint.vertexCount, cache.mapColor))
+        {
+            cache.mapAlpha.clear();
+            cache.hasTextureData = true;
+            cache.textureProxyLevel = proxyLevel;
+            cache.textureFilterResolution = filterResolution;
+            cache.textureSeamSampling = seamSampling;
+            cache.hasRelaxedOffsets = false;
+
+            return MS::kSuccess;
+        }
+
+        stage.next("textureData");
+    }
+
+    if (proxyLevel > 0 && cache.proxySampling.level != proxyLevel)
+    {
+        VectorDisplacementUtilities::buildProxySampling(inputMesh, proxyLevel, cache.proxySampling);
+    }
+
+    // UVs are gathered once and kept until the UV set, the UVs or the topology change
+
+    if (seamSampling == SeamSamplingMode::FIRST_ISLAND && cache.vertexUvs.empty())
+    {
+        MStatus uvDataFetchStatus = VectorDisplacementUtilities::getMeshUvData(inputMesh, uvSetName, cache.vertexUvs, scratch);
+
+        if (uvDataFetchStatus != MS::kSuccess)
+        {
+            return uvDataFetchStatus;
+        }
+
+        VectorDisplacementUtilities::getUvSamplingOrder(cache.vertexUvs, cache.samplingOrder);
+    }
+
+    MStatus textureDataFetchStatus = MS::kSuccess;
+
+    if (seamSampling == SeamSamplingMode::AVERAGE)
+    {
+        textureDataFetchStatus = VectorDisplacementUtilities::getSeamTextureData(thisMObject(), DISPLACEMENT_MAP_ATTRIBUTE, inputMesh, uvSetName, filterResolution,
+            cache.seamSamples, cache.mapTable, cache.mapColor, cache.mapAlpha, scratch);
+    }
+    else if (filterResolution > 0)
+    {
+        textureDataFetchStatus = VectorDisplacementUtilities::prepareAreaSampling(thisMObject(), DISPLACEMENT_MAP_ATTRIBUTE, inputMesh, uvSetName, filterResolution,
+            cache.vertexUvs, cache.samplingOrder, cache.mapTable, cache.uvFootprints, scratch);
+
+        if (textureDataFetchStatus == MS::kSuccess)
+        {
+            // The table and footprints are ready, so the rest is pure math. Filtered samples are stored in the warm-start cache once they're done.
+
+            filterTask = WorkerThreadPool::submit([&cache, warmCacheKey, traceTag]()
+            {
+                EvaluationTracer::Scope filterStage("areaFilter", traceTag);
+                VectorDisplacementUtilities::getFilteredTextureData(cache.mapTable, cache.samplingOrder, cache.uvFootprints, cache.mapColor, cache.mapAlpha);
+
+                if (warmCacheKey != 0 && cache.mapColor.length() == cache.fingerprint.vertexCount)
+                {
+                    filterStage.next("warmCacheWrite");
+                    VectorDisplacementWarmCache::writeMapSamples(warmCacheKey, cache.mapColor);
+                }
+            });
+        }
+    }
+    else
+    {
+        textureDataFetchStatus = VectorDisplacementUtilities::getTextureData(thisMObject(), cache.vertexUvs, DISPLACEMENT_MAP_ATTRIBUTE, cache.mapColor, cache.mapAlpha,
+            scratch, proxyLevel > 0 ? &cache.proxySampling : nullptr, &cache.samplingOrder);
+    }
+
+    if (textureDataFetchStatus != MS::kSuccess)
+    {
+        return textureDataFetchStatus;
+    }
+
+    cache.hasTextureData = true;
+    cache.textureProxyLevel = proxyLevel;
+    cache.textureFilterResolution = filterResolution;
+    cache.textureSeamSampling = seamSampling;
+    cache.hasRelaxedOffsets = false;
+
+    if (warmCacheKey != 0 && !filterTask.isValid() && cache.mapColor.length() == cache.fingerprint.vertexCount)
+    {
+        stage.next("warmCacheWrite");
+        VectorDisplacementWarmCache::writeMapSamples(warmCacheKey, cache.mapColor);
+    }
+
+    return MS::kSuccess;
+}
+
+MStatus VectorDisplacementDeformerNode::updateVertexData(const MObject& inputMesh, bool useWarmCache, GeometryCache& cache, const TraceTag& traceTag)
+{
+    EvaluationTracer::Scope stage("vertexData", traceTag);
+
+    uint64_t warmCacheKey = useWarmCache ? VectorDisplacementWarmCache::getVertexFramesKey(inputMesh, cache.fingerprint) : 0;
+
+    if (VectorDisplacementWarmCache::readVertexFrames(warmCacheKey, cache.fingerprint.vertexCount, cache.normals, cache.tangents, cache.binormals))
+    {
+        return MS::kSuccess;
+    }
+
+    MStatus vertexDataFetchStatus = VectorDisplacementUtilities::getMeshVertexData(inputMesh, cache.normals, cache.tangents, cache.binormals, scratch);
+
+    if (vertexDataFetchStatus == MS::kSuccess && warmCacheKey != 0)
+    {
+        VectorDisplacementWarmCache::writeVertexFrames(warmCacheKey, cache.normals, cache.tangents, cache.binormals);
+    }
+
+    return vertexDataFetchStatus;
+}
+
+void VectorDisplacementDeformerNode::recordWeightChange(const MPlug& plug)
+{
+    std::lock_guard<std::mutex> lock(dirtyStateMutex);
+
+    // Resetting a journal makes every consumer fetch all the weights of that geometry again
+
+    auto resetJournal = [](WeightChangeJournal& journal)
+    {
+        journal.baseVersion = journal.currentVersion() + 1;
+        journal.changedIndices.clear();
+    };
+
+    if (plug == weights && plug.isElement())
+    {
+        // Single weight: weightList[geomIndex].weights[vertexIndex]
+
+        WeightChangeJournal& journal = weightChangeJournals[plug.array().parent().logicalIndex()];
+
+        // Nothing to record without consumers, since new consumers fetch all the weights anyway
+
+        if (journal.hasConsumers() && journal.changedIndices.size() < MAX_RECORDED_WEIGHT_CHANGES)
+        {
+            journal.changedIndices.push_back(plug.logicalIndex());
+        }
+        else
+        {
+            resetJournal(journal);
+        }
+    }
+    else if (plug == weights)
+    {
+        resetJournal(weightChangeJournals[plug.parent().logicalIndex()]);
+    }
+    else if (plug.isElement())
+    {
+        resetJournal(weightChangeJournals[plug.logicalIndex()]);
+    }
+    else
+    {
+        for (auto& journal : weightChangeJournals)
+        {
+            resetJournal(journal.second);
+        }
+    }
+}
+
 void* VectorDisplacementDeformerNode::creator()
 {
     return new VectorDisplacementDeformerNode;
@@ -126,6 +1005,8 @@ MStatus VectorDisplacementDeformerNode::initialize()
 
     MFnNumericAttribute numberAttr;
     MFnEnumAttribute enumAttr;
+    MFnTypedAttribute typedAttr;
+    MFnStringData stringData;
 
     strengthAttribute = numberAttr.create("strength", "s", MFnNumericData::kFloat);
     numberAttr.setKeyable(true);
@@ -139,12 +1020,95 @@ MStatus VectorDisplacementDeformerNode::initialize()
     enumAttr.addField("Object", 0);
     enumAttr.addField("Tangent", 1);
 
+    useBakedCacheAttribute = numberAttr.create("useBakedCache", "ubc", MFnNumericData::kBoolean, 0);
+
+    bakedCacheFileAttribute = typedAttr.create("bakedCacheFile", "bcf", MFnData::kString, stringData.create(""));
+    typedAttr.setUsedAsFilename(true);
+
+    evaluationQualityAttribute = enumAttr.create("evaluationQuality", "evq", 0);
+    enumAttr.addField("Full", 0);
+    enumAttr.addField("Proxy", 1);
+
+    proxyLevelAttribute = numberAttr.create("proxyLevel", "pxl", MFnNumericData::kInt, 2);
+    numberAttr.setMin(1);
+    numberAttr.setSoftMax(8);
+
+    streamingChunkSizeAttribute = numberAttr.create("streamingChunkSize", "stcs", MFnNumericData::kInt, 0);
+    numberAttr.setMin(0);
+
+    gpuMemoryBudgetAttribute = numberAttr.create("gpuMemoryBudget", "gmb", MFnNumericData::kInt, 0);
+    numberAttr.setMin(0);
+
+    uvSetAttribute = typedAttr.create("uvSet", "uvs", MFnData::kString, stringData.create(""));
+
+    relaxIterationsAttribute = numberAttr.create("relaxIterations", "rxi", MFnNumericData::kInt, 0);
+    numberAttr.setMin(0);
+    numberAttr.setSoftMax(10);
+
+    relaxStrengthAttribute = numberAttr.create("relaxStrength", "rxs", MFnNumericData::kFloat, 0.5);
+    numberAttr.setMin(0.f);
+    numberAttr.setMax(1.f);
+
+    mapSamplingAttribute = enumAttr.create("mapSampling", "msmp", 0);
+    enumAttr.addField("Point", 0);
+    enumAttr.addField("Area", 1);
+
+    filterResolutionAttribute = numberAttr.create("filterResolution", "fres", MFnNumericData::kInt, 1024);
+    numberAttr.setMin(MIN_FILTER_RESOLUTION);
+    numberAttr.setMax(MAX_FILTER_RESOLUTION);
+    numberAttr.setSoftMax(4096);
+
+    seamSamplingAttribute = enumAttr.create("seamSampling", "smsp", 0);
+    enumAttr.addField("First Island", 0);
+    enumAttr.addField("Average", 1);
+
+    backendAttribute = enumAttr.create("backend", "bknd", 0);
+    enumAttr.addField("GPU", 0);
+    enumAttr.addField("CPU", 1);
+    enumAttr.addField("Auto", 2);
+
+    // Measurements aren't saved, so every geometry is measured again when the scene is opened
+
+    activeBackendAttribute = enumAttr.create("activeBackend", "abk", 0);
+    enumAttr.addField("GPU", 0);
+    enumAttr.addField("CPU", 1);
+    enumAttr.setArray(true);
+    enumAttr.setStorable(false);
+
     addAttribute(strengthAttribute);
     addAttribute(displacementMapAttribute);
     addAttribute(displacementMapTypeAttribute);
+    addAttribute(useBakedCacheAttribute);
+    addAttribute(bakedCacheFileAttribute);
+    addAttribute(evaluationQualityAttribute);
+    addAttribute(proxyLevelAttribute);
+    addAttribute(streamingChunkSizeAttribute);
+    addAttribute(gpuMemoryBudgetAttribute);
+    addAttribute(uvSetAttribute);
+    addAttribute(relaxIterationsAttribute);
+    addAttribute(relaxStrengthAttribute);
+    addAttribute(mapSamplingAttribute);
+    addAttribute(filterResolutionAttribute);
+    addAttribute(seamSamplingAttribute);
+    addAttribute(backendAttribute);
+    addAttribute(activeBackendAttribute);
     attributeAffects(strengthAttribute, outputGeom);
     attributeAffects(displacementMapAttribute, outputGeom);
     attributeAffects(displacementMapTypeAttribute, outputGeom);
+    attributeAffects(useBakedCacheAttribute, outputGeom);
+    attributeAffects(bakedCacheFileAttribute, outputGeom);
+    attributeAffects(evaluationQualityAttribute, outputGeom);
+    attributeAffects(proxyLevelAttribute, outputGeom);
+    attributeAffects(streamingChunkSizeAttribute, outputGeom);
+    attributeAffects(gpuMemoryBudgetAttribute, outputGeom);
+    attributeAffects(uvSetAttribute, outputGeom);
+    attributeAffects(relaxIterationsAttribute, outputGeom);
+    attributeAffects(relaxStrengthAttribute, outputGeom);
+    attributeAffects(mapSamplingAttribute, outputGeom);
+    attributeAffects(filterResolutionAttribute, outputGeom);
+    attributeAffects(seamSamplingAttribute, outputGeom);
+    attributeAffects(backendAttribute, outputGeom);
+    attributeAffects(activeBackendAttribute, outputGeom);
 
     // Make paintable
 
@@ -162,12 +1126,51 @@ MStatus initializePlugin(MObject obj)
     MStatus status = plugin.registerNode(name,
         VectorDisplacementDeformerNode::Id, VectorDisplacementDeformerNode::creator,
         VectorDisplacementDeformerNode::initialize, MPxNode::kDeformerNode);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    status = plugin.registerCommand(VectorDisplacementBakeCommand::COMMAND_NAME, VectorDisplacementBakeCommand::creator, VectorDisplacementBakeCommand::newSyntax);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    status = plugin.registerCommand(VectorDisplacementExtractCommand::COMMAND_NAME, VectorDisplacementExtractCommand::creator, VectorDisplacementExtractCommand::newSyntax);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    status = plugin.registerCommand(VectorDisplacementTraceCommand::COMMAND_NAME, VectorDisplacementTraceCommand::creator, VectorDisplacementTraceCommand::newSyntax);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    status = VectorDisplacementTraceCommand::initializeTracing();
+    CHECK_MSTATUS_AND_RETURN_IT(status);
 
     // Register GPU deformer override
     MGPUDeformerRegistry::registerGPUDeformerCreator(name, name + "Override", VectorDisplacementGpuDeformerNode::getGPUDeformerInfo());
+
+    // GPU override validates the node again when these change, so geometries can move between the CPU and GPU deformers
+    MGPUDeformerRegistry::addConditionalAttribute(name, name + "Override", VectorDisplacementDeformerNode::backendAttribute);
+    MGPUDeformerRegistry::addConditionalAttribute(name, name + "Override", VectorDisplacementDeformerNode::activeBackendAttribute);
     
     VectorDisplacementGpuDeformerNode::kernelPath = plugin.loadPath(); 
 
+    // Resolved here since MEL can't be run from evaluation threads
+    GpuKernelAutotuner::storeDirectory = MGlobal::executeCommandStringResult("internalVar -userAppDir");
+
+    // Warm-start cache is opt-in, since it writes data outside of the scene (e.g. to a directory shared by farm jobs). Disabled if the directory can't be created.
+    MString warmCacheDirectory = MGlobal::executeCommandStringResult(MString("getenv ") + WARM_CACHE_ENVIRONMENT_VARIABLE);
+    int isWarmCacheDirectoryCreated = 0;
+
+    if (warmCacheDirectory.length() > 0)
+    {
+        warmCacheDirectory.substitute("\\", "/");
+        MGlobal::executeCommand("sysFile -makeDir \"" + warmCacheDirectory + "\"", isWarmCacheDirectoryCreated);
+    }
+
+    MString warmCacheSize = MGlobal::executeCommandStringResult(MString("getenv ") + WARM_CACHE_SIZE_ENVIRONMENT_VARIABLE);
+    int warmCacheSizeMegabytes = warmCacheSize.isInt() ? warmCacheSize.asInt() : DEFAULT_WARM_CACHE_SIZE_MB;
+
+    VectorDisplacementWarmCache::directory = isWarmCacheDirectoryCreated ? warmCacheDirectory + "/" : MString();
+    VectorDisplacementWarmCache::sizeBudget = static_cast<uint64_t>(std::max(warmCacheSizeMegabytes, 1)) * 1024 * 1024;
+
+    // Parallel loops share one set of worker threads, sized like Maya's own thread pool
+    WorkerThreadPool::setThreadCount(static_cast<unsigned int>(std::max(MThreadUtils::getNumThreads(), 1)));
+
     // Adding menus through C++ API to avoid having to include more complicated MEL/Python script setups for now
     MStringArray modelingMenuItem = plugin.addMenuItem("Vector Displacement", "mainDeformMenu", "deformer", "-type vectorDisplacement");
     MStringArray animMenuItem = plugin.addMenuItem("Vector Displacement", "mainDeformationMenu", "deformer", "-type vectorDisplacement");
@@ -188,10 +1191,18 @@ MStatus uninitializePlugin(MObject obj)
     MString name(NODE_NAME);
     MGPUDeformerRegistry::deregisterGPUDeformerCreator(name, name + "Override");
 
+    plugin.deregisterCommand(VectorDisplacementBakeCommand::COMMAND_NAME);
+    plugin.deregisterCommand(VectorDisplacementExtractCommand::COMMAND_NAME);
+    plugin.deregisterCommand(VectorDisplacementTraceCommand::COMMAND_NAME);
+
+    VectorDisplacementTraceCommand::uninitializeTracing(); // Before the nodes are gone, so the trace still has their names
+
     MStatus status = plugin.deregisterNode(VectorDisplacementDeformerNode::Id);
 
     plugin.removeMenuItem(VectorDisplacementDeformerNode::menuItems);
 
+    WorkerThreadPool::shutdown(); // Threads can't be joined while the plug-in library is being unloaded
+
     CHECK_MSTATUS_AND_RETURN_IT(status);
     return status;
 }
\ No newline at end of file
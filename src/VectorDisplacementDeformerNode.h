@@ -8,8 +8,20 @@
 
 #pragma once
 
+#include "BackendSelector.h"
+#include "EvaluationTracer.h"
+#include "VectorDisplacementCacheFile.h"
+#include "WorkerThreadPool.h"
+
+#include <maya/MEvaluationNode.h>
+#include <maya/MNodeCacheDisablingInfo.h>
+#include <maya/MNodeCacheSetupInfo.h>
+#include <maya/MObjectArray.h>
 #include <maya/MPxDeformerNode.h>
 
+#include <map>
+#include <mutex>
+
 
 /* Deformer node that uses a vector displacement map to deform the geometry */
 class VectorDisplacementDeformerNode : public MPxDeformerNode
@@ -31,6 +43,45 @@ public:
     */
     virtual MStatus deform(MDataBlock& data, MItGeometry& itGeometry, const MMatrix& localToWorldMatrix, unsigned int mIndex);
 
+    /**
+    * Flags the cached data of each geometry as dirty when the displacement map or the input geometry are dirtied (DG evaluation)
+    *
+    * @param[in] plug - Plug that is being dirtied
+    * @param[out] plugArray - Additional plugs to dirty. Not used.
+    *
+    * @return MStatus indicating if operation was successful or not
+    */
+    virtual MStatus setDependentsDirty(const MPlug& plug, MPlugArray& plugArray);
+
+    /**
+    * Flags the cached data of each geometry as dirty when the displacement map or the input geometry are dirty (Evaluation Manager)
+    *
+    * @param[in] context - Context in which the evaluation will happen
+    * @param[in] evaluationNode - Evaluation node that contains the dirty plugs of this node
+    *
+    * @return MStatus indicating if operation was successful or not
+    */
+    virtual MStatus preEvaluation(const MDGContext& context, const MEvaluationNode& evaluationNode);
+
+    /**
+    * Declares this node as safe to evaluate in parallel. Cached data is per node, and the state shared with the main thread
+    * (dirty flags and weight changes) is guarded.
+    *
+    * @return Scheduling type of this node
+    */
+    virtual SchedulingType schedulingType() const { return MPxNode::kParallel; }
+
+    /**
+    * Requests cached playback to cache this node by default. The output only depends on the node inputs, so cached frames stay valid.
+    *
+    * @param[in] evalNode - Evaluation node of this node
+    * @param[out] disablingInfo - Information about why caching would be disabled. Not used.
+    * @param[out] cacheSetupInfo - Caching preferences of this node
+    * @param[out] monitoredAttributes - Attributes that change the cache setup when modified. Not used.
+    */
+    virtual void getCacheSetup(const MEvaluationNode& evalNode, MNodeCacheDisablingInfo& disablingInfo,
+                               MNodeCacheSetupInfo& cacheSetupInfo, MObjectArray& monitoredAttributes) const;
+
     /**
     * Gets the input geometry object
     *
@@ -41,6 +92,140 @@ public:
     */
     virtual MObject getInputGeom(MDataBlock& data, unsigned int geomIndex) const;
 
+    /**
+    * Gets the baked offsets of the given geometry from the cache file set in this node
+    *
+    * @param[in] data - Data block for this given node
+    * @param[in] geomIndex - Index of the geometry
+    * @param[in] fingerprint - Current fingerprints of the input mesh of the geometry
+    *
+    * @return Pointer to 3 floats per vertex, or null if the cache can't be used for this geometry
+    */
+    const float* getBakedOffsets(MDataBlock& data, unsigned int geomIndex, const MeshFingerprint& fingerprint);
+
+    /**
+    * Gets the paint weight changes of the given geometry recorded since the given version.
+    * Changes are only recorded while the geometry has consumers, and are dropped once every consumer has seen them.
+    *
+    * @param[in] geomIndex - Index of the geometry
+    * @param[in] consumer - Consumer of the changes
+    * @param[in,out] version - Weight version last seen by the caller. Updated to the current version.
+    * @param[out] changedIndices - Vertex indices whose weights changed since that version (may contain duplicates)
+    *
+    * @return True if the changes are known. False if all the weights need to be fetched again.
+    */
+    bool getWeightChanges(unsigned int geomIndex, WeightChangeConsumer consumer, uint64_t& version, std::vector<unsigned int>& changedIndices);
+
+    /**
+    * Stops recording paint weight changes for the given consumer, so they don't wait for it to be trimmed
+    *
+    * @param[in] geomIndex - Index of the geometry
+    * @param[in] consumer - Consumer of the changes
+    */
+    void releaseWeightChanges(unsigned int geomIndex, WeightChangeConsumer consumer);
+
+    /**
+    * Gets the proxy level to evaluate with. Proxy quality is only used in interactive sessions, never in batch mode or while rendering.
+    *
+    * @param[in] data - Data block for this given node
+    *
+    * @return Maximum edge distance between a vertex and its nearest sampled vertex, or 0 when evaluating at full quality
+    */
+    static unsigned int getProxyLevel(MDataBlock& data);
+
+    /**
+    * Gets the relax pass settings. The map type is left at its default, since it's not a relax attribute.
+    *
+    * @param[in] data - Data block for this given node
+    *
+    * @return Relax settings. Iterations are 0 when the relax pass is disabled.
+    */
+    static RelaxSettings getRelaxSettings(MDataBlock& data);
+
+    /**
+    * Gets the resolution of the map table used for area-filtered sampling. Proxy quality always point samples the map.
+    *
+    * @param[in] data - Data block for this given node
+    *
+    * @return Map table size in texels along U and V, or 0 when point sampling
+    */
+    static unsigned int getFilterResolution(MDataBlock& data);
+
+    /**
+    * Gets how vertices on UV seams sample the map. Proxy quality always uses the first island, since it only samples a subset of the vertices.
+    *
+    * @param[in] data - Data block for this given node
+    *
+    * @return Seam sampling mode
+    */
+    static SeamSamplingMode getSeamSampling(MDataBlock& data);
+
+    /**
+    * Gets the seam sampling mode that applies to the given map type. Tangent-space maps always use the first island, since each island's
+    * samples are offsets in that island's own tangent frame and can't be averaged as they are.
+    *
+    * @param[in] seamSampling - Seam sampling mode set on the node
+    * @param[in] mapType - Displacement map type
+    *
+    * @return Seam sampling mode to use
+    */
+    static SeamSamplingMode getSeamSampling(SeamSamplingMode seamSampling, VectorDisplacementMapType mapType);
+
+    /**
+    * Gets a hash of the settings that change how much work an evaluation takes, so backend costs are measured again when they change
+    *
+    * @param[in] data - Data block for this given node
+    * @param[in] nodeObject - This deformer node
+    *
+    * @return Settings hash, or 0 when the deformer has no effect (evaluations that skip the work aren't measured)
+    */
+    static uint64_t getBackendSettingsHash(MDataBlock& data, const MObject& nodeObject);
+
+    /**
+    * Gets the backend the given geometry is evaluated with in auto backend mode
+    *
+    * @param[in] data - Data block for this given node
+    * @param[in] geomIndex - Index of the geometry
+    *
+    * @return Active backend of the geometry. Geometries start on the GPU.
+    */
+    static EvaluationBackend getActiveBackend(MDataBlock& data, unsigned int geomIndex);
+
+    /**
+    * Returns true while the given backend of a geometry still needs samples (auto backend mode)
+    *
+    * @param[in] geomIndex - Index of the geometry
+    * @param[in] backend - Backend to check
+    * @param[in] vertexCount - Vertex count of the geometry
+    * @param[in] settingsHash - Hash of the current settings (see getBackendSettingsHash)
+    */
+    bool isMeasuringBackend(unsigned int geomIndex, EvaluationBackend backend, unsigned int vertexCount, uint64_t settingsHash);
+
+    /**
+    * Records the measured cost of evaluating a geometry with the given backend (auto backend mode). When another backend is preferred,
+    * the active backend of the geometry is changed once Maya is idle, which makes GPU override validate the node again.
+    *
+    * @param[in] geomIndex - Index of the geometry
+    * @param[in] backend - Backend that evaluated the geometry
+    * @param[in] vertexCount - Vertex count of the geometry
+    * @param[in] settingsHash - Hash of the current settings (see getBackendSettingsHash)
+    * @param[in] milliseconds - Measured evaluation time
+    */
+    void recordBackendCost(unsigned int geomIndex, EvaluationBackend backend, unsigned int vertexCount, uint64_t settingsHash, double milliseconds);
+
+    /**
+    * Gets the tag of the traced spans of a geometry evaluation. The frame is only read while tracing is enabled.
+    *
+    * @param[in] data - Data block for this given node
+    * @param[in] geomIndex - Index of the geometry
+    *
+    * @return Trace tag (this node, the geometry and the evaluated frame)
+    */
+    TraceTag getTraceTag(MDataBlock& data, unsigned int geomIndex) const;
+
+    /** Returns the id that tags the traced spans of this node */
+    uint32_t getTraceId() const { return traceId; }
+
     /**
     * Logs an error message using a predefined format (Node name + message)
     *
@@ -60,6 +245,165 @@ public:
     static MObject strengthAttribute;   // Strength to use when applying displacement. 1 = Full strenght, 0 = no deformation
     static MObject displacementMapAttribute; // Displacement map to use when deforming
     static MObject displacementMapTypeAttribute; // Displacement map type (object or tangent)
+    static MObject useBakedCacheAttribute; // Whether to apply the offsets from the baked cache file instead of sampling the map
+    static MObject bakedCacheFileAttribute; // Path of the baked cache file written by the vectorDisplacementBake command
+    static MObject evaluationQualityAttribute; // Full or proxy quality (map sampled at a subset of vertices for interactive playback)
+    static MObject proxyLevelAttribute; // Maximum edge distance between a vertex and its nearest sampled vertex in proxy quality
+    static MObject streamingChunkSizeAttribute; // Vertices per chunk when streaming huge meshes with bounded memory. 0 = Streaming disabled.
+    static MObject gpuMemoryBudgetAttribute; // GPU memory (MB) for the auxiliary per-vertex buffers before tiling. 0 = Automatic (based on the device memory).
+    static MObject uvSetAttribute; // UV set used to sample the displacement map. Empty = First UV set.
+    static MObject relaxIterationsAttribute; // Laplacian smoothing iterations applied to the displacement offsets. 0 = Relax disabled.
+    static MObject relaxStrengthAttribute; // How far each offset moves towards the average of its neighbours per relax iteration
+    static MObject mapSamplingAttribute; // Point or area sampling (map box-filtered over each vertex's UV footprint)
+    static MObject filterResolutionAttribute; // Texels per side of the map table area sampling filters from
+    static MObject seamSamplingAttribute; // First island or average (vertices on UV seams blend the samples of every island they're on). Object-space maps only.
+    static MObject backendAttribute; // GPU, CPU or Auto (backend of each geometry chosen from its measured cost)
+    static MObject activeBackendAttribute; // Backend each geometry is evaluated with in auto mode, set from the measurements
 
     static constexpr char* DISPLACEMENT_MAP_ATTRIBUTE = "vectorDisplacementMap";
+
+private:
+    /**
+    * Flags the cached data of every geometry as dirty
+    *
+    * @param[in] isGeometryDirty - Whether the input geometry was dirtied
+    * @param[in] isMapDirty - Whether the displacement map was dirtied
+    * @param[in] isWeightListDirty - Whether the paint weights were dirtied
+    */
+    void markGeometryCachesDirty(bool isGeometryDirty, bool isMapDirty, bool isWeightListDirty);
+
+    /**
+    * Deforms the given geometry on the CPU. Called by deform, which measures it in auto backend mode.
+    *
+    * @param[in] data - Data block for this given node
+    * @param[in, out] itGeometry - Geometry iterator. Vertex position will be updated here.
+    * @param[in] mIndex - Index of the geometry
+    * @param[in] traceTag - Tag of the traced stages
+    *
+    * @return MStatus indicating if operation was successful or not
+    */
+    MStatus deformGeometry(MDataBlock& data, MItGeometry& itGeometry, unsigned int mIndex, const TraceTag& traceTag);
+
+    /**
+    * Deforms the given geometry in fixed-size chunks without keeping any full-size cached data
+    *
+    * @param[in] data - Data block for this given node
+    * @param[in, out] itGeometry - Geometry iterator. Vertex position will be updated here.
+    * @param[in] mIndex - Index of the geometry
+    * @param[in] inputMesh - Input mesh of the geometry
+    * @param[in] chunkSize - Number of vertices per chunk
+    * @param[in] finalWeight - Envelope multiplied by strength
+    *
+    * @return MStatus indicating if operation was successful or not
+    */
+    MStatus deformStreaming(MDataBlock& data, MItGeometry& itGeometry, unsigned int mIndex, const MObject& inputMesh, unsigned int chunkSize, float finalWeight);
+
+    /**
+    * Displaces the vertices with the cached texture data, or the relaxed offsets, using the variant that matches the map type and paint weights
+    *
+    * @param[in, out] itGeometry - Geometry iterator. Vertex position will be updated here.
+    * @param[in] cache - Cached data of the geometry
+    * @param[in] mapType - Map type of the texture data
+    * @param[in] useRelaxedOffsets - Whether to apply the relaxed offsets instead of the texture data
+    * @param[in] finalWeight - Envelope multiplied by strength
+    */
+    static void displaceVertices(MItGeometry& itGeometry, const GeometryCache& cache, VectorDisplacementMapType mapType, bool useRelaxedOffsets, float finalWeight);
+
+    /**
+    * Displaces the vertices with the cached texture data. Map type and weight mode are compile-time constants,
+    * so each variant only loads the data it needs and has no per-vertex branches.
+    *
+    * @param[in, out] itGeometry - Geometry iterator. Vertex position will be updated here.
+    * @param[in] cache - Cached data of the geometry
+    * @param[in] strength - Final weight, multiplied by the paint weight when weights are uniform. Unused when the weight mode is NONE.
+    */
+    template <VectorDisplacementMapType MAP_TYPE, WeightMode WEIGHT_MODE>
+    static void applyMapOffsets(MItGeometry& itGeometry, const GeometryCache& cache, float strength);
+
+    /**
+    * Displaces the vertices with the cached relaxed offsets, specialized for the given weight mode
+    *
+    * @param[in, out] itGeometry - Geometry iterator. Vertex position will be updated here.
+    * @param[in] cache - Cached data of the geometry
+    * @param[in] strength - Final weight, multiplied by the paint weight when weights are uniform. Unused when the weight mode is NONE.
+    */
+    template <WeightMode WEIGHT_MODE>
+    static void applyRelaxedOffsets(MItGeometry& itGeometry, const GeometryCache& cache, float strength);
+
+    /**
+    * Gets the dirty flags of the given geometry and clears them
+    *
+    * @param[in] geomIndex - Index of the geometry
+    *
+    * @return Dirty flags set since the last call. Everything is dirty the first time a geometry is evaluated.
+    */
+    GeometryDirtyFlags takeDirtyFlags(unsigned int geomIndex);
+
+    /**
+    * Updates the dense paint weights of the given geometry cache. Only the weights that changed since the last update are fetched.
+    *
+    * @param[in] data - Data block for this given node
+    * @param[in] geomIndex - Index of the geometry
+    * @param[in,out] cache - Cached data of the geometry. Its fingerprint vertex count needs to be up to date.
+    * @param[in] isWeightListDirty - Whether the paint weights were dirtied since the last update
+    */
+    void updatePaintWeights(MDataBlock& data, unsigned int geomIndex, GeometryCache& cache, bool isWeightListDirty);
+
+    /**
+    * Samples the displacement map at the vertices of the given geometry cache. Reads the mesh and the map through the Maya API, so it needs to be
+    * called from the evaluation thread. Area filtering of the samples is left running on a worker thread.
+    *
+    * @param[in] inputMesh - Input mesh of the geometry
+    * @param[in] uvSetName - UV set used to sample the map
+    * @param[in] proxyLevel - Proxy level to sample with (0 = Full quality)
+    * @param[in] filterResolution - Map table resolution of area sampling (0 = Point sampling)
+    * @param[in] seamSampling - Seam sampling mode
+    * @param[in] mapFilePath - Map file to look up in the warm-start cache first. Empty to always sample the map.
+    * @param[in,out] cache - Cached data of the geometry. Its texture data is updated here.
+    * @param[in] traceTag - Tag of the traced stage
+    * @param[out] filterTask - Area filtering of the samples, when it's still running. The map colors of the cache can't be used until it's done.
+    *
+    * @return MStatus indicating if operation was successful or not
+    */
+    MStatus updateTextureData(const MObject& inputMesh, const MString& uvSetName, unsigned int proxyLevel, unsigned int filterResolution,
+                              SeamSamplingMode seamSampling, const MString& mapFilePath, GeometryCache& cache, const TraceTag& traceTag,
+                              WorkerThreadPool::Task& filterTask);
+
+    /**
+    * Gets the vertex frames of the given geometry cache, reading them from the warm-start cache when possible.
+    * Reads the mesh through the Maya API, so it needs to be called from the evaluation thread.
+    *
+    * @param[in] inputMesh - Input mesh of the geometry
+    * @param[in] useWarmCache - Look up the frames in the warm-start cache first, and store them there when they are calculated
+    * @param[in,out] cache - Cached data of the geometry. Its frames are updated here.
+    * @param[in] traceTag - Tag of the traced stage
+    *
+    * @return MStatus indicating if operation was successful or not
+    */
+    MStatus updateVertexData(const MObject& inputMesh, bool useWarmCache, GeometryCache& cache, const TraceTag& traceTag);
+
+    /**
+    * Records a paint weight change so weight caches can be partially updated
+    *
+    * @param[in] plug - Dirtied plug. Either a single weight, the weights of a geometry, or the whole weight list.
+    */
+    void recordWeightChange(const MPlug& plug);
+
+    VectorDisplacementCacheFile bakedCache;
+    std::map<unsigned int, GeometryCache> geometryCaches; // Geometry index -> cached data (only used while evaluating)
+    EvaluationScratch scratch; // Temporaries shared by the evaluation of every geometry (only used while evaluating)
+
+    // Dirty state is written from the main thread while dirtying, which can overlap evaluation (e.g. cached playback background evaluation)
+
+    std::mutex dirtyStateMutex;
+    std::map<unsigned int, GeometryDirtyFlags> geometryDirtyFlags; // Geometry index -> data dirtied since the last evaluation
+    std::map<unsigned int, WeightChangeJournal> weightChangeJournals; // Geometry index -> recorded paint weight changes
+
+    // Backend costs are recorded by the CPU and GPU deformers, which can evaluate different geometries at the same time
+
+    std::mutex backendMutex;
+    std::map<unsigned int, BackendSelector> backendSelectors; // Geometry index -> measured backend costs
+    std::map<unsigned int, EvaluationBackend> requestedBackends; // Geometry index -> last active backend requested
+
+    uint32_t traceId = EvaluationTracer::newNodeId();
 };
\ No newline at end of file
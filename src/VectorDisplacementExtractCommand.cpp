@@ -0,0 +1,211 @@
+/* Copyright (C) 2020 - Jose Ivan Lopez Romo - All rights reserved
+ *
+ * This file is part of the MayaVectorDisplacementDeformer project found in the
+ * following repository: https://github.com/Zhibade/maya-vector-displacement-deformer
+ *
+ * Released under MIT license. Please see LICENSE file for details.
+ */
+
+#include "VectorDisplacementExtractCommand.h"
+#include "VectorDisplacementExtractor.h"
+#include "VectorDisplacementUtilities.h"
+
+#include <maya/MArgDatabase.h>
+#include <maya/MDagPath.h>
+#include <maya/MFloatVectorArray.h>
+#include <maya/MFnMesh.h>
+#include <maya/MImage.h>
+
+#include <algorithm>
+
+
+constexpr char* FILE_FLAG = "-f";
+constexpr char* FILE_FLAG_LONG = "-file";
+constexpr char* TARGET_FLAG = "-t";
+constexpr char* TARGET_FLAG_LONG = "-target";
+constexpr char* RESOLUTION_FLAG = "-r";
+constexpr char* RESOLUTION_FLAG_LONG = "-resolution";
+constexpr char* TANGENT_SPACE_FLAG = "-ts";
+constexpr char* TANGENT_SPACE_FLAG_LONG = "-tangentSpace";
+constexpr char* PADDING_FLAG = "-p";
+constexpr char* PADDING_FLAG_LONG = "-padding";
+constexpr char* UV_SET_FLAG = "-uv";
+constexpr char* UV_SET_FLAG_LONG = "-uvSet";
+constexpr char* SEARCH_DISTANCE_FLAG = "-sd";
+constexpr char* SEARCH_DISTANCE_FLAG_LONG = "-searchDistance";
+
+constexpr int DEFAULT_RESOLUTION = 4096;
+constexpr int MAX_RESOLUTION = 32768;
+constexpr int DEFAULT_PADDING = 4;
+
+
+MStatus VectorDisplacementExtractCommand::doIt(const MArgList& args)
+{
+    MStatus status;
+    MArgDatabase argData(syntax(), args, &status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    // Get output path, meshes and settings
+
+    if (!argData.isFlagSet(FILE_FLAG) || !argData.isFlagSet(TARGET_FLAG))
+    {
+        displayError("Please specify the output map path with the -file flag and the sculpted mesh with the -target flag.");
+        return MS::kInvalidParameter;
+    }
+
+    MString path;
+    argData.getFlagArgument(FILE_FLAG, 0, path);
+
+    MString targetName;
+    argData.getFlagArgument(TARGET_FLAG, 0, targetName);
+
+    MSelectionList baseSelection;
+    argData.getObjects(baseSelection);
+
+    MSelectionList targetSelection;
+    targetSelection.add(targetName);
+
+    MObject baseMesh;
+    MObject targetMesh;
+
+    if (getMesh(baseSelection, baseMesh) != MS::kSuccess || getMesh(targetSelection, targetMesh) != MS::kSuccess)
+    {
+        displayError("Please specify a base mesh and a target mesh.");
+        return MS::kInvalidParameter;
+    }
+
+    int resolution = DEFAULT_RESOLUTION;
+    int padding = DEFAULT_PADDING;
+    bool isTangentSpace = false;
+    double searchDistance = 0.0;
+    MString uvSetName;
+
+    argData.getFlagArgument(RESOLUTION_FLAG, 0, resolution);
+    argData.getFlagArgument(PADDING_FLAG, 0, padding);
+    argData.getFlagArgument(TANGENT_SPACE_FLAG, 0, isTangentSpace);
+    argData.getFlagArgument(SEARCH_DISTANCE_FLAG, 0, searchDistance);
+    argData.getFlagArgument(UV_SET_FLAG, 0, uvSetName);
+
+    if (resolution <= 0 || resolution > MAX_RESOLUTION)
+    {
+        displayError(MString("Resolution needs to be between 1 and ") + MAX_RESOLUTION + ".");
+        return MS::kInvalidParameter;
+    }
+
+    // Gather both meshes. Frames come from the same functions the deformer uses, so tangent-space maps round-trip exactly.
+
+    ExtractionInput input;
+    EvaluationScratch scratch;
+
+    status = VectorDisplacementUtilities::getMeshTriangles(baseMesh, uvSetName, input.basePositions, input.baseTriangleVertexIds, &input.baseTriangleUvs, scratch);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    status = VectorDisplacementUtilities::getMeshTriangles(targetMesh, uvSetName, input.targetPositions, input.targetTriangleVertexIds, nullptr, scratch);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    MFloatVectorArray& normals = scratch.normals;
+    MFloatVectorArray& tangents = scratch.tangents;
+    MFloatVectorArray& binormals = scratch.binormals;
+
+    if (isTangentSpace)
+    {
+        status = VectorDisplacementUtilities::getMeshVertexData(baseMesh, normals, tangents, binormals, scratch);
+        CHECK_MSTATUS_AND_RETURN_IT(status);
+    }
+    else
+    {
+        MFnMesh(baseMesh).getVertexNormals(false, normals);
+    }
+
+    auto toFloat3 = [](const MFloatVectorArray& vectors, std::vector<Float3>& values)
+    {
+        values.resize(vectors.length());
+
+        for (unsigned int i = 0; i < vectors.length(); i++)
+        {
+            values[i] = Float3(vectors[i].x, vectors[i].y, vectors[i].z);
+        }
+    };
+
+    toFloat3(normals, input.baseNormals);
+
+    if (isTangentSpace)
+    {
+        toFloat3(tangents, input.baseTangents);
+        toFloat3(binormals, input.baseBinormals);
+    }
+
+    if (searchDistance > 0.0)
+    {
+        input.searchDistance = static_cast<float>(searchDistance);
+    }
+
+    // Extract and write
+
+    std::vector<float> image;
+    VectorDisplacementExtractor::extract(input, static_cast<unsigned int>(resolution), static_cast<unsigned int>(resolution), static_cast<unsigned int>(std::max(padding, 0)), image);
+
+    status = writeImage(path, static_cast<unsigned int>(resolution), image);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    setResult(path);
+    return MS::kSuccess;
+}
+
+MStatus VectorDisplacementExtractCommand::getMesh(const MSelectionList& selection, MObject& mesh) const
+{
+    MDagPath path;
+
+    if (selection.length() != 1 || selection.getDagPath(0, path) != MS::kSuccess || path.extendToShape() != MS::kSuccess)
+    {
+        return MS::kInvalidParameter;
+    }
+
+    mesh = path.node();
+
+    return mesh.hasFn(MFn::kMesh) ? MS::kSuccess : MS::kInvalidParameter;
+}
+
+MStatus VectorDisplacementExtractCommand::writeImage(const MString& path, unsigned int resolution, const std::vector<float>& image) const
+{
+    // MImage pixels start at the bottom left, like the extracted rows
+
+    MImage outputImage;
+
+    MStatus status = outputImage.create(resolution, resolution, 4, MImage::kFloat);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    std::copy(image.begin(), image.end(), outputImage.floatPixels());
+
+    int extensionStart = path.rindex('.');
+    MString format = extensionStart > 0 ? path.substring(extensionStart + 1, path.length() - 1).toLowerCase() : MString("exr");
+
+    status = outputImage.writeToFile(path, format);
+    if (status != MS::kSuccess)
+    {
+        displayError("Could not write " + path + ". Please use a format that supports floating point pixels, like EXR.");
+    }
+
+    return status;
+}
+
+void* VectorDisplacementExtractCommand::creator()
+{
+    return new VectorDisplacementExtractCommand;
+}
+
+MSyntax VectorDisplacementExtractCommand::newSyntax()
+{
+    MSyntax syntax;
+    syntax.addFlag(FILE_FLAG, FILE_FLAG_LONG, MSyntax::kString);
+    syntax.addFlag(TARGET_FLAG, TARGET_FLAG_LONG, MSyntax::kString);
+    syntax.addFlag(RESOLUTION_FLAG, RESOLUTION_FLAG_LONG, MSyntax::kLong);
+    syntax.addFlag(TANGENT_SPACE_FLAG, TANGENT_SPACE_FLAG_LONG, MSyntax::kBoolean);
+    syntax.addFlag(PADDING_FLAG, PADDING_FLAG_LONG, MSyntax::kLong);
+    syntax.addFlag(UV_SET_FLAG, UV_SET_FLAG_LONG, MSyntax::kString);
+    syntax.addFlag(SEARCH_DISTANCE_FLAG, SEARCH_DISTANCE_FLAG_LONG, MSyntax::kDouble);
+    syntax.setObjectType(MSyntax::kSelectionList, 1, 1);
+    syntax.useSelectionAsDefault(true);
+
+    return syntax;
+}
\ No newline at end of file
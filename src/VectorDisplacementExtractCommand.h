@@ -0,0 +1,72 @@
+/* Copyright (C) 2020 - Jose Ivan Lopez Romo - All rights reserved
+ *
+ * This file is part of the MayaVectorDisplacementDeformer project found in the
+ * following repository: https://github.com/Zhibade/maya-vector-displacement-deformer
+ *
+ * Released under MIT license. Please see LICENSE file for details.
+ */
+
+#pragma once
+
+#include <maya/MArgList.h>
+#include <maya/MObject.h>
+#include <maya/MPxCommand.h>
+#include <maya/MSelectionList.h>
+#include <maya/MSyntax.h>
+
+#include <vector>
+
+
+/*
+ * Command that extracts a vector displacement map from a base mesh and a sculpted target, to be applied back to the base mesh by the deformer.
+ * Usage: vectorDisplacementExtract -target "sculpt" -file "path/to/map.exr" [-resolution 4096] [-tangentSpace true] [-padding 4] [-uvSet "map1"]
+ *                                  [-searchDistance 0] baseMesh;
+ */
+class VectorDisplacementExtractCommand : public MPxCommand
+{
+public:
+    VectorDisplacementExtractCommand() {};
+    ~VectorDisplacementExtractCommand() override {};
+
+    /**
+    * Extracts the map and writes it as a floating point image (format chosen by the file extension, EXR by default)
+    *
+    * @param[in] args - Command arguments
+    *
+    * @return MStatus indicating if operation was successful or not
+    */
+    MStatus doIt(const MArgList& args) override;
+
+    /** Extracting does not change the scene, so there is nothing to undo */
+    bool isUndoable() const override { return false; }
+
+    /** Creator function that returns a new instance of this command */
+    static void* creator();
+
+    /** Returns the syntax of this command */
+    static MSyntax newSyntax();
+
+    static constexpr char* COMMAND_NAME = "vectorDisplacementExtract";
+
+private:
+    /**
+    * Gets the mesh shape of the first item in a selection list. Transforms are resolved to their shape.
+    *
+    * @param[in] selection - Selection list
+    * @param[out] mesh - Mesh shape
+    *
+    * @return MStatus indicating if operation was successful or not
+    */
+    MStatus getMesh(const MSelectionList& selection, MObject& mesh) const;
+
+    /**
+    * Writes the extracted map
+    *
+    * @param[in] path - Output file path
+    * @param[in] resolution - Width and height of the map
+    * @param[in] image - 4 floats per texel, bottom row first
+    *
+    * @return MStatus indicating if operation was successful or not
+    */
+    MStatus writeImage(const MString& path, unsigned int resolution, const std::vector<float>& image) const;
+};
\ No newline at end of file
@@ -0,0 +1,223 @@
+/* Copyright (C) 2020 - Jose Ivan Lopez Romo - All rights reserved
+ *
+ * This file is part of the MayaVectorDisplacementDeformer project found in the
+ * following repository: https://github.com/Zhibade/maya-vector-displacement-deformer
+ *
+ * Released under MIT license. Please see LICENSE file for details.
+ */
+
+#include "VectorDisplacementExtractor.h"
+#include "TriangleBvh.h"
+
+#include <algorithm>
+#include <cmath>
+
+
+constexpr float BARYCENTRIC_EPSILON = 1e-5f; // Texel centres this close outside a triangle still belong to it (no gaps along shared UV edges)
+constexpr float MIN_FRAME_DETERMINANT = 1e-8f; // Below this the tangent frame is degenerate and offsets are projected instead
+
+
+void VectorDisplacementExtractor::extract(const ExtractionInput& input, unsigned int width, unsigned int height, unsigned int padding, std::vector<float>& image)
+{
+    size_t texelCount = static_cast<size_t>(width) * height;
+
+    image.assign(texelCount * 4, 0.f);
+    std::vector<char> coverage(texelCount, false);
+
+    // Target correspondences: same barycentric point when sculpted from the base, closest surface point otherwise
+
+    bool isSameTopology = hasSameTopology(input);
+    TriangleBvh targetBvh;
+
+    if (!isSameTopology)
+    {
+        targetBvh.build(input.targetPositions, input.targetTriangleVertexIds);
+
+        if (targetBvh.isEmpty())
+        {
+            return;
+        }
+    }
+
+    bool isTangentSpace = !input.baseTangents.empty();
+    bool hasNormals = !input.baseNormals.empty();
+    unsigned int triangleCount = static_cast<unsigned int>(input.baseTriangleVertexIds.size() / 3);
+
+    // Rasterize the base triangles in UV space. Each thread owns a band of rows, so overlapping triangles are resolved in the same order on every run.
+
+    VectorDisplacementMath::parallelFor(height, 0, [&](size_t rowBegin, size_t rowEnd)
+    {
+        unsigned int hintTriangle = TriangleBvh::INVALID_TRIANGLE; // Neighbouring texels usually land on the same target triangle
+
+        for (unsigned int triangle = 0; triangle < triangleCount; triangle++)
+        {
+            const float* uvs = &input.baseTriangleUvs[static_cast<size_t>(triangle) * 6];
+
+            // Corners in texel space, where texel (x, y) is centred on (x, y)
+
+            float px[3];
+            float py[3];
+
+            for (unsigned int i = 0; i < 3; i++)
+            {
+                px[i] = uvs[i * 2] * width - 0.5f;
+                py[i] = uvs[i * 2 + 1] * height - 0.5f;
+            }
+
+            float area = (px[1] - px[0]) * (py[2] - py[0]) - (py[1] - py[0]) * (px[2] - px[0]);
+
+            if (!std::isfinite(area) || std::abs(area) < 1e-12f)
+            {
+                continue; // No UVs, or collapsed in UV space
+            }
+
+            float minY = std::max(std::ceil(std::min({ py[0], py[1], py[2] })), static_cast<float>(rowBegin));
+            float maxY = std::min(std::floor(std::max({ py[0], py[1], py[2] })), static_cast<float>(rowEnd) - 1.f);
+            float minX = std::max(std::ceil(std::min({ px[0], px[1], px[2] })), 0.f);
+            float maxX = std::min(std::floor(std::max({ px[0], px[1], px[2] })), static_cast<float>(width) - 1.f);
+
+            if (minY > maxY || minX > maxX)
+            {
+                continue;
+            }
+
+            const unsigned int* vertexIds = &input.baseTriangleVertexIds[static_cast<size_t>(triangle) * 3];
+            float inverseArea = 1.f / area;
+
+            for (unsigned int y = static_cast<unsigned int>(minY); y <= static_cast<unsigned int>(maxY); y++)
+            {
+                for (unsigned int x = static_cast<unsigned int>(minX); x <= static_cast<unsigned int>(maxX); x++)
+                {
+                    float weight0 = ((px[2] - px[1]) * (y - py[1]) - (py[2] - py[1]) * (x - px[1])) * inverseArea;
+                    float weight1 = ((px[0] - px[2]) * (y - py[2]) - (py[0] - py[2]) * (x - px[2])) * inverseArea;
+                    float weight2 = 1.f - weight0 - weight1;
+
+                    if (weight0 < -BARYCENTRIC_EPSILON || weight1 < -BARYCENTRIC_EPSILON || weight2 < -BARYCENTRIC_EPSILON)
+                    {
+                        continue;
+                    }
+
+                    auto interpolate = [&](const std::vector<Float3>& values)
+                    {
+                        return values[vertexIds[0]] * weight0 + values[vertexIds[1]] * weight1 + values[vertexIds[2]] * weight2;
+                    };
+
+                    Float3 basePoint = interpolate(input.basePositions);
+                    Float3 targetPoint;
+
+                    if (isSameTopology)
+                    {
+                        targetPoint = interpolate(input.targetPositions);
+                    }
+                    else if (!(hasNormals && targetBvh.findNearestHit(basePoint, interpolate(input.baseNormals), input.searchDistance, hintTriangle, targetPoint)) &&
+                             !targetBvh.findClosestPoint(basePoint, hintTriangle, targetPoint))
+                    {
+                        continue;
+                    }
+
+                    Float3 offset = targetPoint - basePoint;
+                    Float3 sample = isTangentSpace ?
+                        getTangentSpaceSample(offset, interpolate(input.baseNormals), interpolate(input.baseTangents), interpolate(input.baseBinormals)) : offset;
+
+                    size_t texel = static_cast<size_t>(y) * width + x;
+                    float* pixel = &image[texel * 4];
+
+                    pixel[0] = sample.x;
+                    pixel[1] = sample.y;
+                    pixel[2] = sample.z;
+                    pixel[3] = 1.f;
+                    coverage[texel] = true;
+                }
+            }
+        }
+    }, 1);
+
+    dilate(width, height, padding, image, coverage);
+}
+
+bool VectorDisplacementExtractor::hasSameTopology(const ExtractionInput& input)
+{
+    return input.basePositions.size() == input.targetPositions.size() && input.baseTriangleVertexIds == input.targetTriangleVertexIds;
+}
+
+Float3 VectorDisplacementExtractor::getTangentSpaceSample(const Float3& offset, const Float3& normal, const Float3& tangent, const Float3& binormal)
+{
+    // Solve tangent * r + normal * g + binormal * b = offset (Cramer's rule). Averaged frames are not orthogonal, so a plain projection wouldn't round-trip.
+
+    Float3 normalCrossBinormal = normal.cross(binormal);
+    float determinant = tangent.dot(normalCrossBinormal);
+
+    if (std::abs(determinant) < MIN_FRAME_DETERMINANT)
+    {
+        return Float3(offset.dot(tangent), offset.dot(normal), offset.dot(binormal));
+    }
+
+    return Float3(offset.dot(normalCrossBinormal) / determinant,
+                  tangent.dot(offset.cross(binormal)) / determinant,
+                  tangent.dot(normal.cross(offset)) / determinant);
+}
+
+void VectorDisplacementExtractor::dilate(unsigned int width, unsigned int height, unsigned int padding, std::vector<float>& image, std::vector<char>& coverage)
+{
+    std::vector<char> nextCoverage;
+
+    for (unsigned int pass = 0; pass < padding; pass++)
+    {
+        nextCoverage = coverage;
+
+        // Only empty texels are written and only covered ones are read, so rows can be processed in parallel
+
+        VectorDisplacementMath::parallelFor(height, 0, [&](size_t rowBegin, size_t rowEnd)
+        {
+            for (size_t y = rowBegin; y < rowEnd; y++)
+            {
+                for (size_t x = 0; x < width; x++)
+                {
+                    size_t texel = y * width + x;
+
+                    if (coverage[texel])
+                    {
+                        continue;
+                    }
+
+                    Float3 sum;
+                    unsigned int neighbourCount = 0;
+
+                    for (int dy = -1; dy <= 1; dy++)
+                    {
+                        for (int dx = -1; dx <= 1; dx++)
+                        {
+                            long long neighbourX = static_cast<long long>(x) + dx;
+                            long long neighbourY = static_cast<long long>(y) + dy;
+
+                            if (neighbourX < 0 || neighbourY < 0 || neighbourX >= width || neighbourY >= height)
+                            {
+                                continue;
+                            }
+
+                            size_t neighbour = static_cast<size_t>(neighbourY) * width + static_cast<size_t>(neighbourX);
+
+                            if (coverage[neighbour])
+                            {
+                                sum += Float3(image[neighbour * 4], image[neighbour * 4 + 1], image[neighbour * 4 + 2]);
+                                neighbourCount++;
+                            }
+                        }
+                    }
+
+                    if (neighbourCount > 0)
+                    {
+                        Float3 average = sum / static_cast<float>(neighbourCount);
+
+                        image[texel * 4] = average.x;
+                        image[texel * 4 + 1] = average.y;
+                        image[texel * 4 + 2] = average.z;
+                        nextCoverage[texel] = true;
+                    }
+                }
+            }
+        }, 64);
+
+        coverage.swap(nextCoverage);
+    }
+}
\ No newline at end of file
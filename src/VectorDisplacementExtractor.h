@@ -0,0 +1,87 @@
+/* Copyright (C) 2020 - Jose Ivan Lopez Romo - All rights reserved
+ *
+ * This file is part of the MayaVectorDisplacementDeformer project found in the
+ * following repository: https://github.com/Zhibade/maya-vector-displacement-deformer
+ *
+ * Released under MIT license. Please see LICENSE file for details.
+ */
+
+#pragma once
+
+#include "VectorDisplacementMath.h"
+
+#include <cfloat>
+#include <vector>
+
+
+/* Base mesh and sculpted target of a vector displacement map extraction */
+struct ExtractionInput
+{
+    std::vector<Float3> basePositions;
+    std::vector<unsigned int> baseTriangleVertexIds; // 3 vertex indices per triangle
+    std::vector<float> baseTriangleUvs; // 6 values per triangle (U and V of each corner). Triangles without UVs are skipped.
+    std::vector<Float3> baseNormals; // Vertex normals, used to find target points along the surface normal
+    std::vector<Float3> baseTangents; // Vertex tangents and binormals, only needed for tangent-space maps. Empty = Object-space map.
+    std::vector<Float3> baseBinormals;
+
+    std::vector<Float3> targetPositions;
+    std::vector<unsigned int> targetTriangleVertexIds; // 3 vertex indices per triangle
+
+    float searchDistance = FLT_MAX; // Maximum distance along the normal between the base and target surfaces
+};
+
+
+/*
+ * Extracts a vector displacement map from a base mesh and a sculpted target. Has no Maya dependency.
+ * The base mesh is rasterized in UV space, and each texel stores the offset from the base surface to its corresponding target point,
+ * in the same convention the deformer applies (see VectorDisplacementMath), so the map displaces the base mesh back into the target.
+ */
+class VectorDisplacementExtractor final
+{
+public:
+    /**
+    * Extracts the map. When the target has the same topology as the base mesh (e.g. sculpted from it), each texel corresponds to the
+    * same barycentric point on the target. Otherwise it corresponds to the nearest target point along the base normal (or the closest
+    * target point if the normal misses the target), found through a BVH of the target triangles.
+    *
+    * @param[in] input - Base and target meshes
+    * @param[in] width - Map width in texels
+    * @param[in] height - Map height in texels
+    * @param[in] padding - Texels the UV islands are extended by, so bilinear sampling along UV borders doesn't blend in empty texels
+    * @param[out] image - 4 floats per texel (offset as RGB, alpha 1 inside the UV islands). Bottom row (V = 0) first.
+    */
+    static void extract(const ExtractionInput& input, unsigned int width, unsigned int height, unsigned int padding, std::vector<float>& image);
+
+    /**
+    * Checks whether the target mesh has the same vertices and triangles as the base mesh
+    *
+    * @param[in] input - Base and target meshes
+    *
+    * @return True if texels can be mapped to the target through the base triangles
+    */
+    static bool hasSameTopology(const ExtractionInput& input);
+
+private:
+    /**
+    * Gets the tangent-space map sample that displaces by the given offset. Inverse of VectorDisplacementMath::getTangentSpaceOffset.
+    *
+    * @param[in] offset - Object-space offset
+    * @param[in] normal - Interpolated vertex normal
+    * @param[in] tangent - Interpolated vertex tangent
+    * @param[in] binormal - Interpolated vertex binormal
+    *
+    * @return Map sample (R along the tangent, G along the normal and B along the binormal)
+    */
+    static Float3 getTangentSpaceSample(const Float3& offset, const Float3& normal, const Float3& tangent, const Float3& binormal);
+
+    /**
+    * Extends the covered texels into the empty ones around them, one texel per pass
+    *
+    * @param[in] width - Map width in texels
+    * @param[in] height - Map height in texels
+    * @param[in] padding - Number of passes
+    * @param[in,out] image - 4 floats per texel. Padded texels keep an alpha of 0.
+    * @param[in,out] coverage - Whether each texel has a value
+    */
+    static void dilate(unsigned int width, unsigned int height, unsigned int padding, std::vector<float>& image, std::vector<char>& coverage);
+};
\ No newline at end of file
@@ -8,18 +8,33 @@
 
 #include "VectorDisplacementGpuDeformerNode.h"
 #include "VectorDisplacementDeformerNode.h"
+#include "VectorDisplacementMath.h"
 #include "VectorDisplacementUtilities.h"
+#include "VectorDisplacementWarmCache.h"
 #include "GpuDeformerUtilities.h"
+#include "GpuKernelAutotuner.h"
 
 #include <clew/clew_cl.h>
 #include <maya/MFloatArray.h>
 #include <maya/MFloatVectorArray.h>
+#include <maya/MFnDependencyNode.h>
 #include <maya/MVectorArray.h>
 
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
 
 constexpr char* KERNEL_FILE_NAME = "VectorDisplacementDeformer.cl";
-constexpr char* KERNEL_OBJECT_SPACE_NAME = "ObjectSpaceDisplacement";
-constexpr char* KERNEL_TANGENT_SPACE_NAME = "TangentSpaceDisplacement";
+constexpr char* TANGENT_SPACE_OFFSETS_KERNEL_NAME = "TangentSpaceOffsets";
+constexpr char* RELAX_OFFSETS_KERNEL_NAME = "RelaxOffsets";
+constexpr char* AREA_FILTERED_SAMPLES_KERNEL_NAME = "AreaFilteredSamples";
+
+constexpr unsigned int WEIGHT_RANGE_MAX_GAP = 1024; // Unchanged weights between two changed ones that are still copied in the same write
+constexpr unsigned int WEIGHT_RANGE_MAX_COUNT = 16; // Maximum number of writes per weight update
+
+constexpr unsigned int TILE_RING_SIZE = 3; // Tile slots in flight: one being read by a kernel while the next ones are uploaded
+constexpr double AUTO_GPU_MEMORY_BUDGET_FRACTION = 0.25; // Device memory used for auxiliary data when no budget is set
 
 
 MString VectorDisplacementGpuDeformerNode::kernelPath;
@@ -40,60 +55,196 @@ void VectorDisplacementGpuDeformerNode::terminate()
     binormalData.reset();
     paintWeightData.reset();
 
-    MOpenCLInfo::releaseOpenCLKernel(kernelObjectSpace);
-    kernelObjectSpace.reset();
+    hasMeshFingerprint = false;
+    isTextureWarmStartPending = true;
+    isFrameWarmStartPending = true;
+    vertexUvs.clear();
+    samplingOrder = UvSamplingOrder();
+    scratch = EvaluationScratch();
+    proxySampling = ProxySampling();
+    paintWeights.clear();
+    paintWeightsVersion = 0;
+    arePaintWeightsZero = false;
+    arePaintWeightsUniform = true;
+    uniformPaintWeight = 1.f;
+
+    {
+        std::unique_lock<std::mutex> bakedCacheLock = bakedCache.lockMapping();
+        bakedCache.close();
+    }
+
+    isUsingBakedCache = false;
+
+    isRelaxing = false;
+    areRelaxedOffsetsStale = true;
+    adjacency = VertexAdjacency();
+    adjacencyOffsetData.reset();
+    adjacencyIndexData.reset();
+    relaxOffsetData[0].reset();
+    relaxOffsetData[1].reset();
+    std::vector<float>().swap(hostRelaxedOffsets);
+
+    textureFilterResolution = 0;
+    mapTable = SummedAreaTable();
+    uvFootprints.clear();
+    mapTableData.reset();
+    uvFootprintData.reset();
+    samplingOrderData.reset();
+
+    textureSeamSampling = SeamSamplingMode::FIRST_ISLAND;
+    seamSamples = SeamUvSamples();
+
+    releaseTileData();
+    isTiled = false;
+
+    if (uploadQueue)
+    {
+        clReleaseCommandQueue(uploadQueue);
+        uploadQueue = nullptr;
+    }
+
+    for (MAutoCLKernel& kernel : kernelObjectSpaceTiled)
+    {
+        MOpenCLInfo::releaseOpenCLKernel(kernel);
+        kernel.reset();
+    }
+
+    for (MAutoCLKernel& kernel : kernelTangentSpaceTiled)
+    {
+        MOpenCLInfo::releaseOpenCLKernel(kernel);
+        kernel.reset();
+    }
+
+    MOpenCLInfo::releaseOpenCLKernel(kernelTangentSpaceOffsets);
+    kernelTangentSpaceOffsets.reset();
+
+    MOpenCLInfo::releaseOpenCLKernel(kernelRelaxOffsets);
+    kernelRelaxOffsets.reset();
 
-    MOpenCLInfo::releaseOpenCLKernel(kernelTangentSpace);
-    kernelTangentSpace.reset();
+    MOpenCLInfo::releaseOpenCLKernel(kernelAreaFilteredSamples);
+    kernelAreaFilteredSamples.reset();
+
+    releaseDisplacementKernels();
 }
 
 MPxGPUDeformer::DeformerStatus VectorDisplacementGpuDeformerNode::evaluate(MDataBlock& block, const MEvaluationNode& evaluationNode, const MPlug& outputPlug, const MGPUDeformerData& inputData, MGPUDeformerData& outputData)
+{
+    BackendMode backendMode = static_cast<BackendMode>(block.inputValue(VectorDisplacementDeformerNode::backendAttribute).asInt());
+    VectorDisplacementDeformerNode* deformerNode = static_cast<VectorDisplacementDeformerNode*>(MFnDependencyNode(outputPlug.node()).userNode());
+
+    // Spans only cover the time spent on the host. Kernels run asynchronously after being enqueued.
+
+    traceTag = deformerNode ? deformerNode->getTraceTag(block, outputPlug.logicalIndex()) : TraceTag();
+    EvaluationTracer::Scope traceScope("evaluate", traceTag);
+
+    if (backendMode != BackendMode::AUTO || !deformerNode)
+    {
+        return evaluateDeformer(block, evaluationNode, outputPlug, inputData, outputData);
+    }
+
+    // Auto backend: measure the evaluation so it can be compared with the CPU deformer
+
+    auto startTime = std::chrono::steady_clock::now();
+    MPxGPUDeformer::DeformerStatus status = evaluateDeformer(block, evaluationNode, outputPlug, inputData, outputData);
+
+    uint64_t settingsHash = VectorDisplacementDeformerNode::getBackendSettingsHash(block, outputPlug.node());
+
+    if (status != MPxGPUDeformer::kDeformerSuccess || settingsHash == 0)
+    {
+        return status;
+    }
+
+    unsigned int geomIndex = outputPlug.logicalIndex();
+    unsigned int vertexCount = inputData.getBuffer(MPxGPUDeformer::sPositionsName()).elementCount();
+
+    // While measuring, wait for the kernels so samples include the device time and not just the time to enqueue them. Once measured,
+    // the time to enqueue says little about the cost of the kernels, so the GPU keeps its measured cost until the vertex count or
+    // the settings change (which starts the measurements over).
+
+    if (!deformerNode->isMeasuringBackend(geomIndex, EvaluationBackend::GPU, vertexCount, settingsHash))
+    {
+        return status;
+    }
+
+    cl_event finishedEvent = outputData.getBuffer(MPxGPUDeformer::sPositionsName()).bufferReadyEvent().get();
+
+    if (finishedEvent)
+    {
+        clWaitForEvents(1, &finishedEvent);
+    }
+
+    std::chrono::duration<double, std::milli> elapsedTime = std::chrono::steady_clock::now() - startTime;
+    deformerNode->recordBackendCost(geomIndex, EvaluationBackend::GPU, vertexCount, settingsHash, elapsedTime.count());
+
+    return status;
+}
+
+MPxGPUDeformer::DeformerStatus VectorDisplacementGpuDeformerNode::evaluateDeformer(MDataBlock& block, const MEvaluationNode& evaluationNode, const MPlug& outputPlug, const MGPUDeformerData& inputData, MGPUDeformerData& outputData)
 {
     const MGPUDeformerBuffer inputPositions = inputData.getBuffer(MPxGPUDeformer::sPositionsName());
-    MGPUDeformerBuffer outputPositions = createOutputBuffer(inputPositions);
 
     // Return early if buffers are not valid
 
-    if (!inputPositions.isValid() || !outputPositions.isValid())
+    if (!inputPositions.isValid())
     {
         return MPxGPUDeformer::kDeformerFailure;
     }
 
-    unsigned int numOfElements = inputPositions.elementCount();
+    // Forward the input buffer when displacement can't have any effect. Dirty plugs of skipped evaluations are lost,
+    // so every buffer is refreshed once the deformer has an effect again.
 
-    // Prepare and copy data to GPU
+    float envelopeVal = block.inputValue(MPxDeformerNode::envelope).asFloat();
+    float strengthVal = block.inputValue(VectorDisplacementDeformerNode::strengthAttribute).asFloat();
+    bool useBakedCache = block.inputValue(VectorDisplacementDeformerNode::useBakedCacheAttribute).asBool();
 
-    prepareAndCopyDataToGpu(block, evaluationNode, outputPlug, numOfElements);
+    if (envelopeVal == 0.f ||
+        (!useBakedCache && (strengthVal == 0.f || !VectorDisplacementUtilities::isTextureConnected(outputPlug.node(), VectorDisplacementDeformerNode::DISPLACEMENT_MAP_ATTRIBUTE))))
+    {
+        areBuffersStale = true;
+        return MPxGPUDeformer::kDeformerPassThrough;
+    }
 
-    // Setup kernel (based on displacement map type)
+    unsigned int numOfElements = inputPositions.elementCount();
 
-    VectorDisplacementMapType mapType = static_cast<VectorDisplacementMapType>(
-        block.inputValue(VectorDisplacementDeformerNode::displacementMapTypeAttribute).asInt());
+    // Keeps the baked cache file mapped while its offsets are uploaded
 
-    MAutoCLKernel& currentKernel = mapType == VectorDisplacementMapType::OBJECT_SPACE ? kernelObjectSpace : kernelTangentSpace;
+    std::unique_lock<std::mutex> bakedCacheLock = bakedCache.lockMapping();
 
-    if (!currentKernel.get())
+    // Prepare and copy data to GPU. Nothing to displace if the data couldn't be prepared (e.g. invalid texture) or every paint weight is 0.
+
+    EvaluationTracer::Scope stage("prepareData", traceTag);
+    MStatus prepareDataStatus = prepareAndCopyDataToGpu(block, evaluationNode, outputPlug, numOfElements);
+
+    if (prepareDataStatus != MS::kSuccess)
     {
-        MStatus initKernelStatus = initKernel(mapType);
-        if (initKernelStatus != MS::kSuccess)
-        {
-            return MPxGPUDeformer::kDeformerFailure;
-        }
+        areBuffersStale = true;
+        return MPxGPUDeformer::kDeformerPassThrough;
     }
 
-    // Calculate work size
+    if (!isUsingBakedCache && arePaintWeightsZero)
+    {
+        return MPxGPUDeformer::kDeformerPassThrough;
+    }
 
-    MStatus workSizeStatus = GpuDeformerUtilities::calculateWorkSize(numOfElements, currentKernel, localWorkSize, globalWorkSize);
-    if (workSizeStatus != MS::kSuccess)
+    MGPUDeformerBuffer outputPositions = createOutputBuffer(inputPositions);
+    if (!outputPositions.isValid())
     {
         return MPxGPUDeformer::kDeformerFailure;
     }
 
-    // Set parameters on the kernel (always need to be set since they can change per frame)
+    // Setup kernel (based on displacement map type). Baked offsets are always applied as object-space displacement.
 
-    float envelopeVal = block.inputValue(MPxDeformerNode::envelope).asFloat();
-    float strengthVal = block.inputValue(VectorDisplacementDeformerNode::strengthAttribute).asFloat();
-    float finalStrength = envelopeVal * strengthVal;
+    VectorDisplacementMapType mapType = static_cast<VectorDisplacementMapType>(
+        block.inputValue(VectorDisplacementDeformerNode::displacementMapTypeAttribute).asInt());
+
+    if (isUsingBakedCache)
+    {
+        mapType = VectorDisplacementMapType::OBJECT_SPACE;
+    }
+
+    // Gather kernel data (always needs to be set since it can change per frame)
+
+    float finalStrength = isUsingBakedCache ? envelopeVal : envelopeVal * strengthVal; // Strength is already baked in the cache
 
     MAutoCLMem inputPosData = inputPositions.buffer();
     MAutoCLMem outputPosData = outputPositions.buffer();
@@ -109,6 +260,92 @@ MPxGPUDeformer::DeformerStatus VectorDisplacementGpuDeformerNode::evaluate(MData
     data.numOfElements = numOfElements;
     data.strength = finalStrength;
 
+    // Uniform paint weights (always the case with baked offsets) are folded into the strength, so the kernel variant doesn't read them
+
+    bool areWeightsUniform = isUsingBakedCache || arePaintWeightsUniform;
+    float uniformWeight = isUsingBakedCache ? 1.f : uniformPaintWeight;
+    WeightMode weightMode = VectorDisplacementUtilities::getWeightMode(areWeightsUniform, uniformWeight, finalStrength);
+
+    if (areWeightsUniform)
+    {
+        data.strength = uniformWeight * finalStrength;
+    }
+
+    // Relaxed offsets replace the texture data. Baked offsets already include the relax pass.
+
+    RelaxSettings currentRelaxSettings = VectorDisplacementDeformerNode::getRelaxSettings(block);
+    currentRelaxSettings.mapType = mapType;
+    isRelaxing = !isUsingBakedCache && currentRelaxSettings.iterations > 0;
+
+    if (isRelaxing)
+    {
+        stage.next("relax");
+
+        if (prepareRelaxedOffsets(block, outputPlug, currentRelaxSettings, numOfElements) != MS::kSuccess)
+        {
+            return MPxGPUDeformer::kDeformerFailure;
+        }
+
+        data.textureData = &relaxOffsetData[relaxResultIndex];
+        mapType = VectorDisplacementMapType::OBJECT_SPACE;
+    }
+
+    stage.next("enqueueKernels");
+
+    if (isTiled)
+    {
+        MAutoCLEvent tilesFinishedEvent;
+        MStatus tilesStatus = enqueueTiles(data, mapType, weightMode, inputPositions.bufferReadyEvent(), tilesFinishedEvent);
+
+        outputPositions.setBufferReadyEvent(tilesFinishedEvent);
+
+        if (isUsingBakedCache && uploadQueue)
+        {
+            clFinish(uploadQueue); // Tiles are uploaded straight from the mapped cache file, which can be closed once the lock is released
+        }
+
+        if (tilesStatus != MS::kSuccess)
+        {
+            return MPxGPUDeformer::kDeformerFailure;
+        }
+
+        outputData.setBuffer(outputPositions);
+        return MPxGPUDeformer::kDeformerSuccess;
+    }
+
+    // Launch configurations are tuned per vertex count bucket
+
+    unsigned int sizeBucket = GpuKernelAutotuner::getSizeBucket(numOfElements);
+
+    if (sizeBucket != kernelSizeBucket)
+    {
+        releaseDisplacementKernels();
+        kernelSizeBucket = sizeBucket;
+    }
+
+    unsigned int weightModeIndex = static_cast<unsigned int>(weightMode);
+    MAutoCLKernel& currentKernel = mapType == VectorDisplacementMapType::OBJECT_SPACE ? kernelObjectSpace[weightModeIndex] : kernelTangentSpace[weightModeIndex];
+    const KernelLaunchConfig& currentConfig = mapType == VectorDisplacementMapType::OBJECT_SPACE ? objectSpaceLaunchConfig : tangentSpaceLaunchConfig;
+
+    if (!currentKernel.get())
+    {
+        MStatus initKernelStatus = initKernel(mapType, weightMode, data);
+        if (initKernelStatus != MS::kSuccess)
+        {
+            return MPxGPUDeformer::kDeformerFailure;
+        }
+    }
+
+    // Calculate work size
+
+    MStatus workSizeStatus = GpuDeformerUtilities::calculateWorkSize(numOfElements, currentKernel, currentConfig, localWorkSize, globalWorkSize);
+    if (workSizeStatus != MS::kSuccess)
+    {
+        return MPxGPUDeformer::kDeformerFailure;
+    }
+
+    // Set parameters on the kernel
+
     MStatus sendParametersStatus = GpuDeformerUtilities::sendParametersToKernel(data, mapType, currentKernel);
     if (sendParametersStatus != MS::kSuccess)
     {
@@ -155,200 +392,1197 @@ MObject VectorDisplacementGpuDeformerNode::getInputGeom(MDataBlock& data, unsign
     return inputHandle.inputValue().child(MPxDeformerNode::inputGeom).asMesh();
 }
 
-MStatus VectorDisplacementGpuDeformerNode::getPaintWeights(MDataBlock& data, unsigned int geomIndex, unsigned int numOfElements, MFloatArray& paintWeights) const
+MStatus VectorDisplacementGpuDeformerNode::initKernel(VectorDisplacementMapType mapType, WeightMode weightMode, const GpuKernelData& data)
 {
-    paintWeights = MFloatArray(numOfElements, 1.f);
+    MString kernelFile = kernelPath + "/" + KERNEL_FILE_NAME;
 
-    MStatus operationStatus; // Paint weights might not be able to be fetched when no painting has been done. Can't assume that the data will be available.
+    // Use the fastest launch configuration for this device and vertex count. Tuning only runs the first time the device is used with large meshes of this size,
+    // and falls back to the default kernel if it fails.
 
-    MArrayDataHandle weightDataHandleArray = data.outputArrayValue(MPxDeformerNode::weightList, &operationStatus);
-    CHECK_MSTATUS_AND_RETURN_IT(operationStatus);
+    KernelLaunchConfig config;
 
-    operationStatus = weightDataHandleArray.jumpToElement(geomIndex);
-    CHECK_MSTATUS_AND_RETURN_IT(operationStatus);
+    if (!GpuKernelAutotuner::getStoredConfig(mapType, data.numOfElements, config) &&
+        GpuKernelAutotuner::tune(kernelFile, mapType, data, config) != MS::kSuccess)
+    {
+        config = KernelLaunchConfig();
+    }
 
-    MDataHandle weightDataHandle = weightDataHandleArray.inputValue(&operationStatus);
-    CHECK_MSTATUS_AND_RETURN_IT(operationStatus);
+    // Compile kernel. Every weight mode variant shares the launch configuration tuned for the map type.
 
-    MArrayDataHandle weightData = weightDataHandle.child(MPxDeformerNode::weights);
+    MAutoCLKernel clKernel = GpuDeformerUtilities::getDisplacementKernel(kernelFile, GpuDeformerUtilities::getKernelName(mapType, config), weightMode);
+    if (clKernel.isNull())
+    {
+        return MS::kFailure;
+    }
 
-    unsigned int count = weightData.elementCount(&operationStatus);
-    CHECK_MSTATUS_AND_RETURN_IT(operationStatus);
+    unsigned int weightModeIndex = static_cast<unsigned int>(weightMode);
 
-    for (unsigned int i = 0; i < count; i++)
+    if (mapType == VectorDisplacementMapType::OBJECT_SPACE)
     {
-        unsigned int index = weightData.elementIndex();
-        MDataHandle data = weightData.inputValue();
+        kernelObjectSpace[weightModeIndex] = clKernel;
+        objectSpaceLaunchConfig = config;
+    }
+    else
+    {
+        kernelTangentSpace[weightModeIndex] = clKernel;
+        tangentSpaceLaunchConfig = config;
+    }
 
-        paintWeights[index] = data.asFloat();
+    return MS::kSuccess;
+}
 
-        weightData.next();
+void VectorDisplacementGpuDeformerNode::releaseDisplacementKernels()
+{
+    for (MAutoCLKernel& kernel : kernelObjectSpace)
+    {
+        MOpenCLInfo::releaseOpenCLKernel(kernel);
+        kernel.reset();
     }
 
-    return MS::kSuccess;
+    for (MAutoCLKernel& kernel : kernelTangentSpace)
+    {
+        MOpenCLInfo::releaseOpenCLKernel(kernel);
+        kernel.reset();
+    }
 }
 
-MStatus VectorDisplacementGpuDeformerNode::initKernel(VectorDisplacementMapType mapType)
+MStatus VectorDisplacementGpuDeformerNode::prepareAndCopyDataToGpu(MDataBlock& data, const MEvaluationNode& evaluationNode, const MPlug& plug, unsigned int numOfElements)
 {
-    // Compile kernel
+    // Classify input geometry changes. Texture samples are only invalidated by UV or topology changes, frames by any change.
 
-    MString kernelFile = kernelPath + "/" + KERNEL_FILE_NAME;
-    MString kernelFunction = mapType == VectorDisplacementMapType::OBJECT_SPACE ? KERNEL_OBJECT_SPACE_NAME : KERNEL_TANGENT_SPACE_NAME;
+    // Buffers that went stale while passing through are refreshed as if everything was dirty
 
-    MAutoCLKernel clKernel = MOpenCLInfo::getOpenCLKernel(kernelFile, kernelFunction);
-    if (clKernel.isNull())
+    EvaluationTracer::Scope stage("fingerprint", traceTag);
+    bool wereBuffersStale = areBuffersStale;
+    areBuffersStale = false;
+
+    // Auxiliary data that doesn't fit in the memory budget is kept on the host and streamed in tiles.
+    // Switching modes refreshes everything, since the data is stored in different places.
+
+    unsigned int newTileSize = getTileSize(data, numOfElements);
+    bool shouldTile = newTileSize > 0;
+
+    if (shouldTile != isTiled)
     {
-        return MS::kFailure;
+        if (shouldTile)
+        {
+            textureData.reset();
+            normalData.reset();
+            tangentData.reset();
+            binormalData.reset();
+            paintWeightData.reset();
+            relaxOffsetData[0].reset();
+            relaxOffsetData[1].reset();
+            mapTableData.reset();
+            uvFootprintData.reset();
+            samplingOrderData.reset();
+        }
+        else
+        {
+            releaseTileData();
+        }
+
+        isTiled = shouldTile;
+        wereBuffersStale = true;
     }
 
-    if (mapType == VectorDisplacementMapType::OBJECT_SPACE)
+    tileSize = newTileSize;
+
+    if (isTiled && uploadQueue)
     {
-        kernelObjectSpace = clKernel;
+        clFinish(uploadQueue); // Uploads of the previous evaluation may still be reading the host data
     }
-    else
+
+    MeshChangeType meshChange = MeshChangeType::NONE;
+    MString uvSetName = data.inputValue(VectorDisplacementDeformerNode::uvSetAttribute).asString();
+
+    if (!hasMeshFingerprint || wereBuffersStale || evaluationNode.dirtyPlugExists(MPxDeformerNode::inputGeom) || meshFingerprint.uvSetName != uvSetName)
     {
-        kernelTangentSpace = clKernel;
+        meshChange = VectorDisplacementUtilities::updateMeshFingerprint(getInputGeom(data, plug.logicalIndex()), uvSetName, meshFingerprint, scratch);
+        hasMeshFingerprint = true;
     }
 
-    return MS::kSuccess;
-}
+    if (meshChange >= MeshChangeType::UVS)
+    {
+        vertexUvs.clear();
+        uvFootprints.clear();
+        seamSamples = SeamUvSamples();
+    }
 
-MStatus VectorDisplacementGpuDeformerNode::prepareAndCopyDataToGpu(MDataBlock& data, const MEvaluationNode& evaluationNode, const MPlug& plug, unsigned int numOfElements)
-{
-    // Texture data
-    if (!textureData.get() || evaluationNode.dirtyPlugExists(VectorDisplacementDeformerNode::displacementMapAttribute))
+    if (meshChange == MeshChangeType::TOPOLOGY)
     {
-        // Fetch data
+        // Buffers were created for the previous vertex count, so they need to be created again
 
-        MVectorArray mapColor;
-        MDoubleArray mapAlpha;
-        MStatus textureDataFetchStatus = VectorDisplacementUtilities::getTextureData(plug.node(), getInputGeom(data, plug.logicalIndex()),
-            VectorDisplacementDeformerNode::DISPLACEMENT_MAP_ATTRIBUTE, mapColor, mapAlpha);
+        textureData.reset();
+        normalData.reset();
+        tangentData.reset();
+        binormalData.reset();
+        paintWeightData.reset();
 
-        if (textureDataFetchStatus != MS::kSuccess)
-        {
-            return textureDataFetchStatus;
-        }
+        proxySampling = ProxySampling();
 
-        // Copy data to GPU
+        adjacency = VertexAdjacency();
+        adjacencyOffsetData.reset();
+        adjacencyIndexData.reset();
 
-        unsigned int dataSize = mapColor.length() * 3; // Each color has 3 values (RGB)
-        float* textureMapData = new float[dataSize];
+        uvFootprintData.reset();
+        samplingOrderData.reset();
+    }
 
-        unsigned int dataIndex = 0;
-        for (unsigned int i = 0; i < mapColor.length(); i++)
-        {
-            textureMapData[dataIndex] = (float)mapColor[i].x;
-            textureMapData[dataIndex + 1] = (float)mapColor[i].y;
-            textureMapData[dataIndex + 2] = (float)mapColor[i].z;
+    bool isMapDirty = evaluationNode.dirtyPlugExists(VectorDisplacementDeformerNode::displacementMapAttribute);
 
-            dataIndex += 3;
-        }
+    if (isMapDirty || wereBuffersStale)
+    {
+        mapTable = SummedAreaTable();
+        mapTableData.reset();
+    }
+
+    // Baked data. Buffers need to be refilled with the map data when switching back from the baked cache.
 
-        GpuDeformerUtilities::enqueueBuffer(dataSize * sizeof(float), (void*)textureMapData, textureData);
+    bool wasUsingBakedCache = isUsingBakedCache;
+    stage.next("bakedData");
 
-        delete[] textureMapData;
+    if (prepareAndCopyBakedDataToGpu(data, evaluationNode, plug, numOfElements, wereBuffersStale))
+    {
+        return MS::kSuccess;
     }
 
-    // Mesh data (normals, tangents, binormal)
-    if (!normalData.get() || !tangentData.get() || !binormalData.get() ||
-        evaluationNode.dirtyPlugExists(MPxDeformerNode::inputGeom) ||
-        evaluationNode.dirtyPlugExists(VectorDisplacementDeformerNode::displacementMapTypeAttribute))
+    // Paint weight data. Nothing to displace if every weight is 0, which is checked before any map or mesh data is fetched.
+    // Those are fetched again once a weight isn't 0, since the dirty plugs of the skipped evaluations are lost.
+
+    stage.next("paintWeights");
+    bool forceFullWeightCopy = (!isTiled && !paintWeightData.get()) || wasUsingBakedCache || wereBuffersStale || paintWeights.size() != numOfElements;
+    MStatus paintWeightStatus = copyPaintWeightsToGpu(data, evaluationNode, plug, numOfElements, forceFullWeightCopy);
+
+    if (paintWeightStatus != MS::kSuccess)
     {
-        VectorDisplacementMapType mapType = static_cast<VectorDisplacementMapType>(
-            data.inputValue(VectorDisplacementDeformerNode::displacementMapTypeAttribute).asInt());
+        return paintWeightStatus;
+    }
 
-        // Only prepare and copy when using tangent-space maps
-        if (mapType == VectorDisplacementMapType::TANGENT_SPACE)
-        {
-            MFloatVectorArray normals;
-            MFloatVectorArray tangents;
-            MFloatVectorArray binormals;
+    if (arePaintWeightsZero)
+    {
+        isMeshDataSkipped = true;
+        return MS::kSuccess;
+    }
 
-            MStatus meshDataFetchStatus = VectorDisplacementUtilities::getMeshVertexData(getInputGeom(data, plug.logicalIndex()), normals, tangents, binormals);
+    // Texture data (resampled when switching between full and proxy quality, between point and area sampling, or between seam sampling modes)
+    unsigned int proxyLevel = VectorDisplacementDeformerNode::getProxyLevel(data);
+    unsigned int filterResolution = VectorDisplacementDeformerNode::getFilterResolution(data);
+    SeamSamplingMode seamSampling = VectorDisplacementDeformerNode::getSeamSampling(data);
+    bool hasTextureData = isTiled ? !hostTextureData.empty() : textureData.get() != nullptr;
 
-            if (meshDataFetchStatus != MS::kSuccess)
-            {
-                return meshDataFetchStatus;
-            }
+    bool needsTextureData = !hasTextureData || wasUsingBakedCache || wereBuffersStale || isMeshDataSkipped || meshChange >= MeshChangeType::UVS ||
+        textureProxyLevel != proxyLevel || textureFilterResolution != filterResolution || textureSeamSampling != seamSampling || isMapDirty;
 
-            unsigned int vertCount = normals.length();
+    // Mesh data (normals, tangents, binormal). Only prepared and copied when using tangent-space maps.
+    bool hasFrameData = isTiled ? !hostNormals.empty() : normalData.get() && tangentData.get() && binormalData.get();
+    VectorDisplacementMapType mapType = static_cast<VectorDisplacementMapType>(
+        data.inputValue(VectorDisplacementDeformerNode::displacementMapTypeAttribute).asInt());
 
-            unsigned int dataSize = vertCount * 3; // All use the same vertex count
-            float* vertNormalData = new float[dataSize];
-            float* vertTangentData = new float[dataSize];
-            float* vertBinormalData = new float[dataSize];
+    bool needsFrameData = mapType == VectorDisplacementMapType::TANGENT_SPACE && (!hasFrameData || isMeshDataSkipped || meshChange != MeshChangeType::NONE ||
+        evaluationNode.dirtyPlugExists(VectorDisplacementDeformerNode::displacementMapTypeAttribute));
 
-            unsigned int dataIndex = 0;
-            for (unsigned int i = 0; i < vertCount; i++)
-            {
-                vertNormalData[dataIndex] = normals[i].x;
-                vertNormalData[dataIndex + 1] = normals[i].y;
-                vertNormalData[dataIndex + 2] = normals[i].z;
+    isMeshDataSkipped = false;
 
-                vertTangentData[dataIndex] = tangents[i].x;
-                vertTangentData[dataIndex + 1] = tangents[i].y;
-                vertTangentData[dataIndex + 2] = tangents[i].z;
+    MObject inputMesh = needsTextureData || needsFrameData ? getInputGeom(data, plug.logicalIndex()) : MObject();
 
-                vertBinormalData[dataIndex] = binormals[i].x;
-                vertBinormalData[dataIndex + 1] = binormals[i].y;
-                vertBinormalData[dataIndex + 2] = binormals[i].z;
+    // The warm-start cache is only used for the first fetch (e.g. when a scene is opened), so animated meshes aren't hashed every frame
 
-                dataIndex += 3;
-            }
+    MString mapFilePath;
+    bool useFrameWarmCache = needsFrameData && isFrameWarmStartPending;
 
-            GpuDeformerUtilities::enqueueBuffer(dataSize * sizeof(float), (void*)vertNormalData, normalData);
-            GpuDeformerUtilities::enqueueBuffer(dataSize * sizeof(float), (void*)vertTangentData, tangentData);
-            GpuDeformerUtilities::enqueueBuffer(dataSize * sizeof(float), (void*)vertBinormalData, binormalData);
+    if (needsTextureData && isTextureWarmStartPending)
+    {
+        mapFilePath = VectorDisplacementWarmCache::getMapFilePath(plug.node(), VectorDisplacementDeformerNode::DISPLACEMENT_MAP_ATTRIBUTE);
+        isTextureWarmStartPending = false;
+    }
 
-            delete[] vertNormalData;
-            delete[] vertTangentData;
-            delete[] vertBinormalData;
-        }
+    if (useFrameWarmCache)
+    {
+        isFrameWarmStartPending = false;
+    }
+
+    // UVs, map samples and frames are read through the Maya API, and buffers are mapped, only on the evaluation thread. Converting the samples
+    // and frames into the mapped buffers is pure math, so it runs on the shared worker threads while the rest of the data is read. Buffers whose
+    // data is already written when the frames are read are unmapped right away, so their uploads overlap with converting the frames.
+
+    stage.next("meshData");
+
+    std::vector<PendingBufferWrite> pendingWrites;
+    MStatus textureDataStatus = MS::kSuccess;
+    MStatus frameDataStatus = MS::kSuccess;
+
+    if (needsTextureData)
+    {
+        textureDataStatus = copyTextureDataToGpu(plug.node(), inputMesh, uvSetName, proxyLevel, filterResolution, seamSampling, mapFilePath, numOfElements,
+            pendingWrites);
     }
 
-    // Paint weight data
-    if (!paintWeightData.get() || evaluationNode.dirtyPlugExists(MPxDeformerNode::weightList))
+    if (needsFrameData && textureDataStatus == MS::kSuccess)
     {
-        MFloatArray paintWeightArray;
-        getPaintWeights(data, plug.logicalIndex(), numOfElements, paintWeightArray);
+        frameDataStatus = copyFrameDataToGpu(inputMesh, useFrameWarmCache, pendingWrites);
+    }
 
-        unsigned int count = paintWeightArray.length();
+    MStatus bufferWriteStatus = finishBufferWrites(pendingWrites, false);
 
-        float* paintWeights = new float[count];
-        for (unsigned int i = 0; i < count; i++)
-        {
-            paintWeights[i] = paintWeightArray[i];
-        }
+    stage.next("waitForData");
+    MStatus remainingWriteStatus = finishBufferWrites(pendingWrites, true);
+    bufferWriteStatus = bufferWriteStatus != MS::kSuccess ? bufferWriteStatus : remainingWriteStatus;
+
+    if (textureDataStatus != MS::kSuccess)
+    {
+        return textureDataStatus;
+    }
 
-        GpuDeformerUtilities::enqueueBuffer(count * sizeof(float), paintWeights, paintWeightData);
+    if (frameDataStatus != MS::kSuccess)
+    {
+        return frameDataStatus;
+    }
+
+    if (bufferWriteStatus != MS::kSuccess)
+    {
+        return bufferWriteStatus;
+    }
 
-        delete[] paintWeights;
+    if (needsTextureData || needsFrameData)
+    {
+        areRelaxedOffsetsStale = true;
     }
 
     return MS::kSuccess;
 }
 
-MGPUDeformerRegistrationInfo* VectorDisplacementGpuDeformerNode::getGPUDeformerInfo()
+MStatus VectorDisplacementGpuDeformerNode::copyPaintWeightsToGpu(MDataBlock& data, const MEvaluationNode& evaluationNode, const MPlug& plug, unsigned int numOfElements, bool forceFullCopy)
 {
-    static VectorDisplacementGpuDeformerInfo deformerInfo;
-    return &deformerInfo;
-}
+    // Weight changes are recorded by the deformer node when weights are dirtied (e.g. on every paint stroke)
 
+    VectorDisplacementDeformerNode* deformerNode = static_cast<VectorDisplacementDeformerNode*>(MFnDependencyNode(plug.node()).userNode());
 
-// Registration info
+    bool areChangesKnown = deformerNode && deformerNode->getWeightChanges(plug.logicalIndex(), WeightChangeConsumer::GPU, paintWeightsVersion,
+        changedWeightIndices);
+    bool isFullCopy = forceFullCopy || !areChangesKnown;
 
-MPxGPUDeformer* VectorDisplacementGpuDeformerInfo::createGPUDeformer()
-{
-    return new VectorDisplacementGpuDeformerNode();
-}
+    if (!isFullCopy && changedWeightIndices.empty())
+    {
+        // Weights dirtied without any recorded change (e.g. connected weights). Can't tell what changed so everything is copied.
 
-bool VectorDisplacementGpuDeformerInfo::validateNodeInGraph(MDataBlock& block, const MEvaluationNode& evaluationNode, const MPlug& plug, MStringArray* messages)
-{
-    return true; // No special conditions for GPU validation for now
+        if (!evaluationNode.dirtyPlugExists(MPxDeformerNode::weightList))
+        {
+            return MS::kSuccess;
+        }
+
+        isFullCopy = true;
+    }
+
+    auto updateWeightState = [this]()
+    {
+        uniformPaintWeight = paintWeights.empty() ? 0.f : paintWeights[0];
+        arePaintWeightsUniform = std::all_of(paintWeights.begin(), paintWeights.end(), [this](float weight) { return weight == uniformPaintWeight; });
+        arePaintWeightsZero = arePaintWeightsUniform && uniformPaintWeight == 0.f;
+    };
+
+    if (isFullCopy)
+    {
+        VectorDisplacementUtilities::getPaintWeights(data, plug.logicalIndex(), numOfElements, paintWeights);
+        updateWeightState();
+
+        if (isTiled)
+        {
+            return MS::kSuccess; // Weights are streamed with each tile
+        }
+
+        cl_int err = GpuDeformerUtilities::enqueueBuffer(numOfElements * sizeof(float), paintWeights.data(), paintWeightData);
+        return err == CL_SUCCESS ? MS::kSuccess : MS::kFailure;
+    }
+
+    // Partial update: refresh only the changed weights and copy them in a few merged ranges
+
+    VectorDisplacementUtilities::updatePaintWeights(data, plug.logicalIndex(), changedWeightIndices, paintWeights);
+    updateWeightState();
+
+    if (isTiled)
+    {
+        return MS::kSuccess;
+    }
+
+    changedWeightIndices.erase(std::remove_if(changedWeightIndices.begin(), changedWeightIndices.end(),
+        [numOfElements](unsigned int index) { return index >= numOfElements; }), changedWeightIndices.end());
+
+    GpuDeformerUtilities::mergeIndexRanges(changedWeightIndices, WEIGHT_RANGE_MAX_GAP, WEIGHT_RANGE_MAX_COUNT, changedWeightRanges);
+
+    cl_int err = GpuDeformerUtilities::enqueueBufferRanges(changedWeightRanges, sizeof(float), paintWeights.data(), paintWeightData);
+    return err == CL_SUCCESS ? MS::kSuccess : MS::kFailure;
 }
 
-bool VectorDisplacementGpuDeformerInfo::validateNodeValues(MDataBlock& block, const MEvaluationNode& evaluationNode, const MPlug& plug, MStringArray* messages)
+MStatus VectorDisplacementGpuDeformerNode::copyTextureDataToGpu(const MObject& nodeObject, const MObject& inputMesh, const MString& uvSetName, unsigned int proxyLevel,
+                                                                unsigned int filterResolution, SeamSamplingMode seamSampling, const MString& mapFilePath,
+                                                                unsigned int numOfElements, std::vector<PendingBufferWrite>& pendingWrites)
 {
-    return true; // No special conditions for GPU validation for now
+    EvaluationTracer::Scope stage("textureData", traceTag);
+
+    // Area-filtered samples are calculated by a kernel straight into the texture data buffer. Tiled data and averaged seams are filtered on the host instead.
+
+    MVectorArray& mapColor = scratch.mapColor;
+    bool isFilteredOnGpu = filterResolution > 0 && !isTiled && seamSampling == SeamSamplingMode::FIRST_ISLAND;
+    bool isWarmStarted = false;
+    uint64_t warmCacheKey = 0;
+
+    if (mapFilePath.length() > 0)
+    {
+        stage.next("warmCacheRead");
+        warmCacheKey = VectorDisplacementWarmCache::getMapSamplesKey(nodeObject, VectorDisplacementDeformerNode::DISPLACEMENT_MAP_ATTRIBUTE, mapFilePath,
+            meshFingerprint, proxyLevel, filterResolution, seamSampling);
+        isWarmStarted = VectorDisplacementWarmCache::readMapSamples(warmCacheKey, numOfElements, mapColor);
+        stage.next("textureData");
+    }
+
+    if (isWarmStarted)
+    {
+        isFilteredOnGpu = false; // Cached samples are copied like host-filtered ones
+    }
+    else
+    {
+        MStatus textureDataFetchStatus = sampleTextureData(nodeObject, inputMesh, uvSetName, proxyLevel, filterResolution, seamSampling, isFilteredOnGpu, numOfElements);
+
+        if (textureDataFetchStatus != MS::kSuccess)
+        {
+            return textureDataFetchStatus;
+        }
+
+        // Samples filtered on the GPU have no host copy to store
+
+        if (warmCacheKey != 0 && !isFilteredOnGpu && mapColor.length() == numOfElements)
+        {
+            stage.next("warmCacheWrite");
+            VectorDisplacementWarmCache::writeMapSamples(warmCacheKey, mapColor);
+            stage.next("textureData");
+        }
+    }
+
+    textureProxyLevel = proxyLevel;
+    textureFilterResolution = filterResolution;
+    textureSeamSampling = seamSampling;
+
+    // Convert to float directly into the mapped GPU buffer, or into the host copy when tiled. Samples filtered on the GPU are already in place.
+
+    if (!isFilteredOnGpu)
+    {
+        unsigned int count = mapColor.length();
+        float* textureMapData = nullptr;
+        PendingBufferWrite write;
+
+        if (isTiled)
+        {
+            hostTextureData.resize(count * 3); // 3 values per color (RGB)
+            textureMapData = hostTextureData.data();
+        }
+        else
+        {
+            cl_int err = CL_SUCCESS;
+            textureMapData = static_cast<float*>(GpuDeformerUtilities::mapBufferForWriting(count * 3 * sizeof(float), textureData, err));
+
+            if (!textureMapData)
+            {
+                return MS::kFailure;
+            }
+
+            write.mappedBuffers.emplace_back(textureMapData, &textureData);
+        }
+
+        write.task = WorkerThreadPool::submit([&mapColor, textureMapData, count]()
+        {
+            for (unsigned int i = 0; i < count; i++)
+            {
+                const MVector& color = mapColor[i];
+
+                textureMapData[i * 3] = static_cast<float>(color.x);
+                textureMapData[i * 3 + 1] = static_cast<float>(color.y);
+                textureMapData[i * 3 + 2] = static_cast<float>(color.z);
+            }
+        });
+
+        pendingWrites.push_back(std::move(write));
+    }
+
+    return MS::kSuccess;
+}
+
+MStatus VectorDisplacementGpuDeformerNode::sampleTextureData(const MObject& nodeObject, const MObject& inputMesh, const MString& uvSetName, unsigned int proxyLevel,
+                                                             unsigned int filterResolution, SeamSamplingMode seamSampling, bool isFilteredOnGpu, unsigned int numOfElements)
+{
+    if (proxyLevel > 0 && proxySampling.level != proxyLevel)
+    {
+        VectorDisplacementUtilities::buildProxySampling(inputMesh, proxyLevel, proxySampling);
+    }
+
+    // UVs are gathered once and kept until the UV set, the UVs or the topology change
+
+    if (seamSampling == SeamSamplingMode::FIRST_ISLAND && vertexUvs.empty())
+    {
+        MStatus uvDataFetchStatus = VectorDisplacementUtilities::getMeshUvData(inputMesh, uvSetName, vertexUvs, scratch);
+
+        if (uvDataFetchStatus != MS::kSuccess)
+        {
+            return uvDataFetchStatus;
+        }
+
+        VectorDisplacementUtilities::getUvSamplingOrder(vertexUvs, samplingOrder);
+    }
+
+    MVectorArray& mapColor = scratch.mapColor;
+    MDoubleArray& mapAlpha = scratch.mapAlpha;
+    MStatus textureDataFetchStatus = MS::kSuccess;
+
+    if (filterResolution > 0 && mapTable.getWidth() != filterResolution)
+    {
+        mapTableData.reset(); // Host table is built again at the new resolution, so the device copy would be stale
+    }
+
+    if (seamSampling == SeamSamplingMode::AVERAGE)
+    {
+        textureDataFetchStatus = VectorDisplacementUtilities::getSeamTextureData(nodeObject, VectorDisplacementDeformerNode::DISPLACEMENT_MAP_ATTRIBUTE,
+            inputMesh, uvSetName, filterResolution, seamSamples, mapTable, mapColor, mapAlpha, scratch);
+    }
+    else if (filterResolution > 0)
+    {
+        textureDataFetchStatus = VectorDisplacementUtilities::prepareAreaSampling(nodeObject, VectorDisplacementDeformerNode::DISPLACEMENT_MAP_ATTRIBUTE,
+            inputMesh, uvSetName, filterResolution, vertexUvs, samplingOrder, mapTable, uvFootprints, scratch);
+
+        if (textureDataFetchStatus == MS::kSuccess)
+        {
+            if (isFilteredOnGpu)
+            {
+                textureDataFetchStatus = enqueueAreaFilteredSamples(numOfElements);
+            }
+            else
+            {
+                VectorDisplacementUtilities::getFilteredTextureData(mapTable, samplingOrder, uvFootprints, mapColor, mapAlpha);
+            }
+        }
+    }
+    else
+    {
+        textureDataFetchStatus = VectorDisplacementUtilities::getTextureData(nodeObject, vertexUvs,
+            VectorDisplacementDeformerNode::DISPLACEMENT_MAP_ATTRIBUTE, mapColor, mapAlpha, scratch, proxyLevel > 0 ? &proxySampling : nullptr, &samplingOrder);
+    }
+
+    return textureDataFetchStatus;
+}
+
+MStatus VectorDisplacementGpuDeformerNode::copyFrameDataToGpu(const MObject& inputMesh, bool useWarmCache, std::vector<PendingBufferWrite>& pendingWrites)
+{
+    EvaluationTracer::Scope stage("vertexData", traceTag);
+
+    MFloatVectorArray& normals = scratch.normals;
+    MFloatVectorArray& tangents = scratch.tangents;
+    MFloatVectorArray& binormals = scratch.binormals;
+
+    uint64_t warmCacheKey = useWarmCache ? VectorDisplacementWarmCache::getVertexFramesKey(inputMesh, meshFingerprint) : 0;
+
+    if (!VectorDisplacementWarmCache::readVertexFrames(warmCacheKey, meshFingerprint.vertexCount, normals, tangents, binormals))
+    {
+        MStatus meshDataFetchStatus = VectorDisplacementUtilities::getMeshVertexData(inputMesh, normals, tangents, binormals, scratch);
+
+        if (meshDataFetchStatus != MS::kSuccess)
+        {
+            return meshDataFetchStatus;
+        }
+
+        if (warmCacheKey != 0)
+        {
+            VectorDisplacementWarmCache::writeVertexFrames(warmCacheKey, normals, tangents, binormals);
+        }
+    }
+
+    // Copy each array directly into its mapped GPU buffer, or into its host copy when tiled (all use the same vertex count)
+
+    size_t dataSize = normals.length() * 3 * sizeof(float);
+
+    MAutoCLMem* frameBuffers[3] = { &normalData, &tangentData, &binormalData };
+    std::vector<float>* hostFrames[3] = { &hostNormals, &hostTangents, &hostBinormals };
+    float* frameData[3] = { nullptr, nullptr, nullptr };
+    PendingBufferWrite write;
+
+    for (unsigned int i = 0; i < 3; i++)
+    {
+        if (isTiled)
+        {
+            hostFrames[i]->resize(normals.length() * 3);
+            frameData[i] = hostFrames[i]->data();
+        }
+        else
+        {
+            cl_int err = CL_SUCCESS;
+            frameData[i] = static_cast<float*>(GpuDeformerUtilities::mapBufferForWriting(dataSize, *frameBuffers[i], err));
+
+            if (!frameData[i])
+            {
+                pendingWrites.push_back(std::move(write)); // Buffers mapped so far still need to be unmapped
+                return MS::kFailure;
+            }
+
+            write.mappedBuffers.emplace_back(frameData[i], frameBuffers[i]);
+        }
+    }
+
+    write.task = WorkerThreadPool::submit([&normals, &tangents, &binormals, frameData]()
+    {
+        normals.get(reinterpret_cast<float(*)[3]>(frameData[0]));
+        tangents.get(reinterpret_cast<float(*)[3]>(frameData[1]));
+        binormals.get(reinterpret_cast<float(*)[3]>(frameData[2]));
+    });
+
+    pendingWrites.push_back(std::move(write));
+
+    return MS::kSuccess;
+}
+
+MStatus VectorDisplacementGpuDeformerNode::finishBufferWrites(std::vector<PendingBufferWrite>& pendingWrites, bool waitForTasks)
+{
+    MStatus status = MS::kSuccess;
+
+    for (auto write = pendingWrites.begin(); write != pendingWrites.end();)
+    {
+        if (!waitForTasks && !write->task.isDone())
+        {
+            ++write;
+            continue;
+        }
+
+        write->task.wait();
+
+        for (const std::pair<void*, MAutoCLMem*>& mappedBuffer : write->mappedBuffers)
+        {
+            if (GpuDeformerUtilities::unmapBuffer(mappedBuffer.first, *mappedBuffer.second) != CL_SUCCESS)
+            {
+                status = MS::kFailure;
+            }
+        }
+
+        write = pendingWrites.erase(write);
+    }
+
+    return status;
+}
+
+bool VectorDisplacementGpuDeformerNode::prepareAndCopyBakedDataToGpu(MDataBlock& data, const MEvaluationNode& evaluationNode, const MPlug& plug, unsigned int numOfElements, bool forceCopy)
+{
+    bool wasUsingBakedCache = isUsingBakedCache;
+    isUsingBakedCache = false;
+
+    if (!data.inputValue(VectorDisplacementDeformerNode::useBakedCacheAttribute).asBool())
+    {
+        return false;
+    }
+
+    MString cachePath = data.inputValue(VectorDisplacementDeformerNode::bakedCacheFileAttribute).asString();
+    if (bakedCache.open(cachePath) != MS::kSuccess)
+    {
+        return false;
+    }
+
+    const float* bakedOffsets = bakedCache.getOffsets(plug.logicalIndex(), meshFingerprint);
+    if (!bakedOffsets)
+    {
+        return false;
+    }
+
+    isUsingBakedCache = true;
+
+    // Tiles read the offsets straight from the mapped cache file
+
+    if (isTiled)
+    {
+        tiledBakedOffsets = bakedOffsets;
+
+        if (uniformWeights.size() != numOfElements)
+        {
+            uniformWeights.assign(numOfElements, 1.f);
+        }
+
+        return true;
+    }
+
+    // Only copy when switching to the cache or when the cache file changed (including files written again to the same path)
+
+    if (wasUsingBakedCache && !forceCopy && textureData.get() && paintWeightData.get() && bakedMappingVersion == bakedCache.getMappingVersion() &&
+        !evaluationNode.dirtyPlugExists(VectorDisplacementDeformerNode::useBakedCacheAttribute) &&
+        !evaluationNode.dirtyPlugExists(VectorDisplacementDeformerNode::bakedCacheFileAttribute))
+    {
+        return true;
+    }
+
+    if (uniformWeights.size() != numOfElements)
+    {
+        uniformWeights.assign(numOfElements, 1.f);
+    }
+
+    cl_int err = GpuDeformerUtilities::enqueueBuffer(numOfElements * 3 * sizeof(float), const_cast<float*>(bakedOffsets), textureData);
+
+    if (err == CL_SUCCESS)
+    {
+        err = GpuDeformerUtilities::enqueueBuffer(numOfElements * sizeof(float), uniformWeights.data(), paintWeightData);
+    }
+
+    MOpenCLInfo::checkCLErrorStatus(err);
+
+    if (err != CL_SUCCESS)
+    {
+        // Fall back to the live displacement. The buffers may be partly written, so they're created again and filled with the live data.
+
+        textureData.reset();
+        paintWeightData.reset();
+        isUsingBakedCache = false;
+        return false;
+    }
+
+    bakedMappingVersion = bakedCache.getMappingVersion();
+
+    return true;
+}
+
+unsigned int VectorDisplacementGpuDeformerNode::getTileSize(MDataBlock& data, unsigned int numOfElements) const
+{
+    // Auxiliary data per vertex: texture (RGB) and paint weight, plus normal, tangent and binormal for tangent-space maps
+
+    VectorDisplacementMapType mapType = static_cast<VectorDisplacementMapType>(
+        data.inputValue(VectorDisplacementDeformerNode::displacementMapTypeAttribute).asInt());
+
+    size_t bytesPerVertex = 4 * sizeof(float);
+
+    if (mapType == VectorDisplacementMapType::TANGENT_SPACE)
+    {
+        bytesPerVertex += 9 * sizeof(float);
+    }
+
+    cl_ulong globalMemorySize = 0;
+    cl_ulong maxAllocationSize = 0;
+
+    clGetDeviceInfo(MOpenCLInfo::getOpenCLDeviceId(), CL_DEVICE_GLOBAL_MEM_SIZE, sizeof(cl_ulong), &globalMemorySize, NULL);
+    clGetDeviceInfo(MOpenCLInfo::getOpenCLDeviceId(), CL_DEVICE_MAX_MEM_ALLOC_SIZE, sizeof(cl_ulong), &maxAllocationSize, NULL);
+
+    // Without a budget, most of the device memory is left to Maya (position buffers, other deformers and the viewport)
+
+    int budgetMegabytes = data.inputValue(VectorDisplacementDeformerNode::gpuMemoryBudgetAttribute).asInt();
+    size_t memoryBudget = budgetMegabytes > 0 ? static_cast<size_t>(budgetMegabytes) * 1024 * 1024 :
+                                                static_cast<size_t>(globalMemorySize * AUTO_GPU_MEMORY_BUDGET_FRACTION);
+
+    if (memoryBudget == 0)
+    {
+        return 0; // Device memory unknown
+    }
+
+    size_t maxBufferSize = maxAllocationSize > 0 ? static_cast<size_t>(maxAllocationSize) : memoryBudget;
+
+    return GpuDeformerUtilities::calculateTileSize(numOfElements, bytesPerVertex, memoryBudget, maxBufferSize, 3 * sizeof(float), TILE_RING_SIZE);
+}
+
+MStatus VectorDisplacementGpuDeformerNode::enqueueTiles(GpuKernelData data, VectorDisplacementMapType mapType, WeightMode weightMode, const MAutoCLEvent& inputReadyEvent, MAutoCLEvent& finishedEvent)
+{
+    // Tiled kernels and the upload queue are only created when tiling is used
+
+    unsigned int weightModeIndex = static_cast<unsigned int>(weightMode);
+    MAutoCLKernel& kernel = mapType == VectorDisplacementMapType::OBJECT_SPACE ? kernelObjectSpaceTiled[weightModeIndex] : kernelTangentSpaceTiled[weightModeIndex];
+
+    if (!kernel.get())
+    {
+        kernel = GpuDeformerUtilities::getDisplacementKernel(kernelPath + "/" + KERNEL_FILE_NAME, GpuDeformerUtilities::getTiledKernelName(mapType), weightMode);
+        if (kernel.isNull())
+        {
+            return MS::kFailure;
+        }
+    }
+
+    cl_int err = CL_SUCCESS;
+
+    if (!uploadQueue)
+    {
+        // Uploads use their own queue so they can run while the kernels run on Maya's queue
+
+        uploadQueue = clCreateCommandQueue(MOpenCLInfo::getOpenCLContext(), MOpenCLInfo::getOpenCLDeviceId(), 0, &err);
+        MOpenCLInfo::checkCLErrorStatus(err);
+
+        if (err != CL_SUCCESS)
+        {
+            uploadQueue = nullptr;
+            return MS::kFailure;
+        }
+    }
+
+    tileSlots.resize(TILE_RING_SIZE);
+
+    // Host data of every auxiliary buffer (baked offsets are applied as object-space displacement with uniform weights)
+
+    const float* sources[5] = {
+        isUsingBakedCache ? tiledBakedOffsets : (isRelaxing ? hostRelaxedOffsets.data() : hostTextureData.data()),
+        isUsingBakedCache ? uniformWeights.data() : paintWeights.data(),
+        hostNormals.data(),
+        hostTangents.data(),
+        hostBinormals.data()
+    };
+
+    const unsigned int componentCounts[5] = { 3, 1, 3, 3, 3 };
+    const unsigned int numOfBuffers = mapType == VectorDisplacementMapType::TANGENT_SPACE ? 5 : 2;
+    const unsigned int numOfElements = data.numOfElements;
+
+    data.isTiled = true;
+
+    for (unsigned int firstVertex = 0, tileIndex = 0; firstVertex < numOfElements; firstVertex += tileSize, tileIndex++)
+    {
+        unsigned int count = std::min(tileSize, numOfElements - firstVertex);
+        GpuTileBuffers& slot = tileSlots[tileIndex % TILE_RING_SIZE];
+
+        // Upload the tile once the kernel that last read this slot is done. The upload queue is in-order,
+        // so only the first write waits for the slot and only the last write signals the kernel.
+
+        MAutoCLMem* buffers[5] = { &slot.textureData, &slot.paintWeightData, &slot.normalData, &slot.tangentData, &slot.binormalData };
+        MAutoCLEvent uploadFinishedEvent;
+        cl_event slotFreeEvent = slot.kernelFinishedEvent.get();
+
+        for (unsigned int i = 0; i < numOfBuffers && err == CL_SUCCESS; i++)
+        {
+            size_t elementSize = componentCounts[i] * sizeof(float);
+
+            err = GpuDeformerUtilities::allocateBuffer(tileSize * elementSize, CL_MEM_READ_ONLY, *buffers[i]);
+            if (err != CL_SUCCESS)
+            {
+                break;
+            }
+
+            bool shouldWait = i == 0 && slotFreeEvent;
+            bool shouldSignal = i + 1 == numOfBuffers;
+
+            err = clEnqueueWriteBuffer(uploadQueue, buffers[i]->get(), CL_FALSE, 0, count * elementSize, sources[i] + static_cast<size_t>(firstVertex) * componentCounts[i],
+                shouldWait ? 1 : 0, shouldWait ? &slotFreeEvent : NULL, shouldSignal ? uploadFinishedEvent.getReferenceForAssignment() : NULL);
+        }
+
+        MOpenCLInfo::checkCLErrorStatus(err);
+        if (err != CL_SUCCESS)
+        {
+            return MS::kFailure;
+        }
+
+        clFlush(uploadQueue); // Commands need to be submitted before another queue can wait for them
+
+        // Displace the tile. Only the first tile needs to wait for the input positions, since Maya's queue is in-order.
+
+        data.textureData = &slot.textureData;
+        data.paintWeightData = &slot.paintWeightData;
+        data.normalData = &slot.normalData;
+        data.tangentData = &slot.tangentData;
+        data.binormalData = &slot.binormalData;
+        data.numOfElements = count;
+        data.firstVertex = firstVertex;
+
+        if (GpuDeformerUtilities::sendParametersToKernel(data, mapType, kernel) != MS::kSuccess ||
+            GpuDeformerUtilities::calculateWorkSize(count, kernel, KernelLaunchConfig(), localWorkSize, globalWorkSize) != MS::kSuccess)
+        {
+            return MS::kFailure;
+        }
+
+        cl_event events[2] = { uploadFinishedEvent.get(), 0 };
+        cl_uint eventCount = 1;
+
+        if (firstVertex == 0 && inputReadyEvent.get())
+        {
+            events[eventCount++] = inputReadyEvent.get();
+        }
+
+        err = clEnqueueNDRangeKernel(MOpenCLInfo::getMayaDefaultOpenCLCommandQueue(), kernel.get(), 1, NULL,
+            &globalWorkSize, &localWorkSize, eventCount, events, slot.kernelFinishedEvent.getReferenceForAssignment());
+
+        MOpenCLInfo::checkCLErrorStatus(err);
+        if (err != CL_SUCCESS)
+        {
+            return MS::kFailure;
+        }
+
+        finishedEvent = slot.kernelFinishedEvent;
+    }
+
+    return MS::kSuccess;
+}
+
+MStatus VectorDisplacementGpuDeformerNode::prepareRelaxedOffsets(MDataBlock& data, const MPlug& plug, const RelaxSettings& settings, unsigned int numOfElements)
+{
+    bool hasRelaxedOffsets = isTiled ? hostRelaxedOffsets.size() == numOfElements * 3 : relaxOffsetData[relaxResultIndex].get() != nullptr;
+
+    if (hasRelaxedOffsets && !areRelaxedOffsetsStale && relaxSettings == settings)
+    {
+        return MS::kSuccess;
+    }
+
+    if (adjacency.isEmpty())
+    {
+        MStatus adjacencyStatus = VectorDisplacementUtilities::getVertexAdjacency(getInputGeom(data, plug.logicalIndex()), adjacency, scratch);
+
+        if (adjacencyStatus != MS::kSuccess)
+        {
+            return adjacencyStatus;
+        }
+    }
+
+    if (adjacency.offsets.size() != static_cast<size_t>(numOfElements) + 1)
+    {
+        return MS::kFailure; // Input mesh doesn't match the deformed points
+    }
+
+    // Tiled: relax on the host, since the full-size buffers the iterations need are what tiling avoids
+
+    if (isTiled)
+    {
+        hostRelaxedOffsets.resize(static_cast<size_t>(numOfElements) * 3);
+
+        if (settings.mapType == VectorDisplacementMapType::TANGENT_SPACE)
+        {
+            const Float3* rgbData = reinterpret_cast<const Float3*>(hostTextureData.data());
+            const Float3* normals = reinterpret_cast<const Float3*>(hostNormals.data());
+            const Float3* tangents = reinterpret_cast<const Float3*>(hostTangents.data());
+            const Float3* binormals = reinterpret_cast<const Float3*>(hostBinormals.data());
+            Float3* offsets = reinterpret_cast<Float3*>(hostRelaxedOffsets.data());
+
+            for (unsigned int i = 0; i < numOfElements; i++)
+            {
+                offsets[i] = VectorDisplacementMath::getTangentSpaceOffset(normals[i], tangents[i], binormals[i], rgbData[i], 1.f);
+            }
+        }
+        else
+        {
+            std::copy(hostTextureData.begin(), hostTextureData.end(), hostRelaxedOffsets.begin());
+        }
+
+        VectorDisplacementRelax::relaxOffsets(adjacency, settings.iterations, settings.strength, hostRelaxedOffsets, scratch.relaxOffsets);
+
+        relaxSettings = settings;
+        areRelaxedOffsetsStale = false;
+        return MS::kSuccess;
+    }
+
+    // Kernels are only created when the relax pass is used
+
+    MString kernelFile = kernelPath + "/" + KERNEL_FILE_NAME;
+
+    if (!kernelRelaxOffsets.get())
+    {
+        kernelRelaxOffsets = MOpenCLInfo::getOpenCLKernel(kernelFile, RELAX_OFFSETS_KERNEL_NAME);
+        if (kernelRelaxOffsets.isNull())
+        {
+            return MS::kFailure;
+        }
+    }
+
+    if (settings.mapType == VectorDisplacementMapType::TANGENT_SPACE && !kernelTangentSpaceOffsets.get())
+    {
+        kernelTangentSpaceOffsets = MOpenCLInfo::getOpenCLKernel(kernelFile, TANGENT_SPACE_OFFSETS_KERNEL_NAME);
+        if (kernelTangentSpaceOffsets.isNull())
+        {
+            return MS::kFailure;
+        }
+    }
+
+    // Adjacency is copied once per topology. Meshes without edges have no neighbour indices to copy.
+
+    cl_int err = CL_SUCCESS;
+
+    if (!adjacencyOffsetData.get())
+    {
+        err = GpuDeformerUtilities::enqueueBuffer(adjacency.offsets.size() * sizeof(unsigned int), adjacency.offsets.data(), adjacencyOffsetData);
+
+        if (err == CL_SUCCESS && !adjacency.indices.empty())
+        {
+            err = GpuDeformerUtilities::enqueueBuffer(adjacency.indices.size() * sizeof(unsigned int), adjacency.indices.data(), adjacencyIndexData);
+        }
+
+        MOpenCLInfo::checkCLErrorStatus(err);
+        if (err != CL_SUCCESS)
+        {
+            adjacencyOffsetData.reset();
+            return MS::kFailure;
+        }
+    }
+
+    size_t offsetsSize = static_cast<size_t>(numOfElements) * 3 * sizeof(float);
+
+    for (MAutoCLMem& buffer : relaxOffsetData)
+    {
+        err = GpuDeformerUtilities::allocateBuffer(offsetsSize, CL_MEM_READ_WRITE, buffer);
+        if (err != CL_SUCCESS)
+        {
+            return MS::kFailure;
+        }
+    }
+
+    // Every kernel runs on Maya's in-order queue, so each one waits for the previous one (and the displacement kernel for the last one)
+
+    cl_command_queue queue = MOpenCLInfo::getMayaDefaultOpenCLCommandQueue();
+    MAutoCLMem* sourceOffsets = &textureData; // Object-space texture data is already the raw offset of each vertex
+    unsigned int destinationIndex = 0;
+
+    if (settings.mapType == VectorDisplacementMapType::TANGENT_SPACE)
+    {
+        unsigned int parameterId = 0;
+
+        err = clSetKernelArg(kernelTangentSpaceOffsets.get(), parameterId++, sizeof(cl_mem), (void*)textureData.getReadOnlyRef());
+        MOpenCLInfo::checkCLErrorStatus(err);
+
+        err = clSetKernelArg(kernelTangentSpaceOffsets.get(), parameterId++, sizeof(cl_mem), (void*)normalData.getReadOnlyRef());
+        MOpenCLInfo::checkCLErrorStatus(err);
+
+        err = clSetKernelArg(kernelTangentSpaceOffsets.get(), parameterId++, sizeof(cl_mem), (void*)tangentData.getReadOnlyRef());
+        MOpenCLInfo::checkCLErrorStatus(err);
+
+        err = clSetKernelArg(kernelTangentSpaceOffsets.get(), parameterId++, sizeof(cl_mem), (void*)binormalData.getReadOnlyRef());
+        MOpenCLInfo::checkCLErrorStatus(err);
+
+        err = clSetKernelArg(kernelTangentSpaceOffsets.get(), parameterId++, sizeof(cl_uint), (void*)&numOfElements);
+        MOpenCLInfo::checkCLErrorStatus(err);
+
+        err = clSetKernelArg(kernelTangentSpaceOffsets.get(), parameterId++, sizeof(cl_mem), (void*)relaxOffsetData[0].getReadOnlyRef());
+        MOpenCLInfo::checkCLErrorStatus(err);
+
+        if (GpuDeformerUtilities::calculateWorkSize(numOfElements, kernelTangentSpaceOffsets, KernelLaunchConfig(), localWorkSize, globalWorkSize) != MS::kSuccess)
+        {
+            return MS::kFailure;
+        }
+
+        err = clEnqueueNDRangeKernel(queue, kernelTangentSpaceOffsets.get(), 1, NULL, &globalWorkSize, &localWorkSize, 0, NULL, NULL);
+
+        MOpenCLInfo::checkCLErrorStatus(err);
+        if (err != CL_SUCCESS)
+        {
+            return MS::kFailure;
+        }
+
+        sourceOffsets = &relaxOffsetData[0];
+        destinationIndex = 1;
+    }
+
+    if (GpuDeformerUtilities::calculateWorkSize(numOfElements, kernelRelaxOffsets, KernelLaunchConfig(), localWorkSize, globalWorkSize) != MS::kSuccess)
+    {
+        return MS::kFailure;
+    }
+
+    for (unsigned int iteration = 0; iteration < settings.iterations; iteration++)
+    {
+        unsigned int parameterId = 0;
+
+        err = clSetKernelArg(kernelRelaxOffsets.get(), parameterId++, sizeof(cl_mem), (void*)sourceOffsets->getReadOnlyRef());
+        MOpenCLInfo::checkCLErrorStatus(err);
+
+        err = clSetKernelArg(kernelRelaxOffsets.get(), parameterId++, sizeof(cl_mem), (void*)adjacencyOffsetData.getReadOnlyRef());
+        MOpenCLInfo::checkCLErrorStatus(err);
+
+        err = clSetKernelArg(kernelRelaxOffsets.get(), parameterId++, sizeof(cl_mem), (void*)adjacencyIndexData.getReadOnlyRef());
+        MOpenCLInfo::checkCLErrorStatus(err);
+
+        err = clSetKernelArg(kernelRelaxOffsets.get(), parameterId++, sizeof(cl_float), (void*)&settings.strength);
+        MOpenCLInfo::checkCLErrorStatus(err);
+
+        err = clSetKernelArg(kernelRelaxOffsets.get(), parameterId++, sizeof(cl_uint), (void*)&numOfElements);
+        MOpenCLInfo::checkCLErrorStatus(err);
+
+        err = clSetKernelArg(kernelRelaxOffsets.get(), parameterId++, sizeof(cl_mem), (void*)relaxOffsetData[destinationIndex].getReadOnlyRef());
+        MOpenCLInfo::checkCLErrorStatus(err);
+
+        err = clEnqueueNDRangeKernel(queue, kernelRelaxOffsets.get(), 1, NULL, &globalWorkSize, &localWorkSize, 0, NULL, NULL);
+
+        MOpenCLInfo::checkCLErrorStatus(err);
+        if (err != CL_SUCCESS)
+        {
+            return MS::kFailure;
+        }
+
+        sourceOffsets = &relaxOffsetData[destinationIndex];
+        relaxResultIndex = destinationIndex;
+        destinationIndex = 1 - destinationIndex;
+    }
+
+    relaxSettings = settings;
+    areRelaxedOffsetsStale = false;
+    return MS::kSuccess;
+}
+
+MStatus VectorDisplacementGpuDeformerNode::enqueueAreaFilteredSamples(unsigned int numOfElements)
+{
+    if (mapTable.isEmpty() || samplingOrder.vertices.size() != numOfElements || uvFootprints.size() != samplingOrder.vertices.size() * 4)
+    {
+        return MS::kFailure; // Input mesh doesn't match the deformed points
+    }
+
+    // Kernel is only created when area sampling is used
+
+    if (!kernelAreaFilteredSamples.get())
+    {
+        kernelAreaFilteredSamples = MOpenCLInfo::getOpenCLKernel(kernelPath + "/" + KERNEL_FILE_NAME, AREA_FILTERED_SAMPLES_KERNEL_NAME);
+        if (kernelAreaFilteredSamples.isNull())
+        {
+            return MS::kFailure;
+        }
+    }
+
+    // Map table is copied once per map. Footprints are already interleaved with their UVs in sampling order, so each work item reads a single float4.
+
+    cl_int err = CL_SUCCESS;
+
+    if (!mapTableData.get())
+    {
+        const std::vector<int64_t>& sums = mapTable.getSums();
+        err = GpuDeformerUtilities::enqueueBuffer(sums.size() * sizeof(cl_long), const_cast<int64_t*>(sums.data()), mapTableData);
+
+        MOpenCLInfo::checkCLErrorStatus(err);
+        if (err != CL_SUCCESS)
+        {
+            mapTableData.reset();
+            return MS::kFailure;
+        }
+    }
+
+    err = GpuDeformerUtilities::enqueueBuffer(uvFootprints.size() * sizeof(float), uvFootprints.data(), uvFootprintData);
+
+    if (err == CL_SUCCESS)
+    {
+        err = GpuDeformerUtilities::enqueueBuffer(samplingOrder.vertices.size() * sizeof(unsigned int), samplingOrder.vertices.data(), samplingOrderData);
+    }
+
+    MOpenCLInfo::checkCLErrorStatus(err);
+    if (err != CL_SUCCESS)
+    {
+        uvFootprintData.reset();
+        samplingOrderData.reset();
+        return MS::kFailure;
+    }
+
+    // Point-sampled texture data is written from the host into a read-only buffer, but the kernel needs to write to it
+
+    cl_mem_flags textureFlags = 0;
+
+    if (textureData.get() && (clGetMemObjectInfo(textureData.get(), CL_MEM_FLAGS, sizeof(cl_mem_flags), &textureFlags, NULL) != CL_SUCCESS ||
+        (textureFlags & CL_MEM_READ_WRITE) == 0))
+    {
+        textureData.reset();
+    }
+
+    err = GpuDeformerUtilities::allocateBuffer(static_cast<size_t>(numOfElements) * 3 * sizeof(float), CL_MEM_READ_WRITE, textureData);
+    if (err != CL_SUCCESS)
+    {
+        return MS::kFailure;
+    }
+
+    cl_uint width = mapTable.getWidth();
+    cl_uint height = mapTable.getHeight();
+    cl_float fixedPointScale = static_cast<cl_float>(SummedAreaTable::FIXED_POINT_SCALE);
+    unsigned int parameterId = 0;
+
+    err = clSetKernelArg(kernelAreaFilteredSamples.get(), parameterId++, sizeof(cl_mem), (void*)mapTableData.getReadOnlyRef());
+    MOpenCLInfo::checkCLErrorStatus(err);
+
+    err = clSetKernelArg(kernelAreaFilteredSamples.get(), parameterId++, sizeof(cl_uint), (void*)&width);
+    MOpenCLInfo::checkCLErrorStatus(err);
+
+    err = clSetKernelArg(kernelAreaFilteredSamples.get(), parameterId++, sizeof(cl_uint), (void*)&height);
+    MOpenCLInfo::checkCLErrorStatus(err);
+
+    err = clSetKernelArg(kernelAreaFilteredSamples.get(), parameterId++, sizeof(cl_float), (void*)&fixedPointScale);
+    MOpenCLInfo::checkCLErrorStatus(err);
+
+    err = clSetKernelArg(kernelAreaFilteredSamples.get(), parameterId++, sizeof(cl_mem), (void*)uvFootprintData.getReadOnlyRef());
+    MOpenCLInfo::checkCLErrorStatus(err);
+
+    err = clSetKernelArg(kernelAreaFilteredSamples.get(), parameterId++, sizeof(cl_mem), (void*)samplingOrderData.getReadOnlyRef());
+    MOpenCLInfo::checkCLErrorStatus(err);
+
+    err = clSetKernelArg(kernelAreaFilteredSamples.get(), parameterId++, sizeof(cl_uint), (void*)&numOfElements);
+    MOpenCLInfo::checkCLErrorStatus(err);
+
+    err = clSetKernelArg(kernelAreaFilteredSamples.get(), parameterId++, sizeof(cl_mem), (void*)textureData.getReadOnlyRef());
+    MOpenCLInfo::checkCLErrorStatus(err);
+
+    if (GpuDeformerUtilities::calculateWorkSize(numOfElements, kernelAreaFilteredSamples, KernelLaunchConfig(), localWorkSize, globalWorkSize) != MS::kSuccess)
+    {
+        return MS::kFailure;
+    }
+
+    // Runs on Maya's in-order queue, so the relax and displacement kernels that read the samples wait for it
+
+    err = clEnqueueNDRangeKernel(MOpenCLInfo::getMayaDefaultOpenCLCommandQueue(), kernelAreaFilteredSamples.get(), 1, NULL, &globalWorkSize, &localWorkSize, 0, NULL, NULL);
+
+    MOpenCLInfo::checkCLErrorStatus(err);
+    if (err != CL_SUCCESS)
+    {
+        return MS::kFailure;
+    }
+
+    return MS::kSuccess;
+}
+
+void VectorDisplacementGpuDeformerNode::releaseTileData()
+{
+    if (uploadQueue)
+    {
+        clFinish(uploadQueue);
+    }
+
+    tileSlots.clear();
+    tileSize = 0;
+
+    std::vector<float>().swap(hostTextureData);
+    std::vector<float>().swap(hostNormals);
+    std::vector<float>().swap(hostTangents);
+    std::vector<float>().swap(hostBinormals);
+    std::vector<float>().swap(uniformWeights);
+    std::vector<float>().swap(hostRelaxedOffsets);
+    tiledBakedOffsets = nullptr;
+    areRelaxedOffsetsStale = true;
+}
+
+MGPUDeformerRegistrationInfo* VectorDisplacementGpuDeformerNode::getGPUDeformerInfo()
+{
+    static VectorDisplacementGpuDeformerInfo deformerInfo;
+    return &deformerInfo;
+}
+
+
+// Registration info
+
+MPxGPUDeformer* VectorDisplacementGpuDeformerInfo::createGPUDeformer()
+{
+    return new VectorDisplacementGpuDeformerNode();
+}
+
+bool VectorDisplacementGpuDeformerInfo::validateNodeInGraph(MDataBlock& block, const MEvaluationNode& evaluationNode, const MPlug& plug, MStringArray* messages)
+{
+    return true; // No special conditions for GPU validation for now
+}
+
+bool VectorDisplacementGpuDeformerInfo::validateNodeValues(MDataBlock& block, const MEvaluationNode& evaluationNode, const MPlug& plug, MStringArray* messages)
+{
+    // Geometries can be sent to the CPU deformer, either always or when it was measured to be cheaper for them
+
+    BackendMode backendMode = static_cast<BackendMode>(block.inputValue(VectorDisplacementDeformerNode::backendAttribute).asInt());
+
+    if (backendMode == BackendMode::CPU ||
+        (backendMode == BackendMode::AUTO && VectorDisplacementDeformerNode::getActiveBackend(block, plug.logicalIndex()) == EvaluationBackend::CPU))
+    {
+        if (messages)
+        {
+            messages->append(backendMode == BackendMode::CPU ? "Backend is set to CPU." :
+                "Backend is set to Auto and the CPU deformer is active for this geometry (see activeBackend).");
+        }
+
+        return false;
+    }
+
+    // Streaming is for meshes too big to keep every per-vertex buffer in memory, which the GPU deformer needs
+
+    if (block.inputValue(VectorDisplacementDeformerNode::streamingChunkSizeAttribute).asInt() > 0)
+    {
+        if (messages)
+        {
+            messages->append("Streaming is enabled (streamingChunkSize > 0), which is only supported by the CPU deformer.");
+        }
+
+        return false;
+    }
+
+    return true;
 }
\ No newline at end of file
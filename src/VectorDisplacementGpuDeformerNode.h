@@ -8,12 +8,38 @@
 
 #pragma once
 
+#include "EvaluationTracer.h"
+#include "VectorDisplacementCacheFile.h"
 #include "VectorDisplacementHelperTypes.h"
+#include "WorkerThreadPool.h"
 
 #include <maya/MPxGPUDeformer.h>
 #include <maya/MGPUDeformerRegistry.h>
 #include <maya/MOpenCLInfo.h>
 
+#include <utility>
+#include <vector>
+
+
+// Device buffers of a single tile slot, used when the auxiliary data is streamed in tiles
+struct GpuTileBuffers
+{
+    MAutoCLMem textureData;
+    MAutoCLMem paintWeightData;
+    MAutoCLMem normalData;
+    MAutoCLMem tangentData;
+    MAutoCLMem binormalData;
+    MAutoCLEvent kernelFinishedEvent; // Last kernel that read this slot. The next upload to this slot waits for it.
+};
+
+
+// Host data being written into mapped buffers (or into host copies when tiled) on the shared worker threads. Buffers are mapped and unmapped on the evaluation thread.
+struct PendingBufferWrite
+{
+    WorkerThreadPool::Task task; // Writes the data. Not valid if mapping failed before the task was started.
+    std::vector<std::pair<void*, MAutoCLMem*>> mappedBuffers; // Mapped memory of each buffer, unmapped once the task is done. Empty for host copies.
+};
+
 
 // GPU implementation of the vector displacement deformer node
 class VectorDisplacementGpuDeformerNode : public MPxGPUDeformer
@@ -43,6 +69,23 @@ public:
                                             const MGPUDeformerData& inputData,
                                             MGPUDeformerData& outputData) override;
 
+    /**
+    * Deforms the geometry on the GPU. Called by evaluate, which measures it in auto backend mode.
+    *
+    * @param[in] block - Data block for this node
+    * @param[in] evaluationNode - Evaluation node that matches this deformer node
+    * @param[in] outputPlug - Output plug for this node
+    * @param[in] inputData - Input data for this deformer (vertex positions and geometry matrices)
+    * @param[in,out] outputData - Output buffer where the output data will be written to
+    *
+    * @return Deform result status
+    */
+    MPxGPUDeformer::DeformerStatus evaluateDeformer(MDataBlock& block,
+                                                    const MEvaluationNode& evaluationNode,
+                                                    const MPlug& outputPlug,
+                                                    const MGPUDeformerData& inputData,
+                                                    MGPUDeformerData& outputData);
+
     /**
     * Gets the input geometry connected to this node
     *
@@ -54,37 +97,169 @@ public:
     MObject getInputGeom(MDataBlock& data, unsigned int geomIndex) const;
 
     /**
-    * Gets the paint weight data of this node
+    * Initializes the kernel that matches the given displacement map type calculation and paint weights.
+    * The kernel variant and work group size are autotuned for the current device the first time it's used.
+    *
+    * @param[in] mapType - Displacement map type currently set in the node
+    * @param[in] weightMode - Paint weight handling the kernel is built for
+    * @param[in] data - Kernel data of the current evaluation (used for autotuning)
+    *
+    * @return Status of whether the operation was successful or not
+    */
+    MStatus initKernel(VectorDisplacementMapType mapType, WeightMode weightMode, const GpuKernelData& data);
+
+    /* Releases the displacement kernels, so they are built again with the launch configuration of the current vertex count */
+    void releaseDisplacementKernels();
+
+    /**
+    * Prepares and copies necessary data to the GPU. If the relevant attributes haven't changed it does nothing.
     *
     * @param[in] data - Data block that corresponds to this node
-    * @param[in] geomIndex - Geometry index of the mesh to be fetched
-    * @param[in] numOfElements - Total number of vertices
-    * @param[out] paintWeights - Paint weights will be stored here
+    * @param[in] evaluationNode - Evaluation node that corresponds to this node
+    * @param[in] plug - Output plug for this node
+    * @param[in] numOfElements - Number of vertices
     *
     * @return Status of whether the operation was successful or not
     */
-    MStatus getPaintWeights(MDataBlock& data, unsigned int geomIndex, unsigned int numOfElements, MFloatArray& paintWeights) const;
+    MStatus prepareAndCopyDataToGpu(MDataBlock& data, const MEvaluationNode& evaluationNode, const MPlug& plug, unsigned int numOfElements);
 
     /**
-    * Initializes the kernel that matches the given displacement map type calculation
+    * Copies the paint weights to the GPU. While painting, only the weights that changed since the last copy are updated and copied.
     *
-    * @param[in] mapType - Displacement map type currently set in the node
+    * @param[in] data - Data block that corresponds to this node
+    * @param[in] evaluationNode - Evaluation node that corresponds to this node
+    * @param[in] plug - Output plug for this node
+    * @param[in] numOfElements - Number of vertices
+    * @param[in] forceFullCopy - Whether all the weights need to be fetched and copied regardless of the recorded changes
     *
     * @return Status of whether the operation was successful or not
     */
-    MStatus initKernel(VectorDisplacementMapType mapType);
+    MStatus copyPaintWeightsToGpu(MDataBlock& data, const MEvaluationNode& evaluationNode, const MPlug& plug, unsigned int numOfElements, bool forceFullCopy);
 
     /**
-    * Prepares and copies necessary data to the GPU. If the relevant attributes haven't changed it does nothing.
+    * Samples the displacement map and copies the samples to the GPU, or to the host copy when tiled. Reads the mesh and the map through the Maya API,
+    * so it needs to be called from the evaluation thread. Samples are converted into the mapped buffer on a worker thread.
+    *
+    * @param[in] nodeObject - Deformer node
+    * @param[in] inputMesh - Input mesh of the geometry
+    * @param[in] uvSetName - UV set used to sample the map
+    * @param[in] proxyLevel - Proxy level to sample with (0 = Full quality)
+    * @param[in] filterResolution - Map table resolution of area sampling (0 = Point sampling)
+    * @param[in] seamSampling - Seam sampling mode
+    * @param[in] mapFilePath - Map file to look up in the warm-start cache first. Empty to always sample the map.
+    * @param[in] numOfElements - Number of vertices
+    * @param[in,out] pendingWrites - Buffer writes still running. The conversion of the samples is added here.
+    *
+    * @return Status of whether the operation was successful or not
+    */
+    MStatus copyTextureDataToGpu(const MObject& nodeObject, const MObject& inputMesh, const MString& uvSetName, unsigned int proxyLevel,
+                                 unsigned int filterResolution, SeamSamplingMode seamSampling, const MString& mapFilePath, unsigned int numOfElements,
+                                 std::vector<PendingBufferWrite>& pendingWrites);
+
+    /**
+    * Samples the displacement map into the scratch map colors, or into the texture data buffer when area filtering on the GPU
+    *
+    * @param[in] nodeObject - Deformer node
+    * @param[in] inputMesh - Input mesh of the geometry
+    * @param[in] uvSetName - UV set used to sample the map
+    * @param[in] proxyLevel - Proxy level to sample with (0 = Full quality)
+    * @param[in] filterResolution - Map table resolution of area sampling (0 = Point sampling)
+    * @param[in] seamSampling - Seam sampling mode
+    * @param[in] isFilteredOnGpu - Whether area-filtered samples are calculated by a kernel
+    * @param[in] numOfElements - Number of vertices
+    *
+    * @return Status of whether the operation was successful or not
+    */
+    MStatus sampleTextureData(const MObject& nodeObject, const MObject& inputMesh, const MString& uvSetName, unsigned int proxyLevel,
+                              unsigned int filterResolution, SeamSamplingMode seamSampling, bool isFilteredOnGpu, unsigned int numOfElements);
+
+    /**
+    * Calculates the vertex normals, tangents and binormals and copies them to the GPU, or to the host copies when tiled.
+    * Reads the mesh through the Maya API, so it needs to be called from the evaluation thread. Frames are copied into the mapped buffers on a worker thread.
+    *
+    * @param[in] inputMesh - Input mesh of the geometry
+    * @param[in] useWarmCache - Look up the frames in the warm-start cache first, and store them there when they are calculated
+    * @param[in,out] pendingWrites - Buffer writes still running. The copy of the frames is added here.
+    *
+    * @return Status of whether the operation was successful or not
+    */
+    MStatus copyFrameDataToGpu(const MObject& inputMesh, bool useWarmCache, std::vector<PendingBufferWrite>& pendingWrites);
+
+    /**
+    * Unmaps the buffers of the given writes once their data is written, which starts their upload
+    *
+    * @param[in,out] pendingWrites - Buffer writes to finish. Finished writes are removed.
+    * @param[in] waitForTasks - Whether to wait for every write. Otherwise only the writes that are already done are finished,
+    *                           so their uploads start while the rest of the data is read.
+    *
+    * @return Status of whether every finished buffer was unmapped
+    */
+    MStatus finishBufferWrites(std::vector<PendingBufferWrite>& pendingWrites, bool waitForTasks);
+
+    /**
+    * Copies the baked offsets to the GPU when the node is set to use a valid baked cache.
+    * Offsets are copied as object-space texture data with uniform paint weights, so the object-space kernel can apply them directly.
     *
     * @param[in] data - Data block that corresponds to this node
     * @param[in] evaluationNode - Evaluation node that corresponds to this node
     * @param[in] plug - Output plug for this node
     * @param[in] numOfElements - Number of vertices
+    * @param[in] forceCopy - Whether the offsets need to be copied even if the cache didn't change
+    *
+    * @return True if the baked cache is being used, false if the data needs to be calculated from the map instead
+    */
+    bool prepareAndCopyBakedDataToGpu(MDataBlock& data, const MEvaluationNode& evaluationNode, const MPlug& plug, unsigned int numOfElements, bool forceCopy);
+
+    /**
+    * Gets the number of vertices per tile. Tiling is used when the auxiliary per-vertex data (texture, weights and frames)
+    * doesn't fit in the GPU memory budget set in the node, or in a fraction of the device memory when no budget is set.
+    *
+    * @param[in] data - Data block that corresponds to this node
+    * @param[in] numOfElements - Number of vertices
+    *
+    * @return Vertices per tile, or 0 if tiling is not needed
+    */
+    unsigned int getTileSize(MDataBlock& data, unsigned int numOfElements) const;
+
+    /**
+    * Runs the kernel tile by tile. Each tile's auxiliary data is uploaded from the host copies into a small ring of tile buffers,
+    * on a separate queue so the upload of the next tile overlaps the kernel of the current one.
+    *
+    * @param[in] data - Kernel data for the whole mesh. Only the positions, vertex count and strength are used.
+    * @param[in] mapType - Displacement map type to calculate
+    * @param[in] weightMode - Paint weight handling of the tiled kernel
+    * @param[in] inputReadyEvent - Event signaled when the input positions are ready
+    * @param[out] finishedEvent - Event signaled when every tile is displaced
     *
     * @return Status of whether the operation was successful or not
     */
-    MStatus prepareAndCopyDataToGpu(MDataBlock& data, const MEvaluationNode& evaluationNode, const MPlug& plug, unsigned int numOfElements);
+    MStatus enqueueTiles(GpuKernelData data, VectorDisplacementMapType mapType, WeightMode weightMode, const MAutoCLEvent& inputReadyEvent, MAutoCLEvent& finishedEvent);
+
+    /**
+    * Calculates the relaxed offsets when the texture data, the frames or the relax settings changed since the last calculation.
+    * Relax iterations run as ping-pong kernels on Maya's queue, or on the host when tiled (the offsets are then streamed like the texture data).
+    *
+    * @param[in] data - Data block that corresponds to this node
+    * @param[in] plug - Output plug for this node
+    * @param[in] settings - Relax settings and map type of the current evaluation
+    * @param[in] numOfElements - Number of vertices
+    *
+    * @return Status of whether the operation was successful or not
+    */
+    MStatus prepareRelaxedOffsets(MDataBlock& data, const MPlug& plug, const RelaxSettings& settings, unsigned int numOfElements);
+
+    /**
+    * Fills the texture data buffer with the area-filtered samples of every vertex, using a kernel on Maya's queue.
+    * The map table is copied once per map, and the footprints and sampling order every time they're sampled.
+    *
+    * @param[in] numOfElements - Number of vertices
+    *
+    * @return Status of whether the operation was successful or not
+    */
+    MStatus enqueueAreaFilteredSamples(unsigned int numOfElements);
+
+    /* Releases the tile buffers and the host copies of the auxiliary data */
+    void releaseTileData();
 
     /**
     * Returns this deformer's registration info
@@ -102,8 +277,82 @@ private:
     MAutoCLMem tangentData;
     MAutoCLMem binormalData;
 
-    MAutoCLKernel kernelObjectSpace;
-    MAutoCLKernel kernelTangentSpace;
+    TraceTag traceTag; // Tag of the traced stages of the current evaluation
+
+    std::vector<float> paintWeights; // Host copy of the paint weight buffer
+    std::vector<unsigned int> changedWeightIndices;
+    std::vector<IndexRange> changedWeightRanges;
+    uint64_t paintWeightsVersion = 0; // Last weight change version copied to the GPU
+    bool arePaintWeightsZero = false; // Every paint weight is 0, so the deformer has no effect
+    bool isMeshDataSkipped = false; // Texture and frame data weren't updated because every paint weight was 0, so their dirty plugs were lost
+    bool arePaintWeightsUniform = true; // Every paint weight has the same value, so it's folded into the strength
+    float uniformPaintWeight = 1.f; // Value of every paint weight when they are uniform
+
+    MeshFingerprint meshFingerprint;
+    bool hasMeshFingerprint = false;
+    bool isTextureWarmStartPending = true; // Texture data hasn't been looked up in the warm-start cache yet (only done for the first fetch)
+    bool isFrameWarmStartPending = true; // Frames haven't been looked up in the warm-start cache yet (only done for the first fetch)
+    std::vector<float> vertexUvs; // 2 values per vertex (U, V). Empty when they need to be gathered again.
+    UvSamplingOrder samplingOrder; // Built with the UVs
+    EvaluationScratch scratch; // Temporaries reused by every evaluation
+
+    ProxySampling proxySampling;
+    unsigned int textureProxyLevel = 0; // Proxy level the texture data was sampled with (0 = Full quality)
+
+    // Area sampling. Samples are box-filtered from the map table by a kernel, or on the host when tiled.
+
+    unsigned int textureFilterResolution = 0; // Filter resolution the texture data was sampled with (0 = Point sampling)
+    SummedAreaTable mapTable; // Host copy of the map table. Cleared when the map changes.
+    std::vector<float> uvFootprints; // 4 values per sampling order entry (U, V, half width, half height). Empty when they need to be gathered again.
+    MAutoCLMem mapTableData;
+    MAutoCLMem uvFootprintData;
+    MAutoCLMem samplingOrderData; // Vertex index of each footprint
+    MAutoCLKernel kernelAreaFilteredSamples;
+
+    // Seam averaging. Samples of the distinct UVs are combined per vertex on the host, so area samples are filtered on the host too.
+
+    SeamSamplingMode textureSeamSampling = SeamSamplingMode::FIRST_ISLAND; // Seam sampling the texture data was sampled with
+    SeamUvSamples seamSamples; // Gathered when averaging seams for the first time. Cleared when the UVs or the topology change.
+
+    VectorDisplacementCacheFile bakedCache;
+    bool isUsingBakedCache = false; // True when the buffers hold baked offsets instead of the map data
+    uint64_t bakedMappingVersion = 0; // Mapping version of the cache file the baked offsets were copied from
+    std::vector<float> uniformWeights; // Paint weights used with baked offsets
+    bool areBuffersStale = false; // Evaluations were passed through, so dirty plugs since the last copy are unknown
+
+    // Tiled execution. Auxiliary data is kept on the host and streamed through the tile slots when dispatching.
+
+    bool isTiled = false;
+    unsigned int tileSize = 0;
+    std::vector<float> hostTextureData; // 3 values per vertex (RGB)
+    std::vector<float> hostNormals;
+    std::vector<float> hostTangents;
+    std::vector<float> hostBinormals;
+    const float* tiledBakedOffsets = nullptr; // Baked offsets read from the mapped cache file
+    std::vector<GpuTileBuffers> tileSlots;
+    cl_command_queue uploadQueue = nullptr;
+    MAutoCLKernel kernelObjectSpaceTiled[3]; // Indexed by weight mode
+    MAutoCLKernel kernelTangentSpaceTiled[3];
+
+    // Relax pass. Relaxed offsets are applied as object-space displacement instead of the texture data.
+
+    bool isRelaxing = false; // Current evaluation applies relaxed offsets
+    bool areRelaxedOffsetsStale = true; // Texture data or frames changed since the offsets were relaxed
+    RelaxSettings relaxSettings; // Settings the relaxed offsets were calculated with
+    VertexAdjacency adjacency; // Host copy of the adjacency. Cleared when the topology changes.
+    MAutoCLMem adjacencyOffsetData;
+    MAutoCLMem adjacencyIndexData;
+    MAutoCLMem relaxOffsetData[2]; // Ping-pong buffers of the relax iterations
+    unsigned int relaxResultIndex = 0; // Ping-pong buffer that holds the relaxed offsets
+    std::vector<float> hostRelaxedOffsets; // Relaxed offsets when tiled (3 values per vertex)
+    MAutoCLKernel kernelTangentSpaceOffsets;
+    MAutoCLKernel kernelRelaxOffsets;
+
+    MAutoCLKernel kernelObjectSpace[3]; // Indexed by weight mode. Each variant is built the first time it's used.
+    MAutoCLKernel kernelTangentSpace[3];
+    KernelLaunchConfig objectSpaceLaunchConfig;
+    KernelLaunchConfig tangentSpaceLaunchConfig;
+    unsigned int kernelSizeBucket = 0; // Vertex count bucket the launch configurations were tuned for
     size_t localWorkSize = 0;
     size_t globalWorkSize = 0;
 };
@@ -8,8 +8,22 @@
 
 #pragma once
 
+#include "SummedAreaTable.h"
+#include "VectorDisplacementRelax.h"
+
+#include <maya/MDoubleArray.h>
+#include <maya/MFloatArray.h>
+#include <maya/MFloatVectorArray.h>
+#include <maya/MIntArray.h>
 #include <maya/MPoint.h>
+#include <maya/MString.h>
 #include <maya/MVector.h>
+#include <maya/MVectorArray.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <vector>
 
 
 enum class VectorDisplacementMapType : int
@@ -18,6 +32,53 @@ enum class VectorDisplacementMapType : int
     TANGENT_SPACE = 1
 };
 
+enum class MeshChangeType : int
+{
+    NONE = 0, // Input geometry did not change
+    POINTS = 1, // Same topology and UVs, only the points changed
+    UVS = 2, // Same topology, UVs changed
+    TOPOLOGY = 3 // Vertex count or face-vertex connectivity changed
+};
+
+enum class EvaluationQuality : int
+{
+    FULL = 0, // Displacement map is sampled at every vertex
+    PROXY = 1 // Displacement map is sampled at a subset of vertices and interpolated for the rest (interactive sessions only)
+};
+
+enum class WeightMode : int
+{
+    NONE = 0, // Every paint weight is 1 and so is the strength, so map offsets are applied as they are
+    UNIFORM = 1, // Every paint weight has the same value, which is folded into the strength
+    PAINTED = 2 // Paint weights are read per vertex
+};
+
+enum class WeightChangeConsumer : int
+{
+    CPU = 0, // Dense paint weights of the CPU deformer
+    GPU = 1, // Paint weight buffer of the GPU deformer
+    COUNT = 2
+};
+
+enum class MapSamplingMode : int
+{
+    POINT = 0, // Map is sampled at the UV of each vertex
+    AREA = 1 // Map is box-filtered over the UV footprint of each vertex
+};
+
+enum class SeamSamplingMode : int
+{
+    FIRST_ISLAND = 0, // Each vertex samples the UV of its first face-vertex
+    AVERAGE = 1 // Each vertex averages the samples of every distinct UV of its face-vertices, so vertices on UV seams blend their islands (object-space maps only)
+};
+
+enum class BackendMode : int
+{
+    GPU = 0, // GPU deformer whenever GPU override can evaluate the node
+    CPU = 1, // Always the CPU deformer
+    AUTO = 2 // Backend of each geometry is chosen from its measured evaluation cost
+};
+
 struct VertexData
 {
     MPoint position;
@@ -27,6 +88,187 @@ struct VertexData
     MVector binormal;
 };
 
+struct MeshFingerprint
+{
+    unsigned int vertexCount = 0;
+    uint64_t topology = 0; // Hash of the face vertex counts and face-vertex connectivity
+    uint64_t uvs = 0; // Hash of the UV values and the face-vertex UV assignments
+    MString uvSetName; // UV set requested when calculating the UV hash (empty = first UV set). Not compared.
+
+    bool operator==(const MeshFingerprint& other) const
+    {
+        return vertexCount == other.vertexCount && topology == other.topology && uvs == other.uvs;
+    }
+
+    bool operator!=(const MeshFingerprint& other) const
+    {
+        return !(*this == other);
+    }
+};
+
+struct ProxySampling
+{
+    unsigned int level = 0; // Every vertex is at most this many edges away from a sampled vertex. 0 = Not built.
+    std::vector<unsigned int> sampledVertices; // Vertices where the displacement map is sampled
+    std::vector<unsigned int> interpolationOffsets; // First interpolation entry of each vertex (plus one extra entry at the end)
+    std::vector<unsigned int> interpolationSources; // Index in sampledVertices of each interpolation entry
+    std::vector<float> interpolationWeights; // Normalized weight of each interpolation entry
+};
+
+struct RelaxSettings
+{
+    unsigned int iterations = 0; // 0 = Relax disabled
+    float strength = 0.f;
+    VectorDisplacementMapType mapType = VectorDisplacementMapType::OBJECT_SPACE; // Map type the offsets were calculated with
+
+    bool operator==(const RelaxSettings& other) const
+    {
+        return iterations == other.iterations && strength == other.strength && mapType == other.mapType;
+    }
+
+    bool operator!=(const RelaxSettings& other) const
+    {
+        return !(*this == other);
+    }
+};
+
+struct GeometryDirtyFlags
+{
+    bool isGeometryDirty = true; // Input geometry was dirtied since the fingerprint was calculated
+    bool isMapDirty = true; // Displacement map was dirtied since the texture data was sampled
+    bool isWeightListDirty = true; // Paint weights were dirtied since the weight array was updated
+};
+
+// Order the map is sampled in. Vertices follow a Morton curve through their UVs, so consecutive samples read nearby texels.
+struct UvSamplingOrder
+{
+    std::vector<unsigned int> vertices; // Vertex index of each entry
+    std::vector<float> uvs; // 2 values per entry (U, V), stored in sampling order so they're read sequentially
+
+    bool isEmpty() const { return vertices.empty(); }
+};
+
+// Distinct UVs of the face-vertices of a mesh. Each one is sampled once and the samples of each vertex are combined, so vertices on UV seams see every island.
+struct SeamUvSamples
+{
+    std::vector<float> uvs; // 2 values per sample (U, V). One sample per distinct UV used by a face-vertex.
+    std::vector<unsigned int> uvSamples; // Sample of each UV of the UV set (INVALID_SAMPLE when no face-vertex uses it)
+    std::vector<unsigned int> vertexSampleOffsets; // First entry of each vertex in vertexSamples (plus one extra entry at the end)
+    std::vector<unsigned int> vertexSamples; // Samples of each vertex, in face order (first island first)
+    UvSamplingOrder samplingOrder; // Built with the samples (its vertex indices are sample indices)
+    std::vector<float> footprints; // 4 values per sampling order entry (U, V, half width, half height). Empty when they need to be gathered again.
+
+    bool isEmpty() const { return vertexSampleOffsets.empty(); }
+
+    static constexpr unsigned int INVALID_SAMPLE = 0xFFFFFFFF;
+};
+
+struct GeometryCache
+{
+    MeshFingerprint fingerprint;
+
+    bool hasTextureData = false;
+    unsigned int textureProxyLevel = 0; // Proxy level the texture data was sampled with (0 = Full quality)
+    ProxySampling proxySampling;
+    unsigned int textureFilterResolution = 0; // Filter resolution the texture data was sampled with (0 = Point sampling)
+    std::vector<float> vertexUvs; // 2 values per vertex (U, V). Empty when they need to be gathered again.
+    UvSamplingOrder samplingOrder; // Built with the UVs
+    std::vector<float> uvFootprints; // 4 values per sampling order entry (U, V, half width, half height). Empty when they need to be gathered again.
+    SeamSamplingMode textureSeamSampling = SeamSamplingMode::FIRST_ISLAND; // Seam sampling the texture data was sampled with
+    SeamUvSamples seamSamples; // Gathered when averaging seams for the first time. Cleared when the UVs or the topology change.
+    SummedAreaTable mapTable; // Built when area sampling for the first time. Cleared when the map changes.
+    MVectorArray mapColor;
+    MDoubleArray mapAlpha;
+    bool isTextureWarmStartPending = true; // Texture data hasn't been looked up in the warm-start cache yet (only done for the first fetch)
+
+    bool hasVertexData = false;
+    MFloatVectorArray normals;
+    MFloatVectorArray tangents;
+    MFloatVectorArray binormals;
+    bool isFrameWarmStartPending = true; // Frames haven't been looked up in the warm-start cache yet (only done for the first fetch)
+
+    VertexAdjacency adjacency; // Built when relaxing for the first time. Cleared when the topology changes.
+    bool hasRelaxedOffsets = false;
+    RelaxSettings relaxSettings; // Settings the relaxed offsets were calculated with
+    std::vector<float> relaxedOffsets; // 3 values per vertex. Strength and paint weights are not applied.
+
+    std::vector<float> paintWeights; // Dense paint weights, one per vertex
+    uint64_t paintWeightsVersion = 0; // Last weight change version applied to the paint weights
+    bool areWeightsUniform = true; // All the paint weights have the same value (e.g. weights were never painted)
+    float uniformWeight = 1.f; // Value of every paint weight when they are uniform
+};
+
+struct IndexRange
+{
+    unsigned int first = 0;
+    unsigned int count = 0;
+};
+
+struct WeightChangeJournal
+{
+    uint64_t baseVersion = 1; // Consumers that last saw an older version need to fetch all the weights again
+    std::vector<unsigned int> changedIndices; // Entry i was recorded at version (baseVersion + i + 1)
+    uint64_t consumerVersions[static_cast<int>(WeightChangeConsumer::COUNT)] = {}; // Version last seen by each consumer (0 = Not consuming the journal)
+
+    uint64_t currentVersion() const
+    {
+        return baseVersion + changedIndices.size();
+    }
+
+    bool hasConsumers() const
+    {
+        return std::any_of(std::begin(consumerVersions), std::end(consumerVersions), [](uint64_t version) { return version != 0; });
+    }
+};
+
+struct KernelLaunchConfig
+{
+    unsigned int verticesPerWorkItem = 1; // 1, 2, 4 or 8
+    bool useVectorLoads = false; // Use the float4 load/store variant (only with 4 vertices per work item)
+    size_t localWorkSize = 0; // 0 = Kernel maximum work group size
+};
+
+/*
+ * Temporaries reused by every evaluation of a node, so steady-state evaluation doesn't allocate.
+ * Arrays keep their storage between evaluations and only grow when a bigger mesh is evaluated.
+ * Worker threads only use the arrays they were handed (e.g. map colors while they're converted into GPU buffers), so the evaluation thread keeps
+ * to the other arrays until they're done.
+ */
+struct EvaluationScratch
+{
+    // Mesh connectivity and UVs (fingerprints and UV gathering)
+    MIntArray faceVertexCounts;
+    MIntArray faceVertexIds;
+    MIntArray uvCounts;
+    MIntArray uvIds;
+    MFloatArray uCoords;
+    MFloatArray vCoords;
+    std::vector<char> vertexFlags;
+
+    // Texture sampling
+    MDoubleArray sampleUCoords;
+    MDoubleArray sampleVCoords;
+    MVectorArray sampledColors;
+    MDoubleArray sampledAlphas;
+    MVectorArray seamSampleColors; // Samples of the distinct UVs, before they're combined per vertex
+    MDoubleArray seamSampleAlphas;
+
+    // Vertex frames
+    MIntArray faceVertices;
+
+    // Relax pass
+    std::vector<float> relaxOffsets;
+
+    // Data fetched before copying it to the GPU
+    MVectorArray mapColor;
+    MDoubleArray mapAlpha;
+    MFloatVectorArray normals;
+    MFloatVectorArray tangents;
+    MFloatVectorArray binormals;
+
+    std::vector<unsigned int> changedWeightIndices;
+};
+
 struct GpuKernelData
 {
     MAutoCLMem* inputPositions;
@@ -38,4 +280,6 @@ struct GpuKernelData
     MAutoCLMem* binormalData;
     unsigned int numOfElements = 0;
     float strength = 1.f;
+    bool isTiled = false; // Auxiliary buffers only hold one tile, starting at firstVertex
+    unsigned int firstVertex = 0;
 };
\ No newline at end of file
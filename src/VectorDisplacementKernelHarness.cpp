@@ -0,0 +1,1053 @@
+/* Copyright (C) 2020 - Jose Ivan Lopez Romo - All rights reserved
+ *
+ * This file is part of the MayaVectorDisplacementDeformer project found in the
+ * following repository: https://github.com/Zhibade/maya-vector-displacement-deformer
+ *
+ * Released under MIT license. Please see LICENSE file for details.
+ */
+
+/*
+ * Standalone host program for the kernels in VectorDisplacementDeformer.cl. Runs every displacement variant, and the tangent-space offset,
+ * relax and area filtering kernels, on any OpenCL device with synthetic data. Checks the output against the CPU reference
+ * (VectorDisplacementMath, VectorDisplacementRelax and SummedAreaTable) and reports the device time and effective bandwidth of each kernel.
+ */
+
+#define CL_TARGET_OPENCL_VERSION 120
+#define CL_USE_DEPRECATED_OPENCL_1_2_APIS
+
+#include "SummedAreaTable.h"
+#include "VectorDisplacementMath.h"
+#include "VectorDisplacementRelax.h"
+
+#ifdef __APPLE__
+#include <OpenCL/cl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <numeric>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+
+namespace
+{
+    constexpr unsigned int DEFAULT_VERTEX_COUNT = 1 << 20;
+    constexpr unsigned int DEFAULT_ITERATIONS = 20;
+    constexpr unsigned int TILE_COUNT = 2; // Tiled kernels are run in this many tiles so the first vertex offset is exercised
+    constexpr float STRENGTH = 0.75f;
+    constexpr float MAX_RELATIVE_ERROR = 1e-5f;
+    constexpr float RELAX_STRENGTH = 0.5f;
+    constexpr unsigned int AREA_MAP_WIDTH = 1024; // Size of the map filtered by AreaFilteredSamples
+    constexpr unsigned int AREA_MAP_HEIGHT = 512;
+    constexpr float MAX_FOOTPRINT_HALF_SIZE = 0.02f; // In UV units. Footprints range from under a texel to tens of texels.
+    constexpr const char* WEIGHT_MODE_NAMES[] = { "none", "uniform", "painted" }; // Indexed by the WEIGHT_MODE values of the kernel file
+
+    /* Command-line options */
+    struct HarnessOptions
+    {
+        std::string kernelPath = "VectorDisplacementDeformer.cl";
+        unsigned int vertexCount = DEFAULT_VERTEX_COUNT;
+        unsigned int iterations = DEFAULT_ITERATIONS;
+        int platformIndex = -1; // -1 = First platform with a GPU, or the first device found
+        int deviceIndex = 0;
+        size_t localWorkSize = 0; // 0 = Kernel maximum work group size
+        int weightMode = 2; // WEIGHT_MODE the kernel file is built with (0 = None, 1 = Uniform, 2 = Painted)
+        bool listDevices = false;
+    };
+
+    /* Kernel variant to run, matching GpuDeformerUtilities::getKernelName and getTiledKernelName */
+    struct KernelCase
+    {
+        std::string name;
+        bool isTangentSpace;
+        unsigned int verticesPerWorkItem;
+        bool isTiled;
+    };
+
+    /* Synthetic input data and CPU reference output. Float3 arrays are tightly packed, like the float3 buffers of the deformer. */
+    struct HarnessData
+    {
+        std::vector<Float3> positions;
+        std::vector<Float3> mapData;
+        std::vector<float> paintWeights;
+        std::vector<Float3> normals;
+        std::vector<Float3> tangents;
+        std::vector<Float3> binormals;
+
+        std::vector<Float3> objectSpaceReference;
+        std::vector<Float3> tangentSpaceReference;
+    };
+
+    /* Argument of a kernel that isn't a displacement variant, passed as is to clSetKernelArg */
+    struct KernelArgument
+    {
+        size_t size;
+        const void* value;
+    };
+
+    /* Owns an OpenCL memory object */
+    class ClBuffer final
+    {
+    public:
+        ClBuffer() {};
+        ~ClBuffer() { reset(); }
+
+        ClBuffer(const ClBuffer&) = delete;
+        ClBuffer& operator=(const ClBuffer&) = delete;
+
+        /** Creates a buffer. When data is given, it's copied to the buffer. Returns false if the buffer could not be created. */
+        bool create(cl_context context, cl_mem_flags flags, size_t size, const void* data)
+        {
+            reset();
+
+            cl_int err = CL_SUCCESS;
+            memory = clCreateBuffer(context, flags | (data ? CL_MEM_COPY_HOST_PTR : 0), size, const_cast<void*>(data), &err);
+
+            return err == CL_SUCCESS;
+        }
+
+        /* Releases the buffer, if any */
+        void reset()
+        {
+            if (memory)
+            {
+                clReleaseMemObject(memory);
+                memory = nullptr;
+            }
+        }
+
+        cl_mem memory = nullptr;
+    };
+
+    /* Device buffers of the whole mesh, or of one tile for the auxiliary data of tiled kernels */
+    struct KernelBuffers
+    {
+        ClBuffer mapData;
+        ClBuffer paintWeights;
+        ClBuffer normals;
+        ClBuffer tangents;
+        ClBuffer binormals;
+    };
+
+    bool checkClError(cl_int err, const char* operation)
+    {
+        if (err != CL_SUCCESS)
+        {
+            std::fprintf(stderr, "OpenCL error %d: %s\n", err, operation);
+            return false;
+        }
+
+        return true;
+    }
+
+    std::string getPlatformInfo(cl_platform_id platform, cl_platform_info info)
+    {
+        char text[256] = {};
+        clGetPlatformInfo(platform, info, sizeof(text) - 1, text, nullptr);
+        return text;
+    }
+
+    std::string getDeviceInfo(cl_device_id device, cl_device_info info)
+    {
+        char text[256] = {};
+        clGetDeviceInfo(device, info, sizeof(text) - 1, text, nullptr);
+        return text;
+    }
+
+    /**
+    * Selects the device to run the kernels on
+    *
+    * @param[in] options - Harness options
+    * @param[out] device - Selected device
+    *
+    * @return True if a device was found
+    */
+    bool selectDevice(const HarnessOptions& options, cl_device_id& device)
+    {
+        cl_uint platformCount = 0;
+        if (clGetPlatformIDs(0, nullptr, &platformCount) != CL_SUCCESS || platformCount == 0)
+        {
+            std::fprintf(stderr, "No OpenCL platforms found. Install an OpenCL driver (e.g. PoCL for CPUs).\n");
+            return false;
+        }
+
+        std::vector<cl_platform_id> platforms(platformCount);
+        clGetPlatformIDs(platformCount, platforms.data(), nullptr);
+
+        std::vector<std::vector<cl_device_id>> platformDevices(platformCount);
+
+        for (cl_uint i = 0; i < platformCount; i++)
+        {
+            cl_uint deviceCount = 0;
+            if (clGetDeviceIDs(platforms[i], CL_DEVICE_TYPE_ALL, 0, nullptr, &deviceCount) == CL_SUCCESS && deviceCount > 0)
+            {
+                platformDevices[i].resize(deviceCount);
+                clGetDeviceIDs(platforms[i], CL_DEVICE_TYPE_ALL, deviceCount, platformDevices[i].data(), nullptr);
+            }
+
+            if (options.listDevices)
+            {
+                std::printf("Platform %u: %s\n", i, getPlatformInfo(platforms[i], CL_PLATFORM_NAME).c_str());
+
+                for (size_t j = 0; j < platformDevices[i].size(); j++)
+                {
+                    std::printf("  Device %zu: %s\n", j, getDeviceInfo(platformDevices[i][j], CL_DEVICE_NAME).c_str());
+                }
+            }
+        }
+
+        if (options.platformIndex >= 0)
+        {
+            if (options.platformIndex >= static_cast<int>(platformCount) || options.deviceIndex < 0 ||
+                options.deviceIndex >= static_cast<int>(platformDevices[options.platformIndex].size()))
+            {
+                std::fprintf(stderr, "Device %d of platform %d not found. Use --list to see the available devices.\n", options.deviceIndex, options.platformIndex);
+                return false;
+            }
+
+            device = platformDevices[options.platformIndex][options.deviceIndex];
+            return true;
+        }
+
+        // Prefer GPUs, like Maya does
+
+        for (const std::vector<cl_device_id>& devices : platformDevices)
+        {
+            for (cl_device_id candidate : devices)
+            {
+                cl_device_type type = 0;
+                clGetDeviceInfo(candidate, CL_DEVICE_TYPE, sizeof(type), &type, nullptr);
+
+                if (type & CL_DEVICE_TYPE_GPU)
+                {
+                    device = candidate;
+                    return true;
+                }
+            }
+        }
+
+        for (const std::vector<cl_device_id>& devices : platformDevices)
+        {
+            if (!devices.empty())
+            {
+                device = devices[0];
+                return true;
+            }
+        }
+
+        std::fprintf(stderr, "No OpenCL devices found\n");
+        return false;
+    }
+
+    /**
+    * Builds the kernel file
+    *
+    * @param[in] context - OpenCL context
+    * @param[in] device - Device to build for
+    * @param[in] path - Path of the kernel file
+    * @param[in] weightMode - Paint weight handling the displacement kernels are specialized for
+    * @param[out] program - Built program
+    *
+    * @return True if the program was built successfully
+    */
+    bool buildProgram(cl_context context, cl_device_id device, const std::string& path, int weightMode, cl_program& program)
+    {
+        std::ifstream stream(path, std::ios::binary);
+        if (!stream)
+        {
+            std::fprintf(stderr, "Could not open kernel file: %s\n", path.c_str());
+            return false;
+        }
+
+        std::stringstream source;
+        source << stream.rdbuf();
+        std::string sourceText = source.str();
+
+        const char* sourcePointer = sourceText.c_str();
+        size_t sourceLength = sourceText.size();
+
+        cl_int err = CL_SUCCESS;
+        program = clCreateProgramWithSource(context, 1, &sourcePointer, &sourceLength, &err);
+        if (!checkClError(err, "clCreateProgramWithSource"))
+        {
+            return false;
+        }
+
+        std::string buildOptions = "-D WEIGHT_MODE=" + std::to_string(weightMode);
+
+        err = clBuildProgram(program, 1, &device, buildOptions.c_str(), nullptr, nullptr);
+        if (err != CL_SUCCESS)
+        {
+            size_t logSize = 0;
+            clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, 0, nullptr, &logSize);
+
+            std::string log(logSize, '\0');
+            clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, logSize, &log[0], nullptr);
+
+            std::fprintf(stderr, "Could not build %s:\n%s\n", path.c_str(), log.c_str());
+            return false;
+        }
+
+        return true;
+    }
+
+    /**
+    * Generates random input data with orthonormal vertex frames, and the CPU reference output of both map types
+    *
+    * @param[in] vertexCount - Number of vertices
+    * @param[in] weightMode - Paint weight handling of the kernels (the paint weights are only applied by the painted variants)
+    * @param[out] data - Generated data
+    */
+    void generateData(unsigned int vertexCount, int weightMode, HarnessData& data)
+    {
+        std::mt19937 generator(1234);
+        std::uniform_real_distribution<float> distribution(-1.f, 1.f);
+        std::uniform_real_distribution<float> weightDistribution(0.f, 1.f);
+
+        auto randomVector = [&]() { return Float3(distribution(generator), distribution(generator), distribution(generator)); };
+
+        data.positions.resize(vertexCount);
+        data.mapData.resize(vertexCount);
+        data.paintWeights.resize(vertexCount);
+        data.normals.resize(vertexCount);
+        data.tangents.resize(vertexCount);
+        data.binormals.resize(vertexCount);
+        data.objectSpaceReference.resize(vertexCount);
+        data.tangentSpaceReference.resize(vertexCount);
+
+        for (unsigned int i = 0; i < vertexCount; i++)
+        {
+            data.positions[i] = randomVector() * 10.f;
+            data.mapData[i] = randomVector();
+            data.paintWeights[i] = weightDistribution(generator);
+
+            Float3 normal = randomVector() + Float3(0.f, 0.f, 2.f); // Keeps it away from zero length
+            normal.normalize();
+
+            Float3 tangent = randomVector() + Float3(2.f, 0.f, 0.f);
+            tangent = tangent - normal * normal.dot(tangent);
+            tangent.normalize();
+
+            data.normals[i] = normal;
+            data.tangents[i] = tangent;
+            data.binormals[i] = normal.cross(tangent);
+
+            // Paint weights scale the strength, like in the deformer. Uniform variants only apply the strength, and the others neither.
+
+            float strength = weightMode == 0 ? 1.f : (weightMode == 1 ? STRENGTH : STRENGTH * data.paintWeights[i]);
+
+            data.objectSpaceReference[i] = data.positions[i] + VectorDisplacementMath::getObjectSpaceOffset(data.mapData[i], strength);
+            data.tangentSpaceReference[i] = data.positions[i] +
+                VectorDisplacementMath::getTangentSpaceOffset(data.normals[i], data.tangents[i], data.binormals[i], data.mapData[i], strength);
+        }
+    }
+
+    /**
+    * Uploads the auxiliary data of the given vertex range
+    *
+    * @param[in] context - OpenCL context
+    * @param[in] data - Input data
+    * @param[in] firstVertex - First vertex of the range
+    * @param[in] count - Number of vertices of the range
+    * @param[in] isTangentSpace - Whether the vertex frames are needed
+    * @param[out] buffers - Created buffers
+    *
+    * @return True if every buffer was created
+    */
+    bool createBuffers(cl_context context, const HarnessData& data, unsigned int firstVertex, unsigned int count, bool isTangentSpace, KernelBuffers& buffers)
+    {
+        size_t float3Size = sizeof(float) * 3 * count;
+        bool isSuccessful = buffers.mapData.create(context, CL_MEM_READ_ONLY, float3Size, &data.mapData[firstVertex]) &&
+                            buffers.paintWeights.create(context, CL_MEM_READ_ONLY, sizeof(float) * count, &data.paintWeights[firstVertex]);
+
+        if (isTangentSpace)
+        {
+            isSuccessful = isSuccessful &&
+                           buffers.normals.create(context, CL_MEM_READ_ONLY, float3Size, &data.normals[firstVertex]) &&
+                           buffers.tangents.create(context, CL_MEM_READ_ONLY, float3Size, &data.tangents[firstVertex]) &&
+                           buffers.binormals.create(context, CL_MEM_READ_ONLY, float3Size, &data.binormals[firstVertex]);
+        }
+
+        return isSuccessful;
+    }
+
+    /**
+    * Sets the kernel arguments in the same order as GpuDeformerUtilities::sendParametersToKernel
+    *
+    * @param[in] kernel - Kernel to set the arguments of
+    * @param[in] kernelCase - Kernel variant
+    * @param[in] inputPositions - Initial positions of the whole mesh
+    * @param[in] buffers - Auxiliary data
+    * @param[in] count - Number of vertices to process
+    * @param[in] firstVertex - First vertex to process (tiled kernels only)
+    * @param[in] outputPositions - Output positions of the whole mesh
+    *
+    * @return True if every argument was set
+    */
+    bool setKernelArguments(cl_kernel kernel, const KernelCase& kernelCase, cl_mem inputPositions, const KernelBuffers& buffers,
+                            cl_uint count, cl_uint firstVertex, cl_mem outputPositions)
+    {
+        cl_uint parameterId = 0;
+        cl_float strength = STRENGTH;
+        cl_int err = CL_SUCCESS;
+
+        err |= clSetKernelArg(kernel, parameterId++, sizeof(cl_mem), &inputPositions);
+        err |= clSetKernelArg(kernel, parameterId++, sizeof(cl_mem), &buffers.mapData.memory);
+        err |= clSetKernelArg(kernel, parameterId++, sizeof(cl_mem), &buffers.paintWeights.memory);
+        err |= clSetKernelArg(kernel, parameterId++, sizeof(cl_float), &strength);
+
+        if (kernelCase.isTangentSpace)
+        {
+            err |= clSetKernelArg(kernel, parameterId++, sizeof(cl_mem), &buffers.normals.memory);
+            err |= clSetKernelArg(kernel, parameterId++, sizeof(cl_mem), &buffers.tangents.memory);
+            err |= clSetKernelArg(kernel, parameterId++, sizeof(cl_mem), &buffers.binormals.memory);
+        }
+
+        err |= clSetKernelArg(kernel, parameterId++, sizeof(cl_uint), &count);
+
+        if (kernelCase.isTiled)
+        {
+            err |= clSetKernelArg(kernel, parameterId++, sizeof(cl_uint), &firstVertex);
+        }
+
+        err |= clSetKernelArg(kernel, parameterId++, sizeof(cl_mem), &outputPositions);
+
+        return checkClError(err, "clSetKernelArg");
+    }
+
+    /**
+    * Calculates the work sizes like GpuDeformerUtilities::calculateWorkSize
+    *
+    * @param[in] kernel - Kernel to launch
+    * @param[in] device - Device the kernel runs on
+    * @param[in] count - Number of vertices
+    * @param[in] verticesPerWorkItem - Vertices processed by each work item
+    * @param[in] requestedLocalWorkSize - Requested local work size (0 = Kernel maximum)
+    * @param[out] localWorkSize - Local work size
+    * @param[out] globalWorkSize - Global work size (multiple of the local work size)
+    */
+    void calculateWorkSize(cl_kernel kernel, cl_device_id device, unsigned int count, unsigned int verticesPerWorkItem, size_t requestedLocalWorkSize,
+                           size_t& localWorkSize, size_t& globalWorkSize)
+    {
+        size_t maxWorkSize = 1;
+        clGetKernelWorkGroupInfo(kernel, device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &maxWorkSize, nullptr);
+
+        localWorkSize = requestedLocalWorkSize > 0 && requestedLocalWorkSize < maxWorkSize ? requestedLocalWorkSize : std::max(maxWorkSize, static_cast<size_t>(1));
+
+        size_t numOfWorkItems = (count + verticesPerWorkItem - 1) / verticesPerWorkItem;
+        globalWorkSize = (numOfWorkItems + localWorkSize - 1) / localWorkSize * localWorkSize;
+    }
+
+    /**
+    * Launches a kernel with its arguments already set and waits for it
+    *
+    * @param[in] kernel - Kernel to launch
+    * @param[in] device - Device the kernel runs on
+    * @param[in] queue - Command queue (with profiling enabled)
+    * @param[in] count - Number of vertices
+    * @param[in] verticesPerWorkItem - Vertices processed by each work item
+    * @param[in] requestedLocalWorkSize - Requested local work size (0 = Kernel maximum)
+    * @param[out] localWorkSize - Local work size
+    * @param[out] timeMs - Device time of the launch
+    *
+    * @return True if the kernel ran
+    */
+    bool launchKernel(cl_kernel kernel, cl_device_id device, cl_command_queue queue, unsigned int count, unsigned int verticesPerWorkItem,
+                      size_t requestedLocalWorkSize, size_t& localWorkSize, double& timeMs)
+    {
+        size_t globalWorkSize = 0;
+        calculateWorkSize(kernel, device, count, verticesPerWorkItem, requestedLocalWorkSize, localWorkSize, globalWorkSize);
+
+        cl_event event = nullptr;
+        cl_int err = clEnqueueNDRangeKernel(queue, kernel, 1, nullptr, &globalWorkSize, &localWorkSize, 0, nullptr, &event);
+        if (!checkClError(err, "clEnqueueNDRangeKernel"))
+        {
+            return false;
+        }
+
+        clWaitForEvents(1, &event);
+
+        cl_ulong startTime = 0;
+        cl_ulong endTime = 0;
+        clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_START, sizeof(startTime), &startTime, nullptr);
+        clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_END, sizeof(endTime), &endTime, nullptr);
+        clReleaseEvent(event);
+
+        timeMs = (endTime - startTime) * 1e-6;
+        return true;
+    }
+
+    /** Returns the largest error of the output relative to the CPU reference. NaN outputs count as infinite errors. */
+    float getMaxRelativeError(const std::vector<Float3>& output, const std::vector<Float3>& reference)
+    {
+        float maxError = 0.f;
+
+        for (size_t i = 0; i < output.size(); i++)
+        {
+            float error = (output[i] - reference[i]).length() / std::max(reference[i].length(), 1.f);
+            maxError = std::max(maxError, std::isnan(error) ? INFINITY : error);
+        }
+
+        return maxError;
+    }
+
+    /**
+    * Prints the results of a kernel as a row of the result table
+    *
+    * @param[in] name - Kernel name
+    * @param[in] localWorkSize - Local work size
+    * @param[in] minTimeMs - Fastest timed run
+    * @param[in] averageTimeMs - Average of the timed runs
+    * @param[in] bytesPerRun - Bytes read and written by each run
+    * @param[in] maxError - Largest error relative to the CPU reference
+    *
+    * @return True if the output matches the CPU reference
+    */
+    bool printResult(const std::string& name, size_t localWorkSize, double minTimeMs, double averageTimeMs, double bytesPerRun, float maxError)
+    {
+        double bandwidth = minTimeMs > 0.0 ? bytesPerRun / (minTimeMs * 1e-3) / 1e9 : 0.0;
+        bool isCorrect = maxError <= MAX_RELATIVE_ERROR;
+
+        std::printf("%-34s %6zu %10.3f %10.3f %10.2f %12.3g  %s\n", name.c_str(), localWorkSize, minTimeMs, averageTimeMs,
+                    bandwidth, maxError, isCorrect ? "OK" : "MISMATCH");
+
+        return isCorrect;
+    }
+
+    /**
+    * Runs a kernel variant, measures its device time and checks its output
+    *
+    * @param[in] kernelCase - Kernel variant to run
+    * @param[in] options - Harness options
+    * @param[in] context - OpenCL context
+    * @param[in] device - Device to run on
+    * @param[in] queue - Command queue (with profiling enabled)
+    * @param[in] program - Built kernel file
+    * @param[in] data - Input data and CPU reference
+    * @param[in] inputPositions - Initial positions of the whole mesh
+    * @param[in] outputPositions - Output positions of the whole mesh
+    *
+    * @return True if the output matches the CPU reference
+    */
+    bool runKernelCase(const KernelCase& kernelCase, const HarnessOptions& options, cl_context context, cl_device_id device, cl_command_queue queue,
+                       cl_program program, const HarnessData& data, cl_mem inputPositions, cl_mem outputPositions)
+    {
+        cl_int err = CL_SUCCESS;
+        cl_kernel kernel = clCreateKernel(program, kernelCase.name.c_str(), &err);
+        if (!checkClError(err, kernelCase.name.c_str()))
+        {
+            return false;
+        }
+
+        // Auxiliary buffers of each launch (the whole mesh, or one tile each for tiled kernels)
+
+        unsigned int launchCount = kernelCase.isTiled ? TILE_COUNT : 1;
+        unsigned int tileSize = (options.vertexCount + launchCount - 1) / launchCount;
+        std::vector<KernelBuffers> launchBuffers(launchCount);
+
+        for (unsigned int launch = 0; launch < launchCount; launch++)
+        {
+            unsigned int firstVertex = launch * tileSize;
+            unsigned int count = std::min(tileSize, options.vertexCount - firstVertex);
+
+            if (!createBuffers(context, data, firstVertex, count, kernelCase.isTangentSpace, launchBuffers[launch]))
+            {
+                std::fprintf(stderr, "Could not create the buffers of %s\n", kernelCase.name.c_str());
+                clReleaseKernel(kernel);
+                return false;
+            }
+        }
+
+        // Clear the output so the results of the previous kernel can't be mistaken for these
+
+        std::vector<float> zeros(options.vertexCount * 3, 0.f);
+        clEnqueueWriteBuffer(queue, outputPositions, CL_TRUE, 0, zeros.size() * sizeof(float), zeros.data(), 0, nullptr, nullptr);
+
+        // Warm-up run, then timed runs
+
+        double minTimeMs = 0.0;
+        double totalTimeMs = 0.0;
+        size_t localWorkSize = 0;
+
+        for (unsigned int iteration = 0; iteration <= options.iterations; iteration++)
+        {
+            double iterationTimeMs = 0.0;
+
+            for (unsigned int launch = 0; launch < launchCount; launch++)
+            {
+                unsigned int firstVertex = launch * tileSize;
+                unsigned int count = std::min(tileSize, options.vertexCount - firstVertex);
+                double launchTimeMs = 0.0;
+
+                if (!setKernelArguments(kernel, kernelCase, inputPositions, launchBuffers[launch], count, firstVertex, outputPositions) ||
+                    !launchKernel(kernel, device, queue, count, kernelCase.verticesPerWorkItem, options.localWorkSize, localWorkSize, launchTimeMs))
+                {
+                    clReleaseKernel(kernel);
+                    return false;
+                }
+
+                iterationTimeMs += launchTimeMs;
+            }
+
+            if (iteration > 0)
+            {
+                minTimeMs = iteration == 1 ? iterationTimeMs : std::min(minTimeMs, iterationTimeMs);
+                totalTimeMs += iterationTimeMs;
+            }
+        }
+
+        clReleaseKernel(kernel);
+
+        // Check the output against the CPU reference
+
+        std::vector<Float3> output(options.vertexCount);
+        clEnqueueReadBuffer(queue, outputPositions, CL_TRUE, 0, output.size() * sizeof(Float3), output.data(), 0, nullptr, nullptr);
+
+        const std::vector<Float3>& reference = kernelCase.isTangentSpace ? data.tangentSpaceReference : data.objectSpaceReference;
+
+        // Bytes read and written per vertex: positions in and out, map sample, paint weight, and the vertex frame in tangent space
+
+        double bytesPerVertex = sizeof(float) * (3 + 3 + 3 + (options.weightMode == 2 ? 1 : 0) + (kernelCase.isTangentSpace ? 9 : 0));
+
+        return printResult(kernelCase.name, localWorkSize, minTimeMs, totalTimeMs / options.iterations, bytesPerVertex * options.vertexCount,
+                           getMaxRelativeError(output, reference));
+    }
+
+    /**
+    * Runs a kernel that isn't a displacement variant over every vertex, measures its device time and checks its output
+    *
+    * @param[in] name - Kernel name
+    * @param[in] arguments - Kernel arguments, in order
+    * @param[in] outputBuffer - Buffer the kernel writes its float3 results to
+    * @param[in] reference - CPU reference of the results
+    * @param[in] bytesPerRun - Bytes read and written by each run
+    * @param[in] options - Harness options
+    * @param[in] device - Device to run on
+    * @param[in] queue - Command queue (with profiling enabled)
+    * @param[in] program - Built kernel file
+    *
+    * @return True if the output matches the CPU reference
+    */
+    bool runAuxiliaryKernel(const std::string& name, const std::vector<KernelArgument>& arguments, cl_mem outputBuffer, const std::vector<Float3>& reference,
+                            double bytesPerRun, const HarnessOptions& options, cl_device_id device, cl_command_queue queue, cl_program program)
+    {
+        cl_int err = CL_SUCCESS;
+        cl_kernel kernel = clCreateKernel(program, name.c_str(), &err);
+        if (!checkClError(err, name.c_str()))
+        {
+            return false;
+        }
+
+        for (size_t i = 0; i < arguments.size(); i++)
+        {
+            err |= clSetKernelArg(kernel, static_cast<cl_uint>(i), arguments[i].size, arguments[i].value);
+        }
+
+        if (!checkClError(err, "clSetKernelArg"))
+        {
+            clReleaseKernel(kernel);
+            return false;
+        }
+
+        std::vector<float> zeros(options.vertexCount * 3, 0.f);
+        clEnqueueWriteBuffer(queue, outputBuffer, CL_TRUE, 0, zeros.size() * sizeof(float), zeros.data(), 0, nullptr, nullptr);
+
+        // Warm-up run, then timed runs
+
+        double minTimeMs = 0.0;
+        double totalTimeMs = 0.0;
+        size_t localWorkSize = 0;
+
+        for (unsigned int iteration = 0; iteration <= options.iterations; iteration++)
+        {
+            double iterationTimeMs = 0.0;
+
+            if (!launchKernel(kernel, device, queue, options.vertexCount, 1, options.localWorkSize, localWorkSize, iterationTimeMs))
+            {
+                clReleaseKernel(kernel);
+                return false;
+            }
+
+            if (iteration > 0)
+            {
+                minTimeMs = iteration == 1 ? iterationTimeMs : std::min(minTimeMs, iterationTimeMs);
+                totalTimeMs += iterationTimeMs;
+            }
+        }
+
+        clReleaseKernel(kernel);
+
+        std::vector<Float3> output(options.vertexCount);
+        clEnqueueReadBuffer(queue, outputBuffer, CL_TRUE, 0, output.size() * sizeof(Float3), output.data(), 0, nullptr, nullptr);
+
+        return printResult(name, localWorkSize, minTimeMs, totalTimeMs / options.iterations, bytesPerRun, getMaxRelativeError(output, reference));
+    }
+
+    /**
+    * Runs TangentSpaceOffsets, which converts the map samples to object-space offsets before they're relaxed
+    *
+    * @param[in] options - Harness options
+    * @param[in] context - OpenCL context
+    * @param[in] device - Device to run on
+    * @param[in] queue - Command queue (with profiling enabled)
+    * @param[in] program - Built kernel file
+    * @param[in] data - Input data
+    *
+    * @return True if the output matches the CPU reference
+    */
+    bool runTangentSpaceOffsets(const HarnessOptions& options, cl_context context, cl_device_id device, cl_command_queue queue, cl_program program,
+                                const HarnessData& data)
+    {
+        std::vector<Float3> reference(options.vertexCount);
+
+        for (unsigned int i = 0; i < options.vertexCount; i++)
+        {
+            reference[i] = VectorDisplacementMath::getTangentSpaceOffset(data.normals[i], data.tangents[i], data.binormals[i], data.mapData[i], 1.f);
+        }
+
+        KernelBuffers buffers;
+        ClBuffer offsets;
+        cl_uint count = options.vertexCount;
+
+        if (!createBuffers(context, data, 0, options.vertexCount, true, buffers) ||
+            !offsets.create(context, CL_MEM_WRITE_ONLY, reference.size() * sizeof(Float3), nullptr))
+        {
+            std::fprintf(stderr, "Could not create the buffers of TangentSpaceOffsets\n");
+            return false;
+        }
+
+        const std::vector<KernelArgument> arguments =
+        {
+            { sizeof(cl_mem), &buffers.mapData.memory },
+            { sizeof(cl_mem), &buffers.normals.memory },
+            { sizeof(cl_mem), &buffers.tangents.memory },
+            { sizeof(cl_mem), &buffers.binormals.memory },
+            { sizeof(cl_uint), &count },
+            { sizeof(cl_mem), &offsets.memory },
+        };
+
+        // Map sample and vertex frame in, offset out
+
+        double bytesPerRun = sizeof(float) * (3 + 9 + 3) * static_cast<double>(options.vertexCount);
+
+        return runAuxiliaryKernel("TangentSpaceOffsets", arguments, offsets.memory, reference, bytesPerRun, options, device, queue, program);
+    }
+
+    /**
+    * Runs one RelaxOffsets iteration over the map samples of a grid mesh. Vertices of the last, partial row that aren't part of a quad
+    * are left isolated, so both branches of the kernel are checked.
+    *
+    * @param[in] options - Harness options
+    * @param[in] context - OpenCL context
+    * @param[in] device - Device to run on
+    * @param[in] queue - Command queue (with profiling enabled)
+    * @param[in] program - Built kernel file
+    * @param[in] data - Input data
+    *
+    * @return True if the output matches the CPU reference
+    */
+    bool runRelaxOffsets(const HarnessOptions& options, cl_context context, cl_device_id device, cl_command_queue queue, cl_program program,
+                         const HarnessData& data)
+    {
+        unsigned int gridWidth = static_cast<unsigned int>(std::ceil(std::sqrt(static_cast<double>(options.vertexCount))));
+        std::vector<int> faceVertexCounts;
+        std::vector<int> faceVertexIds;
+
+        for (unsigned int corner = 0; corner + gridWidth + 1 < options.vertexCount; corner++)
+        {
+            if (corner % gridWidth == gridWidth - 1)
+            {
+                continue; // Last column
+            }
+
+            int firstVertex = static_cast<int>(corner);
+            int nextRowVertex = static_cast<int>(corner + gridWidth);
+
+            faceVertexCounts.push_back(4);
+            faceVertexIds.insert(faceVertexIds.end(), { firstVertex, firstVertex + 1, nextRowVertex + 1, nextRowVertex });
+        }
+
+        VertexAdjacency adjacency;
+        VectorDisplacementRelax::buildAdjacency(options.vertexCount, faceVertexCounts, static_cast<unsigned int>(faceVertexCounts.size()), faceVertexIds, adjacency);
+
+        const float* mapData = reinterpret_cast<const float*>(data.mapData.data());
+        std::vector<float> relaxedOffsets(mapData, mapData + static_cast<size_t>(options.vertexCount) * 3);
+        std::vector<float> scratch;
+        VectorDisplacementRelax::relaxOffsets(adjacency, 1, RELAX_STRENGTH, relaxedOffsets, scratch);
+
+        std::vector<Float3> reference(options.vertexCount);
+
+        for (unsigned int i = 0; i < options.vertexCount; i++)
+        {
+            reference[i] = Float3(relaxedOffsets[i * 3], relaxedOffsets[i * 3 + 1], relaxedOffsets[i * 3 + 2]);
+        }
+
+        ClBuffer sourceOffsets;
+        ClBuffer adjacencyOffsets;
+        ClBuffer adjacencyIndices;
+        ClBuffer outputOffsets;
+        cl_float strength = RELAX_STRENGTH;
+        cl_uint count = options.vertexCount;
+
+        if (!sourceOffsets.create(context, CL_MEM_READ_ONLY, data.mapData.size() * sizeof(Float3), data.mapData.data()) ||
+            !adjacencyOffsets.create(context, CL_MEM_READ_ONLY, adjacency.offsets.size() * sizeof(cl_uint), adjacency.offsets.data()) ||
+            !adjacencyIndices.create(context, CL_MEM_READ_ONLY, std::max(adjacency.indices.size(), static_cast<size_t>(1)) * sizeof(cl_uint),
+                                     adjacency.indices.empty() ? nullptr : adjacency.indices.data()) ||
+            !outputOffsets.create(context, CL_MEM_WRITE_ONLY, reference.size() * sizeof(Float3), nullptr))
+        {
+            std::fprintf(stderr, "Could not create the buffers of RelaxOffsets\n");
+            return false;
+        }
+
+        const std::vector<KernelArgument> arguments =
+        {
+            { sizeof(cl_mem), &sourceOffsets.memory },
+            { sizeof(cl_mem), &adjacencyOffsets.memory },
+            { sizeof(cl_mem), &adjacencyIndices.memory },
+            { sizeof(cl_float), &strength },
+            { sizeof(cl_uint), &count },
+            { sizeof(cl_mem), &outputOffsets.memory },
+        };
+
+        // Offset and adjacency range in, relaxed offset out, plus the index and offset of each neighbour
+
+        double bytesPerRun = sizeof(float) * ((3 + 2 + 3) * static_cast<double>(options.vertexCount) + (1 + 3) * static_cast<double>(adjacency.indices.size()));
+
+        return runAuxiliaryKernel("RelaxOffsets", arguments, outputOffsets.memory, reference, bytesPerRun, options, device, queue, program);
+    }
+
+    /**
+    * Runs AreaFilteredSamples over random footprints of a random map. Footprints are centered outside of the 0 - 1 range too, so rectangles
+    * that wrap around the map are checked, and the vertex order is shuffled like the Morton order of the deformer.
+    *
+    * @param[in] options - Harness options
+    * @param[in] context - OpenCL context
+    * @param[in] device - Device to run on
+    * @param[in] queue - Command queue (with profiling enabled)
+    * @param[in] program - Built kernel file
+    *
+    * @return True if the output matches the CPU reference
+    */
+    bool runAreaFilteredSamples(const HarnessOptions& options, cl_context context, cl_device_id device, cl_command_queue queue, cl_program program)
+    {
+        std::mt19937 generator(5678);
+        std::uniform_real_distribution<float> mapDistribution(-1.f, 1.f);
+        std::uniform_real_distribution<float> centerDistribution(-1.f, 2.f);
+        std::uniform_real_distribution<float> halfSizeDistribution(0.f, MAX_FOOTPRINT_HALF_SIZE);
+
+        std::vector<float> map(static_cast<size_t>(AREA_MAP_WIDTH) * AREA_MAP_HEIGHT * 3);
+        std::generate(map.begin(), map.end(), [&]() { return mapDistribution(generator); });
+
+        SummedAreaTable table;
+        table.build(AREA_MAP_WIDTH, AREA_MAP_HEIGHT, map);
+
+        std::vector<float> uvFootprints(static_cast<size_t>(options.vertexCount) * 4);
+        std::vector<cl_uint> vertexOrder(options.vertexCount);
+        std::iota(vertexOrder.begin(), vertexOrder.end(), 0u);
+        std::shuffle(vertexOrder.begin(), vertexOrder.end(), generator);
+
+        std::vector<Float3> reference(options.vertexCount);
+
+        for (unsigned int i = 0; i < options.vertexCount; i++)
+        {
+            float* footprint = &uvFootprints[static_cast<size_t>(i) * 4];
+            footprint[0] = centerDistribution(generator);
+            footprint[1] = centerDistribution(generator);
+            footprint[2] = halfSizeDistribution(generator);
+            footprint[3] = halfSizeDistribution(generator);
+
+            reference[vertexOrder[i]] = table.getBoxAverage(footprint[0], footprint[1], footprint[2], footprint[3]);
+        }
+
+        ClBuffer tableData;
+        ClBuffer footprintData;
+        ClBuffer orderData;
+        ClBuffer samples;
+        cl_uint width = AREA_MAP_WIDTH;
+        cl_uint height = AREA_MAP_HEIGHT;
+        cl_float fixedPointScale = static_cast<cl_float>(SummedAreaTable::FIXED_POINT_SCALE);
+        cl_uint count = options.vertexCount;
+
+        if (!tableData.create(context, CL_MEM_READ_ONLY, table.getSums().size() * sizeof(cl_long), table.getSums().data()) ||
+            !footprintData.create(context, CL_MEM_READ_ONLY, uvFootprints.size() * sizeof(float), uvFootprints.data()) ||
+            !orderData.create(context, CL_MEM_READ_ONLY, vertexOrder.size() * sizeof(cl_uint), vertexOrder.data()) ||
+            !samples.create(context, CL_MEM_WRITE_ONLY, reference.size() * sizeof(Float3), nullptr))
+        {
+            std::fprintf(stderr, "Could not create the buffers of AreaFilteredSamples\n");
+            return false;
+        }
+
+        const std::vector<KernelArgument> arguments =
+        {
+            { sizeof(cl_mem), &tableData.memory },
+            { sizeof(cl_uint), &width },
+            { sizeof(cl_uint), &height },
+            { sizeof(cl_float), &fixedPointScale },
+            { sizeof(cl_mem), &footprintData.memory },
+            { sizeof(cl_mem), &orderData.memory },
+            { sizeof(cl_uint), &count },
+            { sizeof(cl_mem), &samples.memory },
+        };
+
+        // Footprint and vertex index in, sample out, plus the four table corners of each rectangle (wrapped rectangles read more)
+
+        double bytesPerRun = (sizeof(float) * (4 + 1 + 3) + sizeof(cl_long) * 4 * 3) * static_cast<double>(options.vertexCount);
+
+        return runAuxiliaryKernel("AreaFilteredSamples", arguments, samples.memory, reference, bytesPerRun, options, device, queue, program);
+    }
+
+    void printUsage()
+    {
+        std::printf(
+            "Usage: vectorDisplacementKernelHarness [options]\n"
+            "\n"
+            "Options:\n"
+            "  --kernel <path>      Kernel file (default: VectorDisplacementDeformer.cl)\n"
+            "  --vertices <count>   Number of vertices (default: %u)\n"
+            "  --iterations <count> Timed runs per kernel (default: %u)\n"
+            "  --local <size>       Local work size (default: kernel maximum)\n"
+            "  --weights <mode>     Paint weight variant to build: none, uniform or painted (default: painted)\n"
+            "  --platform <index>   Platform index (default: first GPU found)\n"
+            "  --device <index>     Device index within the platform (default: 0)\n"
+            "  --list               Lists the available devices\n",
+            DEFAULT_VERTEX_COUNT, DEFAULT_ITERATIONS);
+    }
+
+    bool parseOptions(int argc, char* argv[], HarnessOptions& options)
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            std::string argument = argv[i];
+            bool hasValue = i + 1 < argc;
+
+            if (argument == "--kernel" && hasValue) options.kernelPath = argv[++i];
+            else if (argument == "--vertices" && hasValue) options.vertexCount = static_cast<unsigned int>(std::strtoul(argv[++i], nullptr, 10));
+            else if (argument == "--iterations" && hasValue) options.iterations = static_cast<unsigned int>(std::strtoul(argv[++i], nullptr, 10));
+            else if (argument == "--local" && hasValue) options.localWorkSize = std::strtoul(argv[++i], nullptr, 10);
+            else if (argument == "--platform" && hasValue) options.platformIndex = std::atoi(argv[++i]);
+            else if (argument == "--device" && hasValue) options.deviceIndex = std::atoi(argv[++i]);
+            else if (argument == "--weights" && hasValue)
+            {
+                std::string mode = argv[++i];
+                auto name = std::find(std::begin(WEIGHT_MODE_NAMES), std::end(WEIGHT_MODE_NAMES), mode);
+
+                if (name == std::end(WEIGHT_MODE_NAMES))
+                {
+                    return false;
+                }
+
+                options.weightMode = static_cast<int>(name - std::begin(WEIGHT_MODE_NAMES));
+            }
+            else if (argument == "--list") options.listDevices = true;
+            else return false;
+        }
+
+        return options.vertexCount >= TILE_COUNT && options.iterations > 0;
+    }
+}
+
+
+int main(int argc, char* argv[])
+{
+    HarnessOptions options;
+    if (!parseOptions(argc, argv, options))
+    {
+        printUsage();
+        return 1;
+    }
+
+    cl_device_id device = nullptr;
+    if (!selectDevice(options, device))
+    {
+        return 1;
+    }
+
+    if (options.listDevices)
+    {
+        return 0;
+    }
+
+    cl_int err = CL_SUCCESS;
+    cl_context context = clCreateContext(nullptr, 1, &device, nullptr, nullptr, &err);
+    if (!checkClError(err, "clCreateContext"))
+    {
+        return 1;
+    }
+
+    cl_command_queue queue = clCreateCommandQueue(context, device, CL_QUEUE_PROFILING_ENABLE, &err);
+    if (!checkClError(err, "clCreateCommandQueue"))
+    {
+        clReleaseContext(context);
+        return 1;
+    }
+
+    cl_program program = nullptr;
+    bool isSuccessful = buildProgram(context, device, options.kernelPath, options.weightMode, program);
+
+    if (isSuccessful)
+    {
+        std::printf("Device: %s (%s)\n", getDeviceInfo(device, CL_DEVICE_NAME).c_str(), getDeviceInfo(device, CL_DEVICE_VERSION).c_str());
+        std::printf("Vertices: %u, iterations: %u, weights: %s\n\n", options.vertexCount, options.iterations, WEIGHT_MODE_NAMES[options.weightMode]);
+
+        HarnessData data;
+        generateData(options.vertexCount, options.weightMode, data);
+
+        ClBuffer inputPositions;
+        ClBuffer outputPositions;
+
+        isSuccessful = inputPositions.create(context, CL_MEM_READ_ONLY, data.positions.size() * sizeof(Float3), data.positions.data()) &&
+                       outputPositions.create(context, CL_MEM_WRITE_ONLY, data.positions.size() * sizeof(Float3), nullptr);
+
+        if (isSuccessful)
+        {
+            const KernelCase kernelCases[] =
+            {
+                { "ObjectSpaceDisplacement", false, 1, false },
+                { "ObjectSpaceDisplacement_x2", false, 2, false },
+                { "ObjectSpaceDisplacement_x4", false, 4, false },
+                { "ObjectSpaceDisplacement_x8", false, 8, false },
+                { "ObjectSpaceDisplacement_x4v", false, 4, false },
+                { "ObjectSpaceDisplacementTiled", false, 1, true },
+                { "TangentSpaceDisplacement", true, 1, false },
+                { "TangentSpaceDisplacement_x2", true, 2, false },
+                { "TangentSpaceDisplacement_x4", true, 4, false },
+                { "TangentSpaceDisplacement_x8", true, 8, false },
+                { "TangentSpaceDisplacement_x4v", true, 4, false },
+                { "TangentSpaceDisplacementTiled", true, 1, true },
+            };
+
+            std::printf("%-34s %6s %10s %10s %10s %12s  %s\n", "Kernel", "Local", "Min (ms)", "Avg (ms)", "GB/s", "Max error", "Result");
+
+            for (const KernelCase& kernelCase : kernelCases)
+            {
+                isSuccessful &= runKernelCase(kernelCase, options, context, device, queue, program, data, inputPositions.memory, outputPositions.memory);
+            }
+
+            isSuccessful &= runTangentSpaceOffsets(options, context, device, queue, program, data);
+            isSuccessful &= runRelaxOffsets(options, context, device, queue, program, data);
+            isSuccessful &= runAreaFilteredSamples(options, context, device, queue, program);
+        }
+        else
+        {
+            std::fprintf(stderr, "Could not create the position buffers\n");
+        }
+    }
+
+    if (program)
+    {
+        clReleaseProgram(program);
+    }
+
+    clReleaseCommandQueue(queue);
+    clReleaseContext(context);
+
+    return isSuccessful ? 0 : 1;
+}
\ No newline at end of file
@@ -0,0 +1,222 @@
+/* Copyright (C) 2020 - Jose Ivan Lopez Romo - All rights reserved
+ *
+ * This file is part of the MayaVectorDisplacementDeformer project found in the
+ * following repository: https://github.com/Zhibade/maya-vector-displacement-deformer
+ *
+ * Released under MIT license. Please see LICENSE file for details.
+ */
+
+#pragma once
+
+#include "WorkerThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+/*
+ * Displacement math shared by the Maya deformer and the standalone command-line tool. Has no Maya dependency.
+ * Functions are templated on the vector type (e.g. MVector, MFloatVector or Float3), which needs x, y, z members,
+ * addition, multiplication by a scalar, and normalize().
+ */
+class VectorDisplacementMath final
+{
+public:
+    /**
+    * Gets the offset of an object-space vector displacement map sample
+    *
+    * @param[in] rgbData - Map sample (raw offset in object units)
+    * @param[in] strength - Displacement strength
+    *
+    * @return Displacement offset
+    */
+    template <typename Vector>
+    static Vector getObjectSpaceOffset(const Vector& rgbData, float strength)
+    {
+        return rgbData * strength;
+    }
+
+    /**
+    * Gets the offset of a tangent-space vector displacement map sample. R runs along the tangent (U direction),
+    * G along the normal and B along the binormal (V direction).
+    *
+    * @param[in] normal - Vertex normal
+    * @param[in] tangent - Vertex tangent
+    * @param[in] binormal - Vertex binormal
+    * @param[in] rgbData - Map sample
+    * @param[in] strength - Displacement strength
+    *
+    * @return Displacement offset
+    */
+    template <typename Vector, typename Sample>
+    static Vector getTangentSpaceOffset(const Vector& normal, const Vector& tangent, const Vector& binormal, const Sample& rgbData, float strength)
+    {
+        Vector tangentOffset = tangent * rgbData.x;
+        Vector normalOffset = normal * rgbData.y;
+        Vector binormalOffset = binormal * rgbData.z;
+
+        return (tangentOffset + normalOffset + binormalOffset) * strength;
+    }
+
+    /**
+    * Accumulates a face-vertex tangent or binormal into the per-vertex value. Face-vertices need to be visited in face index order
+    * and the per-vertex value needs to start at zero, so every implementation ends up with the same vertex frames.
+    *
+    * @param[in,out] vertexValue - Per-vertex value accumulated so far
+    * @param[in] faceVertexValue - Tangent or binormal of the face-vertex
+    */
+    template <typename Vector, typename FaceVector>
+    static void accumulateFrameVector(Vector& vertexValue, const FaceVector& faceVertexValue)
+    {
+        vertexValue = (vertexValue + faceVertexValue) / 2.f;
+        vertexValue.normalize();
+    }
+
+    /**
+    * Runs the given function over contiguous ranges of [0, count) in parallel, on the shared worker threads (see WorkerThreadPool)
+    * and the calling thread. Small counts run on the calling thread only.
+    *
+    * @param[in] count - Number of elements
+    * @param[in] threadCount - Maximum number of ranges (0 = thread count of the worker pool)
+    * @param[in] function - Function that processes the elements in [begin, end)
+    * @param[in] minRangeSize - Elements per thread below which threads cost more than they save (lower for expensive elements)
+    */
+    template <typename Function>
+    static void parallelFor(size_t count, unsigned int threadCount, const Function& function, size_t minRangeSize = MIN_PARALLEL_RANGE_SIZE)
+    {
+        if (threadCount == 0)
+        {
+            threadCount = WorkerThreadPool::getThreadCount();
+        }
+
+        size_t rangeCount = std::min(static_cast<size_t>(threadCount), (count + minRangeSize - 1) / std::max(minRangeSize, static_cast<size_t>(1)));
+
+        if (rangeCount <= 1)
+        {
+            function(static_cast<size_t>(0), count);
+            return;
+        }
+
+        size_t rangeSize = (count + rangeCount - 1) / rangeCount;
+
+        WorkerThreadPool::run((count + rangeSize - 1) / rangeSize, [&function, rangeSize, count](size_t range)
+        {
+            size_t begin = range * rangeSize;
+            function(begin, std::min(begin + rangeSize, count));
+        });
+    }
+
+    /**
+    * Gets an order of the vertices along a Morton (Z-order) curve through their UVs, so consecutive vertices in that order sample
+    * nearby texels and map reads stay in cache. UVs are wrapped to the 0 - 1 range first, since maps repeat.
+    *
+    * @param[in] vertexUvs - 2 values per vertex (U, V)
+    * @param[out] order - Vertex indices in sampling order. Vertices in the same Morton cell keep their relative order.
+    */
+    static void getUvMortonOrder(const std::vector<float>& vertexUvs, std::vector<unsigned int>& order)
+    {
+        size_t vertexCount = vertexUvs.size() / 2;
+        std::vector<uint32_t> codes(vertexCount);
+
+        for (size_t i = 0; i < vertexCount; i++)
+        {
+            codes[i] = spreadMortonBits(getMortonCell(vertexUvs[i * 2])) | (spreadMortonBits(getMortonCell(vertexUvs[i * 2 + 1])) << 1);
+        }
+
+        // Stable radix sort in two passes (low half of the code first), which is linear in the vertex count
+
+        std::vector<unsigned int> sortedOnLowBits(vertexCount);
+        std::vector<size_t> bucketOffsets(MORTON_RADIX_BUCKETS + 1);
+        order.resize(vertexCount);
+
+        for (unsigned int shift = 0; shift < MORTON_CODE_BITS; shift += MORTON_CODE_BITS / 2)
+        {
+            std::fill(bucketOffsets.begin(), bucketOffsets.end(), 0);
+
+            for (uint32_t code : codes)
+            {
+                bucketOffsets[((code >> shift) & (MORTON_RADIX_BUCKETS - 1)) + 1]++;
+            }
+
+            for (size_t bucket = 0; bucket < MORTON_RADIX_BUCKETS; bucket++)
+            {
+                bucketOffsets[bucket + 1] += bucketOffsets[bucket];
+            }
+
+            for (size_t i = 0; i < vertexCount; i++)
+            {
+                unsigned int vertex = shift == 0 ? static_cast<unsigned int>(i) : sortedOnLowBits[i];
+                std::vector<unsigned int>& destination = shift == 0 ? sortedOnLowBits : order;
+
+                destination[bucketOffsets[(codes[vertex] >> shift) & (MORTON_RADIX_BUCKETS - 1)]++] = vertex;
+            }
+        }
+    }
+
+    static constexpr size_t MIN_PARALLEL_RANGE_SIZE = 4096; // Default elements per thread for cheap per-element work
+
+private:
+    static constexpr unsigned int MORTON_CODE_BITS = 24; // 4096 cells per UV axis, finer than the texel cache lines of any practical map
+    static constexpr size_t MORTON_RADIX_BUCKETS = 1 << (MORTON_CODE_BITS / 2); // Buckets per radix sort pass of the Morton order
+
+    /** Returns the Morton grid cell of a UV coordinate (12 bits), wrapped to the 0 - 1 range */
+    static uint32_t getMortonCell(float coordinate)
+    {
+        float wrapped = coordinate - std::floor(coordinate);
+        return std::isfinite(wrapped) ? std::min(static_cast<uint32_t>(wrapped * 4096.f), 4095u) : 0u;
+    }
+
+    /** Spreads the 12 low bits of the given value to the even bits of the result */
+    static uint32_t spreadMortonBits(uint32_t value)
+    {
+        uint32_t bits = value & 0xFFF;
+        bits = (bits | (bits << 8)) & 0x00FF00FF;
+        bits = (bits | (bits << 4)) & 0x0F0F0F0F;
+        bits = (bits | (bits << 2)) & 0x33333333;
+        bits = (bits | (bits << 1)) & 0x55555555;
+        return bits;
+    }
+};
+
+
+/* Minimal 3D vector used by the Maya-independent code */
+struct Float3
+{
+    float x = 0.f;
+    float y = 0.f;
+    float z = 0.f;
+
+    Float3() {};
+    Float3(float x, float y, float z) : x(x), y(y), z(z) {};
+
+    Float3 operator+(const Float3& other) const { return Float3(x + other.x, y + other.y, z + other.z); }
+    Float3 operator-(const Float3& other) const { return Float3(x - other.x, y - other.y, z - other.z); }
+    Float3 operator*(float scalar) const { return Float3(x * scalar, y * scalar, z * scalar); }
+    Float3 operator/(float scalar) const { return Float3(x / scalar, y / scalar, z / scalar); }
+    Float3& operator+=(const Float3& other) { x += other.x; y += other.y; z += other.z; return *this; }
+
+    /** Returns the dot product with the given vector */
+    float dot(const Float3& other) const { return x * other.x + y * other.y + z * other.z; }
+
+    /** Returns the cross product with the given vector */
+    Float3 cross(const Float3& other) const { return Float3(y * other.z - z * other.y, z * other.x - x * other.z, x * other.y - y * other.x); }
+
+    /** Returns the length of the vector */
+    float length() const { return std::sqrt(dot(*this)); }
+
+    /* Normalizes the vector in place. Zero vectors are left untouched. */
+    void normalize()
+    {
+        float vectorLength = length();
+
+        if (vectorLength > 0.f)
+        {
+            x /= vectorLength;
+            y /= vectorLength;
+            z /= vectorLength;
+        }
+    }
+};
\ No newline at end of file
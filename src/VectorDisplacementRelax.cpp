@@ -0,0 +1,65 @@
+/* Copyright (C) 2020 - Jose Ivan Lopez Romo - All rights reserved
+ *
+ * This file is part of the MayaVectorDisplacementDeformer project found in the
+ * following repository: https://github.com/Zhibade/maya-vector-displacement-deformer
+ *
+ * Released under MIT license. Please see LICENSE file for details.
+ */
+
+#include "VectorDisplacementRelax.h"
+#include "VectorDisplacementMath.h"
+
+
+void VectorDisplacementRelax::relaxOffsets(const VertexAdjacency& adjacency, unsigned int iterations, float strength, std::vector<float>& offsets, std::vector<float>& scratch)
+{
+    size_t vertexCount = offsets.size() / 3;
+
+    if (iterations == 0 || adjacency.offsets.size() != vertexCount + 1)
+    {
+        return;
+    }
+
+    scratch.resize(offsets.size());
+
+    for (unsigned int iteration = 0; iteration < iterations; iteration++)
+    {
+        const float* source = offsets.data();
+        float* destination = scratch.data();
+
+        VectorDisplacementMath::parallelFor(vertexCount, 0, [&](size_t begin, size_t end)
+        {
+            for (size_t vertex = begin; vertex < end; vertex++)
+            {
+                const float* offset = source + vertex * 3;
+                unsigned int first = adjacency.offsets[vertex];
+                unsigned int last = adjacency.offsets[vertex + 1];
+
+                if (first == last)
+                {
+                    std::copy(offset, offset + 3, destination + vertex * 3); // Isolated vertex
+                    continue;
+                }
+
+                float average[3] = { 0.f, 0.f, 0.f };
+
+                for (unsigned int i = first; i < last; i++)
+                {
+                    const float* neighbourOffset = source + static_cast<size_t>(adjacency.indices[i]) * 3;
+
+                    average[0] += neighbourOffset[0];
+                    average[1] += neighbourOffset[1];
+                    average[2] += neighbourOffset[2];
+                }
+
+                float neighbourCount = static_cast<float>(last - first);
+
+                for (unsigned int component = 0; component < 3; component++)
+                {
+                    destination[vertex * 3 + component] = offset[component] + (average[component] / neighbourCount - offset[component]) * strength;
+                }
+            }
+        });
+
+        offsets.swap(scratch);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,118 @@
+/* Copyright (C) 2020 - Jose Ivan Lopez Romo - All rights reserved
+ *
+ * This file is part of the MayaVectorDisplacementDeformer project found in the
+ * following repository: https://github.com/Zhibade/maya-vector-displacement-deformer
+ *
+ * Released under MIT license. Please see LICENSE file for details.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+
+/* Edge neighbours of every vertex in compressed sparse row layout */
+struct VertexAdjacency
+{
+    std::vector<unsigned int> offsets; // First neighbour entry of each vertex (plus one extra entry at the end). Empty when not built.
+    std::vector<unsigned int> indices; // Neighbour vertex indices, sorted per vertex
+
+    /** Returns true if the adjacency was not built yet */
+    bool isEmpty() const { return offsets.empty(); }
+};
+
+
+/*
+ * Laplacian relax pass over per-vertex displacement offsets. Smooths the texel aliasing that appears when dense maps are sampled
+ * at the vertices of a lower-resolution mesh. Has no Maya dependency, and matches the RelaxOffsets OpenCL kernel.
+ */
+class VectorDisplacementRelax final
+{
+public:
+    /**
+    * Builds the vertex adjacency of a polygon mesh from its face-vertex connectivity
+    *
+    * @param[in] vertexCount - Number of vertices
+    * @param[in] faceVertexCounts - Vertex count of each face (e.g. MIntArray or std::vector)
+    * @param[in] faceCount - Number of faces
+    * @param[in] faceVertexIds - Vertex index of each face-vertex
+    * @param[out] adjacency - Built adjacency
+    */
+    template <typename IntArray>
+    static void buildAdjacency(unsigned int vertexCount, const IntArray& faceVertexCounts, unsigned int faceCount, const IntArray& faceVertexIds,
+                               VertexAdjacency& adjacency)
+    {
+        // Each face edge adds both of its vertices as neighbours of each other. Shared edges are deduplicated afterwards.
+
+        std::vector<unsigned int> edgeOffsets(vertexCount + 1, 0);
+        unsigned int faceStart = 0;
+
+        for (unsigned int face = 0; face < faceCount; face++)
+        {
+            unsigned int faceSize = static_cast<unsigned int>(faceVertexCounts[face]);
+
+            for (unsigned int i = 0; faceSize > 1 && i < faceSize; i++)
+            {
+                edgeOffsets[faceVertexIds[faceStart + i] + 1]++;
+                edgeOffsets[faceVertexIds[faceStart + (i + 1) % faceSize] + 1]++;
+            }
+
+            faceStart += faceSize;
+        }
+
+        for (unsigned int i = 0; i < vertexCount; i++)
+        {
+            edgeOffsets[i + 1] += edgeOffsets[i];
+        }
+
+        std::vector<unsigned int> neighbours(edgeOffsets[vertexCount]);
+        std::vector<unsigned int> insertPositions(edgeOffsets.begin(), edgeOffsets.end() - 1);
+        faceStart = 0;
+
+        for (unsigned int face = 0; face < faceCount; face++)
+        {
+            unsigned int faceSize = static_cast<unsigned int>(faceVertexCounts[face]);
+
+            for (unsigned int i = 0; faceSize > 1 && i < faceSize; i++)
+            {
+                unsigned int vertex = faceVertexIds[faceStart + i];
+                unsigned int nextVertex = faceVertexIds[faceStart + (i + 1) % faceSize];
+
+                neighbours[insertPositions[vertex]++] = nextVertex;
+                neighbours[insertPositions[nextVertex]++] = vertex;
+            }
+
+            faceStart += faceSize;
+        }
+
+        adjacency.offsets.assign(vertexCount + 1, 0);
+        adjacency.indices.clear();
+        adjacency.indices.reserve(neighbours.size() / 2);
+
+        for (unsigned int vertex = 0; vertex < vertexCount; vertex++)
+        {
+            auto first = neighbours.begin() + edgeOffsets[vertex];
+            auto last = neighbours.begin() + edgeOffsets[vertex + 1];
+
+            std::sort(first, last);
+            last = std::unique(first, last);
+
+            adjacency.indices.insert(adjacency.indices.end(), first, last);
+            adjacency.offsets[vertex + 1] = static_cast<unsigned int>(adjacency.indices.size());
+        }
+    }
+
+    /**
+    * Relaxes the given offsets. Each iteration moves every offset towards the average of its neighbours' offsets.
+    * Every iteration reads the result of the previous one, so the result doesn't depend on the vertex order or thread count.
+    *
+    * @param[in] adjacency - Vertex adjacency of the mesh
+    * @param[in] iterations - Number of relax iterations
+    * @param[in] strength - How far each offset moves towards the neighbour average per iteration (0 - 1)
+    * @param[in,out] offsets - 3 floats per vertex
+    * @param[in,out] scratch - Temporary buffer. Kept by the caller so repeated calls don't allocate.
+    */
+    static void relaxOffsets(const VertexAdjacency& adjacency, unsigned int iterations, float strength, std::vector<float>& offsets, std::vector<float>& scratch);
+};
\ No newline at end of file
@@ -0,0 +1,166 @@
+/* Copyright (C) 2020 - Jose Ivan Lopez Romo - All rights reserved
+ *
+ * This file is part of the MayaVectorDisplacementDeformer project found in the
+ * following repository: https://github.com/Zhibade/maya-vector-displacement-deformer
+ *
+ * Released under MIT license. Please see LICENSE file for details.
+ */
+
+#include "VectorDisplacementStreamingPipeline.h"
+#include "VectorDisplacementUtilities.h"
+#include "WorkerThreadPool.h"
+
+#include <maya/MDoubleArray.h>
+#include <maya/MDynamicsUtil.h>
+#include <maya/MFloatVectorArray.h>
+#include <maya/MFnDependencyNode.h>
+#include <maya/MFnMesh.h>
+#include <maya/MPoint.h>
+#include <maya/MVectorArray.h>
+
+#include <algorithm>
+
+
+VectorDisplacementStreamingPipeline::VectorDisplacementStreamingPipeline(const MObject& nodeObject, const MObject& meshItem, const char* attributeName,
+                                                                         const MString& uvSetName, VectorDisplacementMapType mapType, unsigned int chunkSize)
+    : nodeObject(nodeObject)
+    , meshItem(meshItem)
+    , mapAttribute(MFnDependencyNode(nodeObject).attribute(attributeName))
+    , uvSetName(uvSetName)
+    , mapType(mapType)
+    , chunkSize(std::max(chunkSize, 1u))
+    , vertexCount(meshItem.hasFn(MFn::kMesh) ? MFnMesh(meshItem).numVertices() : 0)
+{
+}
+
+MStatus VectorDisplacementStreamingPipeline::deform(MItGeometry& itGeometry, const std::function<float(unsigned int)>& getStrength) const
+{
+    DisplacementChunk chunk;
+    DisplacementChunkInputs nextChunkInputs; // Read by the prefetch task, so only replaced once it's done
+    DisplacementChunk nextChunk;
+    WorkerThreadPool::Task nextChunkTask; // Displaces the next chunk on the shared worker threads. Declared last, so it's waited for before the data it uses is destroyed.
+
+    for (; !itGeometry.isDone(); itGeometry.next())
+    {
+        unsigned int index = itGeometry.index();
+
+        if (!chunk.contains(index))
+        {
+            // Iterators usually visit vertices in index order, so the prefetched chunk normally contains the next vertex.
+            // Otherwise, the chunk that starts at this vertex is computed right away.
+
+            if (nextChunkTask.isValid())
+            {
+                nextChunkTask.wait();
+                chunk = std::move(nextChunk);
+            }
+
+            if (!chunk.contains(index))
+            {
+                chunk = displaceChunk(fetchChunkInputs(index), mapType);
+            }
+
+            if (chunk.status != MS::kSuccess)
+            {
+                return chunk.status;
+            }
+
+            // Gather the following chunk here, then displace it while this one is written back
+
+            unsigned int nextFirstVertex = chunk.firstVertex + chunk.count;
+
+            if (nextFirstVertex < vertexCount)
+            {
+                nextChunkInputs = fetchChunkInputs(nextFirstVertex);
+                nextChunkTask = WorkerThreadPool::submit([this, &nextChunkInputs, &nextChunk]()
+                {
+                    nextChunk = displaceChunk(nextChunkInputs, mapType);
+                });
+            }
+        }
+
+        const MVector& offset = chunk.offsets[index - chunk.firstVertex];
+
+        MPoint position = itGeometry.position();
+        position += offset * getStrength(index);
+        itGeometry.setPosition(position);
+    }
+
+    return MS::kSuccess;
+}
+
+DisplacementChunkInputs VectorDisplacementStreamingPipeline::fetchChunkInputs(unsigned int firstVertex) const
+{
+    DisplacementChunkInputs inputs;
+    inputs.firstVertex = firstVertex;
+    inputs.count = firstVertex < vertexCount ? std::min(chunkSize, vertexCount - firstVertex) : 0;
+    inputs.status = MS::kSuccess;
+
+    if (inputs.count == 0)
+    {
+        inputs.status = MS::kInvalidParameter;
+        return inputs;
+    }
+
+    // Gather UVs and sample the map
+
+    MDoubleArray uCoords;
+    MDoubleArray vCoords;
+
+    inputs.status = VectorDisplacementUtilities::getMeshUvData(meshItem, uvSetName, firstVertex, inputs.count, uCoords, vCoords);
+    if (inputs.status != MS::kSuccess)
+    {
+        return inputs;
+    }
+
+    MDoubleArray mapAlpha;
+
+    inputs.status = MDynamicsUtil::evalDynamics2dTexture(nodeObject, mapAttribute, uCoords, vCoords, &inputs.mapColor, &mapAlpha);
+    if (inputs.status != MS::kSuccess)
+    {
+        return inputs;
+    }
+
+    // Vertex frames are only needed for tangent-space maps
+
+    if (mapType == VectorDisplacementMapType::TANGENT_SPACE)
+    {
+        inputs.status = VectorDisplacementUtilities::getMeshVertexData(meshItem, firstVertex, inputs.count, inputs.normals, inputs.tangents, inputs.binormals);
+    }
+
+    return inputs;
+}
+
+DisplacementChunk VectorDisplacementStreamingPipeline::displaceChunk(const DisplacementChunkInputs& inputs, VectorDisplacementMapType mapType)
+{
+    DisplacementChunk chunk;
+    chunk.firstVertex = inputs.firstVertex;
+    chunk.count = inputs.count;
+    chunk.status = inputs.status;
+
+    if (chunk.status != MS::kSuccess)
+    {
+        return chunk;
+    }
+
+    // Displace (chunk-local indices)
+
+    chunk.offsets.resize(chunk.count);
+
+    for (unsigned int i = 0; i < chunk.count; i++)
+    {
+        VertexData vertexData;
+        vertexData.index = i;
+
+        if (mapType == VectorDisplacementMapType::TANGENT_SPACE)
+        {
+            vertexData.normal = inputs.normals[i];
+            vertexData.tangent = inputs.tangents[i];
+            vertexData.binormal = inputs.binormals[i];
+        }
+
+        chunk.offsets[i] = VectorDisplacementUtilities::getDisplacementOffset(vertexData, inputs.mapColor, 1.f, mapType);
+    }
+
+    return chunk;
+}
\ No newline at end of file
@@ -0,0 +1,108 @@
+/* Copyright (C) 2020 - Jose Ivan Lopez Romo - All rights reserved
+ *
+ * This file is part of the MayaVectorDisplacementDeformer project found in the
+ * following repository: https://github.com/Zhibade/maya-vector-displacement-deformer
+ *
+ * Released under MIT license. Please see LICENSE file for details.
+ */
+
+#pragma once
+
+#include "VectorDisplacementHelperTypes.h"
+
+#include <maya/MFloatVectorArray.h>
+#include <maya/MItGeometry.h>
+#include <maya/MObject.h>
+#include <maya/MStatus.h>
+#include <maya/MString.h>
+#include <maya/MVector.h>
+#include <maya/MVectorArray.h>
+
+#include <functional>
+#include <vector>
+
+
+/* Map samples and vertex frames of a contiguous range of vertices, as read from Maya */
+struct DisplacementChunkInputs
+{
+    unsigned int firstVertex = 0;
+    unsigned int count = 0;
+    MVectorArray mapColor;
+    MFloatVectorArray normals; // Only gathered for tangent-space maps
+    MFloatVectorArray tangents;
+    MFloatVectorArray binormals;
+    MStatus status;
+};
+
+
+/* Displacement offsets of a contiguous range of vertices */
+struct DisplacementChunk
+{
+    unsigned int firstVertex = 0;
+    unsigned int count = 0;
+    std::vector<MVector> offsets; // One per vertex. Strength and paint weights are not applied.
+    MStatus status;
+
+    /** Returns true if the given vertex is in this chunk */
+    bool contains(unsigned int vertexIndex) const { return vertexIndex >= firstVertex && vertexIndex - firstVertex < count; }
+};
+
+
+/*
+ * Deforms a mesh in fixed-size chunks of vertices, so no full-size UV, texture or vertex frame arrays are ever allocated.
+ * The next chunk is gathered and sampled on the evaluation thread (Maya data can't be read from other threads), then displaced in a background thread
+ * while the current one is written back. Peak memory is bounded by two chunks regardless of the vertex count.
+ */
+class VectorDisplacementStreamingPipeline final
+{
+public:
+    /**
+    * @param[in] nodeObject - Deformer node that has the displacement map attribute
+    * @param[in] meshItem - Input mesh to read UVs and vertex frames from
+    * @param[in] attributeName - Name of the displacement map attribute
+    * @param[in] uvSetName - UV set to sample the map with (empty = first UV set)
+    * @param[in] mapType - Vector displacement map type
+    * @param[in] chunkSize - Number of vertices per chunk
+    */
+    VectorDisplacementStreamingPipeline(const MObject& nodeObject, const MObject& meshItem, const char* attributeName, const MString& uvSetName,
+                                        VectorDisplacementMapType mapType, unsigned int chunkSize);
+    ~VectorDisplacementStreamingPipeline() {};
+
+    /**
+    * Displaces every vertex of the given geometry iterator
+    *
+    * @param[in,out] itGeometry - Geometry iterator. Vertex positions will be updated here.
+    * @param[in] getStrength - Returns the final strength (envelope, strength and paint weight) of the given vertex index
+    *
+    * @return MStatus indicating if operation was successful or not
+    */
+    MStatus deform(MItGeometry& itGeometry, const std::function<float(unsigned int)>& getStrength) const;
+
+private:
+    /**
+    * Gathers the UVs and vertex frames of a chunk and samples the displacement map. Reads Maya data, so it needs to be called from the evaluation thread.
+    *
+    * @param[in] firstVertex - Index of the first vertex of the chunk
+    *
+    * @return Chunk inputs. Their status is set if anything failed.
+    */
+    DisplacementChunkInputs fetchChunkInputs(unsigned int firstVertex) const;
+
+    /**
+    * Calculates the offsets of a chunk from its inputs. Doesn't read Maya data, so it can run on a background thread.
+    *
+    * @param[in] inputs - Chunk inputs (see fetchChunkInputs)
+    * @param[in] mapType - Vector displacement map type
+    *
+    * @return Displaced chunk. Its status is the one of the inputs.
+    */
+    static DisplacementChunk displaceChunk(const DisplacementChunkInputs& inputs, VectorDisplacementMapType mapType);
+
+    MObject nodeObject;
+    MObject meshItem;
+    MObject mapAttribute;
+    MString uvSetName;
+    VectorDisplacementMapType mapType;
+    unsigned int chunkSize;
+    unsigned int vertexCount;
+};
\ No newline at end of file
@@ -0,0 +1,170 @@
+/* Copyright (C) 2020 - Jose Ivan Lopez Romo - All rights reserved
+ *
+ * This file is part of the MayaVectorDisplacementDeformer project found in the
+ * following repository: https://github.com/Zhibade/maya-vector-displacement-deformer
+ *
+ * Released under MIT license. Please see LICENSE file for details.
+ */
+
+#include "VectorDisplacementTraceCommand.h"
+#include "EvaluationTracer.h"
+#include "VectorDisplacementDeformerNode.h"
+
+#include <maya/MArgDatabase.h>
+#include <maya/MFnDependencyNode.h>
+#include <maya/MGlobal.h>
+#include <maya/MItDependencyNodes.h>
+#include <maya/MSceneMessage.h>
+
+#include <map>
+#include <string>
+
+
+constexpr char* ENABLE_FLAG = "-e";
+constexpr char* ENABLE_FLAG_LONG = "-enable";
+constexpr char* CLEAR_FLAG = "-c";
+constexpr char* CLEAR_FLAG_LONG = "-clear";
+constexpr char* WRITE_FLAG = "-w";
+constexpr char* WRITE_FLAG_LONG = "-write";
+constexpr char* EXIT_FILE_FLAG = "-ef";
+constexpr char* EXIT_FILE_FLAG_LONG = "-exitFile";
+constexpr char* TRACE_ENVIRONMENT_VARIABLE = "VECTOR_DISPLACEMENT_TRACE";
+
+
+MString VectorDisplacementTraceCommand::exitFilePath;
+MCallbackId VectorDisplacementTraceCommand::exitCallbackId = 0;
+bool VectorDisplacementTraceCommand::hasExitCallback = false;
+
+
+MStatus VectorDisplacementTraceCommand::doIt(const MArgList& args)
+{
+    MStatus status;
+    MArgDatabase argData(syntax(), args, &status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    if (argData.isFlagSet(ENABLE_FLAG))
+    {
+        bool isEnabled = false;
+        argData.getFlagArgument(ENABLE_FLAG, 0, isEnabled);
+
+        EvaluationTracer::setEnabled(isEnabled);
+    }
+
+    if (argData.isFlagSet(CLEAR_FLAG))
+    {
+        EvaluationTracer::clear();
+    }
+
+    if (argData.isFlagSet(WRITE_FLAG))
+    {
+        MString path;
+        argData.getFlagArgument(WRITE_FLAG, 0, path);
+
+        status = writeTrace(path);
+        if (status != MS::kSuccess)
+        {
+            displayError("Could not write the trace file " + path + ".");
+            return status;
+        }
+    }
+
+    if (argData.isFlagSet(EXIT_FILE_FLAG))
+    {
+        argData.getFlagArgument(EXIT_FILE_FLAG, 0, exitFilePath);
+    }
+
+    setResult(static_cast<int>(EvaluationTracer::getSpanCount()));
+    return MS::kSuccess;
+}
+
+void* VectorDisplacementTraceCommand::creator()
+{
+    return new VectorDisplacementTraceCommand;
+}
+
+MSyntax VectorDisplacementTraceCommand::newSyntax()
+{
+    MSyntax syntax;
+    syntax.addFlag(ENABLE_FLAG, ENABLE_FLAG_LONG, MSyntax::kBoolean);
+    syntax.addFlag(CLEAR_FLAG, CLEAR_FLAG_LONG);
+    syntax.addFlag(WRITE_FLAG, WRITE_FLAG_LONG, MSyntax::kString);
+    syntax.addFlag(EXIT_FILE_FLAG, EXIT_FILE_FLAG_LONG, MSyntax::kString);
+
+    return syntax;
+}
+
+MStatus VectorDisplacementTraceCommand::initializeTracing()
+{
+    MStatus status;
+    exitCallbackId = MSceneMessage::addCallback(MSceneMessage::kMayaExiting, onMayaExiting, nullptr, &status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    hasExitCallback = true;
+
+    // Resolved through MEL like the other paths the plugin reads when loading
+
+    MString tracePath = MGlobal::executeCommandStringResult(MString("getenv ") + TRACE_ENVIRONMENT_VARIABLE);
+
+    if (tracePath.length() > 0)
+    {
+        exitFilePath = tracePath;
+        EvaluationTracer::setEnabled(true);
+    }
+
+    return MS::kSuccess;
+}
+
+void VectorDisplacementTraceCommand::uninitializeTracing()
+{
+    if (hasExitCallback)
+    {
+        MMessage::removeCallback(exitCallbackId);
+        hasExitCallback = false;
+    }
+
+    // Spans are lost once the plugin is unloaded
+
+    onMayaExiting(nullptr);
+    EvaluationTracer::setEnabled(false);
+}
+
+MStatus VectorDisplacementTraceCommand::writeTrace(const MString& path)
+{
+    // Spans are tagged with node ids, since node names can change while tracing
+
+    std::map<uint32_t, std::string> nodeNames;
+
+    for (MItDependencyNodes itNodes(MFn::kPluginDeformerNode); !itNodes.isDone(); itNodes.next())
+    {
+        MFnDependencyNode node(itNodes.thisNode());
+
+        if (node.typeId() != VectorDisplacementDeformerNode::Id)
+        {
+            continue;
+        }
+
+        const VectorDisplacementDeformerNode* deformerNode = static_cast<const VectorDisplacementDeformerNode*>(node.userNode());
+
+        if (deformerNode)
+        {
+            nodeNames[deformerNode->getTraceId()] = node.name().asChar();
+        }
+    }
+
+    return EvaluationTracer::write(path.asChar(), nodeNames) ? MS::kSuccess : MS::kFailure;
+}
+
+void VectorDisplacementTraceCommand::onMayaExiting(void* clientData)
+{
+    if (exitFilePath.length() == 0 || EvaluationTracer::getSpanCount() == 0)
+    {
+        return;
+    }
+
+    if (writeTrace(exitFilePath) != MS::kSuccess)
+    {
+        MGlobal::displayError("Could not write the trace file " + exitFilePath + ".");
+    }
+
+    exitFilePath = MString(); // Only written once
+}
\ No newline at end of file
@@ -0,0 +1,78 @@
+/* Copyright (C) 2020 - Jose Ivan Lopez Romo - All rights reserved
+ *
+ * This file is part of the MayaVectorDisplacementDeformer project found in the
+ * following repository: https://github.com/Zhibade/maya-vector-displacement-deformer
+ *
+ * Released under MIT license. Please see LICENSE file for details.
+ */
+
+#pragma once
+
+#include <maya/MArgList.h>
+#include <maya/MMessage.h>
+#include <maya/MPxCommand.h>
+#include <maya/MString.h>
+#include <maya/MSyntax.h>
+
+
+/*
+ * Command that controls the tracing of the deformer evaluation stages and writes them as a Chrome trace-event JSON file.
+ * Usage: vectorDisplacementTrace -enable true; (play or render) vectorDisplacementTrace -write "path/to/trace.json";
+ * Tracing can also be enabled for batch and farm jobs by setting the VECTOR_DISPLACEMENT_TRACE environment variable to the
+ * path of the trace file, which is written when Maya exits.
+ */
+class VectorDisplacementTraceCommand : public MPxCommand
+{
+public:
+    VectorDisplacementTraceCommand() {};
+    ~VectorDisplacementTraceCommand() override {};
+
+    /**
+    * Enables or disables tracing, clears the recorded spans, writes them, or sets the file written when Maya exits (in the order of the flags listed here).
+    * The result is the number of recorded spans.
+    *
+    * @param[in] args - Command arguments
+    *
+    * @return MStatus indicating if operation was successful or not
+    */
+    MStatus doIt(const MArgList& args) override;
+
+    /** Tracing does not change the scene, so there is nothing to undo */
+    bool isUndoable() const override { return false; }
+
+    /** Creator function that returns a new instance of this command */
+    static void* creator();
+
+    /** Returns the syntax of this command */
+    static MSyntax newSyntax();
+
+    /**
+    * Registers the callback that writes the trace when Maya exits, and enables tracing when the VECTOR_DISPLACEMENT_TRACE environment variable is set.
+    * Called when the plugin is loaded.
+    *
+    * @return MStatus indicating if operation was successful or not
+    */
+    static MStatus initializeTracing();
+
+    /** Removes the exit callback and writes the trace to the exit file if set. Called when the plugin is unloaded. */
+    static void uninitializeTracing();
+
+    static constexpr char* COMMAND_NAME = "vectorDisplacementTrace";
+
+private:
+    /**
+    * Writes the recorded spans, naming each node by its current name
+    *
+    * @param[in] path - Path of the trace file
+    *
+    * @return MStatus indicating if operation was successful or not
+    */
+    static MStatus writeTrace(const MString& path);
+
+    /** Writes the trace to the exit file when Maya exits */
+    static void onMayaExiting(void* clientData);
+
+    static MString exitFilePath; // Trace file written when Maya exits. Not written if empty.
+    static MCallbackId exitCallbackId;
+    static bool hasExitCallback;
+};
\ No newline at end of file
@@ -7,40 +7,59 @@
  */
 
 #include "VectorDisplacementUtilities.h"
+#include "VectorDisplacementMath.h"
 
 #include <maya/MDynamicsUtil.h>
+#include <maya/MFloatArray.h>
 #include <maya/MFnMesh.h>
 #include <maya/MGlobal.h>
 #include <maya/MItMeshPolygon.h>
 #include <maya/MItMeshVertex.h>
 #include <maya/MPlug.h>
 #include <maya/MPlugArray.h>
+#include <maya/MPxDeformerNode.h>
 
+#include <algorithm>
+#include <cmath>
+#include <limits>
 
-MStatus VectorDisplacementUtilities::getAveragedTangentsAndBinormals(MObject meshItem, MFloatVectorArray& tangents, MFloatVectorArray& binormals)
-{
-    tangents.clear();
-    binormals.clear();
 
+constexpr size_t PROXY_MAX_INTERPOLATION_SOURCES = 4; // Maximum number of sampled vertices a proxy vertex is interpolated from
+constexpr unsigned int MAP_TABLE_BAND_SAMPLES = 1 << 20; // Map samples taken per band when building map tables (about 60 MB of temporaries)
+
+
+MStatus VectorDisplacementUtilities::getAveragedTangentsAndBinormals(MObject meshItem, MFloatVectorArray& tangents, MFloatVectorArray& binormals, EvaluationScratch& scratch)
+{
     // Check that object is a mesh
 
     if (!meshItem.hasFn(MFn::kMesh))
     {
+        tangents.clear();
+        binormals.clear();
+
         VectorDisplacementUtilities::logError("Given object is not a mesh. Please apply deformer to mesh objects only.");
         return MS::kInvalidParameter;
     }
 
-    // Calculate averaged tangents and binormals
+    // Calculate averaged tangents and binormals. Arrays are reset in place so their storage is reused.
 
     MFnMesh meshFn(meshItem);
-    
-    tangents.setLength(meshFn.numVertices());
-    binormals.setLength(meshFn.numVertices());
+    unsigned int numOfVertices = static_cast<unsigned int>(meshFn.numVertices());
+
+    tangents.setLength(numOfVertices);
+    binormals.setLength(numOfVertices);
+
+    for (unsigned int i = 0; i < numOfVertices; i++)
+    {
+        tangents[i] = MFloatVector::zero;
+        binormals[i] = MFloatVector::zero;
+    }
+
+    MIntArray& faceVerts = scratch.faceVertices;
 
     MItMeshPolygon faceIterator(meshItem);
     for (; !faceIterator.isDone(); faceIterator.next())
     {
-        MIntArray faceVerts;
         faceIterator.getVertices(faceVerts);
 
         for (int i = 0; i < faceVerts.length(); i++)
@@ -64,11 +83,8 @@ MStatus VectorDisplacementUtilities::getAveragedTangentsAndBinormals(MObject mes
 
             // Average using previous data
 
-            tangents[vertIndex] = (tangents[vertIndex] + faceVertexTangent) / 2.f;
-            binormals[vertIndex] = (binormals[vertIndex] + faceVertexBinormal) / 2.f;
-            
-            tangents[vertIndex].normalize();
-            binormals[vertIndex].normalize();
+            VectorDisplacementMath::accumulateFrameVector(tangents[vertIndex], faceVertexTangent);
+            VectorDisplacementMath::accumulateFrameVector(binormals[vertIndex], faceVertexBinormal);
         }
     }
 
@@ -76,29 +92,61 @@ MStatus VectorDisplacementUtilities::getAveragedTangentsAndBinormals(MObject mes
 }
 
 MPoint VectorDisplacementUtilities::getDisplacedVertex(VertexData vertexData, const MVectorArray& mapRgbData, const MDoubleArray& mapAlphaData, float strength, VectorDisplacementMapType mapType)
+{
+    return vertexData.position + getDisplacementOffset(vertexData, mapRgbData, strength, mapType);
+}
+
+MVector VectorDisplacementUtilities::getDisplacementOffset(const VertexData& vertexData, const MVectorArray& mapRgbData, float strength, VectorDisplacementMapType mapType)
 {
     // Map RGB data is assumed to be in raw centimeters (not normalized)
 
-    MVector colorValue = mapRgbData[vertexData.index];
+    const MVector& colorValue = mapRgbData[vertexData.index];
 
     switch (mapType)
     {
         case VectorDisplacementMapType::OBJECT_SPACE:
-            return VectorDisplacementUtilities::applyObjectDisplacement(vertexData.position, colorValue, strength);
+            return VectorDisplacementUtilities::getObjectDisplacementOffset(colorValue, strength);
 
         case VectorDisplacementMapType::TANGENT_SPACE:
-            return VectorDisplacementUtilities::applyTangentDisplacement(vertexData, colorValue, strength);
+            return VectorDisplacementUtilities::getTangentDisplacementOffset(vertexData, colorValue, strength);
 
         default:
             VectorDisplacementUtilities::logError("Unsupported vector displacement type. Please use object-space or tangent-space textures");
-            return MPoint();
+            return MVector();
     }
 }
 
-MStatus VectorDisplacementUtilities::getMeshUvData(MObject meshItem, MDoubleArray& uCoords, MDoubleArray& vCoords)
+void VectorDisplacementUtilities::getDisplacementOffsets(const MVectorArray& mapRgbData, const MFloatVectorArray& normals, const MFloatVectorArray& tangents,
+                                                         const MFloatVectorArray& binormals, VectorDisplacementMapType mapType, std::vector<float>& offsets)
 {
-    uCoords.clear();
-    vCoords.clear();
+    unsigned int numOfVertices = mapRgbData.length();
+    offsets.resize(static_cast<size_t>(numOfVertices) * 3);
+
+    for (unsigned int i = 0; i < numOfVertices; i++)
+    {
+        VertexData vertexData;
+        vertexData.index = i;
+
+        if (mapType == VectorDisplacementMapType::TANGENT_SPACE)
+        {
+            vertexData.normal = normals[i];
+            vertexData.tangent = tangents[i];
+            vertexData.binormal = binormals[i];
+        }
+
+        MVector offset = getDisplacementOffset(vertexData, mapRgbData, 1.f, mapType);
+
+        offsets[i * 3] = static_cast<float>(offset.x);
+        offsets[i * 3 + 1] = static_cast<float>(offset.y);
+        offsets[i * 3 + 2] = static_cast<float>(offset.z);
+    }
+}
+
+MStatus VectorDisplacementUtilities::getMeshTriangles(MObject meshItem, const MString& uvSetName, std::vector<Float3>& positions, std::vector<unsigned int>& triangleVertexIds,
+                                                     std::vector<float>* triangleUvs, EvaluationScratch& scratch)
+{
+    positions.clear();
+    triangleVertexIds.clear();
 
     // Check that object is a mesh
 
@@ -108,35 +156,98 @@ MStatus VectorDisplacementUtilities::getMeshUvData(MObject meshItem, MDoubleArra
         return MS::kInvalidParameter;
     }
 
-    // Find first UV set name, then iterate over vertices and get UV values
-
     MFnMesh meshFn(meshItem);
+    MStatus status;
 
-    MStringArray uvSetNames;
-    meshFn.getUVSetNames(uvSetNames); // Maya forces at least 1 UV set per mesh so there is no need to check number of UV sets
+    const float* rawPoints = meshFn.getRawPoints(&status);
+    if (status != MS::kSuccess)
+    {
+        return status;
+    }
 
-    MItMeshVertex vertexIt(meshItem);
+    unsigned int numOfVertices = static_cast<unsigned int>(meshFn.numVertices());
+    positions.resize(numOfVertices);
+
+    for (unsigned int i = 0; i < numOfVertices; i++)
+    {
+        positions[i] = Float3(rawPoints[i * 3], rawPoints[i * 3 + 1], rawPoints[i * 3 + 2]);
+    }
 
-    uCoords.setLength(vertexIt.count());
-    vCoords.setLength(vertexIt.count());
+    MIntArray triangleCounts;
+    MIntArray triangleVertices;
 
-    for (; !vertexIt.isDone(); vertexIt.next())
+    status = meshFn.getTriangles(triangleCounts, triangleVertices);
+    if (status != MS::kSuccess)
     {
-        int index = vertexIt.index(); 
+        return status;
+    }
 
-        float2 uv;
-        vertexIt.getUV(uv, &uvSetNames[0]);
+    triangleVertexIds.resize(triangleVertices.length());
 
-        uCoords[index] = uv[0];
-        vCoords[index] = uv[1];
+    for (unsigned int i = 0; i < triangleVertices.length(); i++)
+    {
+        triangleVertexIds[i] = static_cast<unsigned int>(triangleVertices[i]);
     }
 
-    return MStatus::kSuccess;
+    if (!triangleUvs)
+    {
+        return MS::kSuccess;
+    }
+
+    // Triangles only reference vertices, so each corner's UV is found through the matching face-vertex of its polygon
+
+    MString uvSet = getUvSetName(meshFn, uvSetName);
+
+    MFloatArray& uCoords = scratch.uCoords;
+    MFloatArray& vCoords = scratch.vCoords;
+    meshFn.getUVs(uCoords, vCoords, &uvSet);
+
+    MIntArray& uvCounts = scratch.uvCounts;
+    MIntArray& uvIds = scratch.uvIds;
+    meshFn.getAssignedUVs(uvCounts, uvIds, &uvSet);
+
+    MIntArray& faceVertexCounts = scratch.faceVertexCounts;
+    MIntArray& faceVertexIds = scratch.faceVertexIds;
+    meshFn.getVertices(faceVertexCounts, faceVertexIds);
+
+    triangleUvs->assign(static_cast<size_t>(triangleVertices.length()) * 2, std::numeric_limits<float>::quiet_NaN());
+
+    unsigned int faceVertexOffset = 0;
+    unsigned int uvOffset = 0;
+    unsigned int cornerOffset = 0;
+
+    for (unsigned int face = 0; face < faceVertexCounts.length(); face++)
+    {
+        unsigned int faceVertexCount = static_cast<unsigned int>(faceVertexCounts[face]);
+        unsigned int faceUvCount = face < uvCounts.length() ? static_cast<unsigned int>(uvCounts[face]) : 0;
+        unsigned int faceCornerCount = static_cast<unsigned int>(triangleCounts[face]) * 3;
+
+        for (unsigned int corner = cornerOffset; corner < cornerOffset + faceCornerCount && faceUvCount == faceVertexCount; corner++)
+        {
+            for (unsigned int i = 0; i < faceVertexCount; i++)
+            {
+                unsigned int uvId = static_cast<unsigned int>(uvIds[uvOffset + i]);
+
+                if (faceVertexIds[faceVertexOffset + i] == triangleVertices[corner] && uvId < uCoords.length())
+                {
+                    (*triangleUvs)[corner * 2] = uCoords[uvId];
+                    (*triangleUvs)[corner * 2 + 1] = vCoords[uvId];
+                    break;
+                }
+            }
+        }
+
+        faceVertexOffset += faceVertexCount;
+        uvOffset += faceUvCount;
+        cornerOffset += faceCornerCount;
+    }
+
+    return MS::kSuccess;
 }
 
-MStatus VectorDisplacementUtilities::getMeshVertexData(MObject meshItem, MFloatVectorArray& normals, MFloatVectorArray& tangents, MFloatVectorArray& binormals)
+MStatus VectorDisplacementUtilities::getVertexAdjacency(MObject meshItem, VertexAdjacency& adjacency, EvaluationScratch& scratch)
 {
-    normals.clear();
+    adjacency = VertexAdjacency();
 
     // Check that object is a mesh
 
@@ -146,95 +257,1347 @@ MStatus VectorDisplacementUtilities::getMeshVertexData(MObject meshItem, MFloatV
         return MS::kInvalidParameter;
     }
 
-    // Init function set and fetch averaged normals
-    /// Averaged normals, tangents, and binormals are needed because of how Maya handles mesh data internally.
-    /// A single vertex can have many normal, tangent, and binormal values depending on which face it is being referenced from (face-vertex)
-    /// Since we want a single value for each vertex, the values are all averaged to get a single value.
+    MFnMesh meshFn(meshItem);
+
+    MStatus status = meshFn.getVertices(scratch.faceVertexCounts, scratch.faceVertexIds);
+    if (status != MS::kSuccess)
+    {
+        return status;
+    }
+
+    VectorDisplacementRelax::buildAdjacency(meshFn.numVertices(), scratch.faceVertexCounts, scratch.faceVertexCounts.length(), scratch.faceVertexIds, adjacency);
+
+    return MS::kSuccess;
+}
+
+MStatus VectorDisplacementUtilities::getMeshFingerprint(MObject meshItem, const MString& uvSetName, MeshFingerprint& fingerprint, EvaluationScratch& scratch)
+{
+    fingerprint = MeshFingerprint();
+    fingerprint.uvSetName = uvSetName;
+
+    // Check that object is a mesh
+
+    if (!meshItem.hasFn(MFn::kMesh))
+    {
+        VectorDisplacementUtilities::logError("Given object is not a mesh. Please apply deformer to mesh objects only.");
+        return MS::kInvalidParameter;
+    }
 
     MFnMesh meshFn(meshItem);
-    meshFn.getVertexNormals(false, normals);
+    fingerprint.vertexCount = meshFn.numVertices();
 
-    // Calculate averaged tangents and binormals since the Maya API does not have a method to do this like with normals
+    // Topology: face vertex counts followed by the face-vertex connectivity
 
-    VectorDisplacementUtilities::getAveragedTangentsAndBinormals(meshItem, tangents, binormals);
+    MIntArray& faceVertexCounts = scratch.faceVertexCounts;
+    MIntArray& faceVertexIds = scratch.faceVertexIds;
+    meshFn.getVertices(faceVertexCounts, faceVertexIds);
 
-    return MStatus::kSuccess;
+    uint64_t hash = hashInit();
+    hash = hashIntArray(hash, faceVertexCounts);
+    hash = hashIntArray(hash, faceVertexIds);
+    fingerprint.topology = hash;
+
+    // UVs: values of the UV set and their face-vertex assignments (same UV set used when sampling the map)
+
+    MString uvSet = getUvSetName(meshFn, uvSetName);
+
+    MFloatArray& uCoords = scratch.uCoords;
+    MFloatArray& vCoords = scratch.vCoords;
+    meshFn.getUVs(uCoords, vCoords, &uvSet);
+
+    MIntArray& uvCounts = scratch.uvCounts;
+    MIntArray& uvIds = scratch.uvIds;
+    meshFn.getAssignedUVs(uvCounts, uvIds, &uvSet);
+
+    hash = hashInit();
+    hash = hashFloatArray(hash, uCoords);
+    hash = hashFloatArray(hash, vCoords);
+    hash = hashIntArray(hash, uvCounts);
+    hash = hashIntArray(hash, uvIds);
+    fingerprint.uvs = hash;
+
+    return MS::kSuccess;
 }
 
-MStatus VectorDisplacementUtilities::getTextureData(const MObject& nodeObject, const MObject& meshItem, const char* attributeName, MVectorArray& colorData, MDoubleArray& alphaData)
+MeshChangeType VectorDisplacementUtilities::updateMeshFingerprint(MObject meshItem, const MString& uvSetName, MeshFingerprint& fingerprint, EvaluationScratch& scratch)
 {
-    // Check plug
+    MeshFingerprint previousFingerprint = fingerprint;
+    getMeshFingerprint(meshItem, uvSetName, fingerprint, scratch);
 
-    MStatus displacementMapPlugStatus;
-    MFnDependencyNode thisNode(nodeObject);
-    MPlug displacementMapPlug = thisNode.findPlug(attributeName, true, &displacementMapPlugStatus);
+    if (fingerprint.vertexCount != previousFingerprint.vertexCount || fingerprint.topology != previousFingerprint.topology)
+    {
+        return MeshChangeType::TOPOLOGY;
+    }
 
-    if (displacementMapPlugStatus != MS::kSuccess)
+    if (fingerprint.uvs != previousFingerprint.uvs || fingerprint.uvSetName != previousFingerprint.uvSetName)
     {
-        return displacementMapPlugStatus; // Return same error that we got. In theory this should never be reached.
+        return MeshChangeType::UVS;
     }
 
-    // Check if plug is connected to a source node
+    return MeshChangeType::POINTS;
+}
 
-    MPlugArray connections;
-    displacementMapPlug.connectedTo(connections, true, false);
+MStatus VectorDisplacementUtilities::buildProxySampling(MObject meshItem, unsigned int level, ProxySampling& sampling)
+{
+    sampling = ProxySampling();
+
+    // Check that object is a mesh
 
-    if (connections.length() <= 0)
+    if (!meshItem.hasFn(MFn::kMesh))
     {
+        VectorDisplacementUtilities::logError("Given object is not a mesh. Please apply deformer to mesh objects only.");
         return MS::kInvalidParameter;
     }
 
-    // Check if plugged in texture node is valid
+    if (level == 0)
+    {
+        return MS::kInvalidParameter;
+    }
 
-    MObject mapAttribute = thisNode.attribute(attributeName);
+    MFnMesh meshFn(meshItem);
+    unsigned int numOfVertices = meshFn.numVertices();
 
-    bool isConnectedToValidNode = MDynamicsUtil::hasValidDynamics2dTexture(nodeObject, mapAttribute);
-    if (!isConnectedToValidNode)
+    MIntArray faceVertexCounts;
+    MIntArray faceVertexIds;
+    meshFn.getVertices(faceVertexCounts, faceVertexIds);
+
+    // Vertex adjacency (compressed rows) from the face edges. Edges shared by two faces are listed twice, which doesn't affect distances.
+
+    std::vector<unsigned int> adjacencyOffsets(numOfVertices + 1, 0);
+    std::vector<unsigned int> adjacency;
+
+    auto forEachFaceEdge = [&](auto&& edgeFunction)
     {
-        logError("Connected node is not a valid 2D texture node. Please connect a 2D texture node to the vector displacement map attribute.");
-        return MS::kInvalidParameter;
+        unsigned int faceStart = 0;
+
+        for (unsigned int face = 0; face < faceVertexCounts.length(); face++)
+        {
+            unsigned int count = faceVertexCounts[face];
+
+            for (unsigned int i = 0; i < count; i++)
+            {
+                edgeFunction(faceVertexIds[faceStart + i], faceVertexIds[faceStart + (i + 1) % count]);
+            }
+
+            faceStart += count;
+        }
+    };
+
+    forEachFaceEdge([&](unsigned int a, unsigned int b)
+    {
+        adjacencyOffsets[a + 1]++;
+        adjacencyOffsets[b + 1]++;
+    });
+
+    for (unsigned int i = 0; i < numOfVertices; i++)
+    {
+        adjacencyOffsets[i + 1] += adjacencyOffsets[i];
     }
 
-    // Finally, get texture color and alpha data
+    adjacency.resize(adjacencyOffsets[numOfVertices]);
+    std::vector<unsigned int> adjacencyFill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
 
-    MDoubleArray uCoords;
-    MDoubleArray vCoords;
+    forEachFaceEdge([&](unsigned int a, unsigned int b)
+    {
+        adjacency[adjacencyFill[a]++] = b;
+        adjacency[adjacencyFill[b]++] = a;
+    });
 
-    getMeshUvData(meshItem, uCoords, vCoords);
+    // Pick sampled vertices greedily in vertex order. A bounded breadth-first search from each picked vertex
+    // keeps track of the distance to (and the index of) the nearest sampled vertex of every vertex it reaches.
 
-    MStatus readTextureStatus = MDynamicsUtil::evalDynamics2dTexture(nodeObject, mapAttribute, uCoords, vCoords, &colorData, &alphaData);
+    const unsigned int unreached = std::numeric_limits<unsigned int>::max();
 
-    if (readTextureStatus == MS::kSuccess)
+    std::vector<unsigned int> distances(numOfVertices, unreached);
+    std::vector<unsigned int> nearestSamples(numOfVertices, 0);
+    std::vector<unsigned int> queue;
+
+    for (unsigned int vertex = 0; vertex < numOfVertices; vertex++)
     {
-        return MS::kSuccess;
+        if (distances[vertex] != unreached)
+        {
+            continue;
+        }
+
+        unsigned int sampleIndex = static_cast<unsigned int>(sampling.sampledVertices.size());
+        sampling.sampledVertices.push_back(vertex);
+
+        distances[vertex] = 0;
+        nearestSamples[vertex] = sampleIndex;
+
+        queue.clear();
+        queue.push_back(vertex);
+
+        for (size_t i = 0; i < queue.size(); i++)
+        {
+            unsigned int current = queue[i];
+            unsigned int distance = distances[current] + 1;
+
+            if (distance > level)
+            {
+                continue;
+            }
+
+            for (unsigned int j = adjacencyOffsets[current]; j < adjacencyOffsets[current + 1]; j++)
+            {
+                unsigned int neighbour = adjacency[j];
+
+                if (distance < distances[neighbour])
+                {
+                    distances[neighbour] = distance;
+                    nearestSamples[neighbour] = sampleIndex;
+                    queue.push_back(neighbour);
+                }
+            }
+        }
     }
-    else
+
+    // Interpolate each vertex from the nearest sampled vertices of itself and its neighbours, weighted by inverse edge distance.
+    // Blending the neighbour samples avoids visible steps at the borders between the regions of two sampled vertices.
+
+    sampling.interpolationOffsets.reserve(numOfVertices + 1);
+    sampling.interpolationSources.reserve(numOfVertices * 2);
+    sampling.interpolationWeights.reserve(numOfVertices * 2);
+
+    for (unsigned int vertex = 0; vertex < numOfVertices; vertex++)
     {
-        logError("An error occurred when trying to read vector displacement map texture. Please verify that it is a valid texture");
-        return MS::kFailure;
+        size_t first = sampling.interpolationSources.size();
+        sampling.interpolationOffsets.push_back(static_cast<unsigned int>(first));
+
+        auto addSource = [&](unsigned int sampleIndex, unsigned int distance)
+        {
+            for (size_t i = first; i < sampling.interpolationSources.size(); i++)
+            {
+                if (sampling.interpolationSources[i] == sampleIndex)
+                {
+                    sampling.interpolationWeights[i] = std::max(sampling.interpolationWeights[i], 1.f / distance);
+                    return;
+                }
+            }
+
+            if (sampling.interpolationSources.size() - first < PROXY_MAX_INTERPOLATION_SOURCES)
+            {
+                sampling.interpolationSources.push_back(sampleIndex);
+                sampling.interpolationWeights.push_back(1.f / distance);
+            }
+        };
+
+        if (distances[vertex] == 0)
+        {
+            addSource(nearestSamples[vertex], 1); // Sampled vertices keep their own sample
+            continue;
+        }
+
+        addSource(nearestSamples[vertex], distances[vertex]);
+
+        for (unsigned int j = adjacencyOffsets[vertex]; j < adjacencyOffsets[vertex + 1]; j++)
+        {
+            unsigned int neighbour = adjacency[j];
+            addSource(nearestSamples[neighbour], distances[neighbour] + 1);
+        }
+
+        float totalWeight = 0.f;
+
+        for (size_t i = first; i < sampling.interpolationWeights.size(); i++)
+        {
+            totalWeight += sampling.interpolationWeights[i];
+        }
+
+        for (size_t i = first; i < sampling.interpolationWeights.size(); i++)
+        {
+            sampling.interpolationWeights[i] /= totalWeight;
+        }
+    }
+
+    sampling.interpolationOffsets.push_back(static_cast<unsigned int>(sampling.interpolationSources.size()));
+    sampling.level = level;
+
+    return MS::kSuccess;
+}
+
+MStatus VectorDisplacementUtilities::getMeshUvData(MObject meshItem, const MString& uvSetName, std::vector<float>& vertexUvs, EvaluationScratch& scratch)
+{
+    vertexUvs.clear();
+
+    // Check that object is a mesh
+
+    if (!meshItem.hasFn(MFn::kMesh))
+    {
+        VectorDisplacementUtilities::logError("Given object is not a mesh. Please apply deformer to mesh objects only.");
+        return MS::kInvalidParameter;
+    }
+
+    // Get UV values, their face-vertex assignments and the face-vertex connectivity in bulk
+
+    MFnMesh meshFn(meshItem);
+    MString uvSet = getUvSetName(meshFn, uvSetName);
+
+    MFloatArray& uCoords = scratch.uCoords;
+    MFloatArray& vCoords = scratch.vCoords;
+    meshFn.getUVs(uCoords, vCoords, &uvSet);
+
+    MIntArray& uvCounts = scratch.uvCounts;
+    MIntArray& uvIds = scratch.uvIds;
+    meshFn.getAssignedUVs(uvCounts, uvIds, &uvSet);
+
+    MIntArray& faceVertexCounts = scratch.faceVertexCounts;
+    MIntArray& faceVertexIds = scratch.faceVertexIds;
+    meshFn.getVertices(faceVertexCounts, faceVertexIds);
+
+    // Walk the face-vertices in face order. Each vertex keeps the first UV assigned to it.
+
+    unsigned int numOfVertices = static_cast<unsigned int>(meshFn.numVertices());
+
+    vertexUvs.assign(numOfVertices * 2, 0.f);
+
+    std::vector<char>& hasUv = scratch.vertexFlags;
+    hasUv.assign(numOfVertices, false);
+
+    unsigned int faceVertexOffset = 0;
+    unsigned int uvOffset = 0;
+
+    for (unsigned int face = 0; face < faceVertexCounts.length(); face++)
+    {
+        unsigned int faceVertexCount = static_cast<unsigned int>(faceVertexCounts[face]);
+        unsigned int faceUvCount = face < uvCounts.length() ? static_cast<unsigned int>(uvCounts[face]) : 0;
+
+        // Faces without UVs in this set have no assignments
+
+        if (faceUvCount == faceVertexCount)
+        {
+            for (unsigned int i = 0; i < faceVertexCount; i++)
+            {
+                unsigned int vertex = static_cast<unsigned int>(faceVertexIds[faceVertexOffset + i]);
+                unsigned int uvId = static_cast<unsigned int>(uvIds[uvOffset + i]);
+
+                if (vertex < numOfVertices && !hasUv[vertex] && uvId < uCoords.length())
+                {
+                    vertexUvs[vertex * 2] = uCoords[uvId];
+                    vertexUvs[vertex * 2 + 1] = vCoords[uvId];
+                    hasUv[vertex] = true;
+                }
+            }
+        }
+
+        faceVertexOffset += faceVertexCount;
+        uvOffset += faceUvCount;
     }
+
+    return MStatus::kSuccess;
 }
 
-MPoint VectorDisplacementUtilities::applyObjectDisplacement(const MPoint& vertex, MVector rgbData, float strength)
+void VectorDisplacementUtilities::getUvSamplingOrder(const std::vector<float>& vertexUvs, UvSamplingOrder& order)
 {
-    double x = vertex.x + (rgbData.x * strength);
-    double y = vertex.y + (rgbData.y * strength);
-    double z = vertex.z + (rgbData.z * strength);
+    VectorDisplacementMath::getUvMortonOrder(vertexUvs, order.vertices);
+
+    order.uvs.resize(order.vertices.size() * 2);
+
+    for (size_t i = 0; i < order.vertices.size(); i++)
+    {
+        unsigned int vertex = order.vertices[i];
 
-    return MPoint(x, y, z);
+        order.uvs[i * 2] = vertexUvs[vertex * 2];
+        order.uvs[i * 2 + 1] = vertexUvs[vertex * 2 + 1];
+    }
 }
 
-MPoint VectorDisplacementUtilities::applyTangentDisplacement(VertexData vertexData, MVector rgbData, float strength)
+MStatus VectorDisplacementUtilities::getMeshUvSamples(MObject meshItem, const MString& uvSetName, SeamUvSamples& samples, EvaluationScratch& scratch)
 {
-    MVector tangentOffset = vertexData.tangent * rgbData.x;
-    MVector normalOffset = vertexData.normal * rgbData.y;
-    MVector binormalOffset = vertexData.binormal * rgbData.z;
+    samples = SeamUvSamples();
+
+    // Check that object is a mesh
+
+    if (!meshItem.hasFn(MFn::kMesh))
+    {
+        VectorDisplacementUtilities::logError("Given object is not a mesh. Please apply deformer to mesh objects only.");
+        return MS::kInvalidParameter;
+    }
+
+    MFnMesh meshFn(meshItem);
+    MString uvSet = getUvSetName(meshFn, uvSetName);
+
+    MFloatArray& uCoords = scratch.uCoords;
+    MFloatArray& vCoords = scratch.vCoords;
+    meshFn.getUVs(uCoords, vCoords, &uvSet);
+
+    MIntArray& uvCounts = scratch.uvCounts;
+    MIntArray& uvIds = scratch.uvIds;
+    meshFn.getAssignedUVs(uvCounts, uvIds, &uvSet);
+
+    MIntArray& faceVertexCounts = scratch.faceVertexCounts;
+    MIntArray& faceVertexIds = scratch.faceVertexIds;
+    meshFn.getVertices(faceVertexCounts, faceVertexIds);
+
+    unsigned int numOfVertices = static_cast<unsigned int>(meshFn.numVertices());
+    unsigned int numOfUvs = uCoords.length();
+
+    // Calls the given function with the vertex and UV of every face-vertex that has a UV in this set
+
+    auto forEachFaceVertexUv = [&](const auto& function)
+    {
+        unsigned int faceVertexOffset = 0;
+        unsigned int uvOffset = 0;
+
+        for (unsigned int face = 0; face < faceVertexCounts.length(); face++)
+        {
+            unsigned int faceVertexCount = static_cast<unsigned int>(faceVertexCounts[face]);
+            unsigned int faceUvCount = face < uvCounts.length() ? static_cast<unsigned int>(uvCounts[face]) : 0;
+
+            if (faceUvCount == faceVertexCount)
+            {
+                for (unsigned int i = 0; i < faceVertexCount; i++)
+                {
+                    unsigned int vertex = static_cast<unsigned int>(faceVertexIds[faceVertexOffset + i]);
+                    unsigned int uvId = static_cast<unsigned int>(uvIds[uvOffset + i]);
+
+                    if (vertex < numOfVertices && uvId < numOfUvs)
+                    {
+                        function(vertex, uvId);
+                    }
+                }
+            }
+
+            faceVertexOffset += faceVertexCount;
+            uvOffset += faceUvCount;
+        }
+    };
+
+    // Reserve a slot per face-vertex of each vertex (at least one), then keep each distinct UV once per vertex
+
+    std::vector<unsigned int>& offsets = samples.vertexSampleOffsets;
+    offsets.assign(numOfVertices + 1, 0);
+
+    forEachFaceVertexUv([&offsets](unsigned int vertex, unsigned int uvId) { offsets[vertex + 1]++; });
+
+    for (unsigned int vertex = 0; vertex < numOfVertices; vertex++)
+    {
+        offsets[vertex + 1] = offsets[vertex] + std::max(offsets[vertex + 1], 1u);
+    }
 
-    double x = vertexData.position.x + ((tangentOffset.x + normalOffset.x + binormalOffset.x) * strength);
-    double y = vertexData.position.y + ((tangentOffset.y + normalOffset.y + binormalOffset.y) * strength);
-    double z = vertexData.position.z + ((tangentOffset.z + normalOffset.z + binormalOffset.z) * strength);
+    std::vector<unsigned int> sampleCounts(numOfVertices, 0);
+    samples.vertexSamples.resize(offsets[numOfVertices]);
+    samples.uvSamples.assign(numOfUvs, SeamUvSamples::INVALID_SAMPLE);
+
+    forEachFaceVertexUv([&](unsigned int vertex, unsigned int uvId)
+    {
+        unsigned int& sample = samples.uvSamples[uvId];
+
+        if (sample == SeamUvSamples::INVALID_SAMPLE)
+        {
+            sample = static_cast<unsigned int>(samples.uvs.size() / 2);
+            samples.uvs.push_back(uCoords[uvId]);
+            samples.uvs.push_back(vCoords[uvId]);
+        }
+
+        auto vertexBegin = samples.vertexSamples.begin() + offsets[vertex];
+        auto vertexEnd = vertexBegin + sampleCounts[vertex];
+
+        if (std::find(vertexBegin, vertexEnd, sample) == vertexEnd)
+        {
+            *vertexEnd = sample;
+            sampleCounts[vertex]++;
+        }
+    });
+
+    // Compact the slots. Every vertex has at least one slot, so entries never move past the ones still to be read.
+
+    unsigned int zeroUvSample = SeamUvSamples::INVALID_SAMPLE;
+    unsigned int writeOffset = 0;
+
+    for (unsigned int vertex = 0; vertex < numOfVertices; vertex++)
+    {
+        unsigned int readOffset = offsets[vertex];
+        offsets[vertex] = writeOffset;
+
+        if (sampleCounts[vertex] == 0)
+        {
+            if (zeroUvSample == SeamUvSamples::INVALID_SAMPLE)
+            {
+                zeroUvSample = static_cast<unsigned int>(samples.uvs.size() / 2);
+                samples.uvs.push_back(0.f);
+                samples.uvs.push_back(0.f);
+            }
+
+            samples.vertexSamples[writeOffset++] = zeroUvSample;
+            continue;
+        }
+
+        for (unsigned int i = 0; i < sampleCounts[vertex]; i++)
+        {
+            samples.vertexSamples[writeOffset++] = samples.vertexSamples[readOffset + i];
+        }
+    }
+
+    offsets[numOfVertices] = writeOffset;
+    samples.vertexSamples.resize(writeOffset);
+    samples.vertexSamples.shrink_to_fit();
+
+    getUvSamplingOrder(samples.uvs, samples.samplingOrder);
+
+    return MStatus::kSuccess;
+}
+
+MStatus VectorDisplacementUtilities::getMeshUvData(MObject meshItem, const MString& uvSetName, unsigned int firstVertex, unsigned int count, MDoubleArray& uCoords, MDoubleArray& vCoords)
+{
+    uCoords.clear();
+    vCoords.clear();
+
+    // Check that object is a mesh
+
+    if (!meshItem.hasFn(MFn::kMesh))
+    {
+        VectorDisplacementUtilities::logError("Given object is not a mesh. Please apply deformer to mesh objects only.");
+        return MS::kInvalidParameter;
+    }
+
+    MFnMesh meshFn(meshItem);
+    MString uvSet = getUvSetName(meshFn, uvSetName);
+
+    MItMeshVertex vertexIt(meshItem);
+
+    int previousIndex = 0;
+    if (vertexIt.setIndex(firstVertex, previousIndex) != MS::kSuccess)
+    {
+        return MS::kInvalidParameter;
+    }
+
+    uCoords.setLength(count);
+    vCoords.setLength(count);
+
+    MIntArray connectedFaces;
+
+    for (unsigned int i = 0; i < count && !vertexIt.isDone(); i++, vertexIt.next())
+    {
+        // Use the UV of the lowest connected face that has UVs in this set. Vertices without UVs get (0, 0).
+
+        vertexIt.getConnectedFaces(connectedFaces);
+
+        int uvFace = -1;
+        float2 uv = { 0.f, 0.f };
+
+        for (unsigned int face = 0; face < connectedFaces.length(); face++)
+        {
+            float2 faceUv;
+
+            if ((uvFace < 0 || connectedFaces[face] < uvFace) && vertexIt.getUV(connectedFaces[face], faceUv, &uvSet) == MS::kSuccess)
+            {
+                uvFace = connectedFaces[face];
+                uv[0] = faceUv[0];
+                uv[1] = faceUv[1];
+            }
+        }
+
+        uCoords[i] = uv[0];
+        vCoords[i] = uv[1];
+    }
+
+    return MStatus::kSuccess;
+}
+
+MStatus VectorDisplacementUtilities::getMeshVertexData(MObject meshItem, MFloatVectorArray& normals, MFloatVectorArray& tangents, MFloatVectorArray& binormals, EvaluationScratch& scratch)
+{
+    // Check that object is a mesh
+
+    if (!meshItem.hasFn(MFn::kMesh))
+    {
+        normals.clear();
+        VectorDisplacementUtilities::logError("Given object is not a mesh. Please apply deformer to mesh objects only.");
+        return MS::kInvalidParameter;
+    }
+
+    // Init function set and fetch averaged normals
+    /// Averaged normals, tangents, and binormals are needed because of how Maya handles mesh data internally.
+    /// A single vertex can have many normal, tangent, and binormal values depending on which face it is being referenced from (face-vertex)
+    /// Since we want a single value for each vertex, the values are all averaged to get a single value.
+
+    MFnMesh meshFn(meshItem);
+    meshFn.getVertexNormals(false, normals);
+
+    // Calculate averaged tangents and binormals since the Maya API does not have a method to do this like with normals
+
+    VectorDisplacementUtilities::getAveragedTangentsAndBinormals(meshItem, tangents, binormals, scratch);
+
+    return MStatus::kSuccess;
+}
+
+MStatus VectorDisplacementUtilities::getMeshVertexData(MObject meshItem, unsigned int firstVertex, unsigned int count,
+                                                       MFloatVectorArray& normals, MFloatVectorArray& tangents, MFloatVectorArray& binormals)
+{
+    normals.clear();
+    tangents.clear();
+    binormals.clear();
+
+    // Check that object is a mesh
+
+    if (!meshItem.hasFn(MFn::kMesh))
+    {
+        VectorDisplacementUtilities::logError("Given object is not a mesh. Please apply deformer to mesh objects only.");
+        return MS::kInvalidParameter;
+    }
+
+    MFnMesh meshFn(meshItem);
+    MItMeshVertex vertexIt(meshItem);
+
+    int previousIndex = 0;
+    if (vertexIt.setIndex(firstVertex, previousIndex) != MS::kSuccess)
+    {
+        return MS::kInvalidParameter;
+    }
+
+    normals.setLength(count);
+    tangents.setLength(count);
+    binormals.setLength(count);
+
+    MIntArray connectedFaces;
+    std::vector<int> sortedFaces;
+
+    for (unsigned int i = 0; i < count && !vertexIt.isDone(); i++, vertexIt.next())
+    {
+        int vertIndex = vertexIt.index();
+
+        MVector normal;
+        meshFn.getVertexNormal(vertIndex, false, normal);
+        normals[i] = normal;
+
+        // Same running average as getAveragedTangentsAndBinormals, which visits the faces in index order
+
+        vertexIt.getConnectedFaces(connectedFaces);
+
+        sortedFaces.resize(connectedFaces.length());
+        for (unsigned int j = 0; j < connectedFaces.length(); j++)
+        {
+            sortedFaces[j] = connectedFaces[j];
+        }
+
+        std::sort(sortedFaces.begin(), sortedFaces.end());
+
+        for (int faceIndex : sortedFaces)
+        {
+            MVector faceVertexTangent;
+            MVector faceVertexBinormal;
+
+            MStatus tangentFetchStatus = meshFn.getFaceVertexTangent(faceIndex, vertIndex, faceVertexTangent);
+            MStatus binormalFetchStatus = meshFn.getFaceVertexBinormal(faceIndex, vertIndex, faceVertexBinormal);
+
+            if (tangentFetchStatus != MS::kSuccess || binormalFetchStatus != MS::kSuccess)
+            {
+                MString message = MString("An error occurred while fetching face-vertex ("
+                    + MString() + faceIndex + MString("-") + vertIndex + MString(") tangent or binormal. Displacement might not be correct."));
+
+                VectorDisplacementUtilities::logError(message);
+                continue;
+            }
+
+            VectorDisplacementMath::accumulateFrameVector(tangents[i], faceVertexTangent);
+            VectorDisplacementMath::accumulateFrameVector(binormals[i], faceVertexBinormal);
+        }
+    }
+
+    return MStatus::kSuccess;
+}
+
+MStatus VectorDisplacementUtilities::getPaintWeights(MDataBlock& data, unsigned int geomIndex, unsigned int numOfElements, std::vector<float>& paintWeights)
+{
+    paintWeights.assign(numOfElements, 1.f);
+
+    MStatus operationStatus; // Paint weights might not be able to be fetched when no painting has been done. Can't assume that the data will be available.
+
+    MArrayDataHandle weightDataHandleArray = data.outputArrayValue(MPxDeformerNode::weightList, &operationStatus);
+    CHECK_MSTATUS_AND_RETURN_IT(operationStatus);
+
+    operationStatus = weightDataHandleArray.jumpToElement(geomIndex);
+    CHECK_MSTATUS_AND_RETURN_IT(operationStatus);
+
+    MDataHandle weightDataHandle = weightDataHandleArray.inputValue(&operationStatus);
+    CHECK_MSTATUS_AND_RETURN_IT(operationStatus);
+
+    MArrayDataHandle weightData = weightDataHandle.child(MPxDeformerNode::weights);
+
+    unsigned int count = weightData.elementCount(&operationStatus);
+    CHECK_MSTATUS_AND_RETURN_IT(operationStatus);
+
+    for (unsigned int i = 0; i < count; i++)
+    {
+        unsigned int index = weightData.elementIndex();
+
+        if (index < numOfElements)
+        {
+            paintWeights[index] = weightData.inputValue().asFloat();
+        }
+
+        weightData.next();
+    }
+
+    return MS::kSuccess;
+}
+
+MStatus VectorDisplacementUtilities::updatePaintWeights(MDataBlock& data, unsigned int geomIndex, const std::vector<unsigned int>& changedIndices, std::vector<float>& paintWeights)
+{
+    MStatus operationStatus;
+
+    MArrayDataHandle weightDataHandleArray = data.outputArrayValue(MPxDeformerNode::weightList, &operationStatus);
+    CHECK_MSTATUS_AND_RETURN_IT(operationStatus);
+
+    operationStatus = weightDataHandleArray.jumpToElement(geomIndex);
+    CHECK_MSTATUS_AND_RETURN_IT(operationStatus);
+
+    MDataHandle weightDataHandle = weightDataHandleArray.inputValue(&operationStatus);
+    CHECK_MSTATUS_AND_RETURN_IT(operationStatus);
+
+    MArrayDataHandle weightData = weightDataHandle.child(MPxDeformerNode::weights);
+
+    for (unsigned int index : changedIndices)
+    {
+        if (index >= paintWeights.size())
+        {
+            continue;
+        }
+
+        // Elements that don't exist anymore (e.g. removed while flooding) go back to the default weight
+
+        paintWeights[index] = weightData.jumpToElement(index) == MS::kSuccess ? weightData.inputValue().asFloat() : 1.f;
+    }
+
+    return MS::kSuccess;
+}
+
+WeightMode VectorDisplacementUtilities::getWeightMode(bool areWeightsUniform, float uniformWeight, float strength)
+{
+    if (!areWeightsUniform)
+    {
+        return WeightMode::PAINTED;
+    }
+
+    return uniformWeight * strength == 1.f ? WeightMode::NONE : WeightMode::UNIFORM;
+}
+
+bool VectorDisplacementUtilities::isTextureConnected(const MObject& nodeObject, const char* attributeName)
+{
+    MStatus displacementMapPlugStatus;
+    MFnDependencyNode thisNode(nodeObject);
+    MPlug displacementMapPlug = thisNode.findPlug(attributeName, true, &displacementMapPlugStatus);
+
+    if (displacementMapPlugStatus != MS::kSuccess)
+    {
+        return false; // In theory this should never be reached
+    }
+
+    MPlugArray connections;
+    displacementMapPlug.connectedTo(connections, true, false);
+
+    return connections.length() > 0;
+}
+
+MStatus VectorDisplacementUtilities::validateTexture(const MObject& nodeObject, const char* attributeName)
+{
+    // Check if plug is connected to a source node
+
+    if (!isTextureConnected(nodeObject, attributeName))
+    {
+        return MS::kInvalidParameter;
+    }
+
+    // Check if plugged in texture node is valid
+
+    MObject mapAttribute = MFnDependencyNode(nodeObject).attribute(attributeName);
+
+    bool isConnectedToValidNode = MDynamicsUtil::hasValidDynamics2dTexture(nodeObject, mapAttribute);
+    if (!isConnectedToValidNode)
+    {
+        logError("Connected node is not a valid 2D texture node. Please connect a 2D texture node to the vector displacement map attribute.");
+        return MS::kInvalidParameter;
+    }
+
+    return MS::kSuccess;
+}
+
+MStatus VectorDisplacementUtilities::getTextureData(const MObject& nodeObject, const std::vector<float>& vertexUvs, const char* attributeName, MVectorArray& colorData, MDoubleArray& alphaData,
+                                                    EvaluationScratch& scratch, const ProxySampling* proxySampling, const UvSamplingOrder* samplingOrder)
+{
+    // Check if a valid texture node is connected
+
+    MStatus textureStatus = validateTexture(nodeObject, attributeName);
+    if (textureStatus != MS::kSuccess)
+    {
+        return textureStatus;
+    }
+
+    MObject mapAttribute = MFnDependencyNode(nodeObject).attribute(attributeName);
+
+    // Finally, get texture color and alpha data
+
+    unsigned int numOfVertices = static_cast<unsigned int>(vertexUvs.size() / 2);
+
+    MStatus readTextureStatus;
+
+    bool isProxySampling = proxySampling && proxySampling->level > 0 && proxySampling->interpolationOffsets.size() == numOfVertices + 1;
+
+    if (isProxySampling)
+    {
+        // Only sample the texture at the sampled vertices, then interpolate the rest
+
+        unsigned int sampleCount = static_cast<unsigned int>(proxySampling->sampledVertices.size());
+
+        MDoubleArray& sampledUCoords = scratch.sampleUCoords;
+        MDoubleArray& sampledVCoords = scratch.sampleVCoords;
+
+        sampledUCoords.setLength(sampleCount);
+        sampledVCoords.setLength(sampleCount);
+
+        for (unsigned int i = 0; i < sampleCount; i++)
+        {
+            unsigned int vertex = proxySampling->sampledVertices[i];
+
+            sampledUCoords[i] = vertexUvs[vertex * 2];
+            sampledVCoords[i] = vertexUvs[vertex * 2 + 1];
+        }
+
+        MVectorArray& sampledColors = scratch.sampledColors;
+        MDoubleArray& sampledAlphas = scratch.sampledAlphas;
+
+        readTextureStatus = MDynamicsUtil::evalDynamics2dTexture(nodeObject, mapAttribute, sampledUCoords, sampledVCoords, &sampledColors, &sampledAlphas);
+
+        if (readTextureStatus == MS::kSuccess)
+        {
+            interpolateProxySamples(*proxySampling, sampledColors, sampledAlphas, colorData, alphaData);
+        }
+    }
+    else if (samplingOrder && samplingOrder->vertices.size() == numOfVertices)
+    {
+        // Sample along the Morton curve so the texture reads stay local, then scatter the samples back to their vertices
+
+        MDoubleArray& uCoords = scratch.sampleUCoords;
+        MDoubleArray& vCoords = scratch.sampleVCoords;
+
+        uCoords.setLength(numOfVertices);
+        vCoords.setLength(numOfVertices);
+
+        for (unsigned int i = 0; i < numOfVertices; i++)
+        {
+            uCoords[i] = samplingOrder->uvs[i * 2];
+            vCoords[i] = samplingOrder->uvs[i * 2 + 1];
+        }
+
+        MVectorArray& sampledColors = scratch.sampledColors;
+        MDoubleArray& sampledAlphas = scratch.sampledAlphas;
+
+        readTextureStatus = MDynamicsUtil::evalDynamics2dTexture(nodeObject, mapAttribute, uCoords, vCoords, &sampledColors, &sampledAlphas);
+
+        if (readTextureStatus == MS::kSuccess)
+        {
+            bool hasAlpha = sampledAlphas.length() == sampledColors.length();
+            unsigned int sampleCount = std::min(sampledColors.length(), numOfVertices);
+
+            colorData.setLength(numOfVertices);
+            alphaData.setLength(hasAlpha ? numOfVertices : 0);
+
+            for (unsigned int i = 0; i < sampleCount; i++)
+            {
+                unsigned int vertex = samplingOrder->vertices[i];
+
+                colorData[vertex] = sampledColors[i];
+
+                if (hasAlpha)
+                {
+                    alphaData[vertex] = sampledAlphas[i];
+                }
+            }
+        }
+    }
+    else
+    {
+        MDoubleArray& uCoords = scratch.sampleUCoords;
+        MDoubleArray& vCoords = scratch.sampleVCoords;
+
+        uCoords.setLength(numOfVertices);
+        vCoords.setLength(numOfVertices);
+
+        for (unsigned int i = 0; i < numOfVertices; i++)
+        {
+            uCoords[i] = vertexUvs[i * 2];
+            vCoords[i] = vertexUvs[i * 2 + 1];
+        }
+
+        readTextureStatus = MDynamicsUtil::evalDynamics2dTexture(nodeObject, mapAttribute, uCoords, vCoords, &colorData, &alphaData);
+    }
+
+    if (readTextureStatus == MS::kSuccess)
+    {
+        return MS::kSuccess;
+    }
+    else
+    {
+        logError("An error occurred when trying to read vector displacement map texture. Please verify that it is a valid texture");
+        return MS::kFailure;
+    }
+}
+
+MStatus VectorDisplacementUtilities::getVertexUvFootprints(MObject meshItem, const MString& uvSetName, const std::vector<float>& vertexUvs, std::vector<float>& footprints,
+                                                           EvaluationScratch& scratch)
+{
+    footprints.clear();
+
+    // Check that object is a mesh
+
+    if (!meshItem.hasFn(MFn::kMesh))
+    {
+        VectorDisplacementUtilities::logError("Given object is not a mesh. Please apply deformer to mesh objects only.");
+        return MS::kInvalidParameter;
+    }
+
+    MFnMesh meshFn(meshItem);
+    MString uvSet = getUvSetName(meshFn, uvSetName);
+
+    MFloatArray& uCoords = scratch.uCoords;
+    MFloatArray& vCoords = scratch.vCoords;
+    meshFn.getUVs(uCoords, vCoords, &uvSet);
+
+    MIntArray& uvCounts = scratch.uvCounts;
+    MIntArray& uvIds = scratch.uvIds;
+    meshFn.getAssignedUVs(uvCounts, uvIds, &uvSet);
+
+    MIntArray& faceVertexCounts = scratch.faceVertexCounts;
+    MIntArray& faceVertexIds = scratch.faceVertexIds;
+    meshFn.getVertices(faceVertexCounts, faceVertexIds);
+
+    unsigned int numOfVertices = static_cast<unsigned int>(vertexUvs.size() / 2);
+    footprints.assign(numOfVertices * 2, 0.f);
+
+    // Each face-vertex on the same side of a seam as its vertex's UV grows the footprint to reach halfway to the previous and next face-vertex
+
+    unsigned int faceVertexOffset = 0;
+    unsigned int uvOffset = 0;
+
+    for (unsigned int face = 0; face < faceVertexCounts.length(); face++)
+    {
+        unsigned int faceVertexCount = static_cast<unsigned int>(faceVertexCounts[face]);
+        unsigned int faceUvCount = face < uvCounts.length() ? static_cast<unsigned int>(uvCounts[face]) : 0;
+
+        if (faceUvCount == faceVertexCount)
+        {
+            for (unsigned int i = 0; i < faceVertexCount; i++)
+            {
+                unsigned int vertex = static_cast<unsigned int>(faceVertexIds[faceVertexOffset + i]);
+                unsigned int uvId = static_cast<unsigned int>(uvIds[uvOffset + i]);
+
+                if (vertex >= numOfVertices || uvId >= uCoords.length() ||
+                    uCoords[uvId] != vertexUvs[vertex * 2] || vCoords[uvId] != vertexUvs[vertex * 2 + 1])
+                {
+                    continue;
+                }
+
+                unsigned int neighbours[2] = { (i + faceVertexCount - 1) % faceVertexCount, (i + 1) % faceVertexCount };
+
+                for (unsigned int neighbour : neighbours)
+                {
+                    unsigned int neighbourUvId = static_cast<unsigned int>(uvIds[uvOffset + neighbour]);
+
+                    if (neighbourUvId < uCoords.length())
+                    {
+                        footprints[vertex * 2] = std::max(footprints[vertex * 2], std::abs(uCoords[neighbourUvId] - uCoords[uvId]) * 0.5f);
+                        footprints[vertex * 2 + 1] = std::max(footprints[vertex * 2 + 1], std::abs(vCoords[neighbourUvId] - vCoords[uvId]) * 0.5f);
+                    }
+                }
+            }
+        }
+
+        faceVertexOffset += faceVertexCount;
+        uvOffset += faceUvCount;
+    }
+
+    return MStatus::kSuccess;
+}
+
+MStatus VectorDisplacementUtilities::buildMapTable(const MObject& nodeObject, const char* attributeName, unsigned int resolution, SummedAreaTable& table)
+{
+    table = SummedAreaTable();
+
+    MStatus textureStatus = validateTexture(nodeObject, attributeName);
+    if (textureStatus != MS::kSuccess)
+    {
+        return textureStatus;
+    }
+
+    MObject mapAttribute = MFnDependencyNode(nodeObject).attribute(attributeName);
+
+    // Sample at the texel centers in bands of rows from V = 0 upwards, so only one band of samples is in memory at a time.
+    // Band arrays are local rather than scratch arrays, since scratch arrays keep their largest size for the node's lifetime.
+
+    unsigned int bandRows = std::max(MAP_TABLE_BAND_SAMPLES / resolution, 1u);
+
+    MDoubleArray uCoords;
+    MDoubleArray vCoords;
+    MVectorArray sampledColors;
+    MDoubleArray sampledAlphas;
+    std::vector<float> rgb;
+
+    table.reset(resolution, resolution);
+
+    for (unsigned int firstRow = 0; firstRow < resolution; firstRow += bandRows)
+    {
+        unsigned int rowCount = std::min(bandRows, resolution - firstRow);
+        unsigned int sampleCount = rowCount * resolution;
+
+        uCoords.setLength(sampleCount);
+        vCoords.setLength(sampleCount);
+
+        for (unsigned int y = 0; y < rowCount; y++)
+        {
+            for (unsigned int x = 0; x < resolution; x++)
+            {
+                uCoords[y * resolution + x] = (x + 0.5) / resolution;
+                vCoords[y * resolution + x] = (firstRow + y + 0.5) / resolution;
+            }
+        }
+
+        if (MDynamicsUtil::evalDynamics2dTexture(nodeObject, mapAttribute, uCoords, vCoords, &sampledColors, &sampledAlphas) != MS::kSuccess ||
+            sampledColors.length() != sampleCount)
+        {
+            table = SummedAreaTable();
+            logError("An error occurred when trying to read vector displacement map texture. Please verify that it is a valid texture");
+            return MS::kFailure;
+        }
+
+        rgb.resize(static_cast<size_t>(sampleCount) * 3);
+
+        for (unsigned int i = 0; i < sampleCount; i++)
+        {
+            const MVector& color = sampledColors[i];
+
+            rgb[i * 3] = static_cast<float>(color.x);
+            rgb[i * 3 + 1] = static_cast<float>(color.y);
+            rgb[i * 3 + 2] = static_cast<float>(color.z);
+        }
+
+        table.addRows(firstRow, rowCount, rgb.data());
+    }
+
+    return MS::kSuccess;
+}
+
+MStatus VectorDisplacementUtilities::prepareAreaSampling(const MObject& nodeObject, const char* attributeName, MObject meshItem, const MString& uvSetName, unsigned int resolution,
+                                                         const std::vector<float>& vertexUvs, const UvSamplingOrder& samplingOrder, SummedAreaTable& table, std::vector<float>& footprints,
+                                                         EvaluationScratch& scratch, const SeamUvSamples* seamSamples)
+{
+    if (table.isEmpty() || table.getWidth() != resolution)
+    {
+        MStatus tableStatus = buildMapTable(nodeObject, attributeName, resolution, table);
+
+        if (tableStatus != MS::kSuccess)
+        {
+            return tableStatus;
+        }
+    }
+
+    if (footprints.size() == samplingOrder.vertices.size() * 4)
+    {
+        return MS::kSuccess;
+    }
+
+    // Interleave each footprint with its UV in sampling order, so filtering reads a single sequential array
+
+    std::vector<float> vertexFootprints;
+    MStatus footprintStatus = seamSamples ? getUvSampleFootprints(meshItem, uvSetName, *seamSamples, vertexFootprints, scratch) :
+                                            getVertexUvFootprints(meshItem, uvSetName, vertexUvs, vertexFootprints, scratch);
+
+    if (footprintStatus != MS::kSuccess || vertexFootprints.size() != vertexUvs.size())
+    {
+        footprints.clear();
+        return footprintStatus != MS::kSuccess ? footprintStatus : MS::kFailure;
+    }
+
+    footprints.resize(samplingOrder.vertices.size() * 4);
+
+    for (size_t i = 0; i < samplingOrder.vertices.size(); i++)
+    {
+        unsigned int vertex = samplingOrder.vertices[i];
+
+        footprints[i * 4] = samplingOrder.uvs[i * 2];
+        footprints[i * 4 + 1] = samplingOrder.uvs[i * 2 + 1];
+        footprints[i * 4 + 2] = vertexFootprints[vertex * 2];
+        footprints[i * 4 + 3] = vertexFootprints[vertex * 2 + 1];
+    }
+
+    return MS::kSuccess;
+}
+
+void VectorDisplacementUtilities::getFilteredTextureData(const SummedAreaTable& table, const UvSamplingOrder& samplingOrder, const std::vector<float>& footprints,
+                                                         MVectorArray& colorData, MDoubleArray& alphaData)
+{
+    unsigned int numOfVertices = static_cast<unsigned int>(std::min(samplingOrder.vertices.size(), footprints.size() / 4));
+
+    colorData.setLength(numOfVertices);
+    alphaData.setLength(numOfVertices);
+
+    VectorDisplacementMath::parallelFor(numOfVertices, 0, [&](size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; i++)
+        {
+            const float* footprint = footprints.data() + i * 4;
+            Float3 color = table.getBoxAverage(footprint[0], footprint[1], footprint[2], footprint[3]);
+            unsigned int vertex = samplingOrder.vertices[i];
+
+            colorData[vertex] = MVector(color.x, color.y, color.z);
+            alphaData[vertex] = 1.0;
+        }
+    });
+}
+
+MStatus VectorDisplacementUtilities::getSeamTextureData(const MObject& nodeObject, const char* attributeName, MObject meshItem, const MString& uvSetName, unsigned int filterResolution,
+                                                        SeamUvSamples& samples, SummedAreaTable& table, MVectorArray& colorData, MDoubleArray& alphaData, EvaluationScratch& scratch)
+{
+    // Distinct UVs are gathered once and kept until the UV set, the UVs or the topology change
+
+    if (samples.isEmpty())
+    {
+        MStatus uvSampleStatus = getMeshUvSamples(meshItem, uvSetName, samples, scratch);
+
+        if (uvSampleStatus != MS::kSuccess)
+        {
+            return uvSampleStatus;
+        }
+    }
+
+    // Sample each distinct UV once
+
+    MVectorArray& sampleColors = scratch.seamSampleColors;
+    MDoubleArray& sampleAlphas = scratch.seamSampleAlphas;
+
+    if (filterResolution > 0)
+    {
+        MStatus areaSamplingStatus = prepareAreaSampling(nodeObject, attributeName, meshItem, uvSetName, filterResolution,
+            samples.uvs, samples.samplingOrder, table, samples.footprints, scratch, &samples);
+
+        if (areaSamplingStatus != MS::kSuccess)
+        {
+            return areaSamplingStatus;
+        }
+
+        getFilteredTextureData(table, samples.samplingOrder, samples.footprints, sampleColors, sampleAlphas);
+    }
+    else
+    {
+        MStatus textureStatus = getTextureData(nodeObject, samples.uvs, attributeName, sampleColors, sampleAlphas, scratch, nullptr, &samples.samplingOrder);
+
+        if (textureStatus != MS::kSuccess)
+        {
+            return textureStatus;
+        }
+    }
+
+    // Average the samples of each vertex
+
+    unsigned int numOfVertices = static_cast<unsigned int>(samples.vertexSampleOffsets.size() - 1);
+    unsigned int sampleCount = sampleColors.length();
+    bool hasAlpha = sampleAlphas.length() == sampleCount;
+
+    colorData.setLength(numOfVertices);
+    alphaData.setLength(hasAlpha ? numOfVertices : 0);
+
+    for (unsigned int vertex = 0; vertex < numOfVertices; vertex++)
+    {
+        MVector color;
+        double alpha = 0.0;
+        unsigned int count = 0;
+
+        for (unsigned int i = samples.vertexSampleOffsets[vertex]; i < samples.vertexSampleOffsets[vertex + 1]; i++)
+        {
+            unsigned int sample = samples.vertexSamples[i];
+
+            if (sample < sampleCount)
+            {
+                color += sampleColors[sample];
+                alpha += hasAlpha ? sampleAlphas[sample] : 0.0;
+                count++;
+            }
+        }
+
+        colorData[vertex] = count > 0 ? color / count : color;
+
+        if (hasAlpha)
+        {
+            alphaData[vertex] = count > 0 ? alpha / count : alpha;
+        }
+    }
+
+    return MS::kSuccess;
+}
+
+MString VectorDisplacementUtilities::getUvSetName(const MFnMesh& meshFn, const MString& uvSetName)
+{
+    MStringArray uvSetNames;
+    meshFn.getUVSetNames(uvSetNames); // Maya forces at least 1 UV set per mesh so there is no need to check number of UV sets
+
+    for (unsigned int i = 0; i < uvSetNames.length() && uvSetName.length() > 0; i++)
+    {
+        if (uvSetNames[i] == uvSetName)
+        {
+            return uvSetName;
+        }
+    }
+
+    return uvSetNames[0];
+}
+
+MVector VectorDisplacementUtilities::getObjectDisplacementOffset(const MVector& rgbData, float strength)
+{
+    return VectorDisplacementMath::getObjectSpaceOffset(rgbData, strength);
+}
+
+MVector VectorDisplacementUtilities::getTangentDisplacementOffset(const VertexData& vertexData, const MVector& rgbData, float strength)
+{
+    return VectorDisplacementMath::getTangentSpaceOffset(vertexData.normal, vertexData.tangent, vertexData.binormal, rgbData, strength);
+}
+
+MStatus VectorDisplacementUtilities::getUvSampleFootprints(MObject meshItem, const MString& uvSetName, const SeamUvSamples& samples, std::vector<float>& footprints,
+                                                           EvaluationScratch& scratch)
+{
+    footprints.clear();
+
+    // Check that object is a mesh
+
+    if (!meshItem.hasFn(MFn::kMesh))
+    {
+        VectorDisplacementUtilities::logError("Given object is not a mesh. Please apply deformer to mesh objects only.");
+        return MS::kInvalidParameter;
+    }
+
+    MFnMesh meshFn(meshItem);
+    MString uvSet = getUvSetName(meshFn, uvSetName);
+
+    MFloatArray& uCoords = scratch.uCoords;
+    MFloatArray& vCoords = scratch.vCoords;
+    meshFn.getUVs(uCoords, vCoords, &uvSet);
+
+    MIntArray& uvCounts = scratch.uvCounts;
+    MIntArray& uvIds = scratch.uvIds;
+    meshFn.getAssignedUVs(uvCounts, uvIds, &uvSet);
+
+    MIntArray& faceVertexCounts = scratch.faceVertexCounts;
+    meshFn.getVertices(faceVertexCounts, scratch.faceVertexIds);
+
+    footprints.assign(samples.uvs.size(), 0.f);
+
+    // Each face-vertex grows the footprint of its UV to reach halfway to the previous and next face-vertex.
+    // Samples are per UV, so unlike vertex footprints they never need to skip the face-vertices of other islands.
+
+    unsigned int numOfUvs = std::min(uCoords.length(), static_cast<unsigned int>(samples.uvSamples.size()));
+    unsigned int uvOffset = 0;
+
+    for (unsigned int face = 0; face < faceVertexCounts.length(); face++)
+    {
+        unsigned int faceVertexCount = static_cast<unsigned int>(faceVertexCounts[face]);
+        unsigned int faceUvCount = face < uvCounts.length() ? static_cast<unsigned int>(uvCounts[face]) : 0;
+
+        if (faceUvCount == faceVertexCount)
+        {
+            for (unsigned int i = 0; i < faceVertexCount; i++)
+            {
+                unsigned int uvId = static_cast<unsigned int>(uvIds[uvOffset + i]);
+
+                if (uvId >= numOfUvs || samples.uvSamples[uvId] == SeamUvSamples::INVALID_SAMPLE)
+                {
+                    continue;
+                }
+
+                float* footprint = footprints.data() + samples.uvSamples[uvId] * 2;
+                unsigned int neighbours[2] = { (i + faceVertexCount - 1) % faceVertexCount, (i + 1) % faceVertexCount };
+
+                for (unsigned int neighbour : neighbours)
+                {
+                    unsigned int neighbourUvId = static_cast<unsigned int>(uvIds[uvOffset + neighbour]);
+
+                    if (neighbourUvId < uCoords.length())
+                    {
+                        footprint[0] = std::max(footprint[0], std::abs(uCoords[neighbourUvId] - uCoords[uvId]) * 0.5f);
+                        footprint[1] = std::max(footprint[1], std::abs(vCoords[neighbourUvId] - vCoords[uvId]) * 0.5f);
+                    }
+                }
+            }
+        }
+
+        uvOffset += faceUvCount;
+    }
+
+    return MStatus::kSuccess;
+}
+
+void VectorDisplacementUtilities::interpolateProxySamples(const ProxySampling& sampling, const MVectorArray& sampledColors, const MDoubleArray& sampledAlphas,
+                                                          MVectorArray& colorData, MDoubleArray& alphaData)
+{
+    unsigned int numOfVertices = static_cast<unsigned int>(sampling.interpolationOffsets.size() - 1);
+    bool hasAlpha = sampledAlphas.length() == sampledColors.length();
+
+    colorData.setLength(numOfVertices);
+    alphaData.setLength(hasAlpha ? numOfVertices : 0);
+
+    for (unsigned int vertex = 0; vertex < numOfVertices; vertex++)
+    {
+        MVector color;
+        double alpha = 0.0;
+
+        for (unsigned int i = sampling.interpolationOffsets[vertex]; i < sampling.interpolationOffsets[vertex + 1]; i++)
+        {
+            unsigned int sampleIndex = sampling.interpolationSources[i];
+            double weight = sampling.interpolationWeights[i];
+
+            color += sampledColors[sampleIndex] * weight;
+            alpha += hasAlpha ? sampledAlphas[sampleIndex] * weight : 0.0;
+        }
+
+        colorData[vertex] = color;
+
+        if (hasAlpha)
+        {
+            alphaData[vertex] = alpha;
+        }
+    }
+}
+
+uint64_t VectorDisplacementUtilities::hashInit()
+{
+    return 14695981039346656037ull; // FNV-1a 64-bit offset basis
+}
+
+uint64_t VectorDisplacementUtilities::hashBytes(uint64_t hash, const void* data, size_t size)
+{
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull; // FNV-1a 64-bit prime
+    }
+
+    return hash;
+}
+
+uint64_t VectorDisplacementUtilities::hashIntArray(uint64_t hash, const MIntArray& values)
+{
+    unsigned int count = values.length();
+    hash = hashBytes(hash, &count, sizeof(count));
+
+    for (unsigned int i = 0; i < count; i++)
+    {
+        int value = values[i];
+        hash = hashBytes(hash, &value, sizeof(value));
+    }
+
+    return hash;
+}
+
+uint64_t VectorDisplacementUtilities::hashFloatArray(uint64_t hash, const MFloatArray& values)
+{
+    unsigned int count = values.length();
+    hash = hashBytes(hash, &count, sizeof(count));
+
+    for (unsigned int i = 0; i < count; i++)
+    {
+        float value = values[i];
+        hash = hashBytes(hash, &value, sizeof(value));
+    }
 
-    return MPoint(x, y, z);
+    return hash;
 }
 
 void VectorDisplacementUtilities::logError(const MString& message)
@@ -9,13 +9,20 @@
 #pragma once
 
 #include "VectorDisplacementHelperTypes.h"
+#include "VectorDisplacementMath.h"
 
+#include <maya/MDataBlock.h>
 #include <maya/MDoubleArray.h>
+#include <maya/MFloatArray.h>
+#include <maya/MFnMesh.h>
+#include <maya/MIntArray.h>
 #include <maya/MObject.h>
 #include <maya/MPoint.h>
 #include <maya/MStatus.h>
 #include <maya/MVectorArray.h>
 
+#include <vector>
+
 
 /* Static utilities class for calculations related to the vector displacement deformer */
 class VectorDisplacementUtilities final
@@ -27,10 +34,11 @@ public:
     * @param[in] meshItem - Mesh to get the vertex data from
     * @param[out] tangents - Reference to the array where tangets will be stored
     * @param[out] binormals - Reference to the array where binormals will be stored
+    * @param[in,out] scratch - Reusable temporaries of the evaluating node
     *
     * @return MStatus indicating wheter the operation was successful or not
     */
-    static MStatus getAveragedTangentsAndBinormals(MObject meshItem, MFloatVectorArray& tangents, MFloatVectorArray& binormals);
+    static MStatus getAveragedTangentsAndBinormals(MObject meshItem, MFloatVectorArray& tangents, MFloatVectorArray& binormals, EvaluationScratch& scratch);
 
     /**
     * Gets the final vertex position for the given vertex
@@ -46,15 +54,141 @@ public:
     static MPoint getDisplacedVertex(VertexData vertexData, const MVectorArray& mapRgbData, const MDoubleArray& mapAlphaData, float strength, VectorDisplacementMapType mapType);
 
     /**
-    * Gets the given mesh UV data. Array indices correspond to the vertex index.
+    * Gets the displacement offset for the given vertex (displaced position minus original position)
+    *
+    * @param[in] vertexData - Current vertex data for the vertex that will be displaced
+    * @param[in] mapRgbData - RGB data of the vector displacement map
+    * @param[in] strength - Displacement strength (1 = full vector displacement map effect, 0 = no effect)
+    * @param[in] mapType - Vector displacement map type that corresponds to the texture data
+    *
+    * @return Offset to add to the vertex position
+    */
+    static MVector getDisplacementOffset(const VertexData& vertexData, const MVectorArray& mapRgbData, float strength, VectorDisplacementMapType mapType);
+
+    /**
+    * Gets the displacement offset of every vertex, without strength or paint weights (e.g. as the input of the relax pass)
+    *
+    * @param[in] mapRgbData - RGB data of the vector displacement map. One value per vertex.
+    * @param[in] normals - Vertex normals (only used with tangent-space maps)
+    * @param[in] tangents - Vertex tangents (only used with tangent-space maps)
+    * @param[in] binormals - Vertex binormals (only used with tangent-space maps)
+    * @param[in] mapType - Vector displacement map type that corresponds to the texture data
+    * @param[out] offsets - 3 floats per vertex
+    */
+    static void getDisplacementOffsets(const MVectorArray& mapRgbData, const MFloatVectorArray& normals, const MFloatVectorArray& tangents,
+                                       const MFloatVectorArray& binormals, VectorDisplacementMapType mapType, std::vector<float>& offsets);
+
+    /**
+    * Gets the triangles of the given mesh (as triangulated by Maya), with their vertex positions and optionally their corner UVs
+    *
+    * @param[in] meshItem - Mesh to get the triangles from
+    * @param[in] uvSetName - UV set of the corner UVs. Empty = First UV set.
+    * @param[out] positions - Object-space vertex positions
+    * @param[out] triangleVertexIds - 3 vertex indices per triangle
+    * @param[out] triangleUvs - 6 values per triangle (U and V of each corner). NaN for triangles of faces without UVs. Not gathered when null.
+    * @param[in,out] scratch - Reusable temporaries of the caller
+    *
+    * @return MStatus indicating whether the operation was successful or not
+    */
+    static MStatus getMeshTriangles(MObject meshItem, const MString& uvSetName, std::vector<Float3>& positions, std::vector<unsigned int>& triangleVertexIds,
+                                    std::vector<float>* triangleUvs, EvaluationScratch& scratch);
+
+    /**
+    * Builds the edge neighbours of every vertex of the given mesh
+    *
+    * @param[in] meshItem - Mesh to build the adjacency from
+    * @param[out] adjacency - Built adjacency
+    * @param[in,out] scratch - Reusable temporaries of the evaluating node
+    *
+    * @return MStatus indicating whether the operation was successful or not
+    */
+    static MStatus getVertexAdjacency(MObject meshItem, VertexAdjacency& adjacency, EvaluationScratch& scratch);
+
+    /**
+    * Calculates the topology and UV fingerprints of the given mesh. Used to check if cached data still matches the mesh.
+    *
+    * @param[in] meshItem - Mesh to calculate the fingerprints from
+    * @param[in] uvSetName - UV set used when sampling the map (empty = first UV set)
+    * @param[out] fingerprint - Calculated fingerprints
+    * @param[in,out] scratch - Reusable temporaries of the evaluating node
+    *
+    * @return MStatus indicating whether the operation was successful or not
+    */
+    static MStatus getMeshFingerprint(MObject meshItem, const MString& uvSetName, MeshFingerprint& fingerprint, EvaluationScratch& scratch);
+
+    /**
+    * Recalculates the fingerprints of a mesh whose geometry was dirtied and classifies the change against the previous fingerprints
+    *
+    * @param[in] meshItem - Mesh to calculate the fingerprints from
+    * @param[in] uvSetName - UV set used when sampling the map (empty = first UV set). Switching sets counts as a UV change.
+    * @param[in,out] fingerprint - Previous fingerprints. Updated with the new ones.
+    * @param[in,out] scratch - Reusable temporaries of the evaluating node
+    *
+    * @return Type of change. POINTS when topology and UVs are unchanged, since only the points can have changed then.
+    */
+    static MeshChangeType updateMeshFingerprint(MObject meshItem, const MString& uvSetName, MeshFingerprint& fingerprint, EvaluationScratch& scratch);
+
+    /**
+    * Picks the vertices where the displacement map is sampled in proxy mode and how every other vertex is interpolated from them.
+    * Sampled vertices are picked so that every vertex is at most the given number of edges away from one.
+    *
+    * @param[in] meshItem - Mesh to build the sampling from
+    * @param[in] level - Maximum edge distance between a vertex and its nearest sampled vertex (at least 1)
+    * @param[out] sampling - Built proxy sampling
+    *
+    * @return MStatus indicating whether the operation was successful or not
+    */
+    static MStatus buildProxySampling(MObject meshItem, unsigned int level, ProxySampling& sampling);
+
+    /**
+    * Gets the UV of every vertex of the given mesh in bulk, from the face-vertex UV assignments.
+    * Each vertex uses the UV of its first face-vertex. Vertices without any assigned UV get (0, 0).
     *
     * @param[in] meshItem - Mesh to get the UV data from
+    * @param[in] uvSetName - UV set to read (empty = first UV set). Falls back to the first UV set if the mesh doesn't have it.
+    * @param[out] vertexUvs - 2 values per vertex (U, V). Array indices correspond to the vertex index.
+    * @param[in,out] scratch - Reusable temporaries of the evaluating node
+    *
+    * @return MStatus indicating whether operation was successful or not
+    */
+    static MStatus getMeshUvData(MObject meshItem, const MString& uvSetName, std::vector<float>& vertexUvs, EvaluationScratch& scratch);
+
+    /**
+    * Gets the order to sample the map in, along a Morton curve through the vertex UVs
+    *
+    * @param[in] vertexUvs - Per-vertex UVs, as returned by getMeshUvData
+    * @param[out] order - Sampling order
+    */
+    static void getUvSamplingOrder(const std::vector<float>& vertexUvs, UvSamplingOrder& order);
+
+    /**
+    * Gathers the distinct UVs of the face-vertices of the given mesh, and the ones used by each vertex. UVs shared by several face-vertices
+    * are only stored once, so the number of samples follows the number of distinct UVs rather than face-vertices.
+    * Vertices without any assigned UV share a single sample at (0, 0).
+    *
+    * @param[in] meshItem - Mesh to get the UV data from
+    * @param[in] uvSetName - UV set to read (empty = first UV set). Falls back to the first UV set if the mesh doesn't have it.
+    * @param[out] samples - Distinct UVs, the samples of each vertex, and their sampling order
+    * @param[in,out] scratch - Reusable temporaries of the evaluating node
+    *
+    * @return MStatus indicating whether operation was successful or not
+    */
+    static MStatus getMeshUvSamples(MObject meshItem, const MString& uvSetName, SeamUvSamples& samples, EvaluationScratch& scratch);
+
+    /**
+    * Gets the UV data of a range of vertices of the given mesh. Array indices correspond to the vertex index minus the first vertex.
+    * Each vertex uses the UV of its first face-vertex in face order, like the full-mesh version, so both pick the same UV on seams.
+    *
+    * @param[in] meshItem - Mesh to get the UV data from
+    * @param[in] uvSetName - UV set to read (empty = first UV set). Falls back to the first UV set if the mesh doesn't have it.
+    * @param[in] firstVertex - Index of the first vertex of the range
+    * @param[in] count - Number of vertices in the range
     * @param[out] uCoords - Reference to the array where the U coords will be stored
     * @param[out] vCoords - Reference to the array where the V coords will be stored
     *
     * @return MStatus indicating whether operation was successful or not
     */
-    static MStatus getMeshUvData(MObject meshItem, MDoubleArray& uCoords, MDoubleArray& vCoords);
+    static MStatus getMeshUvData(MObject meshItem, const MString& uvSetName, unsigned int firstVertex, unsigned int count, MDoubleArray& uCoords, MDoubleArray& vCoords);
 
     /**
     * Gets the given mesh vertex data. Array indeces correspond to the vertex index.
@@ -63,46 +197,261 @@ public:
     * @param[out] normals - Reference to the array where normals will be stored
     * @param[out] tangents - Reference to the array where tangets will be stored
     * @param[out] binormals - Reference to the array where binormals will be stored
+    * @param[in,out] scratch - Reusable temporaries of the evaluating node
+    *
+    * @return MStatus indicating wheter the opration was successful or not
+    */
+    static MStatus getMeshVertexData(MObject meshItem, MFloatVectorArray& normals, MFloatVectorArray& tangents, MFloatVectorArray& binormals, EvaluationScratch& scratch);
+
+    /**
+    * Gets the vertex data of a range of vertices of the given mesh. Values match the ones of the whole mesh version.
+    * Array indices correspond to the vertex index minus the first vertex.
+    *
+    * @param[in] meshItem - Mesh to get the vertex data from
+    * @param[in] firstVertex - Index of the first vertex of the range
+    * @param[in] count - Number of vertices in the range
+    * @param[out] normals - Reference to the array where normals will be stored
+    * @param[out] tangents - Reference to the array where tangets will be stored
+    * @param[out] binormals - Reference to the array where binormals will be stored
     *
     * @return MStatus indicating wheter the opration was successful or not
     */
-    static MStatus getMeshVertexData(MObject meshItem, MFloatVectorArray& normals, MFloatVectorArray& tangents, MFloatVectorArray& binormals);
+    static MStatus getMeshVertexData(MObject meshItem, unsigned int firstVertex, unsigned int count,
+                                     MFloatVectorArray& normals, MFloatVectorArray& tangents, MFloatVectorArray& binormals);
+
+    /**
+    * Gets all the paint weights of the given geometry as a dense array. Vertices without painted weights default to 1.
+    *
+    * @param[in] data - Data block of the deformer node
+    * @param[in] geomIndex - Index of the geometry
+    * @param[in] numOfElements - Total number of vertices
+    * @param[out] paintWeights - Paint weights will be stored here
+    *
+    * @return MStatus indicating whether the operation was successful or not. Weights are still initialized to 1 on failure.
+    */
+    static MStatus getPaintWeights(MDataBlock& data, unsigned int geomIndex, unsigned int numOfElements, std::vector<float>& paintWeights);
+
+    /**
+    * Updates only the given entries of a dense paint weight array
+    *
+    * @param[in] data - Data block of the deformer node
+    * @param[in] geomIndex - Index of the geometry
+    * @param[in] changedIndices - Vertex indices whose weights changed. Indices out of range are ignored.
+    * @param[in,out] paintWeights - Dense paint weights to update
+    *
+    * @return MStatus indicating whether the operation was successful or not
+    */
+    static MStatus updatePaintWeights(MDataBlock& data, unsigned int geomIndex, const std::vector<unsigned int>& changedIndices, std::vector<float>& paintWeights);
+
+    /**
+    * Gets the weight mode the displacement variants are specialized for
+    *
+    * @param[in] areWeightsUniform - Whether every paint weight has the same value
+    * @param[in] uniformWeight - Value of every paint weight when they are uniform
+    * @param[in] strength - Strength applied on top of the paint weights (e.g. envelope multiplied by strength)
+    *
+    * @return NONE when the combined weight is exactly 1, UNIFORM when it's the same for every vertex, or PAINTED otherwise
+    */
+    static WeightMode getWeightMode(bool areWeightsUniform, float uniformWeight, float strength);
+
+    /**
+    * Checks if the given texture map attribute of the given node has an incoming connection
+    *
+    * @param[in] nodeObject - Node that has the texture map attribute
+    * @param[in] attributeName - Name of the texture map attribute
+    *
+    * @return True if a node is connected to the attribute
+    */
+    static bool isTextureConnected(const MObject& nodeObject, const char* attributeName);
+
+    /**
+    * Checks that a valid 2D texture node is connected to the given texture map attribute. Logs an error if the connected node is not valid.
+    *
+    * @param[in] nodeObject - Node that has the texture map attribute
+    * @param[in] attributeName - Name of the texture map attribute
+    *
+    * @return MStatus indicating whether the texture can be sampled or not
+    */
+    static MStatus validateTexture(const MObject& nodeObject, const char* attributeName);
 
     /**
     * Gets a map texture data from the given node. If no texture is connected it does nothing.
     *
     * @param[in] nodeObject - Node to get the texture data from as an MObject
-    * @param[in] meshItem - Mesh item to get the corresponding UV-matched texture data from
+    * @param[in] vertexUvs - Per-vertex UVs to sample the texture at (2 values per vertex), as returned by getMeshUvData
     * @param[in] attributeName - Name of the texture map attribute
     * @param[out] colorData - Texture color data will be copied to this parameter if successful
     * @param[out] alphaData - Texture alpha data will be copied to this parameter if successful
+    * @param[in,out] scratch - Reusable temporaries of the evaluating node
+    * @param[in] proxySampling - If set, the texture is only sampled at the proxy sampled vertices and interpolated for the rest
+    * @param[in] samplingOrder - If set, every vertex is sampled in this order (for texture cache locality) and scattered back to vertex order
+    *
+    * @return MStatus indicating if operation was successful or not
+    */
+    static MStatus getTextureData(const MObject& nodeObject, const std::vector<float>& vertexUvs, const char* attributeName, MVectorArray& colorData, MDoubleArray& alphaData,
+                                  EvaluationScratch& scratch, const ProxySampling* proxySampling = nullptr, const UvSamplingOrder* samplingOrder = nullptr);
+
+    /**
+    * Gets the UV footprint of every vertex, from the UVs of its neighbouring face-vertices. Only face-vertices that share the UV
+    * chosen by getMeshUvData are used, so footprints don't stretch across UV seams. Vertices without neighbours get an empty footprint.
+    *
+    * @param[in] meshItem - Mesh to get the footprints of
+    * @param[in] uvSetName - UV set to read (empty = first UV set). Falls back to the first UV set if the mesh doesn't have it.
+    * @param[in] vertexUvs - Per-vertex UVs, as returned by getMeshUvData
+    * @param[out] footprints - 2 values per vertex (half width and half height in UV units), covering halfway to the furthest neighbour
+    * @param[in,out] scratch - Reusable temporaries of the evaluating node
+    *
+    * @return MStatus indicating whether operation was successful or not
+    */
+    static MStatus getVertexUvFootprints(MObject meshItem, const MString& uvSetName, const std::vector<float>& vertexUvs, std::vector<float>& footprints,
+                                         EvaluationScratch& scratch);
+
+    /**
+    * Samples the map texture on a regular grid and builds its summed-area table, used for area-filtered sampling.
+    * The map is only reachable through its texture node, so the grid resolution sets the texel size of the filter.
+    *
+    * @param[in] nodeObject - Node that has the texture map attribute
+    * @param[in] attributeName - Name of the texture map attribute
+    * @param[in] resolution - Grid size in samples along U and V
+    * @param[out] table - Summed-area table of the map
+    *
+    * @return MStatus indicating if operation was successful or not
+    */
+    static MStatus buildMapTable(const MObject& nodeObject, const char* attributeName, unsigned int resolution, SummedAreaTable& table);
+
+    /**
+    * Makes sure the map table and the vertex footprints needed for area-filtered sampling are up to date.
+    * The table is rebuilt when it's empty or was built at another resolution, and the footprints are gathered when they're empty.
+    *
+    * @param[in] nodeObject - Node that has the texture map attribute
+    * @param[in] attributeName - Name of the texture map attribute
+    * @param[in] meshItem - Mesh being sampled
+    * @param[in] uvSetName - UV set to read (empty = first UV set)
+    * @param[in] resolution - Grid size the map table is built at
+    * @param[in] vertexUvs - Per-vertex UVs, as returned by getMeshUvData
+    * @param[in] samplingOrder - Sampling order of the vertices, as returned by getUvSamplingOrder
+    * @param[in,out] table - Summed-area table of the map
+    * @param[in,out] footprints - 4 values per sampling order entry (U, V, half width, half height)
+    * @param[in,out] scratch - Reusable temporaries of the evaluating node
+    * @param[in] seamSamples - If set, the UVs and the sampling order are the ones of these samples, and footprints are gathered per sample
     *
     * @return MStatus indicating if operation was successful or not
     */
-    static MStatus getTextureData(const MObject& nodeObject, const MObject& meshItem, const char* attributeName, MVectorArray& colorData, MDoubleArray& alphaData);
+    static MStatus prepareAreaSampling(const MObject& nodeObject, const char* attributeName, MObject meshItem, const MString& uvSetName, unsigned int resolution,
+                                       const std::vector<float>& vertexUvs, const UvSamplingOrder& samplingOrder, SummedAreaTable& table, std::vector<float>& footprints,
+                                       EvaluationScratch& scratch, const SeamUvSamples* seamSamples = nullptr);
+
+    /**
+    * Gets the box-filtered map sample of every vertex over its UV footprint. Each sample takes constant time regardless of the footprint size.
+    * Vertices are filtered in sampling order and the results are scattered back to vertex order.
+    *
+    * @param[in] table - Summed-area table of the map, as returned by buildMapTable
+    * @param[in] samplingOrder - Sampling order of the vertices, as returned by getUvSamplingOrder
+    * @param[in] footprints - Footprints in sampling order, as returned by prepareAreaSampling
+    * @param[out] colorData - Filtered color of each vertex
+    * @param[out] alphaData - Alpha of each vertex (always 1, the table only holds color)
+    */
+    static void getFilteredTextureData(const SummedAreaTable& table, const UvSamplingOrder& samplingOrder, const std::vector<float>& footprints,
+                                       MVectorArray& colorData, MDoubleArray& alphaData);
+
+    /**
+    * Gets the map data of every vertex by sampling each distinct UV of the mesh once and averaging the samples of each vertex,
+    * so vertices on UV seams blend the islands they're on instead of using the first one. Only valid for object-space maps, since the raw samples
+    * of tangent-space maps are in the tangent frame of each island.
+    *
+    * @param[in] nodeObject - Node that has the texture map attribute
+    * @param[in] attributeName - Name of the texture map attribute
+    * @param[in] meshItem - Mesh being sampled
+    * @param[in] uvSetName - UV set to read (empty = first UV set)
+    * @param[in] filterResolution - Grid size of the map table to area sample, or 0 to point sample
+    * @param[in,out] samples - Distinct UVs of the mesh. Gathered when empty, and so are their footprints when area sampling.
+    * @param[in,out] table - Summed-area table of the map (area sampling only)
+    * @param[out] colorData - Averaged color of each vertex
+    * @param[out] alphaData - Averaged alpha of each vertex
+    * @param[in,out] scratch - Reusable temporaries of the evaluating node
+    *
+    * @return MStatus indicating if operation was successful or not
+    */
+    static MStatus getSeamTextureData(const MObject& nodeObject, const char* attributeName, MObject meshItem, const MString& uvSetName, unsigned int filterResolution,
+                                      SeamUvSamples& samples, SummedAreaTable& table, MVectorArray& colorData, MDoubleArray& alphaData, EvaluationScratch& scratch);
+
+    /** Returns the initial value for the FNV-1a hashes used by the mesh fingerprints and the backend settings */
+    static uint64_t hashInit();
+
+    /**
+    * Hashes the given bytes into the given FNV-1a hash
+    *
+    * @param[in] hash - Current hash value
+    * @param[in] data - Data to hash
+    * @param[in] size - Size of the data in bytes
+    *
+    * @return Updated hash value
+    */
+    static uint64_t hashBytes(uint64_t hash, const void* data, size_t size);
 
 private:
     /**
-    * Applies the vector displacement map as an object space displacement
+    * Gets the name of the UV set to read from the given mesh
+    *
+    * @param[in] meshFn - Mesh function set
+    * @param[in] uvSetName - Requested UV set (empty = first UV set)
+    *
+    * @return Requested UV set name if the mesh has it, the first UV set name otherwise
+    */
+    static MString getUvSetName(const MFnMesh& meshFn, const MString& uvSetName);
+
+    /**
+    * Gets the offset of the vector displacement map applied as an object space displacement
     *
-    * @param[in] vertex - Original vertex position
     * @param[in] rgbData - RGB value that corresponds to this vertex
     * @param[in] strength - Displacement strength (1 = full vector displacement map effect, 0 = no effect)
     *
-    * @return Displaced vertex as an MPoint
+    * @return Displacement offset as an MVector
     */
-    static MPoint applyObjectDisplacement(const MPoint& vertex, MVector rgbData, float strength);
+    static MVector getObjectDisplacementOffset(const MVector& rgbData, float strength);
 
     /**
-    * Applies the vector displacement map as a tangent space displacement
+    * Gets the offset of the vector displacement map applied as a tangent space displacement
     *
     * @param[in] vertexData - Vertex data to be used for the displacement
     * @param[in] rgbData - RGB value that corresponds to this vertex
     * @param[in] strength - Displacement strength (1 = full vector displacement map effect, 0 = no effect)
     *
-    * @return Displaced vertex as an MPoint
+    * @return Displacement offset as an MVector
+    */
+    static MVector getTangentDisplacementOffset(const VertexData& vertexData, const MVector& rgbData, float strength);
+
+    /**
+    * Gets the UV footprint of every distinct UV, from the UVs of the neighbouring face-vertices of the face-vertices that use it
+    *
+    * @param[in] meshItem - Mesh to get the footprints of
+    * @param[in] uvSetName - UV set to read (empty = first UV set)
+    * @param[in] samples - Distinct UVs, as returned by getMeshUvSamples
+    * @param[out] footprints - 2 values per sample (half width and half height in UV units)
+    * @param[in,out] scratch - Reusable temporaries of the evaluating node
+    *
+    * @return MStatus indicating whether operation was successful or not
     */
-    static MPoint applyTangentDisplacement(VertexData vertexData, MVector rgbData, float strength);
+    static MStatus getUvSampleFootprints(MObject meshItem, const MString& uvSetName, const SeamUvSamples& samples, std::vector<float>& footprints,
+                                         EvaluationScratch& scratch);
+
+    /**
+    * Interpolates texture data sampled at the proxy sampled vertices to every vertex
+    *
+    * @param[in] sampling - Proxy sampling used to sample the texture
+    * @param[in] sampledColors - Color sampled at each sampled vertex
+    * @param[in] sampledAlphas - Alpha sampled at each sampled vertex
+    * @param[out] colorData - Interpolated color of every vertex
+    * @param[out] alphaData - Interpolated alpha of every vertex
+    */
+    static void interpolateProxySamples(const ProxySampling& sampling, const MVectorArray& sampledColors, const MDoubleArray& sampledAlphas,
+                                        MVectorArray& colorData, MDoubleArray& alphaData);
+
+    /** Hashes the length and the values of the given array into the given hash. Returns the updated hash value. */
+    static uint64_t hashIntArray(uint64_t hash, const MIntArray& values);
+
+    /** Hashes the length and the values of the given array into the given hash. Returns the updated hash value. */
+    static uint64_t hashFloatArray(uint64_t hash, const MFloatArray& values);
 
     /**
     * Logs an error using a predefined format using the given message
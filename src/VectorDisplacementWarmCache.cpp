@@ -0,0 +1,536 @@
+/* Copyright (C) 2020 - Jose Ivan Lopez Romo - All rights reserved
+ *
+ * This file is part of the MayaVectorDisplacementDeformer project found in the
+ * following repository: https://github.com/Zhibade/maya-vector-displacement-deformer
+ *
+ * Released under MIT license. Please see LICENSE file for details.
+ */
+
+#include "VectorDisplacementWarmCache.h"
+#include "MemoryMappedFile.h"
+#include "VectorDisplacementUtilities.h"
+
+#include <maya/MDoubleArray.h>
+#include <maya/MDynamicsUtil.h>
+#include <maya/MFileObject.h>
+#include <maya/MFnDependencyNode.h>
+#include <maya/MFnMesh.h>
+#include <maya/MPlug.h>
+#include <maya/MPlugArray.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <sys/utime.h>
+#else
+#include <dirent.h>
+#include <utime.h>
+#endif
+
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+constexpr char ENTRY_MAGIC[4] = { 'V', 'D', 'W', 'C' };
+constexpr uint32_t ENTRY_VERSION = 1; // Part of every key, so changing it invalidates every entry
+constexpr char* ENTRY_EXTENSION = ".vdw";
+constexpr char* FILE_TEXTURE_NAME_ATTRIBUTE = "fileTextureName";
+constexpr char* FRAME_EXTENSION_ATTRIBUTE = "useFrameExtension";
+constexpr char* UV_TILING_MODE_ATTRIBUTE = "uvTilingMode";
+constexpr unsigned int MAP_PROBE_GRID_SIZE = 4; // Samples per side of the grid sampled to detect texture node settings (color gain, UV placement...)
+
+
+MString VectorDisplacementWarmCache::directory;
+uint64_t VectorDisplacementWarmCache::sizeBudget = 0;
+std::mutex VectorDisplacementWarmCache::fileHashesMutex;
+std::mutex VectorDisplacementWarmCache::trimMutex;
+std::map<std::string, VectorDisplacementWarmCache::FileHash> VectorDisplacementWarmCache::fileHashes;
+
+
+MString VectorDisplacementWarmCache::getMapFilePath(const MObject& nodeObject, const char* attributeName)
+{
+    if (directory.length() == 0)
+    {
+        return MString();
+    }
+
+    MPlug mapPlug = MFnDependencyNode(nodeObject).findPlug(attributeName, true);
+
+    MPlugArray connections;
+    mapPlug.connectedTo(connections, true, false);
+
+    if (connections.length() == 0)
+    {
+        return MString();
+    }
+
+    // Only file textures can be cached, since the contents of other texture nodes can't be hashed
+
+    MFnDependencyNode textureNode(connections[0].node());
+    MStatus plugStatus;
+    MPlug fileNamePlug = textureNode.findPlug(FILE_TEXTURE_NAME_ATTRIBUTE, true, &plugStatus);
+
+    if (plugStatus != MS::kSuccess)
+    {
+        return MString();
+    }
+
+    // Image sequences and UDIM tiles read other files than the one in the file name
+
+    MPlug frameExtensionPlug = textureNode.findPlug(FRAME_EXTENSION_ATTRIBUTE, true, &plugStatus);
+
+    if (plugStatus == MS::kSuccess && frameExtensionPlug.asBool())
+    {
+        return MString();
+    }
+
+    MPlug uvTilingModePlug = textureNode.findPlug(UV_TILING_MODE_ATTRIBUTE, true, &plugStatus);
+
+    if (plugStatus == MS::kSuccess && uvTilingModePlug.asInt() != 0)
+    {
+        return MString();
+    }
+
+    MFileObject file;
+    file.setRawFullName(fileNamePlug.asString());
+
+    return file.exists() ? file.resolvedFullName() : MString();
+}
+
+uint64_t VectorDisplacementWarmCache::getMapSamplesKey(const MObject& nodeObject, const char* attributeName, const MString& mapFilePath, const MeshFingerprint& fingerprint,
+                                                       unsigned int proxyLevel, unsigned int filterResolution, SeamSamplingMode seamSampling)
+{
+    uint64_t fileHash = mapFilePath.length() > 0 ? getFileHash(mapFilePath) : 0;
+
+    if (fileHash == 0)
+    {
+        return 0;
+    }
+
+    // Samples also depend on the settings of the texture node and its UV placement, which are detected by sampling a small grid
+
+    MDoubleArray uCoords(MAP_PROBE_GRID_SIZE * MAP_PROBE_GRID_SIZE);
+    MDoubleArray vCoords(MAP_PROBE_GRID_SIZE * MAP_PROBE_GRID_SIZE);
+
+    for (unsigned int i = 0; i < MAP_PROBE_GRID_SIZE * MAP_PROBE_GRID_SIZE; i++)
+    {
+        uCoords[i] = (i % MAP_PROBE_GRID_SIZE + 0.37) / MAP_PROBE_GRID_SIZE; // Off the texel centers, so filtering settings are detected too
+        vCoords[i] = (i / MAP_PROBE_GRID_SIZE + 0.61) / MAP_PROBE_GRID_SIZE;
+    }
+
+    MVectorArray probeColors;
+    MDoubleArray probeAlphas;
+    MObject mapAttribute = MFnDependencyNode(nodeObject).attribute(attributeName);
+
+    if (MDynamicsUtil::evalDynamics2dTexture(nodeObject, mapAttribute, uCoords, vCoords, &probeColors, &probeAlphas) != MS::kSuccess)
+    {
+        return 0;
+    }
+
+    uint64_t hash = VectorDisplacementUtilities::hashInit();
+    uint32_t settings[] = { ENTRY_VERSION, static_cast<uint32_t>(EntryContent::MAP_SAMPLES), fingerprint.vertexCount, proxyLevel, filterResolution,
+        static_cast<uint32_t>(seamSampling) };
+    uint64_t fingerprints[] = { fileHash, fingerprint.topology, fingerprint.uvs };
+
+    hash = VectorDisplacementUtilities::hashBytes(hash, settings, sizeof(settings));
+    hash = VectorDisplacementUtilities::hashBytes(hash, fingerprints, sizeof(fingerprints));
+
+    for (unsigned int i = 0; i < probeColors.length(); i++)
+    {
+        double color[3] = { probeColors[i].x, probeColors[i].y, probeColors[i].z };
+        hash = VectorDisplacementUtilities::hashBytes(hash, color, sizeof(color));
+    }
+
+    return hash != 0 ? hash : 1;
+}
+
+uint64_t VectorDisplacementWarmCache::getVertexFramesKey(MObject meshItem, const MeshFingerprint& fingerprint)
+{
+    if (directory.length() == 0 || !meshItem.hasFn(MFn::kMesh))
+    {
+        return 0;
+    }
+
+    // Frames depend on the points too, which the fingerprints don't cover
+
+    MFnMesh meshFn(meshItem);
+    MStatus pointsStatus;
+    const float* points = meshFn.getRawPoints(&pointsStatus);
+
+    if (pointsStatus != MS::kSuccess || !points)
+    {
+        return 0;
+    }
+
+    uint64_t hash = VectorDisplacementUtilities::hashInit();
+    uint32_t settings[] = { ENTRY_VERSION, static_cast<uint32_t>(EntryContent::VERTEX_FRAMES), fingerprint.vertexCount };
+    uint64_t fingerprints[] = { fingerprint.topology, fingerprint.uvs };
+
+    hash = VectorDisplacementUtilities::hashBytes(hash, settings, sizeof(settings));
+    hash = VectorDisplacementUtilities::hashBytes(hash, fingerprints, sizeof(fingerprints));
+    hash = VectorDisplacementUtilities::hashBytes(hash, points, static_cast<size_t>(meshFn.numVertices()) * 3 * sizeof(float));
+
+    return hash != 0 ? hash : 1;
+}
+
+bool VectorDisplacementWarmCache::readMapSamples(uint64_t key, unsigned int vertexCount, MVectorArray& colors)
+{
+    size_t dataSize = static_cast<size_t>(vertexCount) * 3 * sizeof(double);
+
+    return readEntry(key, EntryContent::MAP_SAMPLES, vertexCount, dataSize, [&](const void* data)
+    {
+        colors.setLength(vertexCount);
+        const double* values = static_cast<const double*>(data);
+
+        for (unsigned int i = 0; i < vertexCount; i++)
+        {
+            colors[i] = MVector(values[i * 3], values[i * 3 + 1], values[i * 3 + 2]);
+        }
+    });
+}
+
+void VectorDisplacementWarmCache::writeMapSamples(uint64_t key, const MVectorArray& colors)
+{
+    std::vector<double> values(static_cast<size_t>(colors.length()) * 3);
+
+    for (unsigned int i = 0; i < colors.length(); i++)
+    {
+        values[i * 3] = colors[i].x;
+        values[i * 3 + 1] = colors[i].y;
+        values[i * 3 + 2] = colors[i].z;
+    }
+
+    writeEntry(key, EntryContent::MAP_SAMPLES, colors.length(), values.data(), values.size() * sizeof(double));
+}
+
+bool VectorDisplacementWarmCache::readVertexFrames(uint64_t key, unsigned int vertexCount, MFloatVectorArray& normals, MFloatVectorArray& tangents, MFloatVectorArray& binormals)
+{
+    size_t dataSize = static_cast<size_t>(vertexCount) * 9 * sizeof(float);
+
+    return readEntry(key, EntryContent::VERTEX_FRAMES, vertexCount, dataSize, [&](const void* data)
+    {
+        MFloatVectorArray* frameArrays[3] = { &normals, &tangents, &binormals };
+        const float* values = static_cast<const float*>(data);
+
+        for (MFloatVectorArray* frameArray : frameArrays)
+        {
+            frameArray->setLength(vertexCount);
+
+            for (unsigned int i = 0; i < vertexCount; i++)
+            {
+                (*frameArray)[i] = MFloatVector(values[i * 3], values[i * 3 + 1], values[i * 3 + 2]);
+            }
+
+            values += static_cast<size_t>(vertexCount) * 3;
+        }
+    });
+}
+
+void VectorDisplacementWarmCache::writeVertexFrames(uint64_t key, const MFloatVectorArray& normals, const MFloatVectorArray& tangents, const MFloatVectorArray& binormals)
+{
+    unsigned int vertexCount = normals.length();
+
+    if (tangents.length() != vertexCount || binormals.length() != vertexCount)
+    {
+        return;
+    }
+
+    std::vector<float> values(static_cast<size_t>(vertexCount) * 9);
+    const MFloatVectorArray* frameArrays[3] = { &normals, &tangents, &binormals };
+
+    for (unsigned int frame = 0; frame < 3; frame++)
+    {
+        frameArrays[frame]->get(reinterpret_cast<float(*)[3]>(values.data() + static_cast<size_t>(vertexCount) * 3 * frame));
+    }
+
+    writeEntry(key, EntryContent::VERTEX_FRAMES, vertexCount, values.data(), values.size() * sizeof(float));
+}
+
+uint64_t VectorDisplacementWarmCache::getFileHash(const MString& path)
+{
+    struct stat fileStatus;
+
+    if (stat(path.asChar(), &fileStatus) != 0)
+    {
+        return 0;
+    }
+
+    // Scenes often share a few maps between many nodes, so each file is only hashed once. Other nodes wait for the hash of that file
+    // instead of hashing it too, while nodes that need other files go on.
+
+    uint64_t size = static_cast<uint64_t>(fileStatus.st_size);
+    int64_t modificationTime = static_cast<int64_t>(fileStatus.st_mtime);
+    std::promise<uint64_t> hashPromise;
+    std::shared_future<uint64_t> hash;
+    bool isHashedHere = false;
+
+    {
+        std::lock_guard<std::mutex> lock(fileHashesMutex);
+
+        FileHash& fileHash = fileHashes[path.asChar()];
+
+        if (!fileHash.hash.valid() || fileHash.size != size || fileHash.modificationTime != modificationTime)
+        {
+            fileHash.size = size;
+            fileHash.modificationTime = modificationTime;
+            fileHash.hash = hashPromise.get_future().share();
+            isHashedHere = true;
+        }
+
+        hash = fileHash.hash;
+    }
+
+    if (isHashedHere)
+    {
+        MemoryMappedFile file;
+        uint64_t fileHash = 0;
+
+        if (file.open(path) == MS::kSuccess)
+        {
+            fileHash = VectorDisplacementUtilities::hashBytes(VectorDisplacementUtilities::hashInit(), file.data(), file.size());
+            fileHash = fileHash != 0 ? fileHash : 1;
+        }
+
+        hashPromise.set_value(fileHash);
+
+        // Failures aren't kept, so the file is hashed again once it can be read
+
+        if (fileHash == 0)
+        {
+            std::lock_guard<std::mutex> lock(fileHashesMutex);
+
+            auto failedHash = fileHashes.find(path.asChar());
+
+            if (failedHash != fileHashes.end() && failedHash->second.hash.wait_for(std::chrono::seconds(0)) == std::future_status::ready &&
+                failedHash->second.hash.get() == 0)
+            {
+                fileHashes.erase(failedHash);
+            }
+        }
+    }
+
+    return hash.get();
+}
+
+template <typename Function>
+bool VectorDisplacementWarmCache::readEntry(uint64_t key, EntryContent content, unsigned int vertexCount, size_t dataSize, const Function& read)
+{
+    if (key == 0 || directory.length() == 0)
+    {
+        return false;
+    }
+
+    MString path = getEntryPath(key);
+    bool isValid = false;
+
+    {
+        MemoryMappedFile file;
+
+        if (file.open(path) != MS::kSuccess)
+        {
+            return false; // Not cached yet
+        }
+
+        // Entries of other plugin versions or truncated files are ignored, and replaced when the data is written again
+
+        const EntryHeader* header = static_cast<const EntryHeader*>(file.data());
+        isValid = file.size() == sizeof(EntryHeader) + dataSize &&
+            std::memcmp(header->magic, ENTRY_MAGIC, sizeof(ENTRY_MAGIC)) == 0 &&
+            header->version == ENTRY_VERSION &&
+            header->key == key &&
+            header->content == static_cast<uint32_t>(content) &&
+            header->vertexCount == vertexCount;
+
+        if (isValid)
+        {
+            read(header + 1);
+        }
+    }
+
+    if (isValid)
+    {
+        markEntryUsed(path);
+    }
+
+    return isValid;
+}
+
+void VectorDisplacementWarmCache::writeEntry(uint64_t key, EntryContent content, unsigned int vertexCount, const void* data, size_t dataSize)
+{
+    if (key == 0 || directory.length() == 0 || dataSize == 0)
+    {
+        return;
+    }
+
+    EntryHeader header;
+    std::memcpy(header.magic, ENTRY_MAGIC, sizeof(ENTRY_MAGIC));
+    header.version = ENTRY_VERSION;
+    header.key = key;
+    header.content = static_cast<uint32_t>(content);
+    header.vertexCount = vertexCount;
+
+    // Temporary name is unique per thread and write, since other sessions (e.g. farm jobs sharing the directory) can write the same entry
+
+    MString path = getEntryPath(key);
+    uint64_t writeId = static_cast<uint64_t>(std::hash<std::thread::id>()(std::this_thread::get_id())) ^
+        static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+
+    char writeIdText[17];
+    std::snprintf(writeIdText, sizeof(writeIdText), "%016llx", static_cast<unsigned long long>(writeId));
+
+    MString temporaryPath = path + "." + writeIdText + ".tmp";
+
+    {
+        std::ofstream stream(temporaryPath.asChar(), std::ios::binary | std::ios::trunc);
+
+        if (!stream)
+        {
+            return;
+        }
+
+        stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        stream.write(static_cast<const char*>(data), dataSize);
+
+        if (!stream)
+        {
+            stream.close();
+            std::remove(temporaryPath.asChar());
+            return;
+        }
+    }
+
+    // Renaming doesn't replace existing files on Windows, so an existing entry (invalid, or written by another session) is removed first.
+    // If another session is reading it, it can't be removed and is kept instead.
+
+    if (std::rename(temporaryPath.asChar(), path.asChar()) != 0)
+    {
+        std::remove(path.asChar());
+
+        if (std::rename(temporaryPath.asChar(), path.asChar()) != 0)
+        {
+            std::remove(temporaryPath.asChar());
+            return;
+        }
+    }
+
+    trimEntries();
+}
+
+MString VectorDisplacementWarmCache::getEntryPath(uint64_t key)
+{
+    char keyText[17];
+    std::snprintf(keyText, sizeof(keyText), "%016llx", static_cast<unsigned long long>(key));
+
+    return directory + keyText + ENTRY_EXTENSION;
+}
+
+void VectorDisplacementWarmCache::markEntryUsed(const MString& path)
+{
+#ifdef _WIN32
+    _utime(path.asChar(), nullptr);
+#else
+    utime(path.asChar(), nullptr);
+#endif
+}
+
+void VectorDisplacementWarmCache::trimEntries()
+{
+    struct EntryFile
+    {
+        std::string path;
+        uint64_t size = 0;
+        int64_t lastUse = 0;
+    };
+
+    std::lock_guard<std::mutex> lock(trimMutex);
+
+    std::vector<EntryFile> entries;
+    uint64_t totalSize = 0;
+
+#ifdef _WIN32
+    WIN32_FIND_DATAA findData;
+    HANDLE find = FindFirstFileA((directory + "*" + ENTRY_EXTENSION).asChar(), &findData);
+
+    if (find != INVALID_HANDLE_VALUE)
+    {
+        do
+        {
+            EntryFile entry;
+            entry.path = std::string(directory.asChar()) + findData.cFileName;
+            entry.size = (static_cast<uint64_t>(findData.nFileSizeHigh) << 32) | findData.nFileSizeLow;
+            entry.lastUse = static_cast<int64_t>((static_cast<uint64_t>(findData.ftLastWriteTime.dwHighDateTime) << 32) | findData.ftLastWriteTime.dwLowDateTime);
+
+            totalSize += entry.size;
+            entries.push_back(entry);
+        }
+        while (FindNextFileA(find, &findData));
+
+        FindClose(find);
+    }
+#else
+    DIR* entryDirectory = opendir(directory.asChar());
+
+    if (entryDirectory)
+    {
+        size_t extensionLength = std::strlen(ENTRY_EXTENSION);
+
+        while (dirent* directoryEntry = readdir(entryDirectory))
+        {
+            size_t nameLength = std::strlen(directoryEntry->d_name);
+
+            if (nameLength <= extensionLength || std::strcmp(directoryEntry->d_name + nameLength - extensionLength, ENTRY_EXTENSION) != 0)
+            {
+                continue;
+            }
+
+            EntryFile entry;
+            entry.path = std::string(directory.asChar()) + directoryEntry->d_name;
+
+            struct stat fileStatus;
+
+            if (stat(entry.path.c_str(), &fileStatus) != 0)
+            {
+                continue; // Removed by another session
+            }
+
+            entry.size = static_cast<uint64_t>(fileStatus.st_size);
+            entry.lastUse = static_cast<int64_t>(fileStatus.st_mtime);
+
+            totalSize += entry.size;
+            entries.push_back(entry);
+        }
+
+        closedir(entryDirectory);
+    }
+#endif
+
+    if (totalSize <= sizeBudget)
+    {
+        return;
+    }
+
+    std::sort(entries.begin(), entries.end(), [](const EntryFile& a, const EntryFile& b) { return a.lastUse < b.lastUse; });
+
+    for (const EntryFile& entry : entries)
+    {
+        if (totalSize <= sizeBudget)
+        {
+            break;
+        }
+
+        if (std::remove(entry.path.c_str()) == 0)
+        {
+            totalSize -= entry.size;
+        }
+    }
+}
\ No newline at end of file
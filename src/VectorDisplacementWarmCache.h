@@ -0,0 +1,187 @@
+/* Copyright (C) 2020 - Jose Ivan Lopez Romo - All rights reserved
+ *
+ * This file is part of the MayaVectorDisplacementDeformer project found in the
+ * following repository: https://github.com/Zhibade/maya-vector-displacement-deformer
+ *
+ * Released under MIT license. Please see LICENSE file for details.
+ */
+
+#pragma once
+
+#include "VectorDisplacementHelperTypes.h"
+
+#include <maya/MFloatVectorArray.h>
+#include <maya/MObject.h>
+#include <maya/MString.h>
+#include <maya/MVectorArray.h>
+
+#include <cstdint>
+#include <future>
+#include <map>
+#include <mutex>
+#include <string>
+
+
+/*
+ * On-disk cache of the sampled map data and vertex frames of each geometry, so reopening a scene doesn't sample the maps and build the frames again.
+ * Entries are stored in one file per key, named after it, and are memory-mapped when read. Keys hash everything the data depends on
+ * (map file contents, mesh fingerprints and sampling settings), so entries never need to be invalidated. Reading and writing entries can be done
+ * from worker threads, but the keys read the map and the mesh through the Maya API, so they need to be calculated on the evaluation thread.
+ * The cache is disabled until a directory is set. Once the entries take more than the size budget, the least recently used ones are deleted.
+ */
+class VectorDisplacementWarmCache final
+{
+public:
+    /**
+    * Gets the path of the map file the displacement map attribute reads from. Reads plugs, so it needs to be called from the evaluation thread.
+    *
+    * @param[in] nodeObject - Deformer node
+    * @param[in] attributeName - Name of the displacement map attribute
+    *
+    * @return Resolved path of the file texture connected to the attribute. Empty if it isn't a file texture or the cache is disabled.
+    */
+    static MString getMapFilePath(const MObject& nodeObject, const char* attributeName);
+
+    /**
+    * Gets the key of the sampled map data of a geometry. Samples the map, so it needs to be called from the evaluation thread.
+    *
+    * @param[in] nodeObject - Deformer node
+    * @param[in] attributeName - Name of the displacement map attribute
+    * @param[in] mapFilePath - Path of the map file (see getMapFilePath)
+    * @param[in] fingerprint - Mesh fingerprints of the geometry
+    * @param[in] proxyLevel - Proxy level the map is sampled with (0 = Full quality)
+    * @param[in] filterResolution - Map table resolution of area sampling (0 = Point sampling)
+    * @param[in] seamSampling - Seam sampling mode
+    *
+    * @return Entry key, or 0 if the map data can't be cached (e.g. the map file can't be read)
+    */
+    static uint64_t getMapSamplesKey(const MObject& nodeObject, const char* attributeName, const MString& mapFilePath, const MeshFingerprint& fingerprint,
+                                     unsigned int proxyLevel, unsigned int filterResolution, SeamSamplingMode seamSampling);
+
+    /**
+    * Gets the key of the vertex frames of a geometry. Reads the mesh, so it needs to be called from the evaluation thread.
+    *
+    * @param[in] meshItem - Input mesh of the geometry
+    * @param[in] fingerprint - Mesh fingerprints of the geometry
+    *
+    * @return Entry key, or 0 if the frames can't be cached
+    */
+    static uint64_t getVertexFramesKey(MObject meshItem, const MeshFingerprint& fingerprint);
+
+    /**
+    * Reads the sampled map data of the given key
+    *
+    * @param[in] key - Entry key (see getMapSamplesKey)
+    * @param[in] vertexCount - Vertex count of the geometry
+    * @param[out] colors - Map sample of each vertex
+    *
+    * @return True if a valid entry was read
+    */
+    static bool readMapSamples(uint64_t key, unsigned int vertexCount, MVectorArray& colors);
+
+    /**
+    * Writes the sampled map data of the given key. Errors are ignored, since the data is sampled again when it isn't cached.
+    *
+    * @param[in] key - Entry key (see getMapSamplesKey)
+    * @param[in] colors - Map sample of each vertex
+    */
+    static void writeMapSamples(uint64_t key, const MVectorArray& colors);
+
+    /**
+    * Reads the vertex frames of the given key
+    *
+    * @param[in] key - Entry key (see getVertexFramesKey)
+    * @param[in] vertexCount - Vertex count of the geometry
+    * @param[out] normals - Vertex normals
+    * @param[out] tangents - Vertex tangents
+    * @param[out] binormals - Vertex binormals
+    *
+    * @return True if a valid entry was read
+    */
+    static bool readVertexFrames(uint64_t key, unsigned int vertexCount, MFloatVectorArray& normals, MFloatVectorArray& tangents, MFloatVectorArray& binormals);
+
+    /**
+    * Writes the vertex frames of the given key. Errors are ignored, since the frames are calculated again when they aren't cached.
+    *
+    * @param[in] key - Entry key (see getVertexFramesKey)
+    * @param[in] normals - Vertex normals
+    * @param[in] tangents - Vertex tangents
+    * @param[in] binormals - Vertex binormals
+    */
+    static void writeVertexFrames(uint64_t key, const MFloatVectorArray& normals, const MFloatVectorArray& tangents, const MFloatVectorArray& binormals);
+
+    static MString directory; // Directory of the cache files, ending with a separator. Cache is disabled if empty.
+    static uint64_t sizeBudget; // Total size of the entries in bytes, past which the least recently used ones are deleted
+
+private:
+    enum class EntryContent : uint32_t
+    {
+        MAP_SAMPLES = 0, // 3 doubles per vertex (RGB)
+        VERTEX_FRAMES = 1 // 3 floats per vertex for the normals, then the tangents, then the binormals
+    };
+
+    struct EntryHeader
+    {
+        char magic[4];
+        uint32_t version;
+        uint64_t key;
+        uint32_t content;
+        uint32_t vertexCount;
+    };
+
+    // Hash of a map file, reused until the file changes
+    struct FileHash
+    {
+        uint64_t size = 0;
+        int64_t modificationTime = 0;
+        std::shared_future<uint64_t> hash; // Set by the thread hashing the file. Other threads that need the same file wait for it.
+    };
+
+    /**
+    * Gets the hash of the contents of a file. Hashes are reused by every node until the file size or modification time change.
+    * Files are hashed outside of the lock of the hash list, so different files are hashed in parallel.
+    *
+    * @param[in] path - Path of the file
+    *
+    * @return Hash of the file contents, or 0 if it can't be read
+    */
+    static uint64_t getFileHash(const MString& path);
+
+    /**
+    * Reads the data of an entry
+    *
+    * @param[in] key - Entry key
+    * @param[in] content - Expected entry content
+    * @param[in] vertexCount - Expected vertex count
+    * @param[in] dataSize - Expected data size in bytes
+    * @param[in] read - Function that copies the data out of the mapped file
+    *
+    * @return True if a valid entry was read
+    */
+    template <typename Function>
+    static bool readEntry(uint64_t key, EntryContent content, unsigned int vertexCount, size_t dataSize, const Function& read);
+
+    /**
+    * Writes an entry. The file is written under a temporary name first, so other sessions never map partially written entries.
+    *
+    * @param[in] key - Entry key
+    * @param[in] content - Entry content
+    * @param[in] vertexCount - Vertex count of the geometry
+    * @param[in] data - Entry data
+    * @param[in] dataSize - Data size in bytes
+    */
+    static void writeEntry(uint64_t key, EntryContent content, unsigned int vertexCount, const void* data, size_t dataSize);
+
+    /** Returns the path of the file of an entry */
+    static MString getEntryPath(uint64_t key);
+
+    /** Updates the modification time of an entry file, which is used as its last use time when trimming */
+    static void markEntryUsed(const MString& path);
+
+    /** Deletes the least recently used entries until the entries fit in the size budget. Entries that are in use by other sessions are skipped. */
+    static void trimEntries();
+
+    static std::mutex fileHashesMutex;
+    static std::mutex trimMutex; // Only one thread trims the directory at a time
+    static std::map<std::string, FileHash> fileHashes; // Map file path -> hash of its contents
+};
\ No newline at end of file
@@ -0,0 +1,284 @@
+/* Copyright (C) 2020 - Jose Ivan Lopez Romo - All rights reserved
+ *
+ * This file is part of the MayaVectorDisplacementDeformer project found in the
+ * following repository: https://github.com/Zhibade/maya-vector-displacement-deformer
+ *
+ * Released under MIT license. Please see LICENSE file for details.
+ */
+
+#include "WorkerThreadPool.h"
+
+#include <algorithm>
+
+
+std::mutex WorkerThreadPool::mutex;
+std::condition_variable WorkerThreadPool::workAvailable;
+std::deque<std::shared_ptr<WorkerThreadPool::Loop>> WorkerThreadPool::loops;
+std::vector<std::thread> WorkerThreadPool::workers;
+unsigned int WorkerThreadPool::threadCount = 0;
+bool WorkerThreadPool::isStopping = false;
+
+namespace
+{
+    /* Joins the workers on exit, since joinable threads can't be destroyed. The Maya plug-in shuts the pool down
+       when it's unloaded instead, because threads can't be joined while a DLL is being unloaded on Windows. */
+    struct WorkerThreadPoolGuard
+    {
+        ~WorkerThreadPoolGuard() { WorkerThreadPool::shutdown(); }
+    };
+
+    WorkerThreadPoolGuard workerThreadPoolGuard; // Defined after the pool members, so it's destroyed before them
+}
+
+
+void WorkerThreadPool::run(size_t rangeCount, const std::function<void(size_t)>& function)
+{
+    if (rangeCount == 0)
+    {
+        return;
+    }
+
+    if (rangeCount == 1)
+    {
+        function(0);
+        return;
+    }
+
+    std::shared_ptr<Loop> loop = std::make_shared<Loop>();
+    loop->function = &function;
+    loop->rangeCount = rangeCount;
+
+    std::unique_lock<std::mutex> lock(mutex);
+
+    startWorkers();
+    loops.push_back(loop);
+
+    size_t workersToWake = std::min(rangeCount - 1, workers.size());
+    for (size_t i = 0; i < workersToWake; i++)
+    {
+        workAvailable.notify_one();
+    }
+
+    // Run ranges on this thread too, so the loop finishes even if every worker is busy with other loops
+
+    size_t range = 0;
+    while (claimRange(*loop, range))
+    {
+        lock.unlock();
+        function(range);
+        lock.lock();
+
+        finishRange(*loop);
+    }
+
+    loop->finished.wait(lock, [&loop]() { return loop->finishedRanges == loop->rangeCount; });
+}
+
+WorkerThreadPool::Task WorkerThreadPool::submit(std::function<void()> function)
+{
+    Task task;
+    task.loop = std::make_shared<Loop>();
+    task.loop->rangeCount = 1;
+
+    Loop* loop = task.loop.get();
+    loop->task = [loop, function](size_t)
+    {
+        try
+        {
+            function();
+        }
+        catch (...)
+        {
+            loop->exception = std::current_exception(); // Read after the range is marked as done, under the mutex
+        }
+    };
+    loop->function = &loop->task;
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    startWorkers();
+    loops.push_back(task.loop);
+    workAvailable.notify_one();
+
+    return task;
+}
+
+WorkerThreadPool::Task::~Task()
+{
+    try
+    {
+        wait();
+    }
+    catch (...)
+    {
+        // Exceptions of tasks nobody waited for are dropped
+    }
+}
+
+WorkerThreadPool::Task& WorkerThreadPool::Task::operator=(Task&& other) noexcept
+{
+    if (this != &other)
+    {
+        try
+        {
+            wait();
+        }
+        catch (...)
+        {
+        }
+
+        loop = std::move(other.loop);
+    }
+
+    return *this;
+}
+
+bool WorkerThreadPool::Task::isDone() const
+{
+    if (!loop)
+    {
+        return true;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    return loop->finishedRanges == loop->rangeCount;
+}
+
+void WorkerThreadPool::Task::wait()
+{
+    if (!loop)
+    {
+        return;
+    }
+
+    std::shared_ptr<Loop> waitedLoop = std::move(loop);
+    std::unique_lock<std::mutex> lock(mutex);
+
+    // Nobody started the task yet (e.g. every worker is busy, or there are none), so it runs here
+
+    size_t range = 0;
+    if (claimRange(*waitedLoop, range))
+    {
+        lock.unlock();
+        (*waitedLoop->function)(range);
+        lock.lock();
+
+        finishRange(*waitedLoop);
+    }
+
+    waitedLoop->finished.wait(lock, [&waitedLoop]() { return waitedLoop->finishedRanges == waitedLoop->rangeCount; });
+
+    if (waitedLoop->exception)
+    {
+        std::exception_ptr exception = waitedLoop->exception;
+        lock.unlock();
+        std::rethrow_exception(exception);
+    }
+}
+
+void WorkerThreadPool::setThreadCount(unsigned int threadCount)
+{
+    shutdown();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    WorkerThreadPool::threadCount = threadCount;
+}
+
+unsigned int WorkerThreadPool::getThreadCount()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return threadCount > 0 ? threadCount : std::max(std::thread::hardware_concurrency(), 1u);
+}
+
+void WorkerThreadPool::shutdown()
+{
+    std::vector<std::thread> stoppedWorkers;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        isStopping = true;
+        stoppedWorkers.swap(workers);
+    }
+
+    // Workers stop after their current range. Callers run the ranges left in their loops themselves.
+
+    workAvailable.notify_all();
+
+    for (std::thread& worker : stoppedWorkers)
+    {
+        worker.join();
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    isStopping = false;
+}
+
+void WorkerThreadPool::startWorkers()
+{
+    if (!workers.empty() || isStopping)
+    {
+        return;
+    }
+
+    unsigned int workerCount = (threadCount > 0 ? threadCount : std::max(std::thread::hardware_concurrency(), 1u)) - 1; // Callers are the last thread
+
+    for (unsigned int i = 0; i < workerCount; i++)
+    {
+        workers.emplace_back(&WorkerThreadPool::workerLoop);
+    }
+}
+
+void WorkerThreadPool::workerLoop()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+
+    while (true)
+    {
+        workAvailable.wait(lock, []() { return isStopping || !loops.empty(); });
+
+        if (isStopping)
+        {
+            return;
+        }
+
+        std::shared_ptr<Loop> loop = loops.front(); // Keeps the loop alive until its range is marked as done
+        size_t range = 0;
+
+        if (!claimRange(*loop, range))
+        {
+            continue;
+        }
+
+        lock.unlock();
+        (*loop->function)(range);
+        lock.lock();
+
+        finishRange(*loop);
+    }
+}
+
+bool WorkerThreadPool::claimRange(Loop& loop, size_t& range)
+{
+    bool isClaimed = loop.nextRange < loop.rangeCount;
+
+    if (isClaimed)
+    {
+        range = loop.nextRange++;
+    }
+
+    if (loop.nextRange >= loop.rangeCount)
+    {
+        loops.erase(std::remove_if(loops.begin(), loops.end(), [&loop](const std::shared_ptr<Loop>& queuedLoop) { return queuedLoop.get() == &loop; }), loops.end());
+    }
+
+    return isClaimed;
+}
+
+void WorkerThreadPool::finishRange(Loop& loop)
+{
+    if (++loop.finishedRanges == loop.rangeCount)
+    {
+        loop.finished.notify_all();
+    }
+}
\ No newline at end of file
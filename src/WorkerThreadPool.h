@@ -0,0 +1,134 @@
+/* Copyright (C) 2020 - Jose Ivan Lopez Romo - All rights reserved
+ *
+ * This file is part of the MayaVectorDisplacementDeformer project found in the
+ * following repository: https://github.com/Zhibade/maya-vector-displacement-deformer
+ *
+ * Released under MIT license. Please see LICENSE file for details.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+/*
+ * Persistent worker threads shared by every parallel loop of the process (see VectorDisplacementMath::parallelFor),
+ * so loops don't create and join threads on every call, and concurrent callers share one fixed set of threads
+ * instead of each spawning their own. Callers run ranges of their own loop too, so nested and concurrent loops
+ * always make progress even when every worker is busy. Single tasks (see submit) run on the same threads, so overlapping
+ * work with the evaluation thread doesn't start a thread per call either. Has no Maya dependency.
+ */
+class WorkerThreadPool final
+{
+    struct Loop;
+
+public:
+    /* Handle of a task started with submit(). Waits for the task when destroyed, so tasks can't outlive the data they reference. */
+    class Task final
+    {
+    public:
+        Task() {};
+        ~Task();
+
+        Task(Task&& other) noexcept : loop(std::move(other.loop)) {};
+        Task& operator=(Task&& other) noexcept;
+
+        Task(const Task&) = delete;
+        Task& operator=(const Task&) = delete;
+
+        /** Returns true if the handle refers to a task that hasn't been waited for */
+        bool isValid() const { return loop != nullptr; }
+
+        /** Returns true if the task finished. Doesn't block. */
+        bool isDone() const;
+
+        /**
+        * Waits for the task to finish. If no worker started it yet, it runs on the calling thread instead, so waiting never
+        * depends on a free worker. Exceptions thrown by the task are rethrown here. The handle is no longer valid afterwards.
+        */
+        void wait();
+
+    private:
+        friend class WorkerThreadPool;
+
+        std::shared_ptr<Loop> loop; // Single-range loop of the task
+    };
+
+    /**
+    * Runs the given function over the ranges of a loop. Returns once every range is done.
+    *
+    * @param[in] rangeCount - Number of ranges
+    * @param[in] function - Function that processes the range with the given index
+    */
+    static void run(size_t rangeCount, const std::function<void(size_t)>& function);
+
+    /**
+    * Starts a task on a worker thread and returns right away
+    *
+    * @param[in] function - Task to run
+    *
+    * @return Handle to wait for the task with
+    */
+    static Task submit(std::function<void()> function);
+
+    /**
+    * Sets the number of threads loops can use, the calling thread included. Waits for running loops to finish
+    * and restarts the workers if they were already started.
+    *
+    * @param[in] threadCount - Number of threads (0 = hardware concurrency)
+    */
+    static void setThreadCount(unsigned int threadCount);
+
+    /** Returns the number of threads loops can use, the calling thread included */
+    static unsigned int getThreadCount();
+
+    /** Stops and joins the workers. They are started again by the next loop. */
+    static void shutdown();
+
+private:
+    /* Ranges of a single loop. Workers and the caller claim ranges until there are none left. */
+    struct Loop
+    {
+        const std::function<void(size_t)>* function = nullptr; // Only used for claimed ranges, which finish before the caller returns
+        std::function<void(size_t)> task; // Function of submitted tasks, which the loop owns since the caller doesn't wait for it
+        std::exception_ptr exception; // Exception thrown by a submitted task, rethrown by Task::wait()
+        size_t rangeCount = 0;
+        size_t nextRange = 0; // Guarded by mutex
+        size_t finishedRanges = 0; // Guarded by mutex
+        std::condition_variable finished;
+    };
+
+    /** Starts the workers if they aren't running. Expects mutex to be locked. */
+    static void startWorkers();
+
+    /** Loop run by each worker thread */
+    static void workerLoop();
+
+    /**
+    * Claims the next range of the given loop
+    *
+    * @param[in] loop - Loop to claim a range from. Expects mutex to be locked.
+    * @param[out] range - Claimed range index
+    *
+    * @return True if a range was claimed, false if every range of the loop was already claimed
+    */
+    static bool claimRange(Loop& loop, size_t& range);
+
+    /** Marks a claimed range as done and wakes up the caller after the last one. Expects mutex to be locked. */
+    static void finishRange(Loop& loop);
+
+    static std::mutex mutex;
+    static std::condition_variable workAvailable;
+    static std::deque<std::shared_ptr<Loop>> loops; // Loops that still have unclaimed ranges
+    static std::vector<std::thread> workers;
+    static unsigned int threadCount;
+    static bool isStopping;
+};
\ No newline at end of file